@@ -0,0 +1,483 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <inttypes.h>
+#include <math.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "expect.h"
+#include "meter.h"
+#include "path.h"
+#include "string.h"
+
+/**
+ * \brief Default number of concurrent operations.
+ */
+#define CONCURRENCY_DEFAULT 4
+
+/**
+ * \brief Maximum number of concurrent operations.
+ */
+#define CONCURRENCY_MAXIMUM 256
+
+/**
+ * \brief Default number of objects.
+ */
+#define COUNT_DEFAULT 100
+
+/**
+ * \brief Default (median) object size.
+ */
+#define SIZE_DEFAULT (64 * 1024)
+
+/**
+ * \brief Default maximum object size.
+ */
+#define LIMIT_DEFAULT (64 * 1024 * 1024)
+
+/**
+ * \brief Benchmarked operations, in the order they run.
+ */
+static const enum meter_op phases[] = { METER_DEPOSIT, METER_RETRIEVE, METER_EFFACE };
+
+/**
+ * \brief Operation names.
+ */
+static const char *const names[] = {
+	[METER_DEPOSIT]  = "deposit",
+	[METER_RETRIEVE] = "retrieve",
+	[METER_EFFACE]   = "efface"
+};
+
+/**
+ * \brief Benchmark object.
+ */
+struct object {
+	uint8_t  ident[32]; /**< Object identifier. */
+	uint64_t size;      /**< Object size. */
+};
+
+/**
+ * \brief Operation slot.
+ */
+struct slot {
+	pid_t    pid;   /**< Module process or 0 if idle. */
+	int      fd;    /**< Deposit input file. */
+	uint64_t size;  /**< Bytes moved by the operation. */
+	uint64_t start; /**< Start time in microseconds. */
+};
+
+/**
+ * \brief Objects.
+ */
+static struct object *objects;
+
+/**
+ * \brief Number of objects.
+ */
+static size_t count;
+
+/**
+ * \brief Operation slots.
+ */
+static struct slot slots[CONCURRENCY_MAXIMUM];
+
+/**
+ * \brief Number of concurrent operations.
+ */
+static size_t concurrency;
+
+/**
+ * \brief Random object data.
+ */
+static uint8_t *data;
+
+extern char **environ;
+
+/**
+ * \brief Get monotonic time.
+ *
+ * \return Microseconds since an arbitrary point.
+ */
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * UINT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
+/**
+ * \brief Draw object sizes.
+ *
+ * Sizes are replayed from the file named by \c BENCH_TRACE, one per line
+ * and repeated as needed, or drawn from a log‐normal distribution with
+ * median \c BENCH_SIZE and shape \c BENCH_SIGMA in hundredths.  A shape
+ * of zero yields fixed sizes.
+ *
+ * \param limit Maximum object size.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool draw(uint64_t limit) {
+	const char *trace = getenv("BENCH_TRACE");
+	double median = setting("BENCH_SIZE", SIZE_DEFAULT);
+	double sigma  = setting("BENCH_SIGMA", 0) / 100.0;
+
+	srand48(setting("BENCH_SEED", 1));
+
+	for (size_t iter = 0; iter < count; ++iter)
+		for (size_t byte = 0; byte < sizeof objects[iter].ident; ++byte)
+			objects[iter].ident[byte] = lrand48();
+
+	if (trace && *trace) {
+		FILE *file = fopen(trace, "r");
+		if (unlikely(!file)) {
+			perror("Unable to open trace");
+			return false;
+		}
+
+		size_t len = 0;
+		unsigned long long int size;
+
+		while (len < count && fscanf(file, "%llu%*[^\n]", &size) == 1)
+			objects[len++].size = size;
+
+		fclose(file);
+
+		if (unlikely(!len)) {
+			fputs("Empty trace!\n", stderr);
+			return false;
+		}
+
+		for (size_t iter = len; iter < count; ++iter)
+			objects[iter].size = objects[iter % len].size;
+	}
+
+	else
+		for (size_t iter = 0; iter < count; ++iter) {
+			/* Box–Muller transform */
+			double normal = sqrt(-2 * log(1 - drand48())) * cos(2 * M_PI * drand48());
+			objects[iter].size = llround(median * exp(sigma * normal));
+		}
+
+	for (size_t iter = 0; iter < count; ++iter)
+		if (objects[iter].size > limit)
+			objects[iter].size = limit;
+
+	return true;
+}
+
+/**
+ * \brief Remove directory entry.
+ */
+static int removal(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+	return remove(path);
+}
+
+/**
+ * \brief Start operation.
+ *
+ * \param slot Operation slot.
+ * \param argv Argument vector of the module.
+ * \param op Operation.
+ * \param obj Object.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool launch(struct slot *restrict slot, char *argv[], enum meter_op op, const struct object *restrict obj) {
+	char ident[32 * 2 + 1];
+	inthexs(ident, obj->ident, sizeof obj->ident);
+
+	argv[4] = ident;
+	argv[5] = (char *) names[op];
+
+	slot->size = op == METER_EFFACE ? 0 : obj->size;
+
+	/* Object data is prepared before the clock starts */
+	if (op == METER_DEPOSIT && unlikely(
+		ftruncate(slot->fd, 0) ||
+		pwrite(slot->fd, data, obj->size, 0) != (ssize_t) obj->size ||
+		lseek(slot->fd, 0, SEEK_SET))) {
+		perror("Unable to prepare object");
+		return false;
+	}
+
+	posix_spawn_file_actions_t file_actions;
+	if (unlikely(posix_spawn_file_actions_init(&file_actions))) {
+		perror("Unable to set file descriptors up");
+		return false;
+	}
+
+	bool result = !(op == METER_DEPOSIT ?
+		posix_spawn_file_actions_adddup2(&file_actions, slot->fd, 0) :
+		posix_spawn_file_actions_addopen(&file_actions, 0, "/dev/null", O_RDONLY, 0)) &&
+		!posix_spawn_file_actions_addopen(&file_actions, 1, "/dev/null", O_WRONLY, 0);
+
+	slot->start = now();
+
+	if (unlikely(!result || (errno = posix_spawn(&slot->pid, argv[0], &file_actions, (posix_spawnattr_t *) 0, argv, environ)))) {
+		perror("Unable to spawn module");
+		result = false;
+	}
+
+	posix_spawn_file_actions_destroy(&file_actions);
+
+	return result;
+}
+
+/**
+ * \brief Wait for an operation to end and record it.
+ *
+ * Only successful operations count towards the bytes moved.
+ *
+ * \param cell Metrics of the operation.
+ *
+ * \return \c true if an operation ended or \c false on failure.
+ */
+static bool reap(struct meter_cell *restrict cell) {
+	int status;
+	pid_t pid;
+
+	while ((pid = waitpid(-1, &status, 0)) < 0)
+		if (errno != EINTR)
+			return false;
+
+	uint64_t end = now();
+
+	for (size_t iter = 0; iter < concurrency; ++iter)
+		if (slots[iter].pid == pid) {
+			uint64_t size = status ? 0 : slots[iter].size;
+
+			slots[iter].pid = 0;
+			meter_end(cell, end - slots[iter].start, status, size, 0);
+			break;
+		}
+
+	return true;
+}
+
+/**
+ * \brief Run one operation on all objects.
+ *
+ * The phase is cut short if a module cannot be started or reports the
+ * operation as unsupported.
+ *
+ * \param argv Argument vector of the module.
+ * \param op Operation.
+ * \param cell Buffer to hold the metrics.
+ *
+ * \return Elapsed time in microseconds.
+ */
+static uint64_t phase(char *argv[], enum meter_op op, struct meter_cell *restrict cell) {
+	uint64_t start = now();
+	size_t next = 0, active = 0;
+	bool stopped = false;
+
+	memset(cell, 0, sizeof *cell);
+
+	while (!stopped && next < count || active) {
+		if (!stopped && next < count && active < concurrency) {
+			struct slot *slot = slots;
+			while (slot->pid)
+				++slot;
+
+			meter_begin(cell);
+
+			if (likely(launch(slot, argv, op, &objects[next++]))) {
+				++active;
+				continue;
+			}
+
+			meter_end(cell, 0, EXIT_FAILURE << 8, 0, 0);
+			stopped = true;
+			continue;
+		}
+
+		if (unlikely(!reap(cell)))
+			break;
+
+		--active;
+
+		if (cell->exits[METER_INVALID])
+			stopped = true;
+	}
+
+	return now() - start;
+}
+
+/**
+ * \brief Locate storage module.
+ *
+ * \param name Module name or path.
+ *
+ * \return Path of the module executable, to be freed by the caller.
+ */
+static char *locate(const char *restrict name) {
+	const char *home = getenv("HOME");
+	char *path;
+
+	if (strchr(name, '/'))
+		return strdup(name);
+
+	if (home && (path = malloc(strlen(home) + strlen(name) + sizeof "/.opencorpus/storage/"))) {
+		strcat(strcat(strcpy(path, home), "/.opencorpus/storage/"), name);
+
+		if (!access(path, X_OK))
+			return path;
+
+		free(path);
+	}
+
+	if ((path = malloc(strlen(name) + sizeof EXEC_BASE "storage/")))
+		strcat(strcpy(path, EXEC_BASE "storage/"), name);
+
+	return path;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * Each module deposits, retrieves and effaces the same set of objects in
+ * a scratch store, with \c BENCH_CONCURRENCY operations in flight.  One
+ * line per module and operation reports throughput and latency
+ * quantiles in microseconds.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector: storage module names or paths.
+ *
+ * \return EXIT_SUCCESS if all operations succeeded or EXIT_FAILURE otherwise.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc < 2)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	count       = setting("BENCH_COUNT", COUNT_DEFAULT);
+	concurrency = setting("BENCH_CONCURRENCY", CONCURRENCY_DEFAULT);
+
+	if (!concurrency)
+		concurrency = 1;
+
+	if (concurrency > CONCURRENCY_MAXIMUM)
+		concurrency = CONCURRENCY_MAXIMUM;
+
+	uint64_t limit = setting("BENCH_LIMIT", LIMIT_DEFAULT);
+
+	objects = calloc(count ? count : 1, sizeof *objects);
+	if (unlikely(!objects)) {
+		perror("Unable to allocate objects");
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(!draw(limit)))
+		return EXIT_FAILURE;
+
+	uint64_t largest = 0;
+	for (size_t iter = 0; iter < count; ++iter)
+		if (objects[iter].size > largest)
+			largest = objects[iter].size;
+
+	/* Random data keeps compressing modules honest */
+	data = malloc(largest ? largest : 1);
+	if (unlikely(!data)) {
+		perror("Unable to allocate object data");
+		return EXIT_FAILURE;
+	}
+
+	for (uint64_t iter = 0; iter < largest; ++iter)
+		data[iter] = lrand48();
+
+	char base[64];
+	snprintf(base, sizeof base, TEMP_BASE "bench-%ld", (long int) getpid());
+
+	if (mkdir(base, 0700)) {
+		snprintf(base, sizeof base, "/tmp/bench-%ld", (long int) getpid());
+
+		if (unlikely(mkdir(base, 0700))) {
+			perror("Unable to create scratch store");
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (size_t iter = 0; iter < concurrency; ++iter) {
+		char name[sizeof base + 32];
+		snprintf(name, sizeof name, "%s/input-%zu", base, iter);
+
+		if (unlikely((slots[iter].fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0)) {
+			perror("Unable to create input file");
+			return EXIT_FAILURE;
+		}
+
+		unlink(name);
+	}
+
+	printf("module op count failed seconds ops/s MiB/s p50 p99 p999 max\n");
+
+	int rc = EXIT_SUCCESS;
+
+	for (int arg = 1; arg < argc; ++arg) {
+		const char *name = strrchr(argv[arg], '/') ? strrchr(argv[arg], '/') + 1 : argv[arg];
+		char *module = locate(argv[arg]);
+		char store[sizeof base + 40], cache[sizeof store + 8], temp[sizeof store + 8];
+
+		snprintf(store, sizeof store, "%s/%.32s", base, name);
+		snprintf(cache, sizeof cache, "%s/cache", store);
+		snprintf(temp, sizeof temp, "%s/temp", store);
+
+		if (unlikely(!module || mkdir(store, 0700) || mkdir(cache, 0700) || mkdir(temp, 0700))) {
+			perror("Unable to set scratch store up");
+			rc = EXIT_FAILURE;
+			free(module);
+			continue;
+		}
+
+		char *args[] = { module, store, cache, temp, (char *) 0, (char *) 0, (char *) 0 };
+
+		for (size_t iter = 0; iter < sizeof phases / sizeof *phases; ++iter) {
+			enum meter_op op = phases[iter];
+			struct meter_cell cell;
+
+			uint64_t elapsed = phase(args, op, &cell);
+			uint64_t failed  = cell.count - cell.exits[METER_SUCCESS];
+			double   seconds = elapsed / 1e6;
+
+			/* Unsupported operations are no failure of the module */
+			if (cell.exits[METER_INVALID]) {
+				printf("%s %s - - - - - - - - -\n", name, names[op]);
+				continue;
+			}
+
+			printf("%s %s %" PRIu64 " %" PRIu64 " %.3f %.1f %.1f %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+				name, names[op], cell.count, failed, seconds,
+				seconds > 0 ? cell.count / seconds : 0, seconds > 0 ? cell.in / seconds / 1048576 : 0,
+				meter_quantile(&cell, 500000), meter_quantile(&cell, 990000), meter_quantile(&cell, 999000), cell.maximum);
+
+			fflush(stdout);
+
+			if (failed)
+				rc = EXIT_FAILURE;
+		}
+
+		free(module);
+	}
+
+	/* Keep the scratch store for inspection if asked to */
+	if (!setting("BENCH_KEEP", 0))
+		nftw(base, removal, 16, FTW_DEPTH | FTW_PHYS);
+	else
+		fprintf(stderr, "Scratch store kept in %s\n", base);
+
+	return rc;
+}
@@ -2,23 +2,51 @@
 
 set -e
 
+# Prefer the block‐parallel implementation, which writes standard streams
+if command -v lbzip2 >/dev/null 2>&1
+then
+	bzip2="lbzip2"
+else
+	bzip2="bzip2"
+fi
+
 case "$5" in
 	"assay")
 		[ -f "$1/$4.bz2" ] || exit 3
 	;;
 
 	"retrieve")
-		bzip2 -d -c <"$1/$4.bz2"
+		"$bzip2" -d -c <"$1/$4.bz2"
+	;;
+
+	"range")
+		# Compressed streams cannot seek
+		exit 2
+	;;
+
+	"inspect")
+		# The size of the decompressed stream is not recorded
+		[ -f "$1/$4.bz2" ] || exit 3
+		echo "- `stat -c "%s %Y" "$1/$4.bz2"`000000000 $1/$4.bz2"
 	;;
 
 	"deposit")
-		bzip2 -z -c -9 >"$1/$4.bz2"
+		# Store objects whole or not at all, even when cut short
+		trap 'rm -f -- "$1/$4.bz2.$$.part"' EXIT
+		trap 'exit 1' HUP INT TERM
+		"$bzip2" -z -c -9 >"$1/$4.bz2.$$.part"
+		mv -f -- "$1/$4.bz2.$$.part" "$1/$4.bz2"
 	;;
 
 	"efface")
 		rm -- "$1/$4.bz2"
 	;;
 
+	"list")
+		[ -d "$1" ] || exit 0
+		ls -- "$1" | sed -n 's/^\([0-9A-Fa-f]\{64\}\)\.bz2$/\1/p'
+	;;
+
 	*)
 		echo "Invalid storage operation “$5”!" >&2
 		exit 2
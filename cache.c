@@ -0,0 +1,520 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "expect.h"
+#include "index.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Default cache capacity in bytes.
+ */
+#define CACHE_DEFAULT (UINT64_C(1) << 30)
+
+/**
+ * \brief Number of fill lock stripes.
+ */
+#define CACHE_STRIPES 65536
+
+/**
+ * \brief Index file name.
+ */
+#define INDEX_NAME "index"
+
+/**
+ * \brief Fill lock file name.
+ */
+#define FILL_NAME "fill"
+
+/**
+ * \brief Object was referenced since the clock hand passed it.
+ */
+#define CACHE_REFERENCED INDEX_USER
+
+/**
+ * \brief Index state word holding the number of cached bytes.
+ */
+#define STATE_BYTES 0
+
+/**
+ * \brief Index state word holding the clock hand.
+ */
+#define STATE_HAND 1
+
+extern char **environ;
+
+/**
+ * \brief I/O buffer.
+ */
+static uint8_t buf[STREAM_BUFSIZE];
+
+/**
+ * \brief Object file name.
+ */
+static char name[32 * 2 + 1];
+
+/**
+ * \brief Temporary object file name.
+ */
+static char part[32 * 2 + sizeof ".part"];
+
+/**
+ * \brief Parse cache capacity.
+ *
+ * \param str Size with optional binary suffix \c K, \c M, \c G or \c T.
+ *
+ * \return Capacity in bytes.
+ */
+static uint64_t capacity(const char *restrict str) {
+	if (!str || !*str)
+		return CACHE_DEFAULT;
+
+	char *end;
+	uint64_t size = strtoull(str, &end, 10);
+
+	switch (*end) {
+	case 'T':
+		size <<= 10;
+	case 'G':
+		size <<= 10;
+	case 'M':
+		size <<= 10;
+	case 'K':
+		size <<= 10;
+	}
+
+	return size;
+}
+
+/**
+ * \brief Populate index from the cached object files.
+ *
+ * \param idx Writable index.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool rebuild(struct index *restrict idx) {
+	DIR *dir = opendir(".");
+	if (unlikely(!dir))
+		return false;
+
+	index_reset(idx);
+
+	for (struct dirent *ent; (ent = readdir(dir));) {
+		uint8_t ident[32];
+		struct stat st;
+
+		if (strlen(ent->d_name) != sizeof name - 1 || !hexsint(ident, ent->d_name, sizeof ident) ||
+			stat(ent->d_name, &st))
+			continue;
+
+		struct index_entry *entry = index_insert(idx, ident);
+		if (unlikely(!entry)) {
+			closedir(dir);
+			return false;
+		}
+
+		entry->length = st.st_size;
+		idx->head->state[STATE_BYTES] += st.st_size;
+	}
+
+	closedir(dir);
+
+	idx->dirty = false;
+
+	return true;
+}
+
+/**
+ * \brief Open index and rebuild it if required.
+ *
+ * \param idx Index context.
+ * \param write Open for writing.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool cache_index(struct index *restrict idx, bool write) {
+	if (index_open(idx, INDEX_NAME, write)) {
+		if (!idx->dirty)
+			return true;
+
+		if (!write)
+			index_close(idx);
+	}
+
+	else if (errno != EINVAL)
+		return false;
+
+	if (!write && unlikely(!index_open(idx, INDEX_NAME, true)))
+		return false;
+
+	if (idx->dirty && unlikely(!rebuild(idx))) {
+		index_close(idx);
+		return false;
+	}
+
+	if (write)
+		return true;
+
+	index_close(idx);
+
+	return index_open(idx, INDEX_NAME, false);
+}
+
+/**
+ * \brief Serve cached object or a byte range of it.
+ *
+ * \param ident Object identifier.
+ * \param offset Offset of first byte.
+ * \param length Maximum number of bytes.
+ *
+ * \return 0 if served, 3 if not cached or \c EXIT_FAILURE on failure.
+ */
+static int serve(const uint8_t ident[restrict 32], uint64_t offset, uint64_t length) {
+	struct index idx;
+	if (!cache_index(&idx, false))
+		return errno == ENOENT ? 3 : EXIT_FAILURE;
+
+	const struct index_entry *entry = index_find(&idx, ident);
+	if (!entry) {
+		index_close(&idx);
+		return 3;
+	}
+
+	/* Clip range to object */
+	if (offset > entry->length)
+		offset = entry->length;
+
+	if (length > entry->length - offset)
+		length = entry->length - offset;
+
+	bool referenced = entry->flags & CACHE_REFERENCED;
+
+	/* Eviction cannot remove the file while the index is locked */
+	int fd = open(name, O_RDONLY);
+
+	index_close(&idx);
+
+	if (unlikely(fd < 0))
+		return 3;
+
+	/* Mark object as recently used */
+	if (!referenced && cache_index(&idx, true)) {
+		struct index_entry *mark = index_find(&idx, ident);
+		if (mark)
+			mark->flags |= CACHE_REFERENCED;
+
+		index_close(&idx);
+	}
+
+	if (unlikely(!stream_send(1, fd, offset, length))) {
+		perror("Unable to send object");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	close(fd);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Evict objects until there is room for \a size more bytes.
+ *
+ * \param idx Writable index.
+ * \param size Number of bytes required.
+ * \param cap Cache capacity.
+ */
+static void evict(struct index *restrict idx, uint64_t size, uint64_t cap) {
+	uint64_t *bytes = &idx->head->state[STATE_BYTES];
+	uint64_t *hand  = &idx->head->state[STATE_HAND];
+
+	/* Two sweeps clear every reference bit */
+	for (uint64_t step = 0; *bytes + size > cap && idx->head->count && step < 2 * idx->head->slots; ++step) {
+		*hand &= idx->head->slots - 1;
+
+		struct index_entry *entry = &idx->slot[*hand];
+
+		if (!(entry->flags & INDEX_USED)) {
+			++*hand;
+			continue;
+		}
+
+		if (entry->flags & CACHE_REFERENCED) {
+			entry->flags &= ~CACHE_REFERENCED;
+			++*hand;
+			continue;
+		}
+
+		char victim[sizeof name];
+		inthexs(victim, entry->ident, sizeof entry->ident);
+
+		if (unlikely(unlink(victim)) && errno != ENOENT) {
+			++*hand;
+			continue;
+		}
+
+		*bytes -= *bytes < entry->length ? *bytes : entry->length;
+
+		/* Removal moves the next entry under the hand */
+		index_remove(idx, entry);
+	}
+}
+
+/**
+ * \brief Retrieve object through the cache.
+ *
+ * \param ident Object identifier.
+ * \param argv Argument vector of the retrieving program.
+ * \param cap Cache capacity.
+ *
+ * \return Exit status of the retrieving program or \c EXIT_FAILURE on failure.
+ */
+static int fill(const uint8_t ident[restrict 32], char *argv[], uint64_t cap) {
+	/* Serialise fills of the same object */
+	int lock = open(FILL_NAME, O_RDWR | O_CREAT, 0644);
+	if (unlikely(lock < 0)) {
+		perror("Unable to open fill lock");
+		return EXIT_FAILURE;
+	}
+
+	uint64_t stripe;
+	memcpy(&stripe, ident, sizeof stripe);
+
+	struct flock region = {
+		.l_type   = F_WRLCK,
+		.l_whence = SEEK_SET,
+		.l_start  = stripe % CACHE_STRIPES,
+		.l_len    = 1
+	};
+
+	while (unlikely(fcntl(lock, F_SETLKW, &region)))
+		if (errno != EINTR) {
+			perror("Unable to lock fill lock");
+			return EXIT_FAILURE;
+		}
+
+	/* Another process may have filled the cache meanwhile */
+	int rc = serve(ident, 0, UINT64_MAX);
+	if (rc != 3)
+		return rc;
+
+	int pipefd[2];
+	if (unlikely(pipe(pipefd))) {
+		perror("Unable to create pipe");
+		return EXIT_FAILURE;
+	}
+
+	posix_spawn_file_actions_t file_actions;
+	if (unlikely(posix_spawn_file_actions_init(&file_actions))) {
+		perror("Unable to set file descriptors up");
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, pipefd[1], 1) ||
+		posix_spawn_file_actions_addclose(&file_actions, pipefd[0]) ||
+		posix_spawn_file_actions_addclose(&file_actions, pipefd[1]))) {
+		perror("Unable to set file descriptors up");
+		return EXIT_FAILURE;
+	}
+
+	pid_t pid;
+	if (unlikely(errno = posix_spawnp(&pid, argv[0], &file_actions, (posix_spawnattr_t *) 0, argv, environ))) {
+		perror("Unable to spawn retrieval");
+		return EXIT_FAILURE;
+	}
+
+	posix_spawn_file_actions_destroy(&file_actions);
+	close(pipefd[1]);
+
+	int fd = open(part, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (unlikely(fd < 0))
+		perror("Unable to create cache file");
+
+	/* Copy object to standard output and cache file */
+	uint64_t length = 0;
+	bool fault = false;
+
+	for (;;) {
+		ssize_t in = read(pipefd[0], buf, sizeof buf);
+		if (unlikely(in < 0)) {
+			if (errno == EINTR)
+				continue;
+
+			perror("Read error");
+			fault = true;
+			break;
+		}
+
+		if (!in)
+			break;
+
+		if (unlikely(!stream_write(1, buf, in))) {
+			perror("Write error");
+			fault = true;
+			break;
+		}
+
+		if (fd >= 0 && unlikely(!stream_write(fd, buf, in))) {
+			perror("Unable to write cache file");
+			close(fd);
+			unlink(part);
+			fd = -1;
+		}
+
+		length += in;
+	}
+
+	close(pipefd[0]);
+
+	int status;
+	while (unlikely(waitpid(pid, &status, 0) < 0))
+		if (errno != EINTR) {
+			perror("Unable to wait for retrieval");
+			status = EXIT_FAILURE << 8;
+			break;
+		}
+
+	rc = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+	if (fault && rc == EXIT_SUCCESS)
+		rc = EXIT_FAILURE;
+
+	if (fd < 0)
+		return rc;
+
+	close(fd);
+
+	/* Only complete objects that fit are cached */
+	if (rc != EXIT_SUCCESS || length > cap) {
+		unlink(part);
+		return rc;
+	}
+
+	struct index idx;
+	if (unlikely(!cache_index(&idx, true))) {
+		perror("Unable to open index");
+		unlink(part);
+		return rc;
+	}
+
+	evict(&idx, length, cap);
+
+	struct index_entry *entry;
+	if (unlikely(rename(part, name) || !(entry = index_insert(&idx, ident)))) {
+		perror("Unable to insert cache entry");
+		unlink(part);
+	}
+
+	else {
+		idx.head->state[STATE_BYTES] += length - entry->length;
+		entry->length = length;
+	}
+
+	index_close(&idx);
+
+	return rc;
+}
+
+/**
+ * \brief Remove object from the cache.
+ *
+ * \param ident Object identifier.
+ *
+ * \return \c EXIT_SUCCESS if successful or \c EXIT_FAILURE on failure.
+ */
+static int drop(const uint8_t ident[restrict 32]) {
+	struct index idx;
+	if (!cache_index(&idx, true)) {
+		perror("Unable to open index");
+		return EXIT_FAILURE;
+	}
+
+	struct index_entry *entry = index_find(&idx, ident);
+	if (entry) {
+		uint64_t *bytes = &idx.head->state[STATE_BYTES];
+
+		*bytes -= *bytes < entry->length ? *bytes : entry->length;
+		index_remove(&idx, entry);
+	}
+
+	unlink(name);
+	index_close(&idx);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector.
+ *
+ * \return Exit status of the operation.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc < 4)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	uint8_t ident[32];
+	if (!hexsint(ident, argv[2], sizeof ident)) {
+		perror("Failed to parse identifier");
+		return EXIT_FAILURE;
+	}
+
+	inthexs(name, ident, sizeof ident);
+	strcpy(part, name);
+	strcat(part, ".part");
+
+	/* Change to cache directory */
+	if (unlikely(chdir(argv[1]))) {
+		perror("Unable to change to cache directory");
+		return EXIT_FAILURE;
+	}
+
+	/* Parse operation string */
+	if (!strcmp(argv[3], "serve")) {
+		uint64_t offset = 0, length = UINT64_MAX;
+
+		/* An optional byte range follows */
+		if (unlikely(argc != 4 && (argc != 6 || !decsint(&offset, argv[4]) || !decsint(&length, argv[5])))) {
+			fputs("Invalid byte range!\n", stderr);
+			return EXIT_FAILURE;
+		}
+
+		return serve(ident, offset, length);
+	}
+
+	else if (!strcmp(argv[3], "fill")) {
+		if (unlikely(argc < 5)) {
+			fputs("No retrieval command specified!\n", stderr);
+			return EXIT_FAILURE;
+		}
+
+		/* The cached object may be served to a reader that went away */
+		signal(SIGPIPE, SIG_IGN);
+
+		return fill(ident, &argv[4], capacity(getenv("CACHE_SIZE")));
+	}
+
+	else if (!strcmp(argv[3], "evict"))
+		return drop(ident);
+
+	else {
+		fprintf(stderr, "Invalid cache operation “%s”!\n", argv[3]);
+		return 2;
+	}
+}
@@ -0,0 +1,382 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bzlib.h>
+#include <lz4.h>
+#include <lz4hc.h>
+#include <lzma.h>
+#include <zdict.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "codec.h"
+#include "expect.h"
+
+/* Verbatim storage */
+
+static size_t store_bound(size_t size) {
+	return size;
+}
+
+static bool store_compress(void *restrict dest, size_t *restrict dlen, const void *restrict src, size_t slen, int level) {
+	if (unlikely(*dlen < slen))
+		return false;
+
+	memcpy(dest, src, slen);
+	*dlen = slen;
+
+	return true;
+}
+
+static bool store_decompress(void *restrict dest, size_t dlen, const void *restrict src, size_t slen) {
+	if (unlikely(dlen != slen))
+		return false;
+
+	memcpy(dest, src, slen);
+
+	return true;
+}
+
+/* Deflate through zlib */
+
+static size_t deflate_bound(size_t size) {
+	return compressBound(size);
+}
+
+static bool deflate_compress(void *restrict dest, size_t *restrict dlen, const void *restrict src, size_t slen, int level) {
+	uLongf size = *dlen;
+
+	if (unlikely(compress2(dest, &size, src, slen, level) != Z_OK))
+		return false;
+
+	*dlen = size;
+
+	return true;
+}
+
+static bool deflate_decompress(void *restrict dest, size_t dlen, const void *restrict src, size_t slen) {
+	uLongf size = dlen;
+
+	return uncompress(dest, &size, src, slen) == Z_OK && size == dlen;
+}
+
+/* bzip2 through libbz2 */
+
+static size_t bzip2_bound(size_t size) {
+	return size + size / 100 + 600;
+}
+
+static bool bzip2_compress(void *restrict dest, size_t *restrict dlen, const void *restrict src, size_t slen, int level) {
+	if (unlikely(slen > UINT_MAX))
+		return false;
+
+	unsigned int size = *dlen > UINT_MAX ? UINT_MAX : *dlen;
+
+	if (unlikely(BZ2_bzBuffToBuffCompress(dest, &size, (char *) src, slen, level, 0, 0) != BZ_OK))
+		return false;
+
+	*dlen = size;
+
+	return true;
+}
+
+static bool bzip2_decompress(void *restrict dest, size_t dlen, const void *restrict src, size_t slen) {
+	if (unlikely(dlen > UINT_MAX || slen > UINT_MAX))
+		return false;
+
+	unsigned int size = dlen;
+
+	return BZ2_bzBuffToBuffDecompress(dest, &size, (char *) src, slen, 0, 0) == BZ_OK && size == dlen;
+}
+
+/* xz through liblzma */
+
+static size_t xz_bound(size_t size) {
+	return lzma_stream_buffer_bound(size);
+}
+
+static bool xz_compress(void *restrict dest, size_t *restrict dlen, const void *restrict src, size_t slen, int level) {
+	size_t pos = 0;
+
+	if (unlikely(lzma_easy_buffer_encode(level, LZMA_CHECK_CRC32, (lzma_allocator *) 0, src, slen, dest, &pos, *dlen) != LZMA_OK))
+		return false;
+
+	*dlen = pos;
+
+	return true;
+}
+
+static bool xz_decompress(void *restrict dest, size_t dlen, const void *restrict src, size_t slen) {
+	uint64_t limit = UINT64_MAX;
+	size_t ipos = 0, opos = 0;
+
+	return lzma_stream_buffer_decode(&limit, 0, (lzma_allocator *) 0, src, &ipos, slen, dest, &opos, dlen) == LZMA_OK &&
+		opos == dlen;
+}
+
+/* Zstandard through libzstd */
+
+static size_t zstd_bound(size_t size) {
+	return ZSTD_compressBound(size);
+}
+
+static bool zstd_compress(void *restrict dest, size_t *restrict dlen, const void *restrict src, size_t slen, int level) {
+	size_t size = ZSTD_compress(dest, *dlen, src, slen, level);
+
+	if (unlikely(ZSTD_isError(size)))
+		return false;
+
+	*dlen = size;
+
+	return true;
+}
+
+static bool zstd_decompress(void *restrict dest, size_t dlen, const void *restrict src, size_t slen) {
+	return ZSTD_decompress(dest, dlen, src, slen) == dlen;
+}
+
+/* LZ4 through liblz4, using the high‐compression variant from level 3 on */
+
+static size_t lz4_bound(size_t size) {
+	return size > LZ4_MAX_INPUT_SIZE ? 0 : LZ4_compressBound(size);
+}
+
+static bool lz4_compress(void *restrict dest, size_t *restrict dlen, const void *restrict src, size_t slen, int level) {
+	if (unlikely(slen > LZ4_MAX_INPUT_SIZE))
+		return false;
+
+	int cap  = *dlen > INT_MAX ? INT_MAX : *dlen;
+	int size = level >= LZ4HC_CLEVEL_MIN ?
+		LZ4_compress_HC(src, dest, slen, cap, level) :
+		LZ4_compress_fast(src, dest, slen, cap, 1);
+
+	if (unlikely(size <= 0))
+		return false;
+
+	*dlen = size;
+
+	return true;
+}
+
+static bool lz4_decompress(void *restrict dest, size_t dlen, const void *restrict src, size_t slen) {
+	if (unlikely(dlen > INT_MAX || slen > INT_MAX))
+		return false;
+
+	return LZ4_decompress_safe(src, dest, slen, dlen) == (int) dlen;
+}
+
+/**
+ * \brief Available codecs.
+ */
+static const struct codec codecs[] = {
+	{ "store",   CODEC_STORE,   0, store_bound,   store_compress,   store_decompress   },
+	{ "deflate", CODEC_DEFLATE, 6, deflate_bound, deflate_compress, deflate_decompress },
+	{ "bzip2",   CODEC_BZIP2,   9, bzip2_bound,   bzip2_compress,   bzip2_decompress   },
+	{ "xz",      CODEC_XZ,      6, xz_bound,      xz_compress,      xz_decompress      },
+	{ "zstd",    CODEC_ZSTD,    3, zstd_bound,    zstd_compress,    zstd_decompress    },
+	{ "lz4",     CODEC_LZ4,     1, lz4_bound,     lz4_compress,     lz4_decompress     }
+};
+
+#define CODECS (sizeof codecs / sizeof *codecs)
+
+const struct codec *codec_name(const char *restrict name) {
+	for (size_t iter = 0; iter < CODECS; ++iter)
+		if (!strcmp(codecs[iter].name, name))
+			return &codecs[iter];
+
+	return (const struct codec *) 0;
+}
+
+const struct codec *codec_ident(uint8_t ident) {
+	for (size_t iter = 0; iter < CODECS; ++iter)
+		if (codecs[iter].ident == ident)
+			return &codecs[iter];
+
+	return (const struct codec *) 0;
+}
+
+/* Zstandard dictionaries */
+
+struct codec_dict {
+	const void *buf;   /**< Dictionary. */
+	size_t      size;  /**< Dictionary size. */
+	int         level; /**< Compression level of the digested dictionary. */
+	ZSTD_CDict *cdict; /**< Dictionary digested for compression. */
+	ZSTD_DDict *ddict; /**< Dictionary digested for decompression. */
+	ZSTD_CCtx  *cctx;  /**< Compression context. */
+	ZSTD_DCtx  *dctx;  /**< Decompression context. */
+};
+
+size_t codec_train(void *restrict dict, size_t capacity, const void *restrict samples, const size_t *restrict sizes, unsigned int count) {
+	size_t size = ZDICT_trainFromBuffer(dict, capacity, samples, sizes, count);
+	return ZDICT_isError(size) ? 0 : size;
+}
+
+struct codec_dict *codec_dict_open(const void *restrict buf, size_t size) {
+	struct codec_dict *dict = calloc(1, sizeof *dict);
+	if (unlikely(!dict))
+		return dict;
+
+	dict->buf  = buf;
+	dict->size = size;
+
+	return dict;
+}
+
+bool codec_dict_compress(struct codec_dict *restrict dict, void *restrict dest, size_t *restrict dlen, const void *restrict src, size_t slen, int level) {
+	/* The digested form depends on the compression level */
+	if (dict->cdict && dict->level != level) {
+		ZSTD_freeCDict(dict->cdict);
+		dict->cdict = (ZSTD_CDict *) 0;
+	}
+
+	if (!dict->cdict && !(dict->cdict = ZSTD_createCDict(dict->buf, dict->size, level)))
+		return false;
+
+	dict->level = level;
+
+	if (!dict->cctx && !(dict->cctx = ZSTD_createCCtx()))
+		return false;
+
+	size_t size = ZSTD_compress_usingCDict(dict->cctx, dest, *dlen, src, slen, dict->cdict);
+
+	if (unlikely(ZSTD_isError(size)))
+		return false;
+
+	*dlen = size;
+
+	return true;
+}
+
+bool codec_dict_decompress(struct codec_dict *restrict dict, void *restrict dest, size_t dlen, const void *restrict src, size_t slen) {
+	if (!dict->ddict && !(dict->ddict = ZSTD_createDDict(dict->buf, dict->size)))
+		return false;
+
+	if (!dict->dctx && !(dict->dctx = ZSTD_createDCtx()))
+		return false;
+
+	return ZSTD_decompress_usingDDict(dict->dctx, dest, dlen, src, slen, dict->ddict) == dlen;
+}
+
+void codec_dict_close(struct codec_dict *restrict dict) {
+	if (!dict)
+		return;
+
+	ZSTD_freeDCtx(dict->dctx);
+	ZSTD_freeCCtx(dict->cctx);
+	ZSTD_freeDDict(dict->ddict);
+	ZSTD_freeCDict(dict->cdict);
+	free(dict);
+}
+
+#ifdef TEST
+
+#include "essai.h"
+
+/**
+ * \brief Size of test data.
+ */
+#define SIZE 100000
+
+/**
+ * \brief Number of dictionary samples.
+ */
+#define SAMPLES 2000
+
+/**
+ * \brief Maximum size of dictionary samples.
+ */
+#define RECORD 256
+
+/**
+ * \brief Maximum dictionary size.
+ */
+#define DICTIONARY 4096
+
+/**
+ * \brief Compress and decompress test data.
+ */
+static bool roundtrip(const struct codec *restrict codec, const uint8_t *restrict data, size_t size) {
+	size_t dlen = codec->bound(size);
+	uint8_t *comp = malloc(dlen + 1);
+	uint8_t *back = malloc(size + 1);
+
+	bool result = comp && back &&
+		codec->compress(comp, &dlen, data, size, codec->level) &&
+		codec->decompress(back, size, comp, dlen) &&
+		!memcmp(back, data, size) &&
+		(codec->ident == CODEC_STORE || dlen < size);
+
+	free(comp);
+	free(back);
+
+	return result;
+}
+
+/**
+ * \brief Train dictionary on small records and compress a record with it.
+ */
+static bool dictionary(void) {
+	static uint8_t samples[SAMPLES * RECORD], dict[DICTIONARY], comp[RECORD * 2], back[RECORD];
+	static size_t sizes[SAMPLES];
+
+	for (size_t iter = 0; iter < SAMPLES; ++iter)
+		sizes[iter] = snprintf((char *) samples + iter * RECORD, RECORD,
+			"{\"ident\": %zu, \"kind\": \"document\", \"title\": \"Revision %u\", \"language\": \"%s\", \"licence\": \"%s\"}",
+			iter, rand() % 1000, rand() % 2 ? "en" : "fr", rand() % 2 ? "CC-BY" : "CC0");
+
+	/* Samples are passed back to back */
+	size_t fill = 0;
+	for (size_t iter = 0; iter < SAMPLES; ++iter) {
+		memmove(samples + fill, samples + iter * RECORD, sizes[iter]);
+		fill += sizes[iter];
+	}
+
+	size_t size = codec_train(dict, sizeof dict, samples, sizes, SAMPLES);
+	struct codec_dict *cdict = size ? codec_dict_open(dict, size) : (struct codec_dict *) 0;
+
+	if (!cdict)
+		return false;
+
+	const struct codec *zstd = codec_name("zstd");
+	size_t plain = sizeof comp, dlen = sizeof comp;
+
+	bool result =
+		zstd->compress(comp, &plain, samples, sizes[0], zstd->level) &&
+		codec_dict_compress(cdict, comp, &dlen, samples, sizes[0], zstd->level) &&
+		dlen < plain &&
+		codec_dict_decompress(cdict, back, sizes[0], comp, dlen) &&
+		!memcmp(back, samples, sizes[0]);
+
+	codec_dict_close(cdict);
+
+	return result;
+}
+
+int main(void) {
+	static uint8_t data[SIZE];
+
+	/* Moderately compressible data */
+	srand(0);
+	for (size_t iter = 0; iter < SIZE; ++iter)
+		data[iter] = "abcdefgh"[rand() % 8];
+
+	essaye(roundtrip(codec_name("store"), data, SIZE));
+	essaye(roundtrip(codec_name("deflate"), data, SIZE));
+	essaye(roundtrip(codec_name("bzip2"), data, SIZE));
+	essaye(roundtrip(codec_name("xz"), data, SIZE));
+	essaye(roundtrip(codec_name("zstd"), data, SIZE));
+	essaye(roundtrip(codec_name("lz4"), data, SIZE));
+
+	essaye(codec_ident(CODEC_ZSTD) == codec_name("zstd"));
+
+	essaye(dictionary());
+	essaye(!codec_name("gzip -z"));
+
+	return EXIT_SUCCESS;
+}
+#endif /* TEST */
@@ -0,0 +1,160 @@
+#pragma once
+#ifndef OC_CODEC_H
+#define OC_CODEC_H
+
+/**
+ * \file
+ *
+ * \brief Compression codecs.
+ *
+ * All codecs operate on complete buffers, which makes every frame of a
+ * compressed object independently decodable.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Codec identifiers.
+ */
+enum codec_ident {
+	CODEC_STORE   = 0, /**< No compression. */
+	CODEC_DEFLATE = 1, /**< Deflate (zlib). */
+	CODEC_BZIP2   = 2, /**< bzip2. */
+	CODEC_XZ      = 3, /**< LZMA2 in the xz container. */
+	CODEC_ZSTD    = 4, /**< Zstandard. */
+	CODEC_LZ4     = 5  /**< LZ4. */
+};
+
+/**
+ * \brief Codec description.
+ */
+struct codec {
+	const char *name;  /**< Codec name. */
+	uint8_t     ident; /**< Codec identifier. */
+	int         level; /**< Default compression level. */
+
+	/**
+	 * \brief Compute upper bound of compressed size.
+	 *
+	 * \param size Size of uncompressed data.
+	 *
+	 * \return Upper bound in bytes.
+	 */
+	size_t (*bound)(size_t size);
+
+	/**
+	 * \brief Compress buffer.
+	 *
+	 * \param dest Output buffer.
+	 * \param dlen Pointer to output buffer size, updated to the compressed size.
+	 * \param src Input buffer.
+	 * \param slen Size of input.
+	 * \param level Compression level.
+	 *
+	 * \return \c true if successful or \c false on failure.
+	 */
+	bool (*compress)(void *restrict dest, size_t *restrict dlen, const void *restrict src, size_t slen, int level);
+
+	/**
+	 * \brief Decompress buffer.
+	 *
+	 * \param dest Output buffer.
+	 * \param dlen Exact size of the uncompressed data.
+	 * \param src Input buffer.
+	 * \param slen Size of input.
+	 *
+	 * \return \c true if successful or \c false on failure.
+	 */
+	bool (*decompress)(void *restrict dest, size_t dlen, const void *restrict src, size_t slen);
+};
+
+/**
+ * \brief Compression dictionary.
+ *
+ * Dictionaries are only supported by Zstandard.  They are digested for
+ * compression or decompression when first used and kept digested until
+ * closed.
+ */
+struct codec_dict;
+
+/**
+ * \brief Train dictionary.
+ *
+ * \param dict Buffer to hold the dictionary.
+ * \param capacity Maximum dictionary size.
+ * \param samples Concatenated samples.
+ * \param sizes Sizes of the samples.
+ * \param count Number of samples.
+ *
+ * \return Dictionary size or 0 on failure.
+ */
+extern size_t codec_train(void *restrict dict, size_t capacity, const void *restrict samples, const size_t *restrict sizes, unsigned int count);
+
+/**
+ * \brief Open dictionary.
+ *
+ * The dictionary is only copied when it is digested, so it must stay
+ * valid until the dictionary is closed.
+ *
+ * \param buf Dictionary.
+ * \param size Dictionary size.
+ *
+ * \return Dictionary or <tt>(struct codec_dict *) 0</tt> on failure.
+ */
+extern struct codec_dict *codec_dict_open(const void *restrict buf, size_t size);
+
+/**
+ * \brief Compress buffer with dictionary.
+ *
+ * \param dict Dictionary.
+ * \param dest Output buffer.
+ * \param dlen Pointer to output buffer size, updated to the compressed size.
+ * \param src Input buffer.
+ * \param slen Size of input.
+ * \param level Compression level.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool codec_dict_compress(struct codec_dict *restrict dict, void *restrict dest, size_t *restrict dlen, const void *restrict src, size_t slen, int level);
+
+/**
+ * \brief Decompress buffer with dictionary.
+ *
+ * \param dict Dictionary.
+ * \param dest Output buffer.
+ * \param dlen Exact size of the uncompressed data.
+ * \param src Input buffer.
+ * \param slen Size of input.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool codec_dict_decompress(struct codec_dict *restrict dict, void *restrict dest, size_t dlen, const void *restrict src, size_t slen);
+
+/**
+ * \brief Close dictionary.
+ *
+ * \param dict Dictionary.
+ */
+extern void codec_dict_close(struct codec_dict *restrict dict);
+
+/**
+ * \brief Look codec up by name.
+ *
+ * \param name Codec name.
+ *
+ * \return Codec or <tt>(const struct codec *) 0</tt> if there is none.
+ */
+extern const struct codec *codec_name(const char *restrict name);
+
+/**
+ * \brief Look codec up by identifier.
+ *
+ * \param ident Codec identifier.
+ *
+ * \return Codec or <tt>(const struct codec *) 0</tt> if there is none.
+ */
+extern const struct codec *codec_ident(uint8_t ident);
+
+#endif /* OC_CODEC_H */
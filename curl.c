@@ -0,0 +1,1368 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <curl/curl.h>
+
+#include "expect.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Configuration file.
+ *
+ * The file consists of shell‐style assignments and may be overridden
+ * through \c CURL_CONFIG.
+ */
+#define CONFIG_PATH "/etc/opencorpus/storage/curl"
+
+/**
+ * \brief Default number of concurrent requests when assaying batches.
+ */
+#define PARALLEL_DEFAULT 16
+
+/**
+ * \brief Maximum number of concurrent requests.
+ */
+#define PARALLEL_MAXIMUM 256
+
+/**
+ * \brief Upload buffer size.
+ *
+ * This is the largest upload buffer libcurl accepts.
+ */
+#define UPLOAD_BUFSIZE (2 * 1024 * 1024)
+
+/**
+ * \brief Poll timeout in milliseconds.
+ */
+#define POLL_TIMEOUT 1000
+
+/**
+ * \brief Configuration variables.
+ */
+enum {
+	CONF_BASE_URI,
+	CONF_TIMEOUT,
+	CONF_CERT,
+	CONF_KEY,
+	CONF_PASS,
+	CONF_AUTH,
+	CONFS
+};
+
+/**
+ * \brief Configuration variable names.
+ */
+static const char *const names[CONFS] = {
+	"BASE_URI",
+	"TIMEOUT",
+	"CERT",
+	"KEY",
+	"PASS",
+	"AUTH"
+};
+
+/**
+ * \brief Configuration values.
+ */
+static char *conf[CONFS];
+
+/**
+ * \brief Protocol classes.
+ */
+enum protocol {
+	PROTO_HTTP,
+	PROTO_FTP,
+	PROTO_SFTP,
+	PROTO_OTHER
+};
+
+/**
+ * \brief Protocol of the base URI.
+ */
+static enum protocol proto;
+
+/**
+ * \brief Multi handle.
+ *
+ * All transfers are driven through it and share its connection cache,
+ * so connections are kept alive and reused for the life of the process.
+ */
+static CURLM *multi;
+
+/**
+ * \brief Number of transfers added to the multi handle.
+ */
+static size_t active;
+
+/**
+ * \brief Number of concurrent requests.
+ */
+static unsigned long int width;
+
+/**
+ * \brief Additional request headers.
+ */
+static struct curl_slist *headers;
+
+/**
+ * \brief Response body destination.
+ */
+struct sink {
+	CURL    *easy;  /**< Transfer. */
+	int      fd;    /**< Output file descriptor or −1 to discard. */
+	uint64_t skip;  /**< Number of bytes to discard first. */
+	uint64_t limit; /**< Number of bytes to write at most. */
+};
+
+/**
+ * \brief Assay request.
+ */
+struct probe {
+	uint8_t ident[32]; /**< Object identifier. */
+	int result;        /**< Outcome. */
+};
+
+/**
+ * \brief Batch of assay requests.
+ */
+struct batch {
+	struct probe *probe; /**< Requests. */
+	size_t count;        /**< Number of requests. */
+	size_t next;         /**< Next request to start. */
+};
+
+/**
+ * \brief Parse configuration line.
+ *
+ * \param line Line, which is modified in place.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool config_line(char *restrict line) {
+	size_t len = strlen(line);
+
+	while (len && strchr(" \t\r\n", line[len - 1]))
+		line[--len] = '\0';
+
+	while (*line == ' ' || *line == '\t')
+		++line;
+
+	if (!*line || *line == '#')
+		return true;
+
+	if (!strncmp(line, "export ", 7))
+		line += 7;
+
+	char *value = strchr(line, '=');
+	if (!value)
+		return true;
+
+	*value++ = '\0';
+
+	/* Strip matching quotes */
+	len = strlen(value);
+	if (len >= 2 && (*value == '"' || *value == '\'') && value[len - 1] == *value) {
+		value[len - 1] = '\0';
+		++value;
+	}
+
+	for (size_t iter = 0; iter < CONFS; ++iter)
+		if (!strcmp(line, names[iter])) {
+			free(conf[iter]);
+
+			if (unlikely(!(conf[iter] = strdup(value))))
+				return false;
+		}
+
+	return true;
+}
+
+/**
+ * \brief Load configuration.
+ *
+ * Variables not set in the configuration file are taken from the
+ * environment, as they were when the file was sourced by a shell.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool config_load(void) {
+	const char *path = getenv("CURL_CONFIG");
+	if (!path || !*path)
+		path = CONFIG_PATH;
+
+	FILE *file = fopen(path, "r");
+
+	if (file) {
+		char line[4096];
+		bool result = true;
+
+		while (result && fgets(line, sizeof line, file))
+			result = config_line(line);
+
+		if (unlikely(!result || ferror(file))) {
+			perror("Unable to read configuration");
+			fclose(file);
+			return false;
+		}
+
+		fclose(file);
+	}
+
+	else if (unlikely(errno != ENOENT)) {
+		perror("Unable to open configuration");
+		return false;
+	}
+
+	for (size_t iter = 0; iter < CONFS; ++iter) {
+		const char *value = getenv(names[iter]);
+
+		if (!conf[iter] && value && *value && unlikely(!(conf[iter] = strdup(value)))) {
+			perror("Unable to load configuration");
+			return false;
+		}
+	}
+
+	if (unlikely(!conf[CONF_BASE_URI] || !*conf[CONF_BASE_URI])) {
+		fputs("No base URI specified!\n", stderr);
+		return false;
+	}
+
+	const char *base = conf[CONF_BASE_URI];
+
+	if (!strncasecmp(base, "http://", 7) || !strncasecmp(base, "https://", 8))
+		proto = PROTO_HTTP;
+
+	else if (!strncasecmp(base, "ftp://", 6) || !strncasecmp(base, "ftps://", 7))
+		proto = PROTO_FTP;
+
+	else if (!strncasecmp(base, "sftp://", 7))
+		proto = PROTO_SFTP;
+
+	else
+		proto = PROTO_OTHER;
+
+	return true;
+}
+
+/**
+ * \brief Set up session.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool session_open(void) {
+	if (!config_load())
+		return false;
+
+	width = setting("CURL_PARALLEL", PARALLEL_DEFAULT);
+
+	if (!width)
+		width = 1;
+
+	if (width > PARALLEL_MAXIMUM)
+		width = PARALLEL_MAXIMUM;
+
+	if (unlikely(curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)) {
+		fputs("Unable to initialise libcurl!\n", stderr);
+		return false;
+	}
+
+	if (unlikely(!(multi = curl_multi_init()))) {
+		fputs("Unable to create multi handle!\n", stderr);
+		return false;
+	}
+
+	/* Keep one idle connection per concurrent request */
+	curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long) width);
+	curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long) width);
+
+	/* Do not wait for “100 Continue” before uploading */
+	if (unlikely(!(headers = curl_slist_append((struct curl_slist *) 0, "Expect:")))) {
+		fputs("Unable to set up request headers!\n", stderr);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Tear down session.
+ */
+static void session_close(void) {
+	if (multi)
+		curl_multi_cleanup(multi);
+
+	curl_slist_free_all(headers);
+	curl_global_cleanup();
+
+	for (size_t iter = 0; iter < CONFS; ++iter)
+		free(conf[iter]);
+
+	multi   = (CURLM *) 0;
+	headers = (struct curl_slist *) 0;
+	memset(conf, 0, sizeof conf);
+}
+
+/**
+ * \brief Write response body.
+ *
+ * Bodies of unsuccessful HTTP responses are discarded so the connection
+ * remains usable.  Servers that ignore a range request send the whole
+ * object, which is then cut down to the range here.
+ */
+static size_t sink_write(char *ptr, size_t size, size_t nmemb, void *data) {
+	struct sink *sink = data;
+	size_t len = size * nmemb, fill = len;
+
+	if (proto == PROTO_HTTP) {
+		long int status = 0;
+		curl_easy_getinfo(sink->easy, CURLINFO_RESPONSE_CODE, &status);
+
+		if (status / 100 != 2)
+			return len;
+
+		/* The server honoured the range request */
+		if (status == 206)
+			sink->skip = 0;
+	}
+
+	if (sink->skip) {
+		size_t drop = sink->skip < fill ? sink->skip : fill;
+
+		ptr        += drop;
+		fill       -= drop;
+		sink->skip -= drop;
+	}
+
+	if (fill > sink->limit)
+		fill = sink->limit;
+
+	sink->limit -= fill;
+
+	return sink->fd < 0 || stream_write(sink->fd, ptr, fill) ? len : 0;
+}
+
+/**
+ * \brief Read request body.
+ */
+static size_t source_read(char *ptr, size_t size, size_t nmemb, void *data) {
+	ssize_t len = stream_read(*(int *) data, ptr, size * nmemb);
+	return len < 0 ? CURL_READFUNC_ABORT : (size_t) len;
+}
+
+/**
+ * \brief Create transfer with the configured options.
+ *
+ * \return Transfer or \c NULL on failure.
+ */
+static CURL *request(void) {
+	CURL *easy = curl_easy_init();
+
+	if (unlikely(!easy)) {
+		fputs("Unable to create transfer!\n", stderr);
+		return (CURL *) 0;
+	}
+
+	curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(easy, CURLOPT_BUFFERSIZE, (long) CURL_MAX_READ_SIZE);
+	curl_easy_setopt(easy, CURLOPT_UPLOAD_BUFFERSIZE, (long) UPLOAD_BUFSIZE);
+	curl_easy_setopt(easy, CURLOPT_HTTPHEADER, headers);
+
+	if (conf[CONF_TIMEOUT])
+		curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, (long) (strtod(conf[CONF_TIMEOUT], (char **) 0) * 1000));
+
+	if (conf[CONF_CERT])
+		curl_easy_setopt(easy, CURLOPT_SSLCERT, conf[CONF_CERT]);
+
+	if (conf[CONF_KEY])
+		curl_easy_setopt(easy, CURLOPT_SSLKEY, conf[CONF_KEY]);
+
+	if (conf[CONF_PASS])
+		curl_easy_setopt(easy, CURLOPT_KEYPASSWD, conf[CONF_PASS]);
+
+	if (conf[CONF_AUTH])
+		curl_easy_setopt(easy, CURLOPT_USERPWD, conf[CONF_AUTH]);
+
+	return easy;
+}
+
+/**
+ * \brief Point transfer at object.
+ *
+ * \param easy Transfer.
+ * \param ident Object identifier.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool target(CURL *restrict easy, const uint8_t ident[restrict 32]) {
+	size_t len = strlen(conf[CONF_BASE_URI]);
+	char url[len + 32 * 2 + 1];
+
+	memcpy(url, conf[CONF_BASE_URI], len);
+	inthexs(url + len, ident, 32);
+
+	return curl_easy_setopt(easy, CURLOPT_URL, url) == CURLE_OK;
+}
+
+/**
+ * \brief Start transfer.
+ *
+ * \param easy Transfer.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool launch(CURL *easy) {
+	if (unlikely(curl_multi_add_handle(multi, easy) != CURLM_OK))
+		return false;
+
+	++active;
+	return true;
+}
+
+/**
+ * \brief Run transfers until all have completed.
+ *
+ * \param finish Function called for every completed transfer, which may
+ * launch further transfers.
+ * \param data Data passed to \a finish.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool drive(void (*finish)(CURL *, CURLcode, void *), void *data) {
+	while (active) {
+		int running;
+
+		if (unlikely(curl_multi_perform(multi, &running) != CURLM_OK))
+			return false;
+
+		CURLMsg *msg;
+		while ((msg = curl_multi_info_read(multi, &running)))
+			if (msg->msg == CURLMSG_DONE) {
+				CURL *easy    = msg->easy_handle;
+				CURLcode code = msg->data.result;
+
+				curl_multi_remove_handle(multi, easy);
+				--active;
+
+				finish(easy, code, data);
+			}
+
+		if (active && unlikely(curl_multi_poll(multi, (struct curl_waitfd *) 0, 0, POLL_TIMEOUT, (int *) 0) != CURLM_OK))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Map transfer result to exit status.
+ *
+ * \param easy Transfer.
+ * \param code Transfer result.
+ *
+ * \return 0 if successful, 3 if there is no such object or \c EXIT_FAILURE on failure.
+ */
+static int outcome(CURL *easy, CURLcode code) {
+	long int status = 0;
+	curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+
+	if (code == CURLE_REMOTE_FILE_NOT_FOUND || proto == PROTO_HTTP && (status == 404 || status == 410))
+		return 3;
+
+	/* Ranges starting past the end of an object are empty */
+	if (proto == PROTO_HTTP && status == 416)
+		return EXIT_SUCCESS;
+
+	if (unlikely(code != CURLE_OK)) {
+		fprintf(stderr, "Transfer failed: %s\n", curl_easy_strerror(code));
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(proto == PROTO_HTTP && status / 100 != 2)) {
+		fprintf(stderr, "Server responded with status %ld!\n", status);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Record result of single transfer.
+ */
+static void single(CURL *easy, CURLcode code, void *data) {
+	*(CURLcode *) data = code;
+}
+
+/**
+ * \brief Run single transfer.
+ *
+ * \param easy Transfer.
+ *
+ * \return 0 if successful, 3 if there is no such object or \c EXIT_FAILURE on failure.
+ */
+static int transfer(CURL *easy) {
+	CURLcode code = CURLE_OK;
+
+	if (unlikely(!launch(easy) || !drive(single, &code))) {
+		fputs("Unable to perform transfer!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	return outcome(easy, code);
+}
+
+/**
+ * \brief Start assay request.
+ *
+ * \param easy Transfer.
+ * \param probe Request.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool probe_start(CURL *restrict easy, struct probe *restrict probe) {
+	curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+	curl_easy_setopt(easy, CURLOPT_PRIVATE, (void *) probe);
+
+	return target(easy, probe->ident) && launch(easy);
+}
+
+/**
+ * \brief Record result of assay request and start the next one on the
+ * same transfer.
+ */
+static void probe_finish(CURL *easy, CURLcode code, void *data) {
+	struct batch *batch = data;
+	struct probe *probe;
+
+	curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **) &probe);
+	probe->result = outcome(easy, code);
+
+	if (batch->next < batch->count && probe_start(easy, &batch->probe[batch->next]))
+		++batch->next;
+	else
+		curl_easy_cleanup(easy);
+}
+
+/**
+ * \brief Assay objects.
+ *
+ * Up to \c CURL_PARALLEL requests are in flight at any time.
+ *
+ * \param probe Requests.
+ * \param count Number of requests.
+ *
+ * \return 0 if all objects exist, 3 if any does not, 2 if the protocol
+ * does not support assaying or \c EXIT_FAILURE on failure.
+ */
+static int op_assay(struct probe *restrict probe, size_t count) {
+	if (unlikely(proto == PROTO_OTHER)) {
+		fputs("The selected protocol does not support assaying!\n", stderr);
+		return 2;
+	}
+
+	struct batch batch = {
+		.probe = probe,
+		.count = count,
+		.next  = 0
+	};
+
+	for (size_t iter = 0; iter < count; ++iter)
+		probe[iter].result = EXIT_FAILURE;
+
+	while (batch.next < count && batch.next < width) {
+		CURL *easy = request();
+
+		if (unlikely(!easy))
+			break;
+
+		if (unlikely(!probe_start(easy, &probe[batch.next]))) {
+			curl_easy_cleanup(easy);
+			break;
+		}
+
+		++batch.next;
+	}
+
+	if (unlikely(!drive(probe_finish, &batch))) {
+		fputs("Unable to perform transfers!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	int rc = EXIT_SUCCESS;
+
+	for (size_t iter = 0; iter < count; ++iter) {
+		if (unlikely(probe[iter].result == EXIT_FAILURE))
+			return EXIT_FAILURE;
+
+		if (probe[iter].result == 3)
+			rc = 3;
+	}
+
+	return rc;
+}
+
+/**
+ * \brief Retrieve byte range of object.
+ *
+ * \param ident Object identifier.
+ * \param fd Output file descriptor.
+ * \param offset Offset of first byte.
+ * \param length Maximum number of bytes.
+ *
+ * \return 0 if successful, 3 if there is no such object or \c EXIT_FAILURE on failure.
+ */
+static int op_retrieve(const uint8_t ident[restrict 32], int fd, uint64_t offset, uint64_t length) {
+	CURL *easy = request();
+
+	if (unlikely(!easy))
+		return EXIT_FAILURE;
+
+	struct sink sink = {
+		.easy  = easy,
+		.fd    = fd,
+		.skip  = proto == PROTO_HTTP ? offset : 0,
+		.limit = length
+	};
+
+	curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, sink_write);
+	curl_easy_setopt(easy, CURLOPT_WRITEDATA, (void *) &sink);
+
+	char range[2 * sizeof "18446744073709551615"];
+
+	/* Empty ranges only check that the object exists */
+	if (!length)
+		curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+
+	else if (offset || length != UINT64_MAX) {
+		if (length > UINT64_MAX - offset)
+			snprintf(range, sizeof range, "%llu-", (unsigned long long int) offset);
+		else
+			snprintf(range, sizeof range, "%llu-%llu", (unsigned long long int) offset, (unsigned long long int) (offset + length - 1));
+
+		curl_easy_setopt(easy, CURLOPT_RANGE, range);
+	}
+
+	int rc = target(easy, ident) ? transfer(easy) : EXIT_FAILURE;
+
+	curl_easy_cleanup(easy);
+	return rc;
+}
+
+/**
+ * \brief Describe object.
+ *
+ * Size and modification time are taken from the response to a request
+ * without body.  The remote storage is opaque, so the stored size is
+ * reported to be the object size.
+ *
+ * \param ident Object identifier.
+ * \param fd Output file descriptor.
+ *
+ * \return 0 if successful, 3 if there is no such object, 2 if the protocol
+ * does not support inspection or \c EXIT_FAILURE on failure.
+ */
+static int op_inspect(const uint8_t ident[restrict 32], int fd) {
+	if (unlikely(proto == PROTO_OTHER)) {
+		fputs("The selected protocol does not support inspection!\n", stderr);
+		return 2;
+	}
+
+	CURL *easy = request();
+
+	if (unlikely(!easy))
+		return EXIT_FAILURE;
+
+	curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+	curl_easy_setopt(easy, CURLOPT_FILETIME, 1L);
+
+	int rc = target(easy, ident) ? transfer(easy) : EXIT_FAILURE;
+
+	if (rc == EXIT_SUCCESS) {
+		curl_off_t size = -1, stamp = -1;
+		char *url = (char *) 0;
+
+		curl_easy_getinfo(easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+		curl_easy_getinfo(easy, CURLINFO_FILETIME_T, &stamp);
+		curl_easy_getinfo(easy, CURLINFO_EFFECTIVE_URL, &url);
+
+		char head[3 * sizeof "18446744073709551615" + 9] = "- - ";
+		if (size >= 0)
+			snprintf(head, sizeof head, "%lld %lld ", (long long int) size, (long long int) size);
+
+		size_t len = strlen(head);
+		if (stamp >= 0)
+			snprintf(head + len, sizeof head - len, "%lld000000000 ", (long long int) stamp);
+		else
+			strcpy(head + len, "- ");
+
+		if (unlikely(!stream_write(fd, head, strlen(head)) ||
+			!stream_write(fd, url ? url : "-", strlen(url ? url : "-")) ||
+			!stream_write(fd, "\n", 1))) {
+			perror("Unable to write description");
+			rc = EXIT_FAILURE;
+		}
+	}
+
+	curl_easy_cleanup(easy);
+	return rc;
+}
+
+/**
+ * \brief Deposit object.
+ *
+ * The size is announced if the input is a regular file; otherwise the
+ * body is streamed with chunked transfer encoding.
+ *
+ * \param ident Object identifier.
+ * \param fd Input file descriptor.
+ *
+ * \return 0 if successful or \c EXIT_FAILURE on failure.
+ */
+static int op_deposit(const uint8_t ident[restrict 32], int fd) {
+	CURL *easy = request();
+
+	if (unlikely(!easy))
+		return EXIT_FAILURE;
+
+	struct sink sink = {
+		.easy  = easy,
+		.fd    = -1,
+		.skip  = 0,
+		.limit = UINT64_MAX
+	};
+
+	curl_easy_setopt(easy, CURLOPT_UPLOAD, 1L);
+	curl_easy_setopt(easy, CURLOPT_READFUNCTION, source_read);
+	curl_easy_setopt(easy, CURLOPT_READDATA, (void *) &fd);
+	curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, sink_write);
+	curl_easy_setopt(easy, CURLOPT_WRITEDATA, (void *) &sink);
+
+	struct stat st;
+	off_t pos;
+
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && (pos = lseek(fd, 0, SEEK_CUR)) >= 0)
+		curl_easy_setopt(easy, CURLOPT_INFILESIZE_LARGE, (curl_off_t) (st.st_size - pos));
+
+	int rc = target(easy, ident) ? transfer(easy) : EXIT_FAILURE;
+
+	curl_easy_cleanup(easy);
+	return rc == 3 ? EXIT_FAILURE : rc;
+}
+
+/**
+ * \brief Efface object.
+ *
+ * Effacing an object that does not exist succeeds.
+ *
+ * \param ident Object identifier.
+ *
+ * \return 0 if successful or \c EXIT_FAILURE on failure.
+ */
+static int op_efface(const uint8_t ident[restrict 32]) {
+	if (unlikely(proto == PROTO_OTHER)) {
+		fputs("The selected protocol does not support effacement!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	CURL *easy = request();
+
+	if (unlikely(!easy))
+		return EXIT_FAILURE;
+
+	struct sink sink = {
+		.easy  = easy,
+		.fd    = -1,
+		.skip  = 0,
+		.limit = UINT64_MAX
+	};
+
+	struct curl_slist *quote = (struct curl_slist *) 0;
+	char cmd[sizeof "DELE " + 32 * 2], hex[32 * 2 + 1];
+	int rc = EXIT_FAILURE;
+
+	inthexs(hex, ident, 32);
+
+	switch (proto) {
+	case PROTO_HTTP:
+		curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, "DELETE");
+		curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, sink_write);
+		curl_easy_setopt(easy, CURLOPT_WRITEDATA, (void *) &sink);
+		break;
+
+	case PROTO_FTP:
+		/* Delete from the object’s directory after checking it exists */
+		snprintf(cmd, sizeof cmd, "DELE %s", hex);
+		curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+		curl_easy_setopt(easy, CURLOPT_POSTQUOTE, quote = curl_slist_append(quote, cmd));
+		break;
+
+	default: {
+		/* SFTP quote commands take absolute paths */
+		const char *base = conf[CONF_BASE_URI] + sizeof "sftp://" - 1;
+		const char *path = strchr(base, '/');
+		size_t len = path ? strlen(path) : 1;
+		char del[sizeof "rm " + len + 32 * 2];
+
+		snprintf(del, sizeof del, "rm %s%s", path ? path : "/", hex);
+		curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+		curl_easy_setopt(easy, CURLOPT_POSTQUOTE, quote = curl_slist_append(quote, del));
+		break;
+	}
+	}
+
+	if ((proto == PROTO_HTTP || quote) && target(easy, ident))
+		rc = transfer(easy);
+
+	curl_easy_cleanup(easy);
+	curl_slist_free_all(quote);
+
+	return rc == 3 ? EXIT_SUCCESS : rc;
+}
+
+#ifndef TEST
+/**
+ * \brief Assay objects whose identifiers are read from standard input.
+ *
+ * The identifiers of objects that exist are written to standard output.
+ */
+static int op_assay_batch(void) {
+	struct probe *probe = (struct probe *) 0;
+	size_t count = 0, size = 0;
+	char line[128];
+
+	while (fgets(line, sizeof line, stdin)) {
+		line[strcspn(line, " \t\r\n")] = '\0';
+
+		if (!*line)
+			continue;
+
+		if (count == size) {
+			struct probe *grown = realloc(probe, (size = size ? size * 2 : 64) * sizeof *probe);
+
+			if (unlikely(!grown)) {
+				perror("Unable to allocate memory");
+				free(probe);
+				return EXIT_FAILURE;
+			}
+
+			probe = grown;
+		}
+
+		if (unlikely(strlen(line) != 32 * 2 || !hexsint(probe[count].ident, line, 32))) {
+			fprintf(stderr, "Failed to parse identifier “%s”!\n", line);
+			free(probe);
+			return EXIT_FAILURE;
+		}
+
+		++count;
+	}
+
+	if (unlikely(ferror(stdin))) {
+		perror("Unable to read identifiers");
+		free(probe);
+		return EXIT_FAILURE;
+	}
+
+	int rc = count ? op_assay(probe, count) : EXIT_SUCCESS;
+
+	for (size_t iter = 0; iter < count && rc != 2; ++iter)
+		if (!probe[iter].result) {
+			inthexs(line, probe[iter].ident, 32);
+			puts(line);
+		}
+
+	free(probe);
+
+	if (unlikely(fflush(stdout))) {
+		perror("Unable to write identifiers");
+		return EXIT_FAILURE;
+	}
+
+	return rc;
+}
+
+int main(int argc, char *argv[]) {
+	if (unlikely(argc != 6 && argc != 8)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	const char *op = argv[5];
+
+	if (strcmp(op, "assay") && strcmp(op, "retrieve") && strcmp(op, "range") && strcmp(op, "inspect") && strcmp(op, "deposit") && strcmp(op, "efface")) {
+		fprintf(stderr, "Invalid storage operation “%s”!\n", op);
+		return 2;
+	}
+
+	/* An identifier of “-” assays the identifiers listed on standard input */
+	bool batch = !strcmp(argv[4], "-");
+
+	if (unlikely(batch && strcmp(op, "assay"))) {
+		fputs("Only assaying supports batches of identifiers!\n", stderr);
+		return 2;
+	}
+
+	struct probe probe;
+	if (!batch && !hexsint(probe.ident, argv[4], sizeof probe.ident)) {
+		perror("Failed to parse identifier");
+		return EXIT_FAILURE;
+	}
+
+	uint64_t offset = 0, length = UINT64_MAX;
+	if (unlikely(!strcmp(op, "range") && (argc != 8 || !decsint(&offset, argv[6]) || !decsint(&length, argv[7])))) {
+		fputs("Invalid byte range!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	int rc = EXIT_FAILURE;
+
+	if (session_open()) {
+		if (!strcmp(op, "assay"))
+			rc = batch ? op_assay_batch() : op_assay(&probe, 1);
+
+		else if (!strcmp(op, "retrieve") || !strcmp(op, "range"))
+			rc = op_retrieve(probe.ident, STDOUT_FILENO, offset, length);
+
+		else if (!strcmp(op, "inspect"))
+			rc = op_inspect(probe.ident, STDOUT_FILENO);
+
+		else if (!strcmp(op, "deposit"))
+			rc = op_deposit(probe.ident, STDIN_FILENO);
+
+		else
+			rc = op_efface(probe.ident);
+	}
+
+	session_close();
+	return rc;
+}
+#else
+#include <signal.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "essai.h"
+
+/**
+ * \brief Size of test object.
+ */
+#define SIZE (3 * 1024 * 1024 + 17)
+
+/**
+ * \brief Number of assay requests in the test batch.
+ */
+#define PROBES 64
+
+/**
+ * \brief Concurrent requests in the test batch.
+ */
+#define WIDTH 4
+
+/**
+ * \brief Name of the file counting accepted connections.
+ */
+#define CONNECTIONS "connections"
+
+/**
+ * \brief Test data byte.
+ */
+static inline uint8_t pattern(size_t pos) {
+	return (uint8_t) (pos * 131 + pos / 4099);
+}
+
+/**
+ * \brief Write test data.
+ */
+static bool produce(int fd) {
+	static uint8_t data[SIZE];
+
+	for (size_t iter = 0; iter < SIZE; ++iter)
+		data[iter] = pattern(iter);
+
+	return stream_write(fd, data, SIZE);
+}
+
+/**
+ * \brief Verify test data.
+ */
+static bool matches(int fd) {
+	static uint8_t data[SIZE + 1];
+
+	return !lseek(fd, 0, SEEK_SET) && stream_read(fd, data, sizeof data) == SIZE &&
+		data[0] == pattern(0) && data[SIZE / 2] == pattern(SIZE / 2) && data[SIZE - 1] == pattern(SIZE - 1);
+}
+
+/**
+ * \brief Verify byte range of test data.
+ */
+static bool excerpt(int fd, uint64_t offset, uint64_t length) {
+	static uint8_t data[SIZE + 1];
+
+	if (lseek(fd, 0, SEEK_SET) || stream_read(fd, data, sizeof data) != (ssize_t) length)
+		return false;
+
+	for (uint64_t iter = 0; iter < length; ++iter)
+		if (data[iter] != pattern(offset + iter))
+			return false;
+
+	return true;
+}
+
+/**
+ * \brief Empty output file.
+ */
+static bool rewound(int fd) {
+	return !ftruncate(fd, 0) && !lseek(fd, 0, SEEK_SET);
+}
+
+/**
+ * \brief Verify object description.
+ */
+static bool described(int fd, const char *restrict uri, const uint8_t ident[restrict 32]) {
+	char line[256], expect[256], hex[32 * 2 + 1];
+	ssize_t len;
+
+	inthexs(hex, ident, 32);
+	snprintf(expect, sizeof expect, "%llu %llu - %s%s\n", (unsigned long long int) SIZE, (unsigned long long int) SIZE, uri, hex);
+
+	if (lseek(fd, 0, SEEK_SET) || (len = stream_read(fd, line, sizeof line - 1)) < 0)
+		return false;
+
+	line[len] = 0;
+	return !strcmp(line, expect);
+}
+
+/**
+ * \brief Send response head and optional body.
+ */
+static bool reply(int conn, int status, uint64_t length, const char *restrict body) {
+	char head[128];
+	int len = snprintf(head, sizeof head, "HTTP/1.1 %d Stand-in\r\nContent-Length: %llu\r\n\r\n",
+		status, (unsigned long long int) length);
+
+	return stream_write(conn, head, len) && (!body || stream_write(conn, body, strlen(body)));
+}
+
+/**
+ * \brief Copy request body.
+ */
+static bool relay(FILE *restrict in, FILE *restrict out, uint64_t length) {
+	char buf[65536];
+
+	while (length) {
+		size_t len = fread(buf, 1, length > sizeof buf ? sizeof buf : length, in);
+
+		if (!len || fwrite(buf, 1, len, out) != len)
+			return false;
+
+		length -= len;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Serve requests on a connection until the client closes it.
+ */
+static void converse(int conn) {
+	FILE *in = fdopen(conn, "r");
+	char line[256], method[16], path[128];
+
+	while (in && fgets(line, sizeof line, in)) {
+		if (sscanf(line, "%15s %127s", method, path) != 2 || strchr(path + 1, '/'))
+			return;
+
+		uint64_t length = 0, first = 0, last = UINT64_MAX;
+		bool chunked = false, ranged = false;
+		char *end;
+
+		while (fgets(line, sizeof line, in) && strcmp(line, "\r\n"))
+			if (!strncasecmp(line, "Content-Length:", 15))
+				length = strtoull(line + 15, (char **) 0, 10);
+			else if (!strncasecmp(line, "Transfer-Encoding:", 18) && strstr(line, "chunked"))
+				chunked = true;
+			else if (!strncasecmp(line, "Range: bytes=", 13)) {
+				ranged = true;
+				first  = strtoull(line + 13, &end, 10);
+
+				if (end[0] == '-' && end[1] >= '0' && end[1] <= '9')
+					last = strtoull(end + 1, (char **) 0, 10);
+			}
+
+		const char *name = path + 1;
+		struct stat st;
+
+		if (!strcmp(method, "HEAD") || !strcmp(method, "GET")) {
+			FILE *file = fopen(name, "r");
+
+			if (!file || fstat(fileno(file), &st)) {
+				if (!reply(conn, 404, strcmp(method, "GET") ? 0 : 15, strcmp(method, "GET") ? (const char *) 0 : "No such object\n"))
+					return;
+
+				continue;
+			}
+
+			uint64_t size = st.st_size;
+
+			if (ranged && first >= size) {
+				fclose(file);
+
+				if (!reply(conn, 416, 0, (const char *) 0))
+					return;
+
+				continue;
+			}
+
+			if (last >= size)
+				last = size - 1;
+
+			/* Ranges are answered with partial content */
+			char head[160];
+			int len = ranged ?
+				snprintf(head, sizeof head, "HTTP/1.1 206 Stand-in\r\nContent-Length: %llu\r\nContent-Range: bytes %llu-%llu/%llu\r\n\r\n",
+					(unsigned long long int) (last - first + 1), (unsigned long long int) first, (unsigned long long int) last, (unsigned long long int) size) :
+				snprintf(head, sizeof head, "HTTP/1.1 200 Stand-in\r\nContent-Length: %llu\r\n\r\n", (unsigned long long int) size);
+
+			bool result = stream_write(conn, head, len) && !fseek(file, first, SEEK_SET);
+			uint64_t remain = ranged ? last - first + 1 : size;
+
+			for (char buf[65536]; result && remain && !strcmp(method, "GET");) {
+				size_t len = fread(buf, 1, remain > sizeof buf ? sizeof buf : remain, file);
+
+				if (!len)
+					break;
+
+				result = stream_write(conn, buf, len);
+				remain -= len;
+			}
+
+			fclose(file);
+
+			if (!result)
+				return;
+		}
+
+		else if (!strcmp(method, "PUT")) {
+			char part[sizeof path + sizeof ".part"];
+			snprintf(part, sizeof part, "%s.part", name);
+
+			FILE *file = fopen(part, "w");
+			bool result = file != (FILE *) 0;
+
+			if (chunked)
+				while (result && (result = fgets(line, sizeof line, in) != (char *) 0)) {
+					uint64_t size = strtoull(line, (char **) 0, 16);
+
+					if (!size) {
+						while ((result = fgets(line, sizeof line, in) != (char *) 0) && strcmp(line, "\r\n"));
+						break;
+					}
+
+					result = relay(in, file, size) && fgets(line, sizeof line, in);
+				}
+
+			else if (result)
+				result = relay(in, file, length);
+
+			if (!file || fclose(file) || !result || rename(part, name) || !reply(conn, 201, 0, (const char *) 0))
+				return;
+		}
+
+		else if (!strcmp(method, "DELETE")) {
+			if (!reply(conn, unlink(name) ? 404 : 204, 0, (const char *) 0))
+				return;
+		}
+
+		else if (!reply(conn, 405, 0, (const char *) 0))
+			return;
+	}
+}
+
+/**
+ * \brief Accept connections, each served by its own process.
+ */
+static void serve(int sock) {
+	signal(SIGCHLD, SIG_IGN);
+
+	for (;;) {
+		int conn = accept(sock, (struct sockaddr *) 0, (socklen_t *) 0);
+
+		if (conn < 0) {
+			if (errno == EINTR)
+				continue;
+
+			_exit(EXIT_FAILURE);
+		}
+
+		/* Count connections to verify they are reused */
+		FILE *count = fopen(CONNECTIONS, "a");
+		if (count) {
+			fputc('+', count);
+			fclose(count);
+		}
+
+		if (!fork()) {
+			close(sock);
+			converse(conn);
+			_exit(EXIT_SUCCESS);
+		}
+
+		close(conn);
+	}
+}
+
+/**
+ * \brief Number of connections accepted by the stand‐in server.
+ */
+static off_t connections(const char *restrict dir) {
+	char path[64];
+	struct stat st;
+
+	snprintf(path, sizeof path, "%s/" CONNECTIONS, dir);
+
+	return stat(path, &st) ? 0 : st.st_size;
+}
+
+/**
+ * \brief Verify outcome of the test batch.
+ */
+static bool probed(const struct probe *restrict probe) {
+	for (size_t iter = 0; iter < PROBES; ++iter)
+		if (probe[iter].result != (iter < 2 ? EXIT_SUCCESS : 3))
+			return false;
+
+	return true;
+}
+
+int main(void) {
+	char dir[32], uri[64], path[128], width[16];
+	snprintf(dir, sizeof dir, "/tmp/curl-%ld", (long int) getpid());
+
+	essaye(!mkdir(dir, 0700));
+
+	/* Stand‐in HTTP server on an ephemeral loopback port */
+	struct sockaddr_in addr;
+	socklen_t len = sizeof addr;
+
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	essaye(sock >= 0 && !bind(sock, (struct sockaddr *) &addr, sizeof addr) && !listen(sock, PROBES));
+	essaye(!getsockname(sock, (struct sockaddr *) &addr, &len));
+
+	pid_t server = fork();
+	if (!server) {
+		if (chdir(dir))
+			_exit(EXIT_FAILURE);
+
+		serve(sock);
+	}
+
+	close(sock);
+
+	snprintf(uri, sizeof uri, "http://127.0.0.1:%u/", (unsigned int) ntohs(addr.sin_port));
+	setenv("CURL_CONFIG", "/dev/null", 1);
+	setenv("BASE_URI", uri, 1);
+	snprintf(width, sizeof width, "%u", WIDTH);
+	setenv("CURL_PARALLEL", width, 1);
+
+	essaye(session_open());
+
+	uint8_t ident[3][32];
+	memset(ident, 0, sizeof ident);
+	ident[0][0] = 0x01;
+	ident[1][0] = 0x02;
+	ident[2][0] = 0x03;
+
+	/* Upload of known size */
+	FILE *data = tmpfile(), *back = tmpfile();
+	essaye(data && back && produce(fileno(data)) && !lseek(fileno(data), 0, SEEK_SET));
+	essaye(op_deposit(ident[0], fileno(data)) == EXIT_SUCCESS);
+
+	/* Streamed upload of unknown size */
+	int pipefd[2];
+	essaye(!pipe(pipefd));
+
+	pid_t writer = fork();
+	if (!writer) {
+		close(pipefd[0]);
+		_exit(produce(pipefd[1]) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	close(pipefd[1]);
+	essaye(op_deposit(ident[1], pipefd[0]) == EXIT_SUCCESS);
+	close(pipefd[0]);
+	waitpid(writer, (int *) 0, 0);
+
+	essaye(op_retrieve(ident[1], fileno(back), 0, UINT64_MAX) == EXIT_SUCCESS);
+	essaye(matches(fileno(back)));
+	essaye(op_retrieve(ident[2], fileno(back), 0, UINT64_MAX) == 3);
+	essaye(matches(fileno(back)));
+
+	/* Byte ranges */
+	essaye(rewound(fileno(back)) && op_retrieve(ident[1], fileno(back), 1000000, 4099) == EXIT_SUCCESS);
+	essaye(excerpt(fileno(back), 1000000, 4099));
+	essaye(rewound(fileno(back)) && op_retrieve(ident[0], fileno(back), SIZE - 10, UINT64_MAX) == EXIT_SUCCESS);
+	essaye(excerpt(fileno(back), SIZE - 10, 10));
+	essaye(rewound(fileno(back)) && op_retrieve(ident[0], fileno(back), SIZE + 10, 10) == EXIT_SUCCESS);
+	essaye(excerpt(fileno(back), SIZE + 10, 0));
+	essaye(op_retrieve(ident[0], fileno(back), 0, 0) == EXIT_SUCCESS);
+	essaye(op_retrieve(ident[2], fileno(back), 0, 0) == 3);
+
+	/* Description from response headers */
+	essaye(rewound(fileno(back)) && op_inspect(ident[0], fileno(back)) == EXIT_SUCCESS);
+	essaye(described(fileno(back), uri, ident[0]));
+	essaye(op_inspect(ident[2], fileno(back)) == 3);
+
+	/* Sequential requests share one kept‐alive connection */
+	essaye(connections(dir) == 1);
+
+	struct probe probe[PROBES];
+	memset(probe, 0, sizeof probe);
+	memcpy(probe[0].ident, ident[0], 32);
+	memcpy(probe[1].ident, ident[1], 32);
+
+	for (size_t iter = 2; iter < PROBES; ++iter) {
+		probe[iter].ident[0] = 0x80;
+		probe[iter].ident[1] = (uint8_t) iter;
+	}
+
+	essaye(op_assay(probe, PROBES) == 3);
+	essaye(probed(probe));
+	essaye(connections(dir) <= 1 + WIDTH);
+
+	essaye(op_efface(ident[0]) == EXIT_SUCCESS);
+	essaye(op_efface(ident[0]) == EXIT_SUCCESS);
+	essaye(op_assay(probe, 1) == 3);
+	essaye(op_efface(ident[1]) == EXIT_SUCCESS);
+
+	session_close();
+	fclose(data);
+	fclose(back);
+
+	kill(server, SIGTERM);
+	waitpid(server, (int *) 0, 0);
+
+	snprintf(path, sizeof path, "%s/" CONNECTIONS, dir);
+	unlink(path);
+	rmdir(dir);
+
+	return EXIT_SUCCESS;
+}
+#endif /* TEST */
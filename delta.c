@@ -0,0 +1,1107 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "binary.h"
+#include "endian.h"
+#include "expect.h"
+#include "patch.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Default maximum delta chain length.
+ */
+#define CHAIN_DEFAULT 8
+
+/**
+ * \brief Maximum delta chain length.
+ */
+#define CHAIN_MAXIMUM 255
+
+/**
+ * \brief Default size of the largest object that is delta‐encoded.
+ */
+#define LIMIT_DEFAULT (1 << 28)
+
+/**
+ * \brief Default size of the base cache.
+ */
+#define CACHE_DEFAULT (1 << 28)
+
+/**
+ * \brief Number of sketch features a base must share with the object.
+ */
+#define SIMILARITY_MINIMUM 2
+
+/**
+ * \brief Sketch file name.
+ */
+#define SKETCH ".sketch"
+
+/**
+ * \brief Lock file name.
+ */
+#define LOCK ".lock"
+
+/**
+ * \brief Object kinds.
+ */
+enum kind {
+	KIND_FULL  = 0, /**< Object bytes follow the header. */
+	KIND_DELTA = 1  /**< Delta against the base follows the header. */
+};
+
+/**
+ * \brief Object file header.
+ *
+ * All integers are stored in little‐endian byte‐order.
+ */
+struct head {
+	uint8_t  magic[16];   /**< Binary representation magic sequence. */
+	uint8_t  kind;        /**< Object kind. */
+	uint8_t  depth;       /**< Upper bound of the delta chain length. */
+	uint8_t  reserved[6]; /**< Reserved for future use. */
+	uint64_t length;      /**< Object length. */
+	uint8_t  base[32];    /**< Base identifier of deltas. */
+};
+
+/**
+ * \brief Sketch file entry.
+ */
+struct entry {
+	uint8_t  ident[32];               /**< Object identifier. */
+	uint8_t  depth;                   /**< Delta chain length of the object. */
+	uint8_t  reserved[7];             /**< Reserved for future use. */
+	uint64_t feature[PATCH_FEATURES]; /**< Sketch features. */
+};
+
+/**
+ * \brief Opened object.
+ */
+struct object {
+	int      fd;       /**< Object file descriptor. */
+	uint8_t  kind;     /**< Object kind. */
+	uint8_t  depth;    /**< Delta chain length. */
+	uint64_t length;   /**< Object length. */
+	uint64_t stored;   /**< Object file size. */
+	uint8_t  base[32]; /**< Base identifier. */
+};
+
+/**
+ * \brief Opened base.
+ */
+struct base {
+	int      fd;     /**< File descriptor. */
+	uint64_t offset; /**< Offset of the base within its file. */
+	uint64_t length; /**< Base length. */
+	uint8_t  depth;  /**< Delta chain length. */
+};
+
+/**
+ * \brief Object file name.
+ */
+static char name[32 * 2 + 1];
+
+/**
+ * \brief Temporary object file name.
+ */
+static char part[32 * 2 + sizeof ".part.XXXXXX"];
+
+/**
+ * \brief Base cache directory.
+ */
+static char *bases;
+
+/**
+ * \brief Temporary directory.
+ */
+static char *temp;
+
+/**
+ * \brief I/O buffer.
+ */
+static uint8_t buf[STREAM_BUFSIZE];
+
+/**
+ * \brief Make path absolute.
+ *
+ * \param path Path relative to the working directory.
+ * \param suffix Suffix to append.
+ *
+ * \return Absolute path or <tt>(char *) 0</tt> on failure.
+ */
+static char *absolute(const char *restrict path, const char *restrict suffix) {
+	if (*path == '/')
+		return concat(path, suffix, (char *) 0);
+
+	char cwd[4096];
+	if (unlikely(!getcwd(cwd, sizeof cwd)))
+		return (char *) 0;
+
+	return concat(cwd, "/", path, suffix, (char *) 0);
+}
+
+/**
+ * \brief Lock storage directory.
+ *
+ * Retrievals and deposits share the lock, while effacing an object,
+ * which rewrites the objects depending on it, holds it exclusively.  The
+ * lock is held until the process exits.
+ *
+ * \param type Lock type.
+ * \param create Create lock file if necessary.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool lock(short type, bool create) {
+	int fd = create ? open(LOCK, O_RDWR | O_CREAT, 0644) : open(LOCK, O_RDONLY);
+
+	/* Nothing has been effaced in a store without lock file yet */
+	if (fd < 0)
+		return !create && errno == ENOENT;
+
+	struct flock region = {
+		.l_type   = type,
+		.l_whence = SEEK_SET,
+		.l_start  = 0,
+		.l_len    = 0
+	};
+
+	while (unlikely(fcntl(fd, F_SETLKW, &region)))
+		if (errno != EINTR) {
+			close(fd);
+			return false;
+		}
+
+	return true;
+}
+
+/**
+ * \brief Open object and read its header.
+ *
+ * \param obj Object to initialise.
+ * \param ident Object identifier.
+ *
+ * \return 0 if successful, 3 if there is no such object or \c EXIT_FAILURE on failure.
+ */
+static int object_open(struct object *restrict obj, const uint8_t ident[restrict 32]) {
+	char file[32 * 2 + 1];
+	inthexs(file, ident, 32);
+
+	obj->fd = open(file, O_RDONLY);
+	if (obj->fd < 0) {
+		if (errno == ENOENT)
+			return 3;
+
+		perror("Unable to open object");
+		return EXIT_FAILURE;
+	}
+
+	struct stat st;
+	struct head head;
+
+	if (unlikely(fstat(obj->fd, &st) ||
+		st.st_size < (off_t) sizeof head ||
+		pread(obj->fd, &head, sizeof head, 0) != sizeof head ||
+		memcmp(head.magic, magic, sizeof magic))) {
+		fputs("Damaged object file!\n", stderr);
+		close(obj->fd);
+		return EXIT_FAILURE;
+	}
+
+	obj->kind   = head.kind;
+	obj->depth  = head.kind == KIND_DELTA ? head.depth : 0;
+	obj->length = le64(head.length);
+	obj->stored = st.st_size;
+	memcpy(obj->base, head.base, sizeof obj->base);
+
+	if (unlikely(head.kind != KIND_FULL && head.kind != KIND_DELTA ||
+		head.kind == KIND_FULL && obj->stored - sizeof head != obj->length ||
+		head.kind == KIND_DELTA && !memcmp(obj->base, ident, sizeof obj->base))) {
+		fputs("Damaged object file!\n", stderr);
+		close(obj->fd);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Evict least recently used bases beyond the cache size.
+ */
+static void evict(void) {
+	unsigned long int limit = setting("DELTA_CACHE", CACHE_DEFAULT);
+
+	DIR *dir = opendir(bases);
+	if (unlikely(!dir))
+		return;
+
+	struct {
+		char   name[32 * 2 + 1];
+		time_t mtime;
+		off_t  size;
+	} *ents = (void *) 0;
+
+	size_t count = 0, size = 0;
+	uint64_t total = 0;
+	uint8_t ident[32];
+	struct dirent *ent;
+
+	while ((ent = readdir(dir))) {
+		struct stat st;
+		char *path;
+
+		if (strlen(ent->d_name) != 32 * 2 || !hexsint(ident, ent->d_name, sizeof ident) ||
+			!(path = concat(bases, "/", ent->d_name, (char *) 0)))
+			continue;
+
+		bool found = !stat(path, &st);
+		free(path);
+
+		if (!found)
+			continue;
+
+		if (count == size) {
+			void *nents = realloc(ents, (size = size ? size * 2 : 64) * sizeof *ents);
+			if (unlikely(!nents))
+				break;
+
+			ents = nents;
+		}
+
+		strcpy(ents[count].name, ent->d_name);
+		ents[count].mtime = st.st_mtime;
+		ents[count].size  = st.st_size;
+
+		total += st.st_size;
+		++count;
+	}
+
+	closedir(dir);
+
+	/* Selection of the oldest entry is quadratic, but the cache holds few large files */
+	while (total > limit && count) {
+		size_t old = 0;
+
+		for (size_t iter = 1; iter < count; ++iter)
+			if (ents[iter].mtime < ents[old].mtime)
+				old = iter;
+
+		char *path = concat(bases, "/", ents[old].name, (char *) 0);
+		if (path) {
+			unlink(path);
+			free(path);
+		}
+
+		total -= ents[old].size;
+		ents[old] = ents[--count];
+	}
+
+	free(ents);
+}
+
+/**
+ * \brief Open base, reconstructing it if it is a delta itself.
+ *
+ * Reconstructed bases are kept in the base cache, so that a chain is
+ * only walked once while its bases are in use.  If the cache is not
+ * writable, the base is reconstructed into an anonymous temporary file.
+ *
+ * \param base Base to initialise.
+ * \param ident Base identifier.
+ * \param guard Maximum remaining chain length.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool base_open(struct base *restrict base, const uint8_t ident[restrict 32], unsigned int guard) {
+	struct object obj;
+
+	int rc = object_open(&obj, ident);
+	if (unlikely(rc != EXIT_SUCCESS)) {
+		if (rc == 3)
+			fputs("Missing delta base!\n", stderr);
+
+		return false;
+	}
+
+	base->depth  = obj.depth;
+	base->length = obj.length;
+
+	if (obj.kind == KIND_FULL) {
+		base->fd     = obj.fd;
+		base->offset = sizeof (struct head);
+		return true;
+	}
+
+	char hex[32 * 2 + 1];
+	inthexs(hex, ident, 32);
+
+	char *path = concat(bases, "/", hex, (char *) 0);
+	if (unlikely(!path)) {
+		perror("Unable to allocate base path");
+		close(obj.fd);
+		return false;
+	}
+
+	struct stat st;
+	base->offset = 0;
+
+	/* Serve from the base cache and mark the entry as recently used */
+	if ((base->fd = open(path, O_RDONLY)) >= 0) {
+		if (likely(!fstat(base->fd, &st) && (uint64_t) st.st_size == obj.length)) {
+			utime(path, (const struct utimbuf *) 0);
+			free(path);
+			close(obj.fd);
+			return true;
+		}
+
+		close(base->fd);
+	}
+
+	struct base parent;
+
+	if (unlikely(!guard)) {
+		fputs("Delta chain too long!\n", stderr);
+		goto failure;
+	}
+
+	if (unlikely(!base_open(&parent, obj.base, guard - 1)))
+		goto failure;
+
+	/* The cache directory usually exists already */
+	mkdir(bases, 0755);
+
+	char *tmp = concat(path, ".XXXXXX", (char *) 0);
+	bool cached = tmp && (base->fd = mkstemp(tmp)) >= 0;
+
+	if (!cached) {
+		free(tmp);
+
+		if ((tmp = concat(temp, "/base-XXXXXX", (char *) 0)) && (base->fd = mkstemp(tmp)) >= 0)
+			unlink(tmp);
+
+		else {
+			perror("Unable to create base file");
+			free(tmp);
+			close(parent.fd);
+			goto failure;
+		}
+	}
+
+	bool result = patch_apply(base->fd, parent.fd, parent.offset, parent.length,
+		obj.fd, sizeof (struct head), obj.stored - sizeof (struct head), 0, obj.length);
+
+	close(parent.fd);
+
+	if (unlikely(!result)) {
+		fputs("Unable to reconstruct delta base!\n", stderr);
+		close(base->fd);
+
+		if (cached)
+			unlink(tmp);
+
+		free(tmp);
+		goto failure;
+	}
+
+	if (cached) {
+		if (rename(tmp, path))
+			unlink(tmp);
+
+		else
+			evict();
+	}
+
+	free(tmp);
+	free(path);
+	close(obj.fd);
+
+	return true;
+
+failure:
+	free(path);
+	close(obj.fd);
+
+	return false;
+}
+
+/**
+ * \brief Retrieve byte range of object.
+ *
+ * Only the bases are reconstructed, the object itself is streamed
+ * straight from its delta.
+ *
+ * \param ident Object identifier.
+ * \param offset Offset of first byte.
+ * \param length Maximum number of bytes.
+ */
+static int op_retrieve(const uint8_t ident[restrict 32], uint64_t offset, uint64_t length) {
+	if (unlikely(!lock(F_RDLCK, false))) {
+		perror("Unable to lock storage directory");
+		return EXIT_FAILURE;
+	}
+
+	struct object obj;
+
+	int rc = object_open(&obj, ident);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	/* Clip range to object */
+	if (offset > obj.length)
+		offset = obj.length;
+
+	if (length > obj.length - offset)
+		length = obj.length - offset;
+
+	if (obj.kind == KIND_FULL) {
+		if (unlikely(!stream_send(1, obj.fd, sizeof (struct head) + offset, length))) {
+			perror("Unable to send object");
+			rc = EXIT_FAILURE;
+		}
+	}
+
+	else {
+		struct base base;
+
+		if (unlikely(!base_open(&base, obj.base, CHAIN_MAXIMUM)))
+			rc = EXIT_FAILURE;
+
+		else {
+			if (unlikely(!patch_apply(1, base.fd, base.offset, base.length,
+				obj.fd, sizeof (struct head), obj.stored - sizeof (struct head), offset, length))) {
+				perror("Unable to apply delta");
+				rc = EXIT_FAILURE;
+			}
+
+			close(base.fd);
+		}
+	}
+
+	close(obj.fd);
+
+	return rc;
+}
+
+/**
+ * \brief Describe object.
+ *
+ * \param ident Object identifier.
+ * \param dir Storage directory.
+ */
+static int op_inspect(const uint8_t ident[restrict 32], const char *restrict dir) {
+	struct object obj;
+	struct stat st;
+
+	int rc = object_open(&obj, ident);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	if (unlikely(fstat(obj.fd, &st))) {
+		perror("Unable to inspect object");
+		close(obj.fd);
+		return EXIT_FAILURE;
+	}
+
+	close(obj.fd);
+
+	printf("%" PRIu64 " %" PRIu64 " %" PRIu64 " %s/%s\n", obj.length, (uint64_t) st.st_size,
+		(uint64_t) st.st_mtime * UINT64_C(1000000000), dir, name);
+
+	if (unlikely(fflush(stdout))) {
+		perror("Unable to write description");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Find most similar base in sketch file.
+ *
+ * \param base Buffer to hold the base identifier.
+ * \param ident Object identifier, which is never its own base.
+ * \param feature Sketch features of the object.
+ * \param chain Maximum delta chain length.
+ *
+ * \return \c true if a base was found or \c false otherwise.
+ */
+static bool sketch_find(uint8_t base[restrict 32], const uint8_t ident[restrict 32], const uint64_t feature[restrict PATCH_FEATURES], unsigned int chain) {
+	int fd = open(SKETCH, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct entry *ents = (struct entry *) buf;
+	unsigned int best = 0;
+	ssize_t fill;
+
+	while ((fill = stream_read(fd, buf, sizeof buf / sizeof *ents * sizeof *ents)) > 0)
+		for (size_t iter = 0; iter < (size_t) fill / sizeof *ents; ++iter) {
+			if (ents[iter].depth >= chain || !memcmp(ents[iter].ident, ident, 32))
+				continue;
+
+			uint64_t cand[PATCH_FEATURES];
+			for (unsigned int feat = 0; feat < PATCH_FEATURES; ++feat)
+				cand[feat] = le64(ents[iter].feature[feat]);
+
+			unsigned int score = patch_similarity(feature, cand);
+
+			/* Later entries win ties, as revisions tend to follow their predecessor */
+			if (score >= best && score >= SIMILARITY_MINIMUM) {
+				char file[32 * 2 + 1];
+				inthexs(file, ents[iter].ident, 32);
+
+				/* Objects effaced since are still listed until the next efface */
+				if (!access(file, F_OK)) {
+					memcpy(base, ents[iter].ident, 32);
+					best = score;
+				}
+			}
+		}
+
+	close(fd);
+
+	return best >= SIMILARITY_MINIMUM;
+}
+
+/**
+ * \brief Append object to sketch file.
+ *
+ * Entries are small enough to be appended atomically.
+ *
+ * \param ident Object identifier.
+ * \param depth Delta chain length.
+ * \param feature Sketch features.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool sketch_append(const uint8_t ident[restrict 32], uint8_t depth, const uint64_t feature[restrict PATCH_FEATURES]) {
+	struct entry ent;
+
+	memset(&ent, 0, sizeof ent);
+	memcpy(ent.ident, ident, sizeof ent.ident);
+	ent.depth = depth;
+
+	for (unsigned int iter = 0; iter < PATCH_FEATURES; ++iter)
+		ent.feature[iter] = le64(feature[iter]);
+
+	int fd = open(SKETCH, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (unlikely(fd < 0))
+		return false;
+
+	bool result = write(fd, &ent, sizeof ent) == sizeof ent;
+
+	return !close(fd) && result;
+}
+
+/**
+ * \brief Encode spooled object as delta against base.
+ *
+ * \param file Object file name.
+ * \param fd File descriptor of the spooled object.
+ * \param length Object length.
+ * \param from Base identifier.
+ * \param depth Buffer to hold the delta chain length.
+ *
+ * \return \c true if the delta was committed or \c false if the object is to be stored in full.
+ */
+static bool encode(const char *restrict file, int fd, uint64_t length, const uint8_t from[restrict 32], uint8_t *restrict depth) {
+	struct base base;
+
+	if (!base_open(&base, from, CHAIN_MAXIMUM))
+		return false;
+
+	if (!base.length || base.length > PATCH_MAXIMUM) {
+		close(base.fd);
+		return false;
+	}
+
+	/* Mappings start on a page boundary, which the header offsets are not */
+	void *bmap = mmap((void *) 0, base.offset + base.length, PROT_READ, MAP_SHARED, base.fd, 0);
+	void *tmap = mmap((void *) 0, sizeof (struct head) + length, PROT_READ, MAP_SHARED, fd, 0);
+
+	close(base.fd);
+
+	char delta[32 * 2 + sizeof ".delta.XXXXXX"];
+	strcpy(delta, file);
+	strcat(delta, ".delta.XXXXXX");
+
+	int dfd = -1;
+	bool result = false;
+
+	if (unlikely(bmap == MAP_FAILED || tmap == MAP_FAILED)) {
+		perror("Unable to map objects");
+		goto done;
+	}
+
+	if (unlikely((dfd = mkstemp(delta)) < 0 || fchmod(dfd, 0644))) {
+		perror("Unable to create delta file");
+		goto done;
+	}
+
+	struct head head;
+	memset(&head, 0, sizeof head);
+
+	memcpy(head.magic, magic, sizeof magic);
+	head.kind   = KIND_DELTA;
+	head.depth  = base.depth + 1;
+	head.length = le64(length);
+	memcpy(head.base, from, sizeof head.base);
+
+	uint64_t size;
+
+	if (unlikely(!stream_write(dfd, &head, sizeof head) ||
+		!patch_encode(dfd, (const uint8_t *) bmap + base.offset, base.length,
+			(const uint8_t *) tmap + sizeof head, length, &size))) {
+		perror("Unable to encode delta");
+		goto done;
+	}
+
+	/* A delta has to halve the object to be worth its reconstruction */
+	if (size > length / 2)
+		goto done;
+
+	if (unlikely(fdatasync(dfd) || close(dfd) || (dfd = -1, rename(delta, file)))) {
+		perror("Unable to commit delta file");
+		goto done;
+	}
+
+	*depth = head.depth;
+	result = true;
+
+done:
+	if (dfd >= 0)
+		close(dfd);
+
+	if (!result)
+		unlink(delta);
+
+	if (bmap != MAP_FAILED)
+		munmap(bmap, base.offset + base.length);
+
+	if (tmap != MAP_FAILED)
+		munmap(tmap, sizeof (struct head) + length);
+
+	return result;
+}
+
+/**
+ * \brief Deposit object.
+ *
+ * The object is spooled in full while its sketch is computed.  It is
+ * then encoded against the base named in \c DELTA_BASE or, failing that,
+ * against the most similar object whose chain is short enough, and the
+ * delta replaces the full object if it pays off.
+ *
+ * \param ident Object identifier.
+ */
+static int op_deposit(const uint8_t ident[restrict 32]) {
+	unsigned long int chain = setting("DELTA_CHAIN", CHAIN_DEFAULT);
+	if (unlikely(chain > CHAIN_MAXIMUM)) {
+		fprintf(stderr, "Invalid delta chain length %lu!\n", chain);
+		return EXIT_FAILURE;
+	}
+
+	unsigned long int limit = setting("DELTA_LIMIT", LIMIT_DEFAULT);
+	if (limit > PATCH_MAXIMUM)
+		limit = PATCH_MAXIMUM;
+
+	uint8_t from[32];
+	const char *chosen = getenv("DELTA_BASE");
+
+	if (unlikely(chosen && *chosen && !hexsint(from, chosen, sizeof from))) {
+		fprintf(stderr, "Invalid delta base “%s”!\n", chosen);
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(!lock(F_RDLCK, true))) {
+		perror("Unable to lock storage directory");
+		return EXIT_FAILURE;
+	}
+
+	/* Identical content is already stored, and replacing it might close a chain into a cycle */
+	if (!access(name, F_OK)) {
+		while (stream_read(0, buf, sizeof buf) > 0);
+		return EXIT_SUCCESS;
+	}
+
+	/* Concurrent deposits of an object must not share a file */
+	int fd = mkstemp(part);
+	if (unlikely(fd < 0 || fchmod(fd, 0644))) {
+		perror("Unable to create object file");
+
+		if (fd >= 0) {
+			close(fd);
+			unlink(part);
+		}
+
+		return EXIT_FAILURE;
+	}
+
+	struct head head;
+	memset(&head, 0, sizeof head);
+
+	if (unlikely(!stream_write(fd, &head, sizeof head))) {
+		perror("Write error");
+		goto failure;
+	}
+
+	struct patch_sketch sketch;
+	patch_sketch_init(&sketch);
+
+	uint64_t length = 0;
+
+	for (;;) {
+		ssize_t fill = stream_read(0, buf, sizeof buf);
+		if (unlikely(fill < 0)) {
+			perror("Read error");
+			goto failure;
+		}
+
+		if (!fill)
+			break;
+
+		patch_sketch_update(&sketch, buf, fill);
+
+		if (unlikely(!stream_write(fd, buf, fill))) {
+			perror("Write error");
+			goto failure;
+		}
+
+		length += fill;
+	}
+
+	/* Close standard input */
+	close(0);
+
+	memcpy(head.magic, magic, sizeof magic);
+	head.kind   = KIND_FULL;
+	head.length = le64(length);
+
+	if (unlikely(pwrite(fd, &head, sizeof head, 0) != sizeof head)) {
+		perror("Write error");
+		goto failure;
+	}
+
+	uint8_t depth = 0;
+	bool based = length && length <= limit && chain && (chosen && *chosen ?
+		memcmp(from, ident, sizeof from) != 0 :
+		sketch_find(from, ident, sketch.feature, chain));
+
+	/* A chosen base must leave room in the chain as well */
+	if (based && chosen && *chosen) {
+		struct object obj;
+
+		if (object_open(&obj, from) != EXIT_SUCCESS) {
+			fputs("Unable to open chosen delta base!\n", stderr);
+			goto failure;
+		}
+
+		based = obj.depth < chain;
+		close(obj.fd);
+	}
+
+	if (!based || !encode(name, fd, length, from, &depth)) {
+		if (unlikely(fdatasync(fd) || close(fd) || rename(part, name))) {
+			perror("Unable to commit object file");
+			unlink(part);
+			return EXIT_FAILURE;
+		}
+	}
+
+	else {
+		close(fd);
+		unlink(part);
+	}
+
+	/* The sketch only serves to find bases, so failing to record it is not fatal */
+	if (length <= limit && unlikely(!sketch_append(ident, depth, sketch.feature)))
+		perror("Unable to record sketch");
+
+	return EXIT_SUCCESS;
+
+failure:
+	close(fd);
+	unlink(part);
+
+	return EXIT_FAILURE;
+}
+
+/**
+ * \brief Rewrite object without its base.
+ *
+ * \param file Object file name.
+ * \param obj Object, which is a delta against \a base.
+ * \param base Base.
+ * \param from Identifier of the base of \a base or <tt>(const uint8_t *) 0</tt> if it is stored in full.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool rewrite(const char *restrict file, const struct object *restrict obj, const struct base *restrict base, const uint8_t *restrict from) {
+	char *tmp = concat(file, ".part.XXXXXX", (char *) 0);
+	if (unlikely(!tmp))
+		return false;
+
+	int fd = mkstemp(tmp);
+	if (unlikely(fd < 0 || fchmod(fd, 0644))) {
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmp);
+		}
+
+		free(tmp);
+		return false;
+	}
+
+	struct head head;
+	memset(&head, 0, sizeof head);
+
+	memcpy(head.magic, magic, sizeof magic);
+	head.kind   = KIND_FULL;
+	head.length = le64(obj->length);
+
+	bool result = stream_write(fd, &head, sizeof head) &&
+		patch_apply(fd, base->fd, base->offset, base->length,
+			obj->fd, sizeof head, obj->stored - sizeof head, 0, obj->length) &&
+		!fdatasync(fd);
+
+	uint8_t depth;
+
+	/* Move the object up the chain if the delta still pays off, or store it in full */
+	if (result && obj->length && from && encode(file, fd, obj->length, from, &depth)) {
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		return true;
+	}
+
+	result = !close(fd) && result && !rename(tmp, file);
+
+	if (!result)
+		unlink(tmp);
+
+	free(tmp);
+
+	return result;
+}
+
+/**
+ * \brief Efface object.
+ *
+ * Objects encoded against it are first encoded against its own base or
+ * rewritten in full, and it is dropped from the sketch file.  The chain lengths recorded for objects
+ * further down their chains are left as they are, since they are only
+ * used as upper bounds.
+ *
+ * \param ident Object identifier.
+ */
+static int op_efface(const uint8_t ident[restrict 32]) {
+	if (unlikely(!lock(F_WRLCK, true))) {
+		perror("Unable to lock storage directory");
+		return EXIT_FAILURE;
+	}
+
+	struct object self;
+
+	int rc = object_open(&self, ident);
+	if (rc == 3)
+		return EXIT_SUCCESS;
+
+	if (unlikely(rc != EXIT_SUCCESS))
+		return rc;
+
+	close(self.fd);
+
+	DIR *dir = opendir(".");
+	if (unlikely(!dir)) {
+		perror("Unable to open storage directory");
+		return EXIT_FAILURE;
+	}
+
+	struct base base;
+	bool opened = false;
+
+	uint8_t dep[32];
+	struct dirent *ent;
+
+	while (rc == EXIT_SUCCESS && (ent = readdir(dir))) {
+		struct object obj;
+
+		if (strlen(ent->d_name) != 32 * 2 || !hexsint(dep, ent->d_name, sizeof dep) ||
+			!memcmp(dep, ident, sizeof dep) || object_open(&obj, dep) != EXIT_SUCCESS)
+			continue;
+
+		if (obj.kind == KIND_DELTA && !memcmp(obj.base, ident, sizeof obj.base)) {
+			if (!opened && !(opened = base_open(&base, ident, CHAIN_MAXIMUM)))
+				rc = EXIT_FAILURE;
+
+			else if (unlikely(!rewrite(ent->d_name, &obj, &base, self.kind == KIND_DELTA ? self.base : (const uint8_t *) 0))) {
+				fprintf(stderr, "Unable to rewrite dependent object %s!\n", ent->d_name);
+				rc = EXIT_FAILURE;
+			}
+		}
+
+		close(obj.fd);
+	}
+
+	closedir(dir);
+
+	if (opened)
+		close(base.fd);
+
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	if (unlikely(unlink(name) && errno != ENOENT)) {
+		perror("Unable to remove object");
+		return EXIT_FAILURE;
+	}
+
+	int in = open(SKETCH, O_RDONLY);
+	if (in < 0)
+		return EXIT_SUCCESS;
+
+	int out = open(SKETCH ".part", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (unlikely(out < 0)) {
+		perror("Unable to rewrite sketch file");
+		close(in);
+		return EXIT_FAILURE;
+	}
+
+	struct entry *ents = (struct entry *) buf;
+	bool result = true;
+	ssize_t fill;
+
+	while (result && (fill = stream_read(in, buf, sizeof buf / sizeof *ents * sizeof *ents)) > 0) {
+		size_t keep = 0;
+
+		for (size_t iter = 0; iter < (size_t) fill / sizeof *ents; ++iter)
+			if (memcmp(ents[iter].ident, ident, 32))
+				ents[keep++] = ents[iter];
+
+		result = stream_write(out, ents, keep * sizeof *ents);
+	}
+
+	close(in);
+
+	if (unlikely(fill < 0 || !result || close(out) || rename(SKETCH ".part", SKETCH))) {
+		perror("Unable to rewrite sketch file");
+		unlink(SKETCH ".part");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief List identifiers of all objects.
+ */
+static int op_list(void) {
+	DIR *dir = opendir(".");
+	if (unlikely(!dir)) {
+		perror("Unable to open storage directory");
+		return EXIT_FAILURE;
+	}
+
+	uint8_t ident[32];
+	struct dirent *ent;
+
+	/* Objects are named by their identifier, anything else is skipped */
+	while ((ent = readdir(dir)))
+		if (strlen(ent->d_name) == 32 * 2 && hexsint(ident, ent->d_name, sizeof ident))
+			puts(ent->d_name);
+
+	closedir(dir);
+
+	if (unlikely(fflush(stdout) || ferror(stdout))) {
+		perror("Unable to write identifiers");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector.
+ *
+ * \return EXIT_SUCCESS if successful or any other value on failure.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc != 6 && argc != 8)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	/* Resolve the cache and temporary directories before leaving the working directory */
+	if (unlikely(!(bases = absolute(argv[2], "/bases")) || !(temp = absolute(argv[3], "")))) {
+		perror("Unable to resolve cache directory");
+		return EXIT_FAILURE;
+	}
+
+	/* Change to storage directory */
+	if (unlikely(chdir(argv[1]))) {
+		perror("Unable to change to storage directory");
+		return EXIT_FAILURE;
+	}
+
+	/* Listing does not refer to an object */
+	if (!strcmp(argv[5], "list"))
+		return op_list();
+
+	uint8_t ident[32];
+	if (!hexsint(ident, argv[4], sizeof ident)) {
+		perror("Failed to parse identifier");
+		return EXIT_FAILURE;
+	}
+
+	inthexs(name, ident, sizeof ident);
+	strcpy(part, name);
+	strcat(part, ".part.XXXXXX");
+
+	/* Parse operation string */
+	if (!strcmp(argv[5], "assay"))
+		return access(name, F_OK) ? 3 : EXIT_SUCCESS;
+
+	else if (!strcmp(argv[5], "retrieve"))
+		return op_retrieve(ident, 0, UINT64_MAX);
+
+	else if (!strcmp(argv[5], "range")) {
+		uint64_t offset, length;
+
+		if (unlikely(argc != 8 || !decsint(&offset, argv[6]) || !decsint(&length, argv[7]))) {
+			fputs("Invalid byte range!\n", stderr);
+			return EXIT_FAILURE;
+		}
+
+		return op_retrieve(ident, offset, length);
+	}
+
+	else if (!strcmp(argv[5], "inspect"))
+		return op_inspect(ident, argv[1]);
+
+	else if (!strcmp(argv[5], "deposit"))
+		return op_deposit(ident);
+
+	else if (!strcmp(argv[5], "efface"))
+		return op_efface(ident);
+
+	else {
+		fprintf(stderr, "Invalid storage operation “%s”!\n", argv[5]);
+		return 2;
+	}
+}
@@ -8,6 +8,12 @@ then
 	exit 1
 fi
 
+# Record metrics of storage operations
+tally="/usr/libexec/opencorpus/tally"
+
+# Spread global storage over the store roots in its routing table
+route="/usr/libexec/opencorpus/route"
+
 # Find storage module
 if [ -n "$HOME" -a -x "$HOME/.opencorpus/storage/$1" ]
 then
@@ -44,8 +50,9 @@ fi
 
 mkdir -p "$temp"
 
-# Clean temp directory upon exit
+# Clean temp directory upon exit, also when an abandoned transfer is killed
 trap 'rm -f -r -- "$temp"' EXIT
+trap 'exit 1' HUP INT TERM
 
 # Launch storage module
 if [ -z "$NO_SANDBOX" ]
@@ -59,19 +66,19 @@ then
 	if [ -d "/var/db/opencorpus" -a -w "/var/db/opencorpus" ]
 	then
 		mkdir -p "/var/db/opencorpus/$1"
-		sydbox -C -L -B "$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2" "deposit"
+		"$tally" "$1" "deposit" sydbox -C -L -B "$route" "$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2" "deposit"
 	else
 		mkdir -p "$HOME/.opencorpus/corpus/$1"
-		sydbox -C -L -B "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "deposit"
+		"$tally" "$1" "deposit" sydbox -C -L -B "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "deposit"
 	fi
 else
 	# Try global storage
 	if [ -d "/var/db/opencorpus" -a -w "/var/db/opencorpus" ]
 	then
 		mkdir -p "/var/db/opencorpus/$1"
-		"$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2" "deposit"
+		"$tally" "$1" "deposit" "$route" "$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2" "deposit"
 	else
 		mkdir -p "$HOME/.opencorpus/corpus/$1"
-		"$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "deposit"
+		"$tally" "$1" "deposit" "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "deposit"
 	fi
 fi
@@ -8,6 +8,12 @@ then
 	exit 1
 fi
 
+# Record metrics of storage operations
+tally="/usr/libexec/opencorpus/tally"
+
+# Spread global storage over the store roots in its routing table
+route="/usr/libexec/opencorpus/route"
+
 # Find storage module
 if [ -n "$HOME" -a -x "$HOME/.opencorpus/storage/$1" ]
 then
@@ -58,16 +64,25 @@ then
 	# Try global storage first
 	if [ -d "/var/db/opencorpus/$1" -a -w "/var/db/opencorpus/$1" ]
 	then
-		sydbox -C -L -B "$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2" "efface"
+		"$tally" "$1" "efface" sydbox -C -L -B "$route" "$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2" "efface"
 	else
-		sydbox -C -L -B "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "efface"
+		"$tally" "$1" "efface" sydbox -C -L -B "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "efface"
 	fi
 else
 	# Try global storage
 	if [ -d "/var/db/opencorpus/$1" -a -w "/var/db/opencorpus/$1" ]
 	then
-		"$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2" "efface"
+		"$tally" "$1" "efface" "$route" "$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2" "efface"
 	else
-		"$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "efface"
+		"$tally" "$1" "efface" "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "efface"
 	fi
 fi
+
+# Drop object from cache
+if [ -d "$cache/objects" ]
+then
+	"/usr/libexec/opencorpus/cache" "$cache/objects" "$2" "evict"
+fi
+
+# Drop object from the object server, which need not be running
+"/usr/libexec/opencorpus/serve" "forget" "$1" "$2" || echo "Unable to drop object from the object server!" >&2
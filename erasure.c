@@ -0,0 +1,529 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "erasure.h"
+#include "expect.h"
+
+/* Vector kernels are compiled for their own targets and chosen at run time */
+#if (defined(__clang__) || defined(__GNUC__)) && (defined(__x86_64__) || defined(__i386__))
+# include <immintrin.h>
+# define ERASURE_X86
+#endif
+
+/**
+ * \brief Reduction polynomial of GF(2⁸), x⁸ + x⁴ + x³ + x² + 1.
+ */
+#define POLYNOMIAL 0x11d
+
+const char *const erasure_kernels[ERASURE_KERNELS] = {
+	[ERASURE_PORTABLE] = "portable",
+	[ERASURE_SSSE3]    = "ssse3",
+	[ERASURE_AVX2]     = "avx2"
+};
+
+/**
+ * \brief Products of all pairs of field elements.
+ */
+static uint8_t product[256][256];
+
+/**
+ * \brief Multiplicative inverses of field elements, zero for zero.
+ */
+static uint8_t inverse[256];
+
+/**
+ * \brief Fill field tables in.
+ */
+static void tables(void) {
+	static bool ready;
+	uint8_t exp[255];
+	unsigned int log[256], value = 1;
+
+	if (ready)
+		return;
+
+	/* Powers of the generator x */
+	for (unsigned int power = 0; power < 255; ++power) {
+		exp[power] = value;
+		log[value] = power;
+
+		if ((value <<= 1) & 0x100)
+			value ^= POLYNOMIAL;
+	}
+
+	for (unsigned int one = 1; one < 256; ++one) {
+		for (unsigned int other = 1; other < 256; ++other)
+			product[one][other] = exp[(log[one] + log[other]) % 255];
+
+		inverse[one] = exp[(255 - log[one]) % 255];
+	}
+
+	ready = true;
+}
+
+/**
+ * \brief Add product of factor and source to destination, with table lookups.
+ *
+ * \param dst Destination.
+ * \param src Source.
+ * \param factor Factor.
+ * \param len Length.
+ */
+static void muladd_portable(uint8_t *restrict dst, const uint8_t *restrict src, uint8_t factor, size_t len) {
+	const uint8_t *row = product[factor];
+
+	for (size_t iter = 0; iter < len; ++iter)
+		dst[iter] ^= row[src[iter]];
+}
+
+#ifdef ERASURE_X86
+/**
+ * \brief Add product of factor and source to destination, with 128‐bit shuffles.
+ *
+ * The products of the factor and both nibbles of each byte are looked up
+ * in sixteen‐entry tables, sixteen bytes at a time.
+ *
+ * \param dst Destination.
+ * \param src Source.
+ * \param factor Factor.
+ * \param len Length.
+ */
+__attribute__((target("ssse3")))
+static void muladd_ssse3(uint8_t *restrict dst, const uint8_t *restrict src, uint8_t factor, size_t len) {
+	uint8_t low[16], high[16];
+
+	for (unsigned int nibble = 0; nibble < 16; ++nibble) {
+		low[nibble]  = product[factor][nibble];
+		high[nibble] = product[factor][nibble << 4];
+	}
+
+	__m128i lows  = _mm_loadu_si128((const __m128i *) low);
+	__m128i highs = _mm_loadu_si128((const __m128i *) high);
+	__m128i mask  = _mm_set1_epi8(0x0f);
+	size_t iter = 0;
+
+	for (; iter + 16 <= len; iter += 16) {
+		__m128i in = _mm_loadu_si128((const __m128i *) &src[iter]);
+		__m128i lo = _mm_shuffle_epi8(lows, _mm_and_si128(in, mask));
+		__m128i hi = _mm_shuffle_epi8(highs, _mm_and_si128(_mm_srli_epi64(in, 4), mask));
+		__m128i out = _mm_loadu_si128((const __m128i *) &dst[iter]);
+
+		_mm_storeu_si128((__m128i *) &dst[iter], _mm_xor_si128(out, _mm_xor_si128(lo, hi)));
+	}
+
+	muladd_portable(&dst[iter], &src[iter], factor, len - iter);
+}
+
+/**
+ * \brief Add product of factor and source to destination, with 256‐bit shuffles.
+ *
+ * \param dst Destination.
+ * \param src Source.
+ * \param factor Factor.
+ * \param len Length.
+ */
+__attribute__((target("avx2")))
+static void muladd_avx2(uint8_t *restrict dst, const uint8_t *restrict src, uint8_t factor, size_t len) {
+	uint8_t low[16], high[16];
+
+	for (unsigned int nibble = 0; nibble < 16; ++nibble) {
+		low[nibble]  = product[factor][nibble];
+		high[nibble] = product[factor][nibble << 4];
+	}
+
+	/* Shuffles stay within 128‐bit lanes, so both lanes get the tables */
+	__m256i lows  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) low));
+	__m256i highs = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) high));
+	__m256i mask  = _mm256_set1_epi8(0x0f);
+	size_t iter = 0;
+
+	for (; iter + 32 <= len; iter += 32) {
+		__m256i in = _mm256_loadu_si256((const __m256i *) &src[iter]);
+		__m256i lo = _mm256_shuffle_epi8(lows, _mm256_and_si256(in, mask));
+		__m256i hi = _mm256_shuffle_epi8(highs, _mm256_and_si256(_mm256_srli_epi64(in, 4), mask));
+		__m256i out = _mm256_loadu_si256((const __m256i *) &dst[iter]);
+
+		_mm256_storeu_si256((__m256i *) &dst[iter], _mm256_xor_si256(out, _mm256_xor_si256(lo, hi)));
+	}
+
+	muladd_portable(&dst[iter], &src[iter], factor, len - iter);
+}
+#endif /* ERASURE_X86 */
+
+/**
+ * \brief Check whether processor supports kernel.
+ *
+ * \param kernel Kernel.
+ *
+ * \return \c true if supported or \c false otherwise.
+ */
+static bool supported(enum erasure_kernel kernel) {
+	switch (kernel) {
+	case ERASURE_PORTABLE:
+		return true;
+
+#ifdef ERASURE_X86
+	case ERASURE_SSSE3:
+		return __builtin_cpu_supports("ssse3");
+
+	case ERASURE_AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+
+	default:
+		return false;
+	}
+}
+
+/**
+ * \brief Add product of factor and source to destination.
+ *
+ * \param kernel Kernel.
+ * \param dst Destination.
+ * \param src Source.
+ * \param factor Factor.
+ * \param len Length.
+ */
+static void muladd(enum erasure_kernel kernel, uint8_t *restrict dst, const uint8_t *restrict src, uint8_t factor, size_t len) {
+	if (!factor)
+		return;
+
+	switch (kernel) {
+#ifdef ERASURE_X86
+	case ERASURE_AVX2:
+		muladd_avx2(dst, src, factor, len);
+		break;
+
+	case ERASURE_SSSE3:
+		muladd_ssse3(dst, src, factor, len);
+		break;
+#endif
+
+	default:
+		muladd_portable(dst, src, factor, len);
+	}
+}
+
+bool erasure_open(struct erasure *restrict code, unsigned int data, unsigned int parity, enum erasure_kernel kernel) {
+	if (unlikely(!data || data + parity > ERASURE_SHARDS_MAXIMUM))
+		return false;
+
+	tables();
+
+	if (kernel >= ERASURE_KERNELS)
+		kernel = ERASURE_KERNELS - 1;
+
+	while (!supported(kernel))
+		--kernel;
+
+	code->kernel = kernel;
+	code->data   = data;
+	code->parity = parity;
+
+	/* Every square submatrix of a Cauchy matrix is invertible */
+	for (unsigned int row = 0; row < parity; ++row)
+		for (unsigned int col = 0; col < data; ++col)
+			code->matrix[row][col] = inverse[(data + row) ^ col];
+
+	return true;
+}
+
+void erasure_encode(const struct erasure *restrict code, uint8_t *const shard[], size_t len) {
+	for (unsigned int row = 0; row < code->parity; ++row) {
+		uint8_t *out = shard[code->data + row];
+		memset(out, 0, len);
+
+		for (unsigned int col = 0; col < code->data; ++col)
+			muladd(code->kernel, out, shard[col], code->matrix[row][col], len);
+	}
+}
+
+bool erasure_decode(const struct erasure *restrict code, uint8_t *const shard[], const bool present[], size_t len) {
+	unsigned int data = code->data, source[ERASURE_SHARDS_MAXIMUM], found = 0;
+	bool whole = true;
+
+	for (unsigned int iter = 0; iter < data + code->parity && found < data; ++iter)
+		if (present[iter])
+			source[found++] = iter;
+		else if (iter < data)
+			whole = false;
+
+	if (whole)
+		return true;
+
+	if (unlikely(found < data))
+		return false;
+
+	/* Rows of the code matrix for the sources, next to the identity */
+	uint8_t matrix[ERASURE_SHARDS_MAXIMUM][2 * ERASURE_SHARDS_MAXIMUM];
+
+	for (unsigned int row = 0; row < data; ++row)
+		for (unsigned int col = 0; col < data; ++col) {
+			matrix[row][col]        = source[row] < data ? source[row] == col : code->matrix[source[row] - data][col];
+			matrix[row][data + col] = row == col;
+		}
+
+	/* Gauss–Jordan elimination leaves the inverse on the right */
+	for (unsigned int col = 0; col < data; ++col) {
+		unsigned int pivot = col;
+
+		while (!matrix[pivot][col])
+			++pivot;
+
+		if (pivot != col)
+			for (unsigned int iter = 0; iter < 2 * data; ++iter) {
+				uint8_t swap = matrix[col][iter];
+				matrix[col][iter] = matrix[pivot][iter];
+				matrix[pivot][iter] = swap;
+			}
+
+		uint8_t scale = inverse[matrix[col][col]];
+
+		for (unsigned int iter = 0; iter < 2 * data; ++iter)
+			matrix[col][iter] = product[scale][matrix[col][iter]];
+
+		for (unsigned int row = 0; row < data; ++row) {
+			uint8_t factor = matrix[row][col];
+
+			if (row == col || !factor)
+				continue;
+
+			for (unsigned int iter = 0; iter < 2 * data; ++iter)
+				matrix[row][iter] ^= product[factor][matrix[col][iter]];
+		}
+	}
+
+	for (unsigned int row = 0; row < data; ++row) {
+		if (present[row])
+			continue;
+
+		memset(shard[row], 0, len);
+
+		for (unsigned int col = 0; col < data; ++col)
+			muladd(code->kernel, shard[row], shard[source[col]], matrix[row][data + col], len);
+	}
+
+	return true;
+}
+
+#if defined(TEST) || defined(BENCH)
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * \brief Fill buffer with pseudo‐random bytes.
+ *
+ * \param buf Buffer.
+ * \param len Length.
+ * \param seed Seed.
+ */
+static void scramble(uint8_t *restrict buf, size_t len, uint64_t seed) {
+	for (size_t iter = 0; iter < len; ++iter) {
+		/* xorshift64* */
+		seed ^= seed >> 12;
+		seed ^= seed << 25;
+		seed ^= seed >> 27;
+		buf[iter] = (seed * UINT64_C(0x2545f4914f6cdd1d)) >> 56;
+	}
+}
+#endif
+
+#ifdef TEST
+#include "essai.h"
+
+/**
+ * \brief Check kernel against table lookups.
+ *
+ * \param kernel Kernel.
+ */
+static bool agrees(enum erasure_kernel kernel) {
+	uint8_t src[1000], want[1000], got[1000];
+
+	scramble(src, sizeof src, 1);
+	scramble(want, sizeof want, 2);
+	memcpy(got, want, sizeof got);
+
+	/* Odd lengths run through the tails as well */
+	for (unsigned int factor = 0; factor < 256; ++factor) {
+		muladd_portable(want, src, factor, sizeof src - factor % 7);
+		muladd(kernel, got, src, factor, sizeof src - factor % 7);
+	}
+
+	return !memcmp(want, got, sizeof got);
+}
+
+/**
+ * \brief Recover data after every combination of lost shards.
+ *
+ * \param kernel Preferred kernel.
+ * \param data Number of data shards.
+ * \param parity Number of parity shards.
+ * \param len Shard length.
+ */
+static bool survives(enum erasure_kernel kernel, unsigned int data, unsigned int parity, size_t len) {
+	struct erasure code;
+	if (!erasure_open(&code, data, parity, kernel))
+		return false;
+
+	unsigned int total = data + parity;
+	uint8_t *orig = malloc(total * len), *work = malloc(total * len);
+	uint8_t *shard[ERASURE_SHARDS_MAXIMUM];
+	bool present[ERASURE_SHARDS_MAXIMUM], result = orig && work;
+
+	for (unsigned int iter = 0; result && iter < total; ++iter)
+		shard[iter] = &orig[iter * len];
+
+	if (result) {
+		scramble(orig, data * len, data * 100 + parity);
+		erasure_encode(&code, shard, len);
+	}
+
+	for (unsigned int iter = 0; result && iter < total; ++iter)
+		shard[iter] = &work[iter * len];
+
+	/* Every subset of shards, of which at least data ones must do */
+	for (uint64_t lost = 0; result && lost < UINT64_C(1) << total; ++lost) {
+		unsigned int missing = 0;
+
+		for (unsigned int iter = 0; iter < total; ++iter)
+			if (!(present[iter] = !(lost >> iter & 1)))
+				++missing;
+
+		memcpy(work, orig, total * len);
+
+		for (unsigned int iter = 0; iter < total; ++iter)
+			if (!present[iter])
+				memset(shard[iter], 0xa5, len);
+
+		bool decoded = erasure_decode(&code, shard, present, len);
+		result = missing > parity ? !decoded : decoded && !memcmp(work, orig, data * len);
+	}
+
+	free(orig);
+	free(work);
+
+	return result;
+}
+
+int main(void) {
+	struct erasure code;
+
+	essaye(erasure_open(&code, 1, 0, ERASURE_AVX2));
+	printf("Kernel: %s\n", erasure_kernels[code.kernel]);
+
+	essaye(!erasure_open(&code, 0, 4, ERASURE_PORTABLE));
+	essaye(!erasure_open(&code, 60, 5, ERASURE_PORTABLE));
+
+	/* Products match schoolbook multiplication modulo the polynomial */
+	unsigned int wrong = 0;
+	for (unsigned int one = 0; one < 256; ++one)
+		for (unsigned int other = 0; other < 256; ++other) {
+			unsigned int want = 0;
+
+			for (unsigned int bit = 0; bit < 8; ++bit)
+				if (other >> bit & 1)
+					want ^= one << bit;
+
+			for (unsigned int bit = 15; bit >= 8; --bit)
+				if (want >> bit & 1)
+					want ^= POLYNOMIAL << (bit - 8);
+
+			wrong += product[one][other] != want;
+		}
+
+	essaye(!wrong);
+
+	for (enum erasure_kernel kernel = 0; kernel < ERASURE_KERNELS; ++kernel)
+		if (supported(kernel)) {
+			printf("Checking kernel %s\n", erasure_kernels[kernel]);
+			essaye(agrees(kernel));
+			essaye(survives(kernel, 4, 2, 333));
+			essaye(survives(kernel, 10, 4, 100));
+			essaye(survives(kernel, 1, 3, 64));
+		}
+
+	return EXIT_SUCCESS;
+}
+#endif /* TEST */
+
+#ifdef BENCH
+#include <time.h>
+
+#include "string.h"
+
+/**
+ * \brief Get monotonic time.
+ *
+ * \return Seconds since an arbitrary point.
+ */
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * \brief Benchmark routine.
+ *
+ * Encodes \c ERASURE_ROUNDS stripes of \c ERASURE_DATA shards of
+ * \c ERASURE_BLOCK bytes into \c ERASURE_PARITY parity shards, then
+ * decodes them with as many data shards lost as there are parity shards,
+ * with every kernel the processor supports.  Throughput counts data
+ * bytes.
+ */
+int main(void) {
+	unsigned int data   = setting("ERASURE_DATA", 10);
+	unsigned int parity = setting("ERASURE_PARITY", 4);
+	size_t       block  = setting("ERASURE_BLOCK", 64 * 1024);
+	size_t       rounds = setting("ERASURE_ROUNDS", 2000);
+
+	if (parity > data)
+		parity = data;
+
+	unsigned int total = data + parity;
+	uint8_t *buf = malloc(total * block);
+	uint8_t *shard[ERASURE_SHARDS_MAXIMUM];
+	bool present[ERASURE_SHARDS_MAXIMUM];
+
+	struct erasure code;
+	if (!buf || !erasure_open(&code, data, parity, ERASURE_PORTABLE)) {
+		fputs("Unable to set benchmark up!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	for (unsigned int iter = 0; iter < total; ++iter) {
+		shard[iter] = &buf[iter * block];
+		present[iter] = iter >= parity;
+	}
+
+	scramble(buf, data * block, 1);
+
+	printf("kernel op data parity block seconds GB/s\n");
+
+	for (enum erasure_kernel kernel = 0; kernel < ERASURE_KERNELS; ++kernel) {
+		if (!supported(kernel) || !erasure_open(&code, data, parity, kernel))
+			continue;
+
+		for (int decode = 0; decode < 2; ++decode) {
+			double start = now();
+
+			for (size_t round = 0; round < rounds; ++round)
+				if (decode)
+					erasure_decode(&code, shard, present, block);
+				else
+					erasure_encode(&code, shard, block);
+
+			double elapsed = now() - start;
+
+			printf("%s %s %u %u %zu %.3f %.2f\n", erasure_kernels[kernel], decode ? "decode" : "encode",
+				data, parity, block, elapsed, rounds * (double) data * block / elapsed / 1e9);
+		}
+	}
+
+	free(buf);
+
+	return EXIT_SUCCESS;
+}
+#endif /* BENCH */
@@ -0,0 +1,93 @@
+#pragma once
+#ifndef OC_ERASURE_H
+#define OC_ERASURE_H
+
+/**
+ * \file
+ *
+ * \brief Reed–Solomon erasure coding.
+ *
+ * Data is cut into \a data shards of equal length, to which \a parity
+ * shards are added, such that any \a data shards out of the whole set
+ * are enough to recover the others.  The code is systematic: the data
+ * shards are the data itself, and the parity shards are products of a
+ * Cauchy matrix and the data shards over GF(2⁸), whose multiplication
+ * runs on SSSE3 or AVX2 shuffles where the processor has them.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Maximum number of data and parity shards together.
+ */
+#define ERASURE_SHARDS_MAXIMUM 64
+
+/**
+ * \brief Multiplication kernels, from slowest to fastest.
+ */
+enum erasure_kernel {
+	ERASURE_PORTABLE, /**< Table lookups. */
+	ERASURE_SSSE3,    /**< 128‐bit nibble shuffles. */
+	ERASURE_AVX2,     /**< 256‐bit nibble shuffles. */
+	ERASURE_KERNELS
+};
+
+/**
+ * \brief Code context structure.
+ */
+struct erasure {
+	enum erasure_kernel kernel; /**< Kernel in use. */
+	unsigned int        data;   /**< Number of data shards. */
+	unsigned int        parity; /**< Number of parity shards. */
+
+	/**
+	 * \brief Parity coefficients, by parity shard and data shard.
+	 */
+	uint8_t matrix[ERASURE_SHARDS_MAXIMUM][ERASURE_SHARDS_MAXIMUM];
+};
+
+/**
+ * \brief Kernel names.
+ */
+extern const char *const erasure_kernels[ERASURE_KERNELS];
+
+/**
+ * \brief Set code up.
+ *
+ * \param code Code context.
+ * \param data Number of data shards, at least one.
+ * \param parity Number of parity shards.
+ * \param kernel Preferred kernel, which falls back to the fastest one
+ * the processor supports.
+ *
+ * \return \c true if successful or \c false if there are too many shards.
+ */
+extern bool erasure_open(struct erasure *restrict code, unsigned int data, unsigned int parity, enum erasure_kernel kernel);
+
+/**
+ * \brief Compute parity shards.
+ *
+ * \param code Code context.
+ * \param shard Data shards followed by the parity shards to fill in.
+ * \param len Shard length.
+ */
+extern void erasure_encode(const struct erasure *restrict code, uint8_t *const shard[], size_t len);
+
+/**
+ * \brief Recover missing data shards.
+ *
+ * Only the data shards are recovered, from the first \a data shards that
+ * are present.  The buffers of missing shards are overwritten.
+ *
+ * \param code Code context.
+ * \param shard Data shards followed by parity shards.
+ * \param present Whether each shard is present.
+ * \param len Shard length.
+ *
+ * \return \c true if successful or \c false if too few shards are present.
+ */
+extern bool erasure_decode(const struct erasure *restrict code, uint8_t *const shard[], const bool present[], size_t len);
+
+#endif /* OC_ERASURE_H */
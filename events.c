@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "expect.h"
+#include "journal.h"
+#include "meter.h"
+#include "string.h"
+
+/**
+ * \brief Order records by time.
+ *
+ * \param one One record.
+ * \param other Other record.
+ *
+ * \return Negative, zero or positive number.
+ */
+static int order(const void *one, const void *other) {
+	const struct journal_record *a = one, *b = other;
+
+	if (a->time != b->time)
+		return a->time < b->time ? -1 : 1;
+
+	if (a->pid != b->pid)
+		return a->pid < b->pid ? -1 : 1;
+
+	return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+/**
+ * \brief Write JSON string.
+ *
+ * \param str String.
+ * \param out Output stream.
+ */
+static void quote(const char *restrict str, FILE *restrict out) {
+	putc('"', out);
+
+	for (; *str; ++str)
+		if (*str == '"' || *str == '\\')
+			fprintf(out, "\\%c", *str);
+		else if ((unsigned char) *str < 0x20)
+			fprintf(out, "\\u%04x", (unsigned int) (unsigned char) *str);
+		else
+			putc(*str, out);
+
+	putc('"', out);
+}
+
+/**
+ * \brief Render record.
+ *
+ * \param rec Record.
+ * \param json Render a JSON object instead of a text line.
+ * \param out Output stream.
+ */
+static void render(const struct journal_record *restrict rec, bool json, FILE *restrict out) {
+	static const uint8_t none[32];
+	char stamp[64], idstr[32 * 2 + 1] = "-", module[JOURNAL_NAMELEN + 1];
+	time_t secs = rec->time / UINT64_C(1000000000);
+	struct tm tm;
+
+	size_t len = gmtime_r(&secs, &tm) ? strftime(stamp, sizeof stamp, "%Y-%m-%dT%H:%M:%S", &tm) : 0;
+	snprintf(stamp + len, sizeof stamp - len, len ? ".%09luZ" : "-", (unsigned long int) (rec->time % UINT64_C(1000000000)));
+
+	if (memcmp(rec->ident, none, sizeof none))
+		inthexs(idstr, rec->ident, 32);
+
+	memcpy(module, rec->module, JOURNAL_NAMELEN);
+	module[JOURNAL_NAMELEN] = 0;
+
+	if (!json) {
+		fprintf(out, "%s %" PRIu32 " %s %s %s %" PRId32 " %" PRIu64 " %" PRIu64 "\n",
+			stamp, rec->pid, *module ? module : "-", meter_name(rec->op), idstr, rec->status, rec->duration, rec->bytes);
+		return;
+	}
+
+	fprintf(out, "{\"time\":\"%s\",\"pid\":%" PRIu32 ",\"module\":", stamp, rec->pid);
+	quote(module, out);
+	fprintf(out, ",\"op\":\"%s\",\"ident\":", meter_name(rec->op));
+
+	if (*idstr == '-')
+		fputs("null", out);
+	else
+		fprintf(out, "\"%s\"", idstr);
+
+	fprintf(out, ",\"status\":%" PRId32 ",\"duration\":%" PRIu64 ",\"bytes\":%" PRIu64 "}\n", rec->status, rec->duration, rec->bytes);
+}
+
+/**
+ * \brief Main routine.
+ *
+ * The records of all rings in \c JOURNAL_PATH are merged by time and
+ * written to standard output, either as lines of time, process ID,
+ * module, operation, identifier, exit status, duration in microseconds
+ * and bytes transferred, or as one JSON object per line.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector: optionally “text” or “json”.
+ *
+ * \return EXIT_SUCCESS if successful or EXIT_FAILURE on failure.
+ */
+int main(int argc, char *argv[]) {
+	const char *dir = getenv("JOURNAL_PATH");
+	bool json = false;
+
+	if (!dir || !*dir)
+		dir = JOURNAL_PATH;
+
+	if (unlikely(argc > 2)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	if (argc == 2 && !(json = !strcmp(argv[1], "json")) && unlikely(strcmp(argv[1], "text"))) {
+		fprintf(stderr, "Unsupported format “%s”!\n", argv[1]);
+		return 2;
+	}
+
+	struct journal_record *buf = malloc(JOURNAL_RINGS * JOURNAL_RECORDS * sizeof *buf);
+	if (unlikely(!buf)) {
+		perror("Unable to allocate memory");
+		return EXIT_FAILURE;
+	}
+
+	size_t count = 0;
+
+	for (unsigned int ring = 0; ring < JOURNAL_RINGS; ++ring) {
+		struct journal journal;
+
+		if (!journal_open(&journal, dir, ring, false)) {
+			if (unlikely(errno != ENOENT)) {
+				perror("Unable to open journal ring");
+				return EXIT_FAILURE;
+			}
+
+			continue;
+		}
+
+		count += journal_collect(&journal, buf + count);
+		journal_close(&journal);
+	}
+
+	qsort(buf, count, sizeof *buf, order);
+
+	for (size_t iter = 0; iter < count; ++iter)
+		render(&buf[iter], json, stdout);
+
+	free(buf);
+
+	if (unlikely(fflush(stdout) || ferror(stdout))) {
+		perror("Unable to write events");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -11,14 +11,33 @@ case "$5" in
 		cat "$1/$4"
 	;;
 
+	"range")
+		[ -f "$1/$4" ] || exit 3
+		tail -c "+$(($6 + 1))" "$1/$4" | head -c "$7"
+	;;
+
+	"inspect")
+		[ -f "$1/$4" ] || exit 3
+		echo "`stat -c "%s %s %Y" "$1/$4"`000000000 $1/$4"
+	;;
+
 	"deposit")
-		>"$1/$4"
+		# Store objects whole or not at all, even when cut short
+		trap 'rm -f -- "$1/$4.$$.part"' EXIT
+		trap 'exit 1' HUP INT TERM
+		cat >"$1/$4.$$.part"
+		mv -f -- "$1/$4.$$.part" "$1/$4"
 	;;
 
 	"efface")
 		rm -- "$1/$4"
 	;;
 
+	"list")
+		[ -d "$1" ] || exit 0
+		ls -- "$1" | sed -n '/^[0-9A-Fa-f]\{64\}$/p'
+	;;
+
 	*)
 		echo "Invalid storage operation “$5”!" >&2
 		exit 2
@@ -0,0 +1,248 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "expect.h"
+#include "path.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Outcome of a flight that cannot be shared.
+ */
+#define UNSHARED 255
+
+/**
+ * \brief Landing record, which the leader leaves in the lock file.
+ */
+struct landing {
+	uint8_t outcome;     /**< Exit status shared with the others. */
+	uint8_t reserved[7]; /**< Reserved, set to zero. */
+};
+
+extern char **environ;
+
+/**
+ * \brief Buffer for discarded input.
+ */
+static uint8_t buf[STREAM_BUFSIZE];
+
+/**
+ * \brief Board flight.
+ *
+ * Whoever holds the write lock on the first byte of the lock file leads
+ * the flight.  A leader removes the lock file when landing, so a lock
+ * won on a file that is no longer linked is given up and tried again.
+ *
+ * \param path Lock file name.
+ * \param leader Buffer to hold whether the flight is led.
+ *
+ * \return Lock file descriptor or -1 on failure.
+ */
+static int board(const char *restrict path, bool *restrict leader) {
+	for (;;) {
+		int fd = open(path, O_RDWR | O_CREAT, 0644);
+		if (unlikely(fd < 0))
+			return -1;
+
+		struct flock region = {
+			.l_type   = F_WRLCK,
+			.l_whence = SEEK_SET,
+			.l_start  = 0,
+			.l_len    = 1
+		};
+
+		if (fcntl(fd, F_SETLK, &region)) {
+			if (unlikely(errno != EACCES && errno != EAGAIN)) {
+				close(fd);
+				return -1;
+			}
+
+			*leader = false;
+			return fd;
+		}
+
+		struct stat held, linked;
+		if (!fstat(fd, &held) && !stat(path, &linked) && held.st_dev == linked.st_dev && held.st_ino == linked.st_ino) {
+			*leader = true;
+			return fd;
+		}
+
+		close(fd);
+	}
+}
+
+/**
+ * \brief Wait for flight to land.
+ *
+ * \param fd Lock file descriptor.
+ *
+ * \return Outcome recorded by the leader or \c UNSHARED if there is none.
+ */
+static int land(int fd) {
+	struct flock region = {
+		.l_type   = F_RDLCK,
+		.l_whence = SEEK_SET,
+		.l_start  = 0,
+		.l_len    = 1
+	};
+
+	while (fcntl(fd, F_SETLKW, &region))
+		if (errno != EINTR)
+			return UNSHARED;
+
+	/* A leader that died on the way left nothing behind */
+	struct landing landing;
+	if (pread(fd, &landing, sizeof landing, 0) != sizeof landing)
+		return UNSHARED;
+
+	return landing.outcome;
+}
+
+/**
+ * \brief Run command.
+ *
+ * \param argv Argument vector of the command.
+ *
+ * \return Exit status of the command or \c EXIT_FAILURE on failure.
+ */
+static int run(char *argv[]) {
+	pid_t pid;
+	if (unlikely(errno = posix_spawnp(&pid, argv[0], (posix_spawn_file_actions_t *) 0, (posix_spawnattr_t *) 0, argv, environ))) {
+		perror("Unable to spawn command");
+		return EXIT_FAILURE;
+	}
+
+	int status;
+	while (unlikely(waitpid(pid, &status, 0) < 0))
+		if (errno != EINTR) {
+			perror("Unable to wait for command");
+			return EXIT_FAILURE;
+		}
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
+
+/**
+ * \brief Discard standard input.
+ *
+ * \return \c EXIT_SUCCESS if successful or \c EXIT_FAILURE on failure.
+ */
+static int discard(void) {
+	for (;;) {
+		ssize_t in = stream_read(0, buf, sizeof buf);
+		if (unlikely(in < 0)) {
+			perror("Read error");
+			return EXIT_FAILURE;
+		}
+
+		if (!in)
+			return EXIT_SUCCESS;
+	}
+}
+
+/**
+ * \brief Main routine.
+ *
+ * Concurrent retrievals of the same object and concurrent deposits of
+ * the same identifier board a single flight, which the first of them
+ * leads by running its command.  Everyone else waits for the flight to
+ * land.  A successful retrieval leaves the object in the object cache,
+ * so the others then run their command to be served from there, without
+ * anything being copied on the leader's side; an object that does not
+ * exist is reported missing to all of them.  A successful deposit stands
+ * for the others, which merely discard their input.  Anything else, such
+ * as a failure, is not shared: the next process in line then leads a
+ * flight of its own.  Without a usable lock directory, the command is
+ * run on its own.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector: operation, module name, object identifier and command.
+ *
+ * \return Exit status of the command or EXIT_FAILURE on failure.
+ */
+int main(int argc, char *argv[]) {
+	uint8_t ident[32];
+
+	if (unlikely(argc < 5)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	bool retrieval = !strcmp(argv[1], "retrieve");
+	if (unlikely(!retrieval && strcmp(argv[1], "deposit"))) {
+		fprintf(stderr, "Unsupported operation “%s”!\n", argv[1]);
+		return 2;
+	}
+
+	if (unlikely(!*argv[2] || *argv[2] == '.' || strchr(argv[2], '/') || strlen(argv[3]) != 32 * 2 || !hexsint(ident, argv[3], 32))) {
+		fputs("Invalid module name or object identifier!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	char *dir  = concat(LOCK_BASE, argv[2], (char *) 0);
+	char *path = concat(LOCK_BASE, argv[2], "/", argv[1], "-", argv[3], (char *) 0);
+
+	if (unlikely(!dir || !path)) {
+		perror("Unable to allocate memory");
+		return EXIT_FAILURE;
+	}
+
+	mkdir(LOCK_BASE, 0755);
+	mkdir(dir, 0755);
+
+	for (;;) {
+		bool leader;
+		int fd = board(path, &leader);
+
+		if (fd < 0)
+			break;
+
+		if (leader) {
+			struct landing landing;
+			memset(&landing, 0, sizeof landing);
+
+			/* A leader that died after landing left its record behind */
+			if (unlikely(ftruncate(fd, 0)))
+				perror("Unable to clear lock file");
+
+			int rc = run(&argv[4]);
+			landing.outcome = rc == EXIT_SUCCESS ? EXIT_SUCCESS : retrieval && rc == 3 ? 3 : UNSHARED;
+
+			/* Land, leaving the outcome to everyone on board */
+			if (unlikely(pwrite(fd, &landing, sizeof landing, 0) != sizeof landing))
+				perror("Unable to record outcome");
+
+			unlink(path);
+			close(fd);
+			return rc;
+		}
+
+		int outcome = land(fd);
+		close(fd);
+
+		if (outcome == 3 && retrieval)
+			return 3;
+
+		/* The object is cached by now */
+		if (outcome == EXIT_SUCCESS && retrieval)
+			break;
+
+		if (outcome == EXIT_SUCCESS)
+			return discard();
+	}
+
+	execvp(argv[4], &argv[4]);
+	perror("Unable to run command");
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,424 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "egress.h"
+#include "expect.h"
+#include "function.h"
+#include "index.h"
+
+/**
+ * \brief Minimum number of slots.
+ */
+#define INDEX_MINIMUM 1024
+
+/**
+ * \brief Index magic sequence.
+ */
+static const uint8_t index_magic[8] = {
+	UINT8_C(0x4f), UINT8_C(0x43), UINT8_C(0x49), UINT8_C(0x44),
+	UINT8_C(0x58), UINT8_C(0x00), UINT8_C(0x00), UINT8_C(0x01)
+};
+
+/**
+ * \brief Compute size of index file.
+ *
+ * \param slots Number of slots.
+ *
+ * \return Size in bytes.
+ */
+static inline constant size_t index_size(uint64_t slots) {
+	return sizeof (struct index_head) + slots * sizeof (struct index_entry);
+}
+
+/**
+ * \brief Compute home slot of identifier.
+ *
+ * Identifiers are hash values themselves, so their leading octets are
+ * used directly.
+ *
+ * \param idx Index context.
+ * \param ident Object identifier.
+ *
+ * \return Slot number.
+ */
+static inline pure uint64_t index_home(const struct index *restrict idx, const uint8_t ident[restrict 32]) {
+	uint64_t hash;
+	memcpy(&hash, ident, sizeof hash);
+	return hash & idx->head->slots - 1;
+}
+
+/**
+ * \brief Map index file.
+ *
+ * \param idx Index context.
+ * \param size Size of mapping.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool index_map(struct index *restrict idx, size_t size) {
+	prime(bool);
+
+	void *map = mmap((void *) 0, size, idx->write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, idx->fd, 0);
+	if (unlikely(map == MAP_FAILED))
+		egress(0, false, errno);
+
+	idx->size = size;
+	idx->head = (struct index_head *) map;
+	idx->slot = (struct index_entry *) (idx->head + 1);
+
+	egress(0, true, errno);
+
+egress0:
+	final();
+}
+
+/**
+ * \brief Initialise empty index file.
+ *
+ * \param idx Index context.
+ * \param slots Number of slots.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool index_create(struct index *restrict idx, uint64_t slots) {
+	prime(bool);
+
+	if (idx->head)
+		munmap(idx->head, idx->size);
+
+	idx->head = (struct index_head *) 0;
+
+	/* Truncating first zeroes all slots */
+	if (unlikely(ftruncate(idx->fd, 0) || ftruncate(idx->fd, index_size(slots))))
+		egress(0, false, errno);
+
+	if (unlikely(!index_map(idx, index_size(slots))))
+		egress(0, false, errno);
+
+	memcpy(idx->head->magic, index_magic, sizeof index_magic);
+	idx->head->slots = slots;
+	idx->head->count = 0;
+	idx->head->flags = INDEX_DIRTY;
+
+	egress(0, true, errno);
+
+egress0:
+	final();
+}
+
+bool index_open(struct index *restrict idx, const char *restrict path, bool write) {
+	prime(bool);
+
+	idx->write = write;
+	idx->dirty = false;
+	idx->size  = 0;
+	idx->head  = (struct index_head *) 0;
+	idx->slot  = (struct index_entry *) 0;
+
+	idx->fd = open(path, write ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+	if (unlikely(idx->fd < 0))
+		egress(0, false, errno);
+
+	/* Lock index */
+	struct flock lock = {
+		.l_type   = write ? F_WRLCK : F_RDLCK,
+		.l_whence = SEEK_SET,
+		.l_start  = 0,
+		.l_len    = 0
+	};
+
+	while (unlikely(fcntl(idx->fd, F_SETLKW, &lock)))
+		if (errno != EINTR)
+			egress(1, false, errno);
+
+	struct stat st;
+	if (unlikely(fstat(idx->fd, &st)))
+		egress(1, false, errno);
+
+	/* Validate header */
+	struct index_head head;
+	if (st.st_size < (off_t) sizeof head ||
+		pread(idx->fd, &head, sizeof head, 0) != sizeof head ||
+		memcmp(head.magic, index_magic, sizeof index_magic) ||
+		!head.slots || head.slots & head.slots - 1 ||
+		(uint64_t) st.st_size != index_size(head.slots)) {
+		if (!write)
+			egress(1, false, st.st_size ? EINVAL : ENOENT);
+
+		if (unlikely(!index_create(idx, INDEX_MINIMUM)))
+			egress(1, false, errno);
+
+		/* A fresh index has to be populated by the index user */
+		idx->dirty = true;
+		egress(0, true, errno);
+	}
+
+	if (unlikely(!index_map(idx, st.st_size)))
+		egress(1, false, errno);
+
+	/* The previous writer has not finished */
+	idx->dirty = idx->head->flags & INDEX_DIRTY;
+
+	if (write)
+		idx->head->flags |= INDEX_DIRTY;
+
+	egress(0, true, errno);
+
+egress1:
+	close(idx->fd);
+
+egress0:
+	final();
+}
+
+struct index_entry *index_find(const struct index *restrict idx, const uint8_t ident[restrict 32]) {
+	const uint64_t mask = idx->head->slots - 1;
+
+	for (uint64_t iter = index_home(idx, ident);; iter = iter + 1 & mask) {
+		struct index_entry *entry = &idx->slot[iter];
+
+		if (!(entry->flags & INDEX_USED))
+			return (struct index_entry *) 0;
+
+		if (likely(!memcmp(entry->ident, ident, sizeof entry->ident)))
+			return entry;
+	}
+}
+
+/**
+ * \brief Double the number of slots.
+ *
+ * \param idx Index context.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool index_grow(struct index *restrict idx) {
+	prime(bool);
+
+	const uint64_t slots = idx->head->slots;
+	const uint64_t count = idx->head->count;
+	const uint64_t flags = idx->head->flags;
+
+	uint64_t state[INDEX_STATE];
+	memcpy(state, idx->head->state, sizeof state);
+
+	/* Save entries in use */
+	struct index_entry *save = malloc(count * sizeof *save + 1);
+	if (unlikely(!save))
+		egress(0, false, errno);
+
+	for (uint64_t iter = 0, fill = 0; iter < slots; ++iter)
+		if (idx->slot[iter].flags & INDEX_USED)
+			save[fill++] = idx->slot[iter];
+
+	if (unlikely(!index_create(idx, slots * 2)))
+		egress(1, false, errno);
+
+	idx->head->flags = flags;
+	memcpy(idx->head->state, state, sizeof state);
+
+	/* Reinsert entries */
+	for (uint64_t iter = 0; iter < count; ++iter)
+		*index_insert(idx, save[iter].ident) = save[iter];
+
+	egress(1, true, errno);
+
+egress1:
+	free(save);
+
+egress0:
+	final();
+}
+
+struct index_entry *index_insert(struct index *restrict idx, const uint8_t ident[restrict 32]) {
+	prime(struct index_entry *);
+
+	struct index_entry *entry = index_find(idx, ident);
+	if (entry)
+		egress(0, entry, errno);
+
+	/* Keep the load factor below three quarters */
+	if (unlikely((idx->head->count + 1) * 4 > idx->head->slots * 3))
+		if (unlikely(!index_grow(idx)))
+			egress(0, (struct index_entry *) 0, errno);
+
+	const uint64_t mask = idx->head->slots - 1;
+
+	uint64_t iter = index_home(idx, ident);
+	while (idx->slot[iter].flags & INDEX_USED)
+		iter = iter + 1 & mask;
+
+	entry = &idx->slot[iter];
+	memset(entry, 0, sizeof *entry);
+	memcpy(entry->ident, ident, sizeof entry->ident);
+	entry->flags = INDEX_USED;
+
+	++idx->head->count;
+
+	egress(0, entry, errno);
+
+egress0:
+	final();
+}
+
+void index_remove(struct index *restrict idx, struct index_entry *restrict entry) {
+	const uint64_t mask = idx->head->slots - 1;
+
+	uint64_t hole = entry - idx->slot;
+
+	/* Shift subsequent entries of the probe sequence backwards */
+	for (uint64_t iter = hole + 1 & mask; idx->slot[iter].flags & INDEX_USED; iter = iter + 1 & mask) {
+		uint64_t home = index_home(idx, idx->slot[iter].ident);
+
+		/* Entry may stay if its home lies cyclically in (hole, iter] */
+		if (hole <= iter ? hole < home && home <= iter : hole < home || home <= iter)
+			continue;
+
+		idx->slot[hole] = idx->slot[iter];
+		hole = iter;
+	}
+
+	memset(&idx->slot[hole], 0, sizeof idx->slot[hole]);
+
+	--idx->head->count;
+}
+
+void index_reset(struct index *restrict idx) {
+	memset(idx->slot, 0, idx->head->slots * sizeof *idx->slot);
+	memset(idx->head->state, 0, sizeof idx->head->state);
+	idx->head->count = 0;
+}
+
+uint8_t (*index_idents(const struct index *restrict idx, size_t *restrict count))[32] {
+	/* Allocate at least one element so that empty indices succeed */
+	uint8_t (*idents)[32] = malloc((idx->head->count + 1) * sizeof *idents);
+	if (unlikely(!idents))
+		return idents;
+
+	size_t len = 0;
+	for (uint64_t iter = 0; iter < idx->head->slots && len < idx->head->count; ++iter)
+		if (idx->slot[iter].flags & INDEX_USED)
+			memcpy(idents[len++], idx->slot[iter].ident, sizeof *idents);
+
+	*count = len;
+
+	return idents;
+}
+
+void index_close(struct index *restrict idx) {
+	if (idx->write)
+		idx->head->flags &= ~INDEX_DIRTY;
+
+	munmap(idx->head, idx->size);
+
+	/* Closing the descriptor releases the lock */
+	close(idx->fd);
+}
+
+#ifdef TEST
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "essai.h"
+
+/**
+ * \brief Number of test identifiers.
+ */
+#define IDENTS 10000
+
+/**
+ * \brief Test identifiers.
+ */
+static uint8_t ident[IDENTS][32];
+
+/**
+ * \brief Verify that exactly the identifiers in [\a from, \a to) are found.
+ */
+static bool verify(const struct index *restrict idx, size_t from, size_t to) {
+	for (size_t iter = 0; iter < IDENTS; ++iter) {
+		const struct index_entry *entry = index_find(idx, ident[iter]);
+
+		if (iter >= from && iter < to) {
+			if (!entry || entry->offset != iter)
+				return false;
+		}
+
+		else if (entry)
+			return false;
+	}
+
+	return true;
+}
+
+int main(void) {
+	char path[] = "/tmp/index-XXXXXX";
+	int fd = mkstemp(path);
+	if (unlikely(fd < 0)) {
+		perror("Cannot create temporary file");
+		return EXIT_FAILURE;
+	}
+
+	close(fd);
+
+	/* Generate identifiers with colliding home slots */
+	srand(0);
+	for (size_t iter = 0; iter < IDENTS; ++iter) {
+		for (size_t byte = 0; byte < sizeof ident[iter]; ++byte)
+			ident[iter][byte] = rand();
+
+		if (iter % 3 == 0)
+			ident[iter][0] = ident[iter][1] = 0;
+	}
+
+	struct index idx;
+
+	essaye(index_open(&idx, path, true) && idx.dirty);
+
+	for (size_t iter = 0; iter < IDENTS; ++iter)
+		index_insert(&idx, ident[iter])->offset = iter;
+
+	essaye(idx.head->count == IDENTS);
+	essaye(verify(&idx, 0, IDENTS));
+
+	for (size_t iter = 0; iter < IDENTS / 2; ++iter)
+		index_remove(&idx, index_find(&idx, ident[iter]));
+
+	essaye(verify(&idx, IDENTS / 2, IDENTS));
+
+	index_close(&idx);
+
+	essaye(index_open(&idx, path, false) && !idx.dirty);
+	essaye(idx.head->count == IDENTS - IDENTS / 2);
+	essaye(verify(&idx, IDENTS / 2, IDENTS));
+
+	size_t count;
+	uint8_t (*idents)[32] = index_idents(&idx, &count);
+
+	essaye(idents && count == IDENTS - IDENTS / 2);
+
+	bool listed = true;
+	for (size_t iter = 0; idents && iter < count; ++iter)
+		listed = listed && index_find(&idx, idents[iter]);
+
+	essaye(listed);
+	free(idents);
+	index_close(&idx);
+
+	essaye(index_open(&idx, path, true));
+	index_reset(&idx);
+	essaye(verify(&idx, 0, 0));
+	index_close(&idx);
+
+	unlink(path);
+
+	return EXIT_SUCCESS;
+}
+#endif /* TEST */
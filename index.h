@@ -0,0 +1,154 @@
+#pragma once
+#ifndef OC_INDEX_H
+#define OC_INDEX_H
+
+/**
+ * \file
+ *
+ * \brief Memory‐mapped identifier index.
+ *
+ * The index is an open‐addressing hash table in a shared file mapping,
+ * keyed by object identifier.  It is a local acceleration structure in
+ * native byte‐order and must always be reconstructible from the data it
+ * describes.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Slot is in use.
+ */
+#define INDEX_USED UINT32_C(0x00000001)
+
+/**
+ * \brief First flag available to the index user.
+ */
+#define INDEX_USER UINT32_C(0x00000100)
+
+/**
+ * \brief Index was not closed properly.
+ */
+#define INDEX_DIRTY UINT64_C(0x0000000000000001)
+
+/**
+ * \brief Number of module‐specific state words.
+ */
+#define INDEX_STATE 4
+
+/**
+ * \brief Index file header.
+ */
+struct index_head {
+	uint8_t  magic[8];           /**< Magic sequence. */
+	uint64_t slots;              /**< Number of slots. */
+	uint64_t count;              /**< Number of slots in use. */
+	uint64_t flags;              /**< Index flags. */
+	uint64_t state[INDEX_STATE]; /**< Module‐specific state. */
+};
+
+/**
+ * \brief Index entry.
+ */
+struct index_entry {
+	uint8_t  ident[32]; /**< Object identifier. */
+	uint64_t offset;    /**< Object location. */
+	uint64_t length;    /**< Object length. */
+	uint64_t stored;    /**< Stored size. */
+	uint64_t time;      /**< Deposit time in nanoseconds. */
+	uint32_t aux;       /**< Module‐specific datum. */
+	uint32_t flags;     /**< Entry flags. */
+};
+
+/**
+ * \brief Index context structure.
+ */
+struct index {
+	int                 fd;    /**< Index file descriptor. */
+	bool                write; /**< Index is writable. */
+	bool                dirty; /**< Index needs to be rebuilt. */
+	size_t              size;  /**< Size of mapping. */
+	struct index_head  *head;  /**< Index header. */
+	struct index_entry *slot;  /**< Index slots. */
+};
+
+/**
+ * \brief Open index.
+ *
+ * \param idx Index context.
+ * \param path Index file path.
+ * \param write Open for writing.
+ *
+ * The index is locked shared for reading or exclusively for writing
+ * until it is closed.  A writable index is created if it does not exist
+ * and reinitialised if it is damaged.  In either case or if a previous
+ * writer did not close the index, \c dirty is set.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool index_open(struct index *restrict idx, const char *restrict path, bool write);
+
+/**
+ * \brief Find index entry.
+ *
+ * \param idx Index context.
+ * \param ident Object identifier.
+ *
+ * \return Pointer to the entry or <tt>(struct index_entry *) 0</tt> if there is none.
+ */
+extern struct index_entry *index_find(const struct index *restrict idx, const uint8_t ident[restrict 32]);
+
+/**
+ * \brief Insert index entry.
+ *
+ * \param idx Index context.
+ * \param ident Object identifier.
+ *
+ * If there already is an entry for \a ident, it is returned unmodified.
+ * Otherwise a new zeroed entry is created.  Insertion may grow the index
+ * and thereby invalidate all entry pointers obtained earlier.
+ *
+ * \return Pointer to the entry or <tt>(struct index_entry *) 0</tt> on failure.
+ */
+extern struct index_entry *index_insert(struct index *restrict idx, const uint8_t ident[restrict 32]);
+
+/**
+ * \brief Remove index entry.
+ *
+ * \param idx Index context.
+ * \param entry Index entry.
+ *
+ * Removal may move other entries and thereby invalidate entry pointers.
+ */
+extern void index_remove(struct index *restrict idx, struct index_entry *restrict entry);
+
+/**
+ * \brief Remove all index entries.
+ *
+ * \param idx Index context.
+ */
+extern void index_reset(struct index *restrict idx);
+
+/**
+ * \brief Copy identifiers of all index entries.
+ *
+ * \param idx Index context.
+ * \param count Pointer to variable receiving the number of identifiers.
+ *
+ * The copy stays valid after the index is closed, so that the lock need
+ * not be held while the identifiers are processed.
+ *
+ * \return Array of identifiers to be freed by the caller or
+ * <tt>(uint8_t (*)[32]) 0</tt> on failure.
+ */
+extern uint8_t (*index_idents(const struct index *restrict idx, size_t *restrict count))[32];
+
+/**
+ * \brief Close index.
+ *
+ * \param idx Index context.
+ */
+extern void index_close(struct index *restrict idx);
+
+#endif /* OC_INDEX_H */
@@ -0,0 +1,229 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "egress.h"
+#include "expect.h"
+#include "journal.h"
+
+/**
+ * \def atomic_add(var, val)
+ *
+ * \brief Add to shared counter without synchronisation.
+ *
+ * \param var Counter.
+ * \param val Value to add.
+ *
+ * \return Previous value.
+ */
+
+/**
+ * \def atomic_fence()
+ *
+ * \brief Order earlier loads before later ones.
+ */
+
+/**
+ * \def atomic_barrier()
+ *
+ * \brief Order earlier stores before later ones.
+ */
+#if defined(__clang__) || defined(__GNUC__)
+# define atomic_add(var, val) __atomic_fetch_add(&(var), (val), __ATOMIC_RELAXED)
+# define atomic_load(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+# define atomic_store(var, val) __atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+# define atomic_fence() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+# define atomic_barrier() __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+# error "Atomic operations are not available for this compiler"
+#endif
+
+/**
+ * \brief Ring magic sequence.
+ */
+static const uint8_t journal_magic[8] = {
+	UINT8_C(0x4f), UINT8_C(0x43), UINT8_C(0x4a), UINT8_C(0x52),
+	UINT8_C(0x4e), UINT8_C(0x00), UINT8_C(0x00), UINT8_C(0x01)
+};
+
+bool journal_open(struct journal *restrict journal, const char *restrict dir, unsigned int ring, bool create) {
+	prime(bool);
+
+	char path[4096];
+	if (unlikely((size_t) snprintf(path, sizeof path, "%s/%u", dir, ring % JOURNAL_RINGS) >= sizeof path))
+		egress(0, false, ENAMETOOLONG);
+
+	if (create)
+		mkdir(dir, 0755);
+
+	journal->fd = open(path, create ? O_RDWR | O_CREAT : O_RDONLY, 0666);
+	if (journal->fd < 0)
+		egress(0, false, errno);
+
+	struct stat st;
+	if (unlikely(fstat(journal->fd, &st)))
+		egress(1, false, errno);
+
+	/* Pages are only allocated once touched */
+	if (!st.st_size && create && unlikely(ftruncate(journal->fd, sizeof (struct journal_ring))))
+		egress(1, false, errno);
+
+	else if (unlikely((st.st_size || !create) && st.st_size != sizeof (struct journal_ring)))
+		egress(1, false, EINVAL);
+
+	void *map = mmap((void *) 0, sizeof (struct journal_ring), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, journal->fd, 0);
+	if (unlikely(map == MAP_FAILED))
+		egress(1, false, errno);
+
+	journal->ring = map;
+
+	/* Concurrent initialisation writes the same bytes */
+	if (create && memcmp(journal->ring->magic, journal_magic, sizeof journal_magic))
+		memcpy(journal->ring->magic, journal_magic, sizeof journal_magic);
+
+	else if (unlikely(!create && memcmp(journal->ring->magic, journal_magic, sizeof journal_magic))) {
+		munmap(map, sizeof (struct journal_ring));
+		egress(1, false, EINVAL);
+	}
+
+	egress(0, true, errno);
+
+egress1:
+	close(journal->fd);
+
+egress0:
+	final();
+}
+
+void journal_append(struct journal *restrict journal, struct journal_record *restrict rec) {
+	struct journal_ring *ring = journal->ring;
+	uint64_t pos = atomic_add(ring->next, 1);
+	struct journal_record *slot = &ring->record[pos % JOURNAL_RECORDS];
+
+	/* Readers skip the record until it is complete */
+	atomic_store(slot->seq, 0);
+	atomic_barrier();
+
+	rec->seq = pos + 1;
+	memcpy((uint8_t *) slot + sizeof slot->seq, (const uint8_t *) rec + sizeof rec->seq, sizeof *rec - sizeof rec->seq);
+
+	atomic_store(slot->seq, pos + 1);
+}
+
+size_t journal_collect(const struct journal *restrict journal, struct journal_record *restrict buf) {
+	struct journal_ring *ring = journal->ring;
+	uint64_t next = atomic_load(ring->next);
+	uint64_t first = next > JOURNAL_RECORDS ? next - JOURNAL_RECORDS : 0;
+	size_t count = 0;
+
+	for (uint64_t pos = first; pos < next; ++pos) {
+		const struct journal_record *slot = &ring->record[pos % JOURNAL_RECORDS];
+
+		/* A record overwritten or rewritten meanwhile changes its sequence number */
+		uint64_t seq = atomic_load(slot->seq);
+		if (seq != pos + 1)
+			continue;
+
+		memcpy(&buf[count], slot, sizeof *slot);
+		atomic_fence();
+
+		if (atomic_load(slot->seq) == seq && buf[count].seq == seq)
+			++count;
+	}
+
+	return count;
+}
+
+void journal_close(struct journal *restrict journal) {
+	munmap(journal->ring, sizeof (struct journal_ring));
+	close(journal->fd);
+}
+
+#ifdef TEST
+#include <stdlib.h>
+
+#include <sys/wait.h>
+
+#include "essai.h"
+
+int main(void) {
+	char dir[32];
+	snprintf(dir, sizeof dir, "/tmp/journal-%ld", (long int) getpid());
+
+	struct journal journal, reader;
+	struct journal_record rec, *buf = malloc(JOURNAL_RECORDS * sizeof *buf);
+
+	essaye(buf);
+	essaye(!journal_open(&reader, dir, 3, false) && errno == ENOENT);
+	essaye(journal_open(&journal, dir, 3, true));
+	essaye(journal_open(&reader, dir, 3, false));
+	essaye(journal_collect(&reader, buf) == 0);
+
+	memset(&rec, 0, sizeof rec);
+	strcpy(rec.module, "sqlite");
+	rec.duration = 42;
+
+	journal_append(&journal, &rec);
+	essaye(rec.seq == 1 && journal_collect(&reader, buf) == 1);
+	essaye(buf[0].duration == 42 && !strcmp(buf[0].module, "sqlite"));
+
+	/* Processes append to the same ring concurrently */
+	for (unsigned int child = 0; child < 4; ++child)
+		if (!fork()) {
+			struct journal mine;
+
+			if (!journal_open(&mine, dir, 3, true))
+				_exit(EXIT_FAILURE);
+
+			for (uint64_t iter = 0; iter < 1000; ++iter) {
+				rec.bytes = iter;
+				rec.pid = child;
+				journal_append(&mine, &rec);
+			}
+
+			journal_close(&mine);
+			_exit(EXIT_SUCCESS);
+		}
+
+	while (wait((int *) 0) > 0);
+
+	size_t count = journal_collect(&reader, buf);
+	uint64_t total = 0;
+	bool ordered = true;
+
+	for (size_t iter = 0; iter < count; ++iter) {
+		total += buf[iter].bytes;
+		ordered &= !iter || buf[iter].seq == buf[iter - 1].seq + 1;
+	}
+
+	essaye(count == 4001 && ordered && total == 4 * 499500);
+
+	/* Wrapping around drops the oldest records */
+	for (uint64_t iter = 0; iter < JOURNAL_RECORDS; ++iter) {
+		rec.bytes = iter;
+		journal_append(&journal, &rec);
+	}
+
+	count = journal_collect(&reader, buf);
+	essaye(count == JOURNAL_RECORDS && buf[0].bytes == 0 && buf[count - 1].bytes == JOURNAL_RECORDS - 1);
+	essaye(buf[0].seq == 4002 && buf[count - 1].seq == 4001 + JOURNAL_RECORDS);
+
+	journal_close(&reader);
+	journal_close(&journal);
+
+	char path[64];
+	snprintf(path, sizeof path, "%s/3", dir);
+	unlink(path);
+	rmdir(dir);
+	free(buf);
+
+	return EXIT_SUCCESS;
+}
+#endif /* TEST */
@@ -0,0 +1,120 @@
+#pragma once
+#ifndef OC_JOURNAL_H
+#define OC_JOURNAL_H
+
+/**
+ * \file
+ *
+ * \brief Event journal.
+ *
+ * Storage operations are recorded as fixed‐size binary records in rings,
+ * which processes map into memory and append to without locks.  Each
+ * record is claimed by an atomic increment of the ring position and
+ * published by storing its sequence number last, so that readers skip
+ * records that are being written.  Once a ring wraps around, the oldest
+ * records are overwritten.  Processes are spread over the rings by
+ * process ID, since most of them are helpers recording a single event.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "path.h"
+
+/**
+ * \brief Default ring directory.
+ *
+ * It may be overridden through \c JOURNAL_PATH.
+ */
+#define JOURNAL_PATH LOG_BASE "journal/"
+
+/**
+ * \brief Number of rings.
+ */
+#define JOURNAL_RINGS 8
+
+/**
+ * \brief Number of records per ring, a power of two.
+ */
+#define JOURNAL_RECORDS 4096
+
+/**
+ * \brief Maximum length of module names, including the terminator.
+ */
+#define JOURNAL_NAMELEN 32
+
+/**
+ * \brief Event record.
+ */
+struct journal_record {
+	uint64_t seq;                     /**< Ring position plus one, or zero while being written. */
+	uint64_t time;                    /**< Start time in nanoseconds since the epoch. */
+	uint64_t duration;                /**< Duration in microseconds. */
+	uint64_t bytes;                   /**< Bytes transferred. */
+	uint8_t  ident[32];               /**< Object identifier, zero if there is none. */
+	char     module[JOURNAL_NAMELEN]; /**< Storage module name. */
+	int32_t  status;                  /**< Exit status. */
+	uint32_t pid;                     /**< Process ID. */
+	uint8_t  op;                      /**< Operation, see \c enum meter_op. */
+	uint8_t  reserved[23];            /**< Reserved, set to zero. */
+};
+
+/**
+ * \brief Ring layout.
+ */
+struct journal_ring {
+	uint8_t               magic[8];                /**< Magic sequence. */
+	uint64_t              next;                    /**< Next ring position. */
+	uint64_t              reserved[14];            /**< Reserved, set to zero. */
+	struct journal_record record[JOURNAL_RECORDS]; /**< Records. */
+};
+
+/**
+ * \brief Journal context structure.
+ */
+struct journal {
+	int                  fd;   /**< Ring file descriptor. */
+	struct journal_ring *ring; /**< Ring mapping. */
+};
+
+/**
+ * \brief Open ring.
+ *
+ * \param journal Journal context.
+ * \param dir Ring directory.
+ * \param ring Ring number.
+ * \param create Create ring if it does not exist.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool journal_open(struct journal *restrict journal, const char *restrict dir, unsigned int ring, bool create);
+
+/**
+ * \brief Append record.
+ *
+ * The sequence number is filled in.
+ *
+ * \param journal Journal context.
+ * \param rec Record.
+ */
+extern void journal_append(struct journal *restrict journal, struct journal_record *restrict rec);
+
+/**
+ * \brief Copy records out of ring.
+ *
+ * \param journal Journal context.
+ * \param buf Buffer to hold up to \c JOURNAL_RECORDS records.
+ *
+ * \return Number of complete records, oldest first.
+ */
+extern size_t journal_collect(const struct journal *restrict journal, struct journal_record *restrict buf);
+
+/**
+ * \brief Close ring.
+ *
+ * \param journal Journal context.
+ */
+extern void journal_close(struct journal *restrict journal);
+
+#endif /* OC_JOURNAL_H */
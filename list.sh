@@ -0,0 +1,83 @@
+#!/bin/sh
+
+set -e
+
+if [ $# -ne 1 ]
+then
+	echo "Invalid number of arguments" >&2
+	exit 1
+fi
+
+# Record metrics of storage operations
+tally="/usr/libexec/opencorpus/tally"
+
+# Spread global storage over the store roots in its routing table
+route="/usr/libexec/opencorpus/route"
+
+# Find storage module
+if [ -n "$HOME" -a -x "$HOME/.opencorpus/storage/$1" ]
+then
+	module="$HOME/.opencorpus/storage/$1"
+elif [ -x "/usr/libexec/opencorpus/storage/$1" ]
+then
+	module="/usr/libexec/opencorpus/storage/$1"
+else
+	echo "Cannot find storage module" >&2
+	exit 1
+fi
+
+# Create cache directory
+if [ -w "/var/cache/opencorpus/storage" ]
+then
+	cache="/var/cache/opencorpus/storage/$1"
+elif [ -n "$HOME" ]
+then
+	cache="$HOME/.opencorpus/cache/storage/$1"
+else
+	echo "Unable to create cache directory" >&2
+	exit 1
+fi
+
+mkdir -p "$cache"
+
+# Create temp directory
+if [ -w "/var/tmp/opencorpus/storage" ]
+then
+	temp=`mktemp -d "/var/tmp/opencorpus/storage/list-XXXXXXXX"`
+else
+	temp=`mktemp -d`
+fi
+
+mkdir -p "$temp"
+
+# Clean temp directory upon exit
+trap 'rm -f -r -- "$temp"' EXIT
+
+# Maintenance operations take a placeholder identifier
+id="-"
+
+# List local storage, then global storage
+if [ -z "$NO_SANDBOX" ]
+then
+	export SYDBOX_WRITE="/dev/fd:/dev/full:/dev/null:/dev/stderr:/dev/stdout:/dev/shm:/dev/tty:/dev/zero:/proc/self/attr:/proc/self/fd:/proc/self/task:/tmp:$cache:$temp"
+
+	if [ -d "$HOME/.opencorpus/corpus/$1" ]
+	then
+		"$tally" "$1" "list" sydbox -C -L -B "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$id" "list"
+	fi
+
+	if [ -d "/var/db/opencorpus/$1" ]
+	then
+		"$tally" "$1" "list" sydbox -C -L -B "$route" "$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$id" "list"
+	fi
+else
+	if [ -d "$HOME/.opencorpus/corpus/$1" ]
+	then
+		"$tally" "$1" "list" "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$id" "list"
+	fi
+
+	if [ -d "/var/db/opencorpus/$1" ]
+	then
+		"$tally" "$1" "list" "$route" "$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$id" "list"
+	fi
+fi
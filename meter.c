@@ -0,0 +1,354 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "egress.h"
+#include "expect.h"
+#include "function.h"
+#include "meter.h"
+
+/**
+ * \def atomic_add(var, val)
+ *
+ * \brief Add to shared counter without synchronisation.
+ *
+ * \param var Counter.
+ * \param val Value to add.
+ */
+
+/**
+ * \def atomic_cas(var, old, val)
+ *
+ * \brief Replace shared value if it is unchanged.
+ *
+ * \param var Variable.
+ * \param old Expected value.
+ * \param val New value.
+ */
+#if defined(__clang__) || defined(__GNUC__)
+# define atomic_add(var, val) __atomic_fetch_add(&(var), (val), __ATOMIC_RELAXED)
+# define atomic_cas(var, old, val) __atomic_compare_exchange_n(&(var), &(old), (val), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+# define atomic_load(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+# define atomic_store(var, val) __atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+#else
+# error "Atomic operations are not available for this compiler"
+#endif
+
+/**
+ * \brief Module slot states.
+ */
+enum {
+	SLOT_FREE,
+	SLOT_CLAIMED,
+	SLOT_READY
+};
+
+/**
+ * \brief Metrics segment magic sequence.
+ */
+static const uint8_t meter_magic[8] = {
+	UINT8_C(0x4f), UINT8_C(0x43), UINT8_C(0x4d), UINT8_C(0x45),
+	UINT8_C(0x54), UINT8_C(0x00), UINT8_C(0x00), UINT8_C(0x01)
+};
+
+/**
+ * \brief Operation names.
+ */
+static const char *const meter_ops[METER_OPS] = {
+	[METER_ASSAY]    = "assay",
+	[METER_RETRIEVE] = "retrieve",
+	[METER_RANGE]    = "range",
+	[METER_INSPECT]  = "inspect",
+	[METER_DEPOSIT]  = "deposit",
+	[METER_EFFACE]   = "efface",
+	[METER_OTHER]    = "other"
+};
+
+/**
+ * \brief Compute histogram bucket of value.
+ *
+ * Values below the number of sub‐buckets have a bucket each; larger
+ * values share buckets of 1⁄8 of their power of two.
+ *
+ * \param value Value.
+ *
+ * \return Bucket number.
+ */
+static inline constant unsigned int meter_bucket(uint64_t value) {
+	if (value < METER_SUBBUCKETS)
+		return value;
+
+	unsigned int log = 63 - __builtin_clzll(value);
+	return (log - 2) * METER_SUBBUCKETS + (value >> log - 3 & METER_SUBBUCKETS - 1);
+}
+
+/**
+ * \brief Compute upper bound of histogram bucket.
+ *
+ * \param bucket Bucket number.
+ *
+ * \return Largest value in the bucket.
+ */
+static inline constant uint64_t meter_bound(unsigned int bucket) {
+	if (bucket < METER_SUBBUCKETS)
+		return bucket;
+
+	unsigned int log = bucket / METER_SUBBUCKETS + 2;
+	uint64_t low = (uint64_t) (METER_SUBBUCKETS + bucket % METER_SUBBUCKETS) << log - 3;
+
+	return low + (UINT64_C(1) << log - 3) - 1;
+}
+
+bool meter_open(struct meter *restrict meter, const char *restrict path) {
+	prime(bool);
+
+	meter->fd = open(path, O_RDWR | O_CREAT, 0666);
+	if (unlikely(meter->fd < 0))
+		egress(0, false, errno);
+
+	struct stat st;
+	if (unlikely(fstat(meter->fd, &st)))
+		egress(1, false, errno);
+
+	/* Pages are only allocated once touched */
+	if (!st.st_size && unlikely(ftruncate(meter->fd, sizeof (struct meter_segment))))
+		egress(1, false, errno);
+
+	else if (unlikely(st.st_size && st.st_size != sizeof (struct meter_segment)))
+		egress(1, false, EINVAL);
+
+	void *map = mmap((void *) 0, sizeof (struct meter_segment), PROT_READ | PROT_WRITE, MAP_SHARED, meter->fd, 0);
+	if (unlikely(map == MAP_FAILED))
+		egress(1, false, errno);
+
+	meter->seg = map;
+
+	/* Concurrent initialisation writes the same bytes */
+	if (memcmp(meter->seg->magic, meter_magic, sizeof meter_magic))
+		memcpy(meter->seg->magic, meter_magic, sizeof meter_magic);
+
+	egress(0, true, errno);
+
+egress1:
+	close(meter->fd);
+
+egress0:
+	final();
+}
+
+enum meter_op meter_op(const char *restrict name) {
+	for (unsigned int op = 0; op < METER_OTHER; ++op)
+		if (!strcmp(name, meter_ops[op]))
+			return op;
+
+	return METER_OTHER;
+}
+
+const char *meter_name(enum meter_op op) {
+	return op < METER_OPS ? meter_ops[op] : meter_ops[METER_OTHER];
+}
+
+struct meter_cell *meter_cell(struct meter *restrict meter, const char *restrict module, enum meter_op op) {
+	struct meter_segment *seg = meter->seg;
+	uint32_t hash = UINT32_C(0x811c9dc5);
+
+	for (const char *ptr = module; *ptr; ++ptr)
+		hash = (hash ^ (uint8_t) *ptr) * UINT32_C(0x01000193);
+
+	for (unsigned int probe = 0; probe < METER_MODULES; ++probe) {
+		unsigned int slot = (hash + probe) % METER_MODULES;
+		uint32_t state = SLOT_FREE;
+
+		/* Claim a free slot and publish its name */
+		if (atomic_cas(seg->state[slot], state, SLOT_CLAIMED)) {
+			strncpy(seg->module[slot], module, METER_NAMELEN - 1);
+			atomic_store(seg->state[slot], SLOT_READY);
+		}
+
+		/* Another process is publishing the name */
+		while ((state = atomic_load(seg->state[slot])) == SLOT_CLAIMED)
+			sched_yield();
+
+		if (!strncmp(seg->module[slot], module, METER_NAMELEN - 1))
+			return &seg->cell[slot][op][getpid() % METER_STRIPES];
+	}
+
+	return (struct meter_cell *) 0;
+}
+
+void meter_begin(struct meter_cell *restrict cell) {
+	atomic_add(cell->inflight, 1);
+}
+
+void meter_end(struct meter_cell *restrict cell, uint64_t latency, int status, uint64_t in, uint64_t out) {
+	enum meter_exit class = METER_ABNORMAL;
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) < METER_ABNORMAL)
+		class = WEXITSTATUS(status);
+
+	atomic_add(cell->inflight, -1);
+	atomic_add(cell->count, 1);
+	atomic_add(cell->in, in);
+	atomic_add(cell->out, out);
+	atomic_add(cell->exits[class], 1);
+	atomic_add(cell->total, latency);
+	atomic_add(cell->bucket[meter_bucket(latency)], 1);
+
+	uint64_t maximum = atomic_load(cell->maximum);
+	while (latency > maximum && !atomic_cas(cell->maximum, maximum, latency));
+}
+
+void meter_sum(const struct meter *restrict meter, unsigned int slot, enum meter_op op, struct meter_cell *restrict sum) {
+	memset(sum, 0, sizeof *sum);
+
+	for (unsigned int stripe = 0; stripe < METER_STRIPES; ++stripe) {
+		const struct meter_cell *cell = &meter->seg->cell[slot][op][stripe];
+
+		sum->count    += cell->count;
+		sum->inflight += cell->inflight;
+		sum->in       += cell->in;
+		sum->out      += cell->out;
+		sum->total    += cell->total;
+
+		if (cell->maximum > sum->maximum)
+			sum->maximum = cell->maximum;
+
+		for (unsigned int iter = 0; iter < METER_EXITS; ++iter)
+			sum->exits[iter] += cell->exits[iter];
+
+		for (unsigned int iter = 0; iter < METER_BUCKETS; ++iter)
+			sum->bucket[iter] += cell->bucket[iter];
+	}
+}
+
+uint64_t meter_quantile(const struct meter_cell *restrict cell, uint64_t quantile) {
+	uint64_t count = 0;
+
+	for (unsigned int iter = 0; iter < METER_BUCKETS; ++iter)
+		count += cell->bucket[iter];
+
+	/* Rank of the quantile, rounded up */
+	uint64_t rank = count / 1000000 * quantile + (count % 1000000 * quantile + 999999) / 1000000, seen = 0;
+
+	for (unsigned int iter = 0; iter < METER_BUCKETS; ++iter)
+		if ((seen += cell->bucket[iter]) >= rank && seen)
+			return meter_bound(iter) < cell->maximum ? meter_bound(iter) : cell->maximum;
+
+	return 0;
+}
+
+bool meter_dump(const struct meter *restrict meter, FILE *restrict out) {
+	struct meter_cell sum;
+
+	fputs("module op count inflight ok failed invalid absent abnormal in out mean p50 p99 p999 max\n", out);
+
+	for (unsigned int slot = 0; slot < METER_MODULES; ++slot) {
+		if (atomic_load(meter->seg->state[slot]) != SLOT_READY)
+			continue;
+
+		for (unsigned int op = 0; op < METER_OPS; ++op) {
+			meter_sum(meter, slot, op, &sum);
+
+			if (!sum.count && !sum.inflight)
+				continue;
+
+			fprintf(out, "%.*s %s %" PRIu64 " %" PRId64, METER_NAMELEN, meter->seg->module[slot], meter_ops[op], sum.count, (int64_t) sum.inflight);
+
+			for (unsigned int iter = 0; iter < METER_EXITS; ++iter)
+				fprintf(out, " %" PRIu64, sum.exits[iter]);
+
+			fprintf(out, " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+				sum.in, sum.out, sum.count ? sum.total / sum.count : 0,
+				meter_quantile(&sum, 500000), meter_quantile(&sum, 990000), meter_quantile(&sum, 999000), sum.maximum);
+		}
+	}
+
+	return !fflush(out) && !ferror(out);
+}
+
+void meter_close(struct meter *restrict meter) {
+	munmap(meter->seg, sizeof (struct meter_segment));
+	close(meter->fd);
+}
+
+#ifdef TEST
+#include <stdlib.h>
+
+#include "essai.h"
+
+int main(void) {
+	char path[32];
+	snprintf(path, sizeof path, "/tmp/meter-%ld", (long int) getpid());
+
+	/* Buckets are contiguous and ordered */
+	essaye(meter_bucket(0) == 0 && meter_bucket(7) == 7 && meter_bucket(8) == 8 && meter_bucket(15) == 15);
+	essaye(meter_bucket(16) == 16 && meter_bucket(17) == 16 && meter_bucket(18) == 17);
+	essaye(meter_bucket(UINT64_MAX) == METER_BUCKETS - 1);
+	essaye(meter_bound(meter_bucket(1000)) >= 1000 && meter_bound(meter_bucket(1000)) < 1000 + 1000 / METER_SUBBUCKETS);
+
+	bool contiguous = true;
+	for (unsigned int iter = 1; iter < METER_BUCKETS; ++iter)
+		contiguous &= meter_bucket(meter_bound(iter - 1) + 1) == iter;
+
+	essaye(contiguous);
+
+	struct meter meter;
+	essaye(meter_open(&meter, path));
+
+	struct meter_cell *cell = meter_cell(&meter, "sqlite", METER_RETRIEVE);
+	essaye(cell && cell == meter_cell(&meter, "sqlite", METER_RETRIEVE));
+	essaye(meter_cell(&meter, "tar", METER_RETRIEVE) != cell);
+	essaye(meter_op("range") == METER_RANGE && meter_op("compact") == METER_OTHER);
+	essaye(!strcmp(meter_name(METER_EFFACE), "efface") && !strcmp(meter_name(METER_OPS), "other"));
+
+	/* Processes record into different stripes */
+	for (unsigned int child = 0; child < 4; ++child)
+		if (!fork()) {
+			struct meter_cell *mine = meter_cell(&meter, "sqlite", METER_RETRIEVE);
+
+			for (uint64_t iter = 1; iter <= 1000; ++iter) {
+				meter_begin(mine);
+				meter_end(mine, iter, iter % 10 ? 0 : 3 << 8, 0, iter);
+			}
+
+			_exit(EXIT_SUCCESS);
+		}
+
+	while (wait((int *) 0) > 0);
+
+	meter_begin(cell);
+
+	struct meter_cell sum;
+	unsigned int slot = (cell - &meter.seg->cell[0][0][0]) / (METER_OPS * METER_STRIPES);
+	meter_sum(&meter, slot, METER_RETRIEVE, &sum);
+
+	essaye(sum.count == 4000 && sum.inflight == 1 && sum.out == 4 * 500500);
+	essaye(sum.exits[METER_SUCCESS] == 3600 && sum.exits[METER_ABSENT] == 400);
+	essaye(sum.maximum == 1000 && sum.total / sum.count == 500);
+	essaye(meter_quantile(&sum, 500000) >= 500 && meter_quantile(&sum, 500000) < 500 + 500 / METER_SUBBUCKETS + 1);
+	essaye(meter_quantile(&sum, 999000) >= 999 && meter_quantile(&sum, 1000000) == 1000);
+
+	FILE *dump = tmpfile();
+	essaye(dump && meter_dump(&meter, dump));
+
+	char line[256];
+	rewind(dump);
+	essaye(fgets(line, sizeof line, dump) && fgets(line, sizeof line, dump) && !strncmp(line, "sqlite retrieve 4000 1 3600 0 0 400 0 0 2002000 500 ", 52));
+
+	fclose(dump);
+	meter_close(&meter);
+	unlink(path);
+
+	return EXIT_SUCCESS;
+}
+#endif /* TEST */
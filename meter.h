@@ -0,0 +1,211 @@
+#pragma once
+#ifndef OC_METER_H
+#define OC_METER_H
+
+/**
+ * \file
+ *
+ * \brief Storage metrics.
+ *
+ * Metrics live in a shared memory segment, which every process records
+ * into with atomic additions and without locks.  Each module and
+ * operation has a number of stripes, selected by process ID, that are
+ * only summed up when the metrics are read.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * \brief Default metrics segment path.
+ *
+ * It may be overridden through \c METER_PATH.
+ */
+#define METER_PATH "/dev/shm/opencorpus-meter"
+
+/**
+ * \brief Maximum number of modules.
+ */
+#define METER_MODULES 32
+
+/**
+ * \brief Maximum length of module names, including the terminator.
+ */
+#define METER_NAMELEN 32
+
+/**
+ * \brief Number of stripes per module and operation.
+ */
+#define METER_STRIPES 8
+
+/**
+ * \brief Number of linear sub‐buckets per power of two in histograms.
+ */
+#define METER_SUBBUCKETS 8
+
+/**
+ * \brief Number of histogram buckets, covering all 64‐bit values.
+ */
+#define METER_BUCKETS (62 * METER_SUBBUCKETS)
+
+/**
+ * \brief Operations.
+ */
+enum meter_op {
+	METER_ASSAY,
+	METER_RETRIEVE,
+	METER_RANGE,
+	METER_INSPECT,
+	METER_DEPOSIT,
+	METER_EFFACE,
+	METER_OTHER,
+	METER_OPS
+};
+
+/**
+ * \brief Exit status classes.
+ */
+enum meter_exit {
+	METER_SUCCESS,  /**< Exit status 0. */
+	METER_FAILURE,  /**< Exit status 1. */
+	METER_INVALID,  /**< Exit status 2. */
+	METER_ABSENT,   /**< Exit status 3. */
+	METER_ABNORMAL, /**< Any other exit status or termination by signal. */
+	METER_EXITS
+};
+
+/**
+ * \brief Metrics of one module and operation.
+ *
+ * Latencies are recorded in microseconds.  The in‐flight gauge counts
+ * operations begun but not yet ended.
+ */
+struct meter_cell {
+	uint64_t count;                  /**< Number of completed operations. */
+	uint64_t inflight;               /**< Number of operations in flight. */
+	uint64_t in;                     /**< Bytes read by the module. */
+	uint64_t out;                    /**< Bytes written by the module. */
+	uint64_t exits[METER_EXITS];     /**< Completed operations by exit status. */
+	uint64_t total;                  /**< Sum of latencies. */
+	uint64_t maximum;                /**< Maximum latency. */
+	uint64_t bucket[METER_BUCKETS];  /**< Latency histogram. */
+};
+
+/**
+ * \brief Metrics segment.
+ */
+struct meter_segment {
+	uint8_t           magic[8];                                       /**< Magic sequence. */
+	uint32_t          state[METER_MODULES];                           /**< Module slot states. */
+	char              module[METER_MODULES][METER_NAMELEN];           /**< Module names. */
+	struct meter_cell cell[METER_MODULES][METER_OPS][METER_STRIPES]; /**< Metrics. */
+};
+
+/**
+ * \brief Metrics context structure.
+ */
+struct meter {
+	int                   fd;  /**< Segment file descriptor. */
+	struct meter_segment *seg; /**< Segment mapping. */
+};
+
+/**
+ * \brief Open metrics segment, creating it if necessary.
+ *
+ * \param meter Metrics context.
+ * \param path Segment path.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool meter_open(struct meter *restrict meter, const char *restrict path);
+
+/**
+ * \brief Look operation up.
+ *
+ * \param name Operation name.
+ *
+ * \return Operation, \c METER_OTHER for unknown names.
+ */
+extern enum meter_op meter_op(const char *restrict name);
+
+/**
+ * \brief Get operation name.
+ *
+ * \param op Operation.
+ *
+ * \return Operation name, “other” for unknown operations.
+ */
+extern const char *meter_name(enum meter_op op);
+
+/**
+ * \brief Get the calling process’s stripe of a module’s metrics.
+ *
+ * \param meter Metrics context.
+ * \param module Module name.
+ * \param op Operation.
+ *
+ * \return Pointer to the stripe or <tt>(struct meter_cell *) 0</tt> if
+ * there is no room for another module.
+ */
+extern struct meter_cell *meter_cell(struct meter *restrict meter, const char *restrict module, enum meter_op op);
+
+/**
+ * \brief Record beginning of operation.
+ *
+ * \param cell Stripe.
+ */
+extern void meter_begin(struct meter_cell *restrict cell);
+
+/**
+ * \brief Record end of operation.
+ *
+ * \param cell Stripe.
+ * \param latency Latency in microseconds.
+ * \param status Wait status of the module process.
+ * \param in Bytes read by the module.
+ * \param out Bytes written by the module.
+ */
+extern void meter_end(struct meter_cell *restrict cell, uint64_t latency, int status, uint64_t in, uint64_t out);
+
+/**
+ * \brief Sum up the stripes of a module and operation.
+ *
+ * \param meter Metrics context.
+ * \param slot Module slot.
+ * \param op Operation.
+ * \param sum Buffer to hold the sum.
+ */
+extern void meter_sum(const struct meter *restrict meter, unsigned int slot, enum meter_op op, struct meter_cell *restrict sum);
+
+/**
+ * \brief Estimate latency quantile.
+ *
+ * \param cell Metrics.
+ * \param quantile Quantile in parts per million.
+ *
+ * \return Upper bound of the histogram bucket holding the quantile.
+ */
+extern uint64_t meter_quantile(const struct meter_cell *restrict cell, uint64_t quantile);
+
+/**
+ * \brief Write metrics as text.
+ *
+ * Every module and operation with completed or ongoing operations gets
+ * one line of whitespace‐separated fields, preceded by a header line.
+ *
+ * \param meter Metrics context.
+ * \param out Output stream.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool meter_dump(const struct meter *restrict meter, FILE *restrict out);
+
+/**
+ * \brief Close metrics segment.
+ *
+ * \param meter Metrics context.
+ */
+extern void meter_close(struct meter *restrict meter);
+
+#endif /* OC_METER_H */
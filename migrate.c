@@ -0,0 +1,212 @@
+/* pipe2 is a Linux extension */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+
+#include "expect.h"
+#include "path.h"
+#include "skein.h"
+#include "storage.h"
+#include "stream.h"
+#include "string.h"
+#include "sweep.h"
+
+/**
+ * \brief Deposition helper.
+ */
+#define DEPOSIT EXEC_BASE "deposit"
+
+/**
+ * \brief Default number of concurrent transfers.
+ */
+#define PARALLEL_DEFAULT 4
+
+extern char **environ;
+
+/**
+ * \brief Migration state.
+ */
+struct migration {
+	const char *source; /**< Source storage module name. */
+	const char *dest;   /**< Destination storage module name. */
+};
+
+/**
+ * \brief Spawn deposition.
+ *
+ * The deposition leads its own process group, so that an object that
+ * fails verification can be stopped short in every process it starts.
+ *
+ * \param pid Pointer to process ID variable.
+ * \param dest Storage module name.
+ * \param idstr Object identifier string.
+ * \param in Input file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool launch(pid_t *restrict pid, const char *restrict dest, const char *restrict idstr, int in) {
+	posix_spawn_file_actions_t file_actions;
+	posix_spawnattr_t attr;
+	sigset_t sigdef;
+
+	/* Undo ignoring SIGPIPE here */
+	sigemptyset(&sigdef);
+	sigaddset(&sigdef, SIGPIPE);
+
+	if (unlikely(posix_spawn_file_actions_init(&file_actions)))
+		return false;
+
+	if (unlikely(posix_spawnattr_init(&attr))) {
+		posix_spawn_file_actions_destroy(&file_actions);
+		return false;
+	}
+
+	const char *argv[] = { "deposit", dest, idstr, (char *) 0 };
+
+	bool result =
+		!posix_spawn_file_actions_adddup2(&file_actions, in, 0) &&
+		!posix_spawn_file_actions_addopen(&file_actions, 1, "/dev/null", O_WRONLY, 0) &&
+		!posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF) &&
+		!posix_spawnattr_setpgroup(&attr, 0) &&
+		!posix_spawnattr_setsigdefault(&attr, &sigdef) &&
+		!(errno = posix_spawn(pid, DEPOSIT, &file_actions, &attr, (char **) argv, environ));
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&file_actions);
+
+	return result;
+}
+
+/**
+ * \brief Transfer object.
+ *
+ * The object is retrieved through a pipe, bypassing the object cache,
+ * and fed into the deposition as it is hashed.  Only once the whole object was found to hash to its
+ * identifier is the deposition allowed to see the end of its input.
+ *
+ * \param arg Migration state.
+ * \param ident Object identifier.
+ * \param buf Transfer buffer of \c SWEEP_CHUNK bytes.
+ *
+ * \return Outcome.
+ */
+static enum sweep_outcome transfer(void *restrict arg, const uint8_t ident[restrict 32], uint8_t *restrict buf) {
+	const struct migration *mig = arg;
+	char idstr[32 * 2 + 1];
+	inthexs(idstr, ident, 32);
+
+	int src[2], sink[2];
+	pid_t fetcher, depositor;
+
+	if (unlikely(pipe2(src, O_CLOEXEC)))
+		return SWEEP_FAILED;
+
+	bool result = retrieve_uncached(&fetcher, mig->source, ident, 2, src[1]);
+	close(src[1]);
+
+	if (unlikely(!result)) {
+		close(src[0]);
+		return SWEEP_FAILED;
+	}
+
+	if (unlikely(pipe2(sink, O_CLOEXEC))) {
+		close(src[0]);
+		sweep_reap(fetcher);
+		return SWEEP_FAILED;
+	}
+
+	bool launched = launch(&depositor, mig->dest, idstr, sink[0]);
+	close(sink[0]);
+
+	struct skein ctx;
+	bool fault = !launched;
+
+	skein_init(&ctx);
+
+	while (!fault) {
+		ssize_t fill = read(src[0], buf, SWEEP_CHUNK);
+
+		if (fill < 0 && errno == EINTR)
+			continue;
+
+		if (fill <= 0) {
+			fault = fill < 0;
+			break;
+		}
+
+		skein_feed(&ctx, buf, fill);
+		fault = !stream_write(sink[1], buf, fill);
+	}
+
+	close(src[0]);
+
+	int status = sweep_reap(fetcher);
+
+	uint8_t hash[SKEIN_BYTES];
+	skein_plug(&ctx, hash);
+
+	enum sweep_outcome outcome = fault || status != EXIT_SUCCESS ? status == 3 ? SWEEP_MISSING : SWEEP_FAILED :
+		memcmp(hash, ident, 32) ? SWEEP_CORRUPT : SWEEP_DONE;
+
+	/* Nothing is deposited unless it was verified */
+	if (outcome != SWEEP_DONE && launched)
+		kill(-depositor, SIGTERM);
+
+	close(sink[1]);
+
+	if (launched && sweep_reap(depositor) != EXIT_SUCCESS && outcome == SWEEP_DONE)
+		outcome = SWEEP_FAILED;
+
+	return outcome;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * Objects listed in the source module are migrated into the destination
+ * module, with up to \c MIGRATE_PARALLEL transfers in flight.  Only
+ * deposited objects are recorded in the checkpoint, so missing and
+ * corrupt ones are tried again by the next run.  Transfers in flight
+ * are completed when stopped.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector: source module, destination module and checkpoint file.
+ *
+ * \return EXIT_SUCCESS if every listed object was migrated or EXIT_FAILURE otherwise.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc != 4)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	struct migration mig = {
+		.source = argv[1],
+		.dest   = argv[2]
+	};
+
+	struct sweep job = {
+		.module  = mig.source,
+		.name    = "migrated",
+		.settled = 1u << SWEEP_DONE,
+		.threads = setting("MIGRATE_PARALLEL", PARALLEL_DEFAULT),
+		.arg     = &mig,
+		.visit   = transfer
+	};
+
+	/* A deposition going away is noticed as a write error */
+	signal(SIGPIPE, SIG_IGN);
+
+	return sweep(&job, argv[3]);
+}
@@ -0,0 +1,1205 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "binary.h"
+#include "endian.h"
+#include "expect.h"
+#include "index.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Segment size beyond which no more objects are appended.
+ */
+#define SEGMENT_LIMIT (UINT64_C(1) << 30)
+
+/**
+ * \brief Segment file name format.
+ */
+#define SEGMENT_NAME "segment-%08" PRIx32
+
+/**
+ * \brief Length of segment file names.
+ */
+#define SEGMENT_NAMELEN (sizeof "segment-" - 1 + 8)
+
+/**
+ * \brief Index file name.
+ */
+#define INDEX_NAME "index"
+
+/**
+ * \brief Record alignment.
+ */
+#define RECORD_ALIGN 8
+
+/**
+ * \brief Object record.
+ */
+#define RECORD_OBJECT UINT32_C(1)
+
+/**
+ * \brief Effacement record.
+ */
+#define RECORD_EFFACED UINT32_C(2)
+
+/**
+ * \brief Index flag for effacement records seen during rebuild.
+ */
+#define PACK_EFFACED INDEX_USER
+
+/**
+ * \brief Index state word holding the first segment that may accept appends.
+ */
+#define STATE_SEGMENT 0
+
+/**
+ * \brief Index state word holding the first segment number never used.
+ *
+ * Segment numbers are not reused once compaction removed a segment, so
+ * that index entries still naming it can never find another segment.
+ */
+#define STATE_NEXT 1
+
+/**
+ * \brief Record header.
+ *
+ * Every record is preceded by this header in little‐endian byte‐order
+ * and padded to \c RECORD_ALIGN bytes.  The header is written after the
+ * object data, so a record without a valid header is never indexed.
+ */
+struct record {
+	uint8_t  mark[8];   /**< Record mark. */
+	uint8_t  ident[32]; /**< Object identifier. */
+	uint64_t length;    /**< Object length. */
+	uint64_t time;      /**< Deposit time in nanoseconds. */
+	uint32_t kind;      /**< Record kind. */
+	uint32_t sum;       /**< Header checksum. */
+};
+
+/**
+ * \brief Record mark.
+ */
+static const uint8_t mark[8] = {
+	UINT8_C(0x4f), UINT8_C(0x43), UINT8_C(0x50), UINT8_C(0x41),
+	UINT8_C(0x43), UINT8_C(0x4b), UINT8_C(0x00), UINT8_C(0x01)
+};
+
+/**
+ * \brief Live object location.
+ */
+struct live {
+	uint64_t offset;  /**< Record offset in the old segment. */
+	uint64_t moved;   /**< Record offset in the new segment. */
+	uint32_t segment; /**< New segment number. */
+};
+
+/**
+ * \brief I/O buffer.
+ */
+static uint8_t buf[STREAM_BUFSIZE];
+
+/**
+ * \brief Round up to record alignment.
+ *
+ * \param size Size to round.
+ *
+ * \return Rounded size.
+ */
+static inline uint64_t align(uint64_t size) {
+	return size + RECORD_ALIGN - 1 & ~(uint64_t) (RECORD_ALIGN - 1);
+}
+
+/**
+ * \brief Get current time.
+ *
+ * \return Nanoseconds since the epoch.
+ */
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t) ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/**
+ * \brief Compute record header checksum.
+ *
+ * The checksum is seeded with the record location, so that copies of
+ * records embedded in object data are not mistaken for records.
+ *
+ * \param rec Record header.
+ * \param segment Segment number.
+ * \param offset Record offset.
+ *
+ * \return Checksum.
+ */
+static uint32_t record_sum(const struct record *restrict rec, uint32_t segment, uint64_t offset) {
+	const uint8_t *byte = (const uint8_t *) rec;
+
+	/* FNV‐1a */
+	uint32_t sum = UINT32_C(0x811c9dc5) ^ segment ^ (uint32_t) offset ^ (uint32_t) (offset >> 32);
+	for (size_t iter = 0; iter < offsetof(struct record, sum); ++iter) {
+		sum ^= byte[iter];
+		sum *= UINT32_C(0x01000193);
+	}
+
+	return sum;
+}
+
+/**
+ * \brief Read and validate record header.
+ *
+ * \param fd Segment file descriptor.
+ * \param segment Segment number.
+ * \param offset Record offset.
+ * \param size Segment size.
+ * \param rec Buffer to hold header in native byte‐order.
+ *
+ * \return \c true if there is a valid record or \c false otherwise.
+ */
+static bool record_read(int fd, uint32_t segment, uint64_t offset, uint64_t size, struct record *restrict rec) {
+	if (offset + sizeof *rec > size ||
+		pread(fd, rec, sizeof *rec, offset) != sizeof *rec ||
+		memcmp(rec->mark, mark, sizeof mark) ||
+		le32(rec->sum) != record_sum(rec, segment, offset))
+		return false;
+
+	rec->length = le64(rec->length);
+	rec->time   = le64(rec->time);
+	rec->kind   = le32(rec->kind);
+
+	return offset + sizeof *rec + rec->length <= size;
+}
+
+/**
+ * \brief Write record header.
+ *
+ * \param fd Segment file descriptor.
+ * \param segment Segment number.
+ * \param offset Record offset.
+ * \param ident Object identifier.
+ * \param length Object length.
+ * \param stamp Deposit time.
+ * \param kind Record kind.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool record_write(int fd, uint32_t segment, uint64_t offset, const uint8_t ident[restrict 32], uint64_t length, uint64_t stamp, uint32_t kind) {
+	struct record rec;
+
+	memcpy(rec.mark, mark, sizeof mark);
+	memcpy(rec.ident, ident, sizeof rec.ident);
+	rec.length = le64(length);
+	rec.time   = le64(stamp);
+	rec.kind   = le32(kind);
+	rec.sum    = le32(record_sum(&rec, segment, offset));
+
+	return pwrite(fd, &rec, sizeof rec, offset) == sizeof rec;
+}
+
+/**
+ * \brief Open segment.
+ *
+ * \param segment Segment number.
+ * \param flags File status flags.
+ *
+ * \return File descriptor or -1 on failure.
+ */
+static int segment_open(uint32_t segment, int flags) {
+	char name[SEGMENT_NAMELEN + 1];
+	snprintf(name, sizeof name, SEGMENT_NAME, segment);
+	return open(name, flags, 0644);
+}
+
+/**
+ * \brief Parse segment file name.
+ *
+ * \param name File name.
+ * \param segment Pointer to segment number variable.
+ *
+ * \return \c true if \a name is a segment file name or \c false otherwise.
+ */
+static bool segment_parse(const char *restrict name, uint32_t *restrict segment) {
+	uint8_t num[4];
+
+	if (strlen(name) != SEGMENT_NAMELEN || strncmp(name, "segment-", SEGMENT_NAMELEN - 8) ||
+		!hexsint(num, name + SEGMENT_NAMELEN - 8, sizeof num))
+		return false;
+
+	*segment = (uint32_t) num[0] << 24 | (uint32_t) num[1] << 16 | (uint32_t) num[2] << 8 | num[3];
+	return true;
+}
+
+/**
+ * \brief Acquire segment for appending.
+ *
+ * Segments are locked exclusively while appending, so that concurrent
+ * writers spread over several segments.
+ *
+ * \param segment Pointer to segment number variable holding the first candidate.
+ * \param skip Segment number that must not be used.
+ * \param next First segment number never used, below which no segment is created.
+ * \param end Pointer to variable receiving the append offset.
+ *
+ * \return Locked file descriptor or -1 on failure.
+ */
+static int segment_acquire(uint32_t *restrict segment, uint32_t skip, uint32_t next, uint64_t *restrict end) {
+	for (;; ++*segment) {
+		if (*segment == skip)
+			continue;
+
+		int fd = segment_open(*segment, *segment < next ? O_RDWR : O_RDWR | O_CREAT);
+		if (fd < 0) {
+			/* Segment was removed by compaction */
+			if (errno == ENOENT)
+				continue;
+
+			return -1;
+		}
+
+		struct flock lock = {
+			.l_type   = F_WRLCK,
+			.l_whence = SEEK_SET,
+			.l_start  = 0,
+			.l_len    = 0
+		};
+
+		if (fcntl(fd, F_SETLK, &lock)) {
+			int errnum = errno;
+			close(fd);
+
+			if (errnum == EACCES || errnum == EAGAIN)
+				continue;
+
+			errno = errnum;
+			return -1;
+		}
+
+		struct stat st;
+		if (unlikely(fstat(fd, &st))) {
+			close(fd);
+			return -1;
+		}
+
+		/* Segment was removed by compaction meanwhile */
+		if (unlikely(!st.st_nlink)) {
+			close(fd);
+			continue;
+		}
+
+		if ((uint64_t) st.st_size >= SEGMENT_LIMIT) {
+			close(fd);
+			continue;
+		}
+
+		if ((uint64_t) st.st_size < sizeof magic) {
+			if (unlikely(pwrite(fd, magic, sizeof magic, 0) != sizeof magic)) {
+				close(fd);
+				return -1;
+			}
+
+			*end = sizeof magic;
+		}
+
+		else
+			*end = align(st.st_size);
+
+		return fd;
+	}
+}
+
+/**
+ * \brief Segment list entry.
+ */
+struct segment {
+	uint32_t num;  /**< Segment number. */
+	uint64_t size; /**< Segment size. */
+};
+
+/**
+ * \brief Compare segment list entries.
+ */
+static int segment_compare(const void *a, const void *b) {
+	const struct segment *x = a, *y = b;
+	return x->num < y->num ? -1 : x->num > y->num;
+}
+
+/**
+ * \brief List segments.
+ *
+ * \param num Pointer to variable receiving the number of segments.
+ *
+ * \return Sorted segment list to be passed to \c free or <tt>(struct segment *) 0</tt> on failure.
+ */
+static struct segment *segment_list(size_t *restrict num) {
+	DIR *dir = opendir(".");
+	if (unlikely(!dir))
+		return (struct segment *) 0;
+
+	struct segment *list = (struct segment *) 0;
+	size_t size = 0;
+
+	*num = 0;
+
+	for (struct dirent *ent; errno = 0, ent = readdir(dir);) {
+		uint32_t segment;
+		struct stat st;
+
+		if (!segment_parse(ent->d_name, &segment) || stat(ent->d_name, &st))
+			continue;
+
+		if (*num == size) {
+			size = size ? size * 2 : 64;
+
+			struct segment *nlist = realloc(list, size * sizeof *list);
+			if (unlikely(!nlist)) {
+				free(list);
+				closedir(dir);
+				return (struct segment *) 0;
+			}
+
+			list = nlist;
+		}
+
+		list[(*num)++] = (struct segment) { .num = segment, .size = st.st_size };
+	}
+
+	closedir(dir);
+
+	if (!list)
+		list = malloc(1);
+
+	if (list)
+		qsort(list, *num, sizeof *list, segment_compare);
+
+	return list;
+}
+
+/**
+ * \brief Rebuild index from segment headers.
+ *
+ * \param idx Writable index.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool rebuild(struct index *restrict idx) {
+	size_t num;
+	struct segment *list = segment_list(&num);
+	if (unlikely(!list)) {
+		perror("Unable to list segments");
+		return false;
+	}
+
+	index_reset(idx);
+
+	for (size_t iter = 0; iter < num; ++iter) {
+		int fd = segment_open(list[iter].num, O_RDONLY);
+		if (unlikely(fd < 0))
+			continue;
+
+		uint8_t head[sizeof magic];
+		if (pread(fd, head, sizeof head, 0) != sizeof head || memcmp(head, magic, sizeof magic)) {
+			fprintf(stderr, "Ignoring damaged segment %08" PRIx32 "\n", list[iter].num);
+			close(fd);
+			continue;
+		}
+
+		for (uint64_t offset = sizeof magic; offset < list[iter].size;) {
+			struct record rec;
+
+			/* Resynchronise after records of failed deposits */
+			if (!record_read(fd, list[iter].num, offset, list[iter].size, &rec)) {
+				offset += RECORD_ALIGN;
+				continue;
+			}
+
+			struct index_entry *entry = index_find(idx, rec.ident);
+
+			/* The most recent record prevails */
+			if (!entry || entry->time <= rec.time) {
+				entry = index_insert(idx, rec.ident);
+				if (unlikely(!entry)) {
+					perror("Unable to insert index entry");
+					close(fd);
+					free(list);
+					return false;
+				}
+
+				entry->offset = offset;
+				entry->length = rec.length;
+				entry->stored = rec.length;
+				entry->time   = rec.time;
+				entry->aux    = list[iter].num;
+				entry->flags  = INDEX_USED | (rec.kind == RECORD_EFFACED ? PACK_EFFACED : 0);
+			}
+
+			offset += align(sizeof rec + rec.length);
+		}
+
+		close(fd);
+	}
+
+	idx->head->state[STATE_NEXT] = num ? (uint64_t) list[num - 1].num + 1 : 0;
+
+	free(list);
+
+	/* Drop effaced objects */
+	for (uint64_t iter = 0; iter < idx->head->slots;) {
+		if (idx->slot[iter].flags & PACK_EFFACED)
+			index_remove(idx, &idx->slot[iter]);
+		else
+			++iter;
+	}
+
+	idx->dirty = false;
+
+	return true;
+}
+
+/**
+ * \brief Open index and rebuild it if required.
+ *
+ * \param idx Index context.
+ * \param write Open for writing.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool pack_index(struct index *restrict idx, bool write) {
+	if (index_open(idx, INDEX_NAME, write)) {
+		if (!idx->dirty)
+			return true;
+
+		if (!write)
+			index_close(idx);
+	}
+
+	else if (errno != EINVAL)
+		return false;
+
+	/* The index is damaged or was left behind by a crashed writer */
+	if (!write && unlikely(!index_open(idx, INDEX_NAME, true)))
+		return false;
+
+	if (idx->dirty && unlikely(!rebuild(idx))) {
+		index_close(idx);
+		return false;
+	}
+
+	if (write)
+		return true;
+
+	index_close(idx);
+
+	return index_open(idx, INDEX_NAME, false);
+}
+
+/**
+ * \brief Look object up.
+ *
+ * \param ident Object identifier.
+ * \param entry Buffer to hold the index entry.
+ *
+ * \return 0 if found, 3 if not found or \c EXIT_FAILURE on failure.
+ */
+static int lookup(const uint8_t ident[restrict 32], struct index_entry *restrict entry) {
+	struct index idx;
+	if (!pack_index(&idx, false)) {
+		if (errno == ENOENT)
+			return 3;
+
+		perror("Unable to open index");
+		return EXIT_FAILURE;
+	}
+
+	const struct index_entry *found = index_find(&idx, ident);
+	if (found)
+		*entry = *found;
+
+	index_close(&idx);
+
+	return found ? EXIT_SUCCESS : 3;
+}
+
+/**
+ * \brief Copy object data.
+ *
+ * \param out Output file descriptor.
+ * \param in Input file descriptor.
+ * \param offset Input offset.
+ * \param length Number of bytes to copy.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool copy(int out, int in, uint64_t offset, uint64_t length) {
+	while (length) {
+		ssize_t fill = pread(in, buf, length > sizeof buf ? sizeof buf : length, offset);
+		if (unlikely(fill <= 0)) {
+			if (fill < 0 && errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		if (unlikely(!stream_write(out, buf, fill)))
+			return false;
+
+		offset += fill;
+		length -= fill;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Retrieve byte range of object.
+ *
+ * \param ident Object identifier.
+ * \param offset Offset of first byte.
+ * \param length Maximum number of bytes.
+ */
+static int op_retrieve(const uint8_t ident[restrict 32], uint64_t offset, uint64_t length) {
+	for (unsigned int attempt = 0; attempt < 2; ++attempt) {
+		struct index_entry entry;
+
+		int rc = lookup(ident, &entry);
+		if (rc != EXIT_SUCCESS)
+			return rc;
+
+		int fd = segment_open(entry.aux, O_RDONLY);
+		if (unlikely(fd < 0)) {
+			/* The object may have been moved by compaction */
+			if (errno == ENOENT)
+				continue;
+
+			perror("Unable to open segment");
+			return EXIT_FAILURE;
+		}
+
+		struct stat st;
+		struct record rec;
+
+		/* Never send anything but the record the index points at */
+		if (unlikely(fstat(fd, &st) || !record_read(fd, entry.aux, entry.offset, st.st_size, &rec) ||
+			rec.kind != RECORD_OBJECT || rec.length != entry.length || memcmp(rec.ident, ident, sizeof rec.ident))) {
+			close(fd);
+			continue;
+		}
+
+		/* Clip range to object */
+		if (offset > entry.length)
+			offset = entry.length;
+
+		if (length > entry.length - offset)
+			length = entry.length - offset;
+
+		if (unlikely(!stream_send(1, fd, entry.offset + sizeof (struct record) + offset, length))) {
+			perror("Unable to send object");
+			close(fd);
+			return EXIT_FAILURE;
+		}
+
+		close(fd);
+		return EXIT_SUCCESS;
+	}
+
+	fputs("Object vanished during retrieval!\n", stderr);
+	return EXIT_FAILURE;
+}
+
+/**
+ * \brief Describe object.
+ *
+ * \param ident Object identifier.
+ * \param dir Storage directory.
+ */
+static int op_inspect(const uint8_t ident[restrict 32], const char *restrict dir) {
+	struct index_entry entry;
+
+	int rc = lookup(ident, &entry);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	printf("%" PRIu64 " %" PRIu64 " %" PRIu64 " %s/" SEGMENT_NAME "@%" PRIu64 "\n",
+		entry.length, entry.stored, entry.time, dir, entry.aux, entry.offset + sizeof (struct record));
+
+	if (unlikely(fflush(stdout))) {
+		perror("Unable to write description");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Deposit object.
+ */
+static int op_deposit(const uint8_t ident[restrict 32]) {
+	struct index idx;
+	uint32_t segment = 0, next = 0;
+
+	/* Start at the first segment known to accept appends */
+	if (index_open(&idx, INDEX_NAME, false)) {
+		segment = idx.head->state[STATE_SEGMENT];
+		next    = idx.head->state[STATE_NEXT];
+		index_close(&idx);
+	}
+
+	uint64_t offset;
+	int fd = segment_acquire(&segment, UINT32_MAX, next, &offset);
+	if (unlikely(fd < 0)) {
+		perror("Unable to acquire segment");
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(lseek(fd, offset + sizeof (struct record), SEEK_SET) < 0)) {
+		perror("Unable to seek in segment");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	/* Append object data */
+	uint64_t length = 0;
+	for (;;) {
+		ssize_t fill = stream_read(0, buf, sizeof buf);
+		if (unlikely(fill < 0)) {
+			perror("Read error");
+			goto failure;
+		}
+
+		if (!fill)
+			break;
+
+		if (unlikely(!stream_write(fd, buf, fill))) {
+			perror("Write error");
+			goto failure;
+		}
+
+		length += fill;
+	}
+
+	/* Close standard input */
+	close(0);
+
+	uint64_t stamp = now();
+
+	/* Commit record */
+	if (unlikely(!record_write(fd, segment, offset, ident, length, stamp, RECORD_OBJECT) || fdatasync(fd))) {
+		perror("Unable to commit record");
+		goto failure;
+	}
+
+	if (unlikely(!pack_index(&idx, true))) {
+		perror("Unable to open index");
+		goto failure;
+	}
+
+	struct index_entry *entry = index_insert(&idx, ident);
+	if (unlikely(!entry)) {
+		perror("Unable to insert index entry");
+		index_close(&idx);
+		goto failure;
+	}
+
+	entry->offset = offset;
+	entry->length = length;
+	entry->stored = length;
+	entry->time   = stamp;
+	entry->aux    = segment;
+
+	/* Let subsequent writers skip full segments */
+	if (offset + sizeof (struct record) + length >= SEGMENT_LIMIT && idx.head->state[STATE_SEGMENT] <= segment)
+		idx.head->state[STATE_SEGMENT] = segment + 1;
+
+	if (idx.head->state[STATE_NEXT] <= segment)
+		idx.head->state[STATE_NEXT] = segment + 1;
+
+	index_close(&idx);
+	close(fd);
+
+	return EXIT_SUCCESS;
+
+failure:
+	/* Discard partial record */
+	if (ftruncate(fd, offset))
+		perror("Unable to discard partial record");
+
+	close(fd);
+
+	return EXIT_FAILURE;
+}
+
+/**
+ * \brief Efface object.
+ */
+static int op_efface(const uint8_t ident[restrict 32]) {
+	struct index idx;
+	if (unlikely(!pack_index(&idx, true))) {
+		perror("Unable to open index");
+		return EXIT_FAILURE;
+	}
+
+	struct index_entry *entry = index_find(&idx, ident);
+	if (!entry) {
+		index_close(&idx);
+		return EXIT_SUCCESS;
+	}
+
+	/* Record effacement, so that it survives index rebuilds */
+	uint32_t segment = idx.head->state[STATE_SEGMENT];
+	uint64_t offset;
+
+	int fd = segment_acquire(&segment, UINT32_MAX, idx.head->state[STATE_NEXT], &offset);
+	if (unlikely(fd < 0)) {
+		perror("Unable to acquire segment");
+		index_close(&idx);
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(!record_write(fd, segment, offset, ident, 0, now(), RECORD_EFFACED) || fdatasync(fd))) {
+		perror("Unable to commit record");
+		index_close(&idx);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	index_remove(&idx, entry);
+
+	if (idx.head->state[STATE_NEXT] <= segment)
+		idx.head->state[STATE_NEXT] = segment + 1;
+
+	index_close(&idx);
+	close(fd);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Check whether record survives compaction.
+ *
+ * Live records are sorted by offset and visited in order.
+ *
+ * \param rec Record header.
+ * \param offset Record offset.
+ * \param live Locations of live records.
+ * \param num Number of live records.
+ * \param next Pointer to index of the next live record to consider.
+ *
+ * \return Matching live record, \a live + \a num for effacement records
+ * or <tt>(struct live *) 0</tt> if the record is dead.
+ */
+static struct live *survivor(const struct record *restrict rec, uint64_t offset, struct live *restrict live, size_t num, size_t *restrict next) {
+	while (*next < num && live[*next].offset < offset)
+		++*next;
+
+	if (*next < num && live[*next].offset == offset)
+		return &live[*next];
+
+	return rec->kind == RECORD_EFFACED ? live + num : (struct live *) 0;
+}
+
+/**
+ * \brief Compact segment.
+ *
+ * Live records and effacement records are copied to other segments, the
+ * index is updated and the old segment is removed, provided that at
+ * least half of it is dead.  Index entries left naming the old segment
+ * are dropped, since their records are gone.  Readers that still hold
+ * the old segment open are unaffected.
+ *
+ * \param victim Segment number.
+ * \param in Segment file descriptor, locked against appends.
+ * \param size Segment size.
+ * \param limit First segment number never used.
+ * \param live Locations of live records, sorted by offset.
+ * \param num Number of live records.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool compact(uint32_t victim, int in, uint64_t size, uint32_t limit, struct live *restrict live, size_t num) {
+	if (size <= sizeof magic)
+		return true;
+
+	/* Count what would be copied */
+	uint64_t keep = 0;
+	size_t next = 0;
+
+	for (uint64_t offset = sizeof magic; offset < size;) {
+		struct record rec;
+
+		if (!record_read(in, victim, offset, size, &rec)) {
+			offset += RECORD_ALIGN;
+			continue;
+		}
+
+		if (survivor(&rec, offset, live, num, &next))
+			keep += align(sizeof rec + rec.length);
+
+		offset += align(sizeof rec + rec.length);
+	}
+
+	if (keep >= size - sizeof magic || keep * 2 > size - sizeof magic)
+		return true;
+
+	uint32_t segment = 0, first = UINT32_MAX;
+	uint64_t end = 0;
+	int out = -1;
+
+	next = 0;
+
+	for (uint64_t offset = sizeof magic; offset < size;) {
+		struct record rec;
+
+		if (!record_read(in, victim, offset, size, &rec)) {
+			offset += RECORD_ALIGN;
+			continue;
+		}
+
+		struct live *found = survivor(&rec, offset, live, num, &next);
+
+		if (found) {
+			/* Move on once the output segment is full */
+			if (out >= 0 && end > sizeof magic && end + sizeof rec + rec.length >= SEGMENT_LIMIT) {
+				if (unlikely(fdatasync(out))) {
+					close(out);
+					return false;
+				}
+
+				close(out);
+				out = -1;
+				++segment;
+			}
+
+			if (out < 0) {
+				if (unlikely((out = segment_acquire(&segment, victim, limit, &end)) < 0))
+					return false;
+
+				if (first == UINT32_MAX)
+					first = segment;
+			}
+
+			if (unlikely(lseek(out, end + sizeof rec, SEEK_SET) < 0 ||
+				!copy(out, in, offset + sizeof rec, rec.length) ||
+				!record_write(out, segment, end, rec.ident, rec.length, rec.time, rec.kind))) {
+				if (ftruncate(out, end))
+					perror("Unable to discard partial record");
+
+				close(out);
+				return false;
+			}
+
+			if (found < live + num) {
+				found->segment = segment;
+				found->moved   = end;
+			}
+
+			end = align(end + sizeof rec + rec.length);
+		}
+
+		offset += align(sizeof rec + rec.length);
+	}
+
+	if (out >= 0 && unlikely(fdatasync(out))) {
+		close(out);
+		return false;
+	}
+
+	/* Point index at the copies */
+	struct index idx;
+	if (unlikely(!pack_index(&idx, true))) {
+		if (out >= 0)
+			close(out);
+
+		return false;
+	}
+
+	for (uint64_t iter = 0; iter < idx.head->slots;) {
+		struct index_entry *entry = &idx.slot[iter];
+
+		if (!(entry->flags & INDEX_USED) || entry->aux != victim) {
+			++iter;
+			continue;
+		}
+
+		size_t low = 0, high = num;
+		while (low < high) {
+			size_t mid = low + (high - low) / 2;
+
+			if (live[mid].offset < entry->offset)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+
+		if (low < num && live[low].offset == entry->offset && live[low].moved) {
+			entry->aux    = live[low].segment;
+			entry->offset = live[low].moved;
+			++iter;
+		}
+
+		/* Removal moves a later entry into this slot */
+		else
+			index_remove(&idx, entry);
+	}
+
+	if (idx.head->state[STATE_SEGMENT] > first)
+		idx.head->state[STATE_SEGMENT] = first;
+
+	/* Neither the old segment nor the new ones may be reused */
+	if (idx.head->state[STATE_NEXT] <= victim)
+		idx.head->state[STATE_NEXT] = (uint64_t) victim + 1;
+
+	if (first != UINT32_MAX && idx.head->state[STATE_NEXT] <= segment)
+		idx.head->state[STATE_NEXT] = (uint64_t) segment + 1;
+
+	char name[SEGMENT_NAMELEN + 1];
+	snprintf(name, sizeof name, SEGMENT_NAME, victim);
+
+	bool result = !unlink(name);
+
+	index_close(&idx);
+
+	if (out >= 0)
+		close(out);
+
+	return result;
+}
+
+/**
+ * \brief Compare live record locations.
+ */
+static int live_compare(const void *a, const void *b) {
+	const struct live *x = a, *y = b;
+	return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+/**
+ * \brief Compact segments that are at least half dead.
+ */
+static int op_compact(void) {
+	size_t num;
+	struct segment *list = segment_list(&num);
+	if (unlikely(!list)) {
+		perror("Unable to list segments");
+		return EXIT_FAILURE;
+	}
+
+	int rc = EXIT_SUCCESS;
+
+	for (size_t iter = 0; iter < num; ++iter) {
+		int in = segment_open(list[iter].num, O_RDWR);
+		if (in < 0)
+			continue;
+
+		struct flock lock = {
+			.l_type   = F_WRLCK,
+			.l_whence = SEEK_SET,
+			.l_start  = 0,
+			.l_len    = 0
+		};
+
+		/* Leave segments alone that are being appended to, and keep
+		 * appends out of the others before taking stock of them */
+		struct stat st;
+		if (fcntl(in, F_SETLK, &lock) || fstat(in, &st) || !st.st_nlink) {
+			close(in);
+			continue;
+		}
+
+		struct index idx;
+		if (unlikely(!pack_index(&idx, false))) {
+			close(in);
+
+			if (errno == ENOENT)
+				break;
+
+			perror("Unable to open index");
+			rc = EXIT_FAILURE;
+			break;
+		}
+
+		/* Collect live records of segment */
+		size_t count = 0, size = 64;
+		struct live *live = malloc(size * sizeof *live);
+
+		for (uint64_t slot = 0; live && slot < idx.head->slots; ++slot) {
+			const struct index_entry *entry = &idx.slot[slot];
+
+			if (!(entry->flags & INDEX_USED) || entry->aux != list[iter].num)
+				continue;
+
+			if (count == size) {
+				struct live *nlive = realloc(live, (size *= 2) * sizeof *live);
+				if (unlikely(!nlive)) {
+					free(live);
+					live = (struct live *) 0;
+					break;
+				}
+
+				live = nlive;
+			}
+
+			live[count++] = (struct live) { .offset = entry->offset, .moved = 0 };
+		}
+
+		uint32_t next = idx.head->state[STATE_NEXT];
+		index_close(&idx);
+
+		if (unlikely(!live)) {
+			perror("Unable to collect live records");
+			close(in);
+			rc = EXIT_FAILURE;
+			break;
+		}
+
+		qsort(live, count, sizeof *live, live_compare);
+
+		if (unlikely(!compact(list[iter].num, in, st.st_size, next, live, count))) {
+			fprintf(stderr, "Unable to compact segment %08" PRIx32 ": %s\n", list[iter].num, strerror(errno));
+			rc = EXIT_FAILURE;
+		}
+
+		free(live);
+		close(in);
+	}
+
+	free(list);
+
+	return rc;
+}
+
+/**
+ * \brief Rebuild index unconditionally.
+ */
+static int op_rebuild(void) {
+	struct index idx;
+	if (unlikely(!index_open(&idx, INDEX_NAME, true))) {
+		perror("Unable to open index");
+		return EXIT_FAILURE;
+	}
+
+	bool result = rebuild(&idx);
+	index_close(&idx);
+
+	return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * \brief List identifiers of all objects.
+ */
+static int op_list(void) {
+	struct index idx;
+	if (!pack_index(&idx, false)) {
+		if (errno == ENOENT)
+			return EXIT_SUCCESS;
+
+		perror("Unable to open index");
+		return EXIT_FAILURE;
+	}
+
+	size_t count;
+	uint8_t (*idents)[32] = index_idents(&idx, &count);
+	index_close(&idx);
+
+	if (unlikely(!idents)) {
+		perror("Unable to list objects");
+		return EXIT_FAILURE;
+	}
+
+	char name[32 * 2 + 1];
+	for (size_t iter = 0; iter < count; ++iter) {
+		inthexs(name, idents[iter], sizeof idents[iter]);
+		puts(name);
+	}
+
+	free(idents);
+
+	if (unlikely(fflush(stdout) || ferror(stdout))) {
+		perror("Unable to write identifiers");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector.
+ *
+ * \return EXIT_SUCCESS if successful or any other value on failure.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc != 6 && argc != 8)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	/* Change to storage directory */
+	if (unlikely(chdir(argv[1]))) {
+		perror("Unable to change to storage directory");
+		return EXIT_FAILURE;
+	}
+
+	/* Maintenance operations do not refer to an object */
+	if (!strcmp(argv[5], "compact"))
+		return op_compact();
+
+	else if (!strcmp(argv[5], "rebuild"))
+		return op_rebuild();
+
+	else if (!strcmp(argv[5], "list"))
+		return op_list();
+
+	uint8_t ident[32];
+	if (!hexsint(ident, argv[4], sizeof ident)) {
+		perror("Failed to parse identifier");
+		return EXIT_FAILURE;
+	}
+
+	/* Parse operation string */
+	if (!strcmp(argv[5], "assay")) {
+		struct index_entry entry;
+		return lookup(ident, &entry);
+	}
+
+	else if (!strcmp(argv[5], "retrieve"))
+		return op_retrieve(ident, 0, UINT64_MAX);
+
+	else if (!strcmp(argv[5], "range")) {
+		uint64_t offset, length;
+
+		if (unlikely(argc != 8 || !decsint(&offset, argv[6]) || !decsint(&length, argv[7]))) {
+			fputs("Invalid byte range!\n", stderr);
+			return EXIT_FAILURE;
+		}
+
+		return op_retrieve(ident, offset, length);
+	}
+
+	else if (!strcmp(argv[5], "inspect"))
+		return op_inspect(ident, argv[1]);
+
+	else if (!strcmp(argv[5], "deposit"))
+		return op_deposit(ident);
+
+	else if (!strcmp(argv[5], "efface"))
+		return op_efface(ident);
+
+	else {
+		fprintf(stderr, "Invalid storage operation “%s”!\n", argv[5]);
+		return 2;
+	}
+}
@@ -0,0 +1,577 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "expect.h"
+#include "patch.h"
+
+/**
+ * \brief Shortest match worth a copy instruction.
+ */
+#define BLOCK 16
+
+/**
+ * \brief Size of I/O buffers.
+ */
+#define BUFSIZE (1 << 16)
+
+/**
+ * \brief Rolling hash multiplier.
+ */
+#define PRIME UINT64_C(0x100000001b3)
+
+/**
+ * \brief One in this many windows is sampled for the sketch.
+ */
+#define SAMPLE 64
+
+/**
+ * \brief Buffered delta output.
+ */
+struct emit {
+	int      fd;           /**< Output file descriptor. */
+	size_t   fill;         /**< Number of buffered bytes. */
+	uint64_t total;        /**< Number of bytes written. */
+	uint8_t  buf[BUFSIZE]; /**< Buffer. */
+};
+
+/**
+ * \brief Buffered delta input.
+ */
+struct take {
+	int      fd;           /**< Input file descriptor. */
+	uint64_t pos;          /**< File offset of next read. */
+	uint64_t end;          /**< File offset past the delta. */
+	size_t   head;         /**< Offset of next buffered byte. */
+	size_t   fill;         /**< Number of buffered bytes. */
+	uint8_t  buf[BUFSIZE]; /**< Buffer. */
+};
+
+/**
+ * \brief Scramble 64‐bit value.
+ *
+ * \param val Value.
+ *
+ * \return Scrambled value.
+ */
+static uint64_t mix(uint64_t val) {
+	val ^= val >> 30;
+	val *= UINT64_C(0xbf58476d1ce4e5b9);
+	val ^= val >> 27;
+	val *= UINT64_C(0x94d049bb133111eb);
+	val ^= val >> 31;
+	return val;
+}
+
+/**
+ * \brief Raise rolling hash multiplier to window size.
+ *
+ * \return Multiplier of the byte leaving the window.
+ */
+static uint64_t leaving(void) {
+	uint64_t pow = 1;
+
+	for (unsigned int iter = 0; iter < PATCH_WINDOW; ++iter)
+		pow *= PRIME;
+
+	return pow;
+}
+
+void patch_sketch_init(struct patch_sketch *restrict sketch) {
+	for (unsigned int iter = 0; iter < PATCH_FEATURES; ++iter)
+		sketch->feature[iter] = UINT64_MAX;
+
+	sketch->hash = 0;
+	sketch->fill = 0;
+	memset(sketch->window, 0, sizeof sketch->window);
+}
+
+void patch_sketch_update(struct patch_sketch *restrict sketch, const void *restrict buf, size_t size) {
+	const uint8_t *data = buf;
+	const uint64_t pow = leaving();
+
+	uint64_t hash = sketch->hash, fill = sketch->fill;
+
+	for (size_t iter = 0; iter < size; ++iter) {
+		uint8_t *slot = &sketch->window[fill % PATCH_WINDOW];
+
+		/* The leaving byte is zero until the window has filled up */
+		hash = hash * PRIME + data[iter] - *slot * pow;
+		*slot = data[iter];
+
+		if (++fill < PATCH_WINDOW)
+			continue;
+
+		uint64_t val = mix(hash);
+		if (val % SAMPLE)
+			continue;
+
+		for (unsigned int feat = 0; feat < PATCH_FEATURES; ++feat) {
+			uint64_t cand = mix(val ^ (feat + 1) * UINT64_C(0x9e3779b97f4a7c15));
+
+			if (cand < sketch->feature[feat])
+				sketch->feature[feat] = cand;
+		}
+	}
+
+	sketch->hash = hash;
+	sketch->fill = fill;
+}
+
+unsigned int patch_similarity(const uint64_t one[restrict PATCH_FEATURES], const uint64_t other[restrict PATCH_FEATURES]) {
+	unsigned int count = 0;
+
+	for (unsigned int iter = 0; iter < PATCH_FEATURES; ++iter)
+		count += one[iter] != UINT64_MAX && one[iter] == other[iter];
+
+	return count;
+}
+
+/**
+ * \brief Write buffer completely.
+ *
+ * \param fd File descriptor.
+ * \param buf Data.
+ * \param size Size of data.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool drain(int fd, const uint8_t *restrict buf, size_t size) {
+	while (size) {
+		ssize_t done = write(fd, buf, size);
+
+		if (unlikely(done < 0)) {
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		buf  += done;
+		size -= done;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Flush delta output.
+ *
+ * \param emit Delta output.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool emit_flush(struct emit *restrict emit) {
+	if (unlikely(!drain(emit->fd, emit->buf, emit->fill)))
+		return false;
+
+	emit->fill = 0;
+	return true;
+}
+
+/**
+ * \brief Append bytes to delta output.
+ *
+ * \param emit Delta output.
+ * \param buf Data.
+ * \param size Size of data.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool emit_bytes(struct emit *restrict emit, const uint8_t *restrict buf, size_t size) {
+	emit->total += size;
+
+	/* Large literals bypass the buffer */
+	if (size >= BUFSIZE)
+		return emit_flush(emit) && drain(emit->fd, buf, size);
+
+	if (emit->fill + size > BUFSIZE && unlikely(!emit_flush(emit)))
+		return false;
+
+	memcpy(emit->buf + emit->fill, buf, size);
+	emit->fill += size;
+
+	return true;
+}
+
+/**
+ * \brief Append instruction to delta output.
+ *
+ * Integers are encoded in little‐endian base 128.
+ *
+ * \param emit Delta output.
+ * \param op Instruction.
+ * \param first First operand.
+ * \param second Second operand, only used by copies.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool emit_op(struct emit *restrict emit, enum patch_op op, uint64_t first, uint64_t second) {
+	uint8_t code[1 + 10 * 2];
+	size_t len = 0;
+
+	code[len++] = op;
+
+	for (unsigned int iter = 0; iter < (op == PATCH_COPY ? 2 : 1); ++iter) {
+		uint64_t val = iter ? second : first;
+
+		do {
+			code[len++] = (val & 0x7f) | (val > 0x7f) << 7;
+			val >>= 7;
+		} while (val);
+	}
+
+	return emit_bytes(emit, code, len);
+}
+
+/**
+ * \brief Hash block.
+ *
+ * \param data Block of \c BLOCK bytes.
+ *
+ * \return Hash value.
+ */
+static uint64_t block_hash(const uint8_t *restrict data) {
+	uint64_t low, high;
+
+	memcpy(&low, data, sizeof low);
+	memcpy(&high, data + sizeof low, sizeof high);
+
+	return mix(low ^ mix(high));
+}
+
+bool patch_encode(int fd, const void *restrict base, size_t blen, const void *restrict target, size_t tlen, uint64_t *restrict size) {
+	const uint8_t *bdata = base, *tdata = target;
+
+	if (unlikely(blen > PATCH_MAXIMUM || tlen > PATCH_MAXIMUM)) {
+		errno = EFBIG;
+		return false;
+	}
+
+	/* Index every block of the base, keeping the first occurrence */
+	size_t slots = 1;
+	while (slots < blen / BLOCK)
+		slots <<= 1;
+
+	uint32_t *table = calloc(slots, sizeof *table);
+	struct emit *emit = malloc(sizeof *emit);
+
+	if (unlikely(!table || !emit)) {
+		free(emit);
+		free(table);
+		return false;
+	}
+
+	for (size_t pos = 0; pos + BLOCK <= blen; pos += BLOCK) {
+		uint32_t *slot = &table[block_hash(bdata + pos) & (slots - 1)];
+
+		if (!*slot)
+			*slot = pos + 1;
+	}
+
+	emit->fd    = fd;
+	emit->fill  = 0;
+	emit->total = 0;
+
+	bool result = true;
+	size_t pos = 0, lit = 0;
+
+	while (result && pos + BLOCK <= tlen) {
+		uint32_t cand = table[block_hash(tdata + pos) & (slots - 1)];
+
+		if (!cand || memcmp(bdata + cand - 1, tdata + pos, BLOCK)) {
+			++pos;
+			continue;
+		}
+
+		size_t from = cand - 1, len = BLOCK;
+
+		/* Extend match backwards into the pending literal and forwards */
+		while (pos > lit && from && tdata[pos - 1] == bdata[from - 1]) {
+			--pos;
+			--from;
+			++len;
+		}
+
+		while (pos + len < tlen && from + len < blen && tdata[pos + len] == bdata[from + len])
+			++len;
+
+		if (pos > lit)
+			result = emit_op(emit, PATCH_INSERT, pos - lit, 0) && emit_bytes(emit, tdata + lit, pos - lit);
+
+		result = result && emit_op(emit, PATCH_COPY, from, len);
+
+		pos += len;
+		lit  = pos;
+	}
+
+	if (result && tlen > lit)
+		result = emit_op(emit, PATCH_INSERT, tlen - lit, 0) && emit_bytes(emit, tdata + lit, tlen - lit);
+
+	result = result && emit_flush(emit);
+	*size  = emit->total;
+
+	free(emit);
+	free(table);
+
+	return result;
+}
+
+/**
+ * \brief Make delta input available.
+ *
+ * \param take Delta input.
+ *
+ * \return \c true if there are buffered bytes or \c false at the end or on failure.
+ */
+static bool take_more(struct take *restrict take) {
+	if (take->head < take->fill)
+		return true;
+
+	size_t want = take->end - take->pos < BUFSIZE ? take->end - take->pos : BUFSIZE;
+	if (!want)
+		return false;
+
+	ssize_t done;
+	while (unlikely((done = pread(take->fd, take->buf, want, take->pos)) < 0))
+		if (errno != EINTR)
+			return false;
+
+	take->pos += done;
+	take->head = 0;
+	take->fill = done;
+
+	return done > 0;
+}
+
+/**
+ * \brief Read integer from delta input.
+ *
+ * \param take Delta input.
+ * \param val Buffer to hold the integer.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool take_int(struct take *restrict take, uint64_t *restrict val) {
+	*val = 0;
+
+	for (unsigned int shift = 0; shift < 64; shift += 7) {
+		if (unlikely(!take_more(take)))
+			return false;
+
+		uint8_t byte = take->buf[take->head++];
+		*val |= (uint64_t) (byte & 0x7f) << shift;
+
+		if (!(byte & 0x80))
+			return true;
+	}
+
+	return false;
+}
+
+bool patch_apply(int out, int base, uint64_t boff, uint64_t blen, int delta, uint64_t doff, uint64_t dlen, uint64_t offset, uint64_t length) {
+	struct take *take = malloc(sizeof *take);
+	uint8_t *buf = malloc(BUFSIZE);
+
+	if (unlikely(!take || !buf)) {
+		free(buf);
+		free(take);
+		return false;
+	}
+
+	take->fd   = delta;
+	take->pos  = doff;
+	take->end  = doff + dlen;
+	take->head = 0;
+	take->fill = 0;
+
+	/* Target position and end of the requested range */
+	uint64_t pos = 0, stop = length > UINT64_MAX - offset ? UINT64_MAX : offset + length;
+	bool result = true;
+
+	while (result && pos < stop && take_more(take)) {
+		uint8_t op = take->buf[take->head++];
+		uint64_t from = 0, len;
+
+		if (op == PATCH_COPY)
+			result = take_int(take, &from) && take_int(take, &len) &&
+				from <= blen && len <= blen - from;
+
+		else
+			result = op == PATCH_INSERT && take_int(take, &len);
+
+		if (unlikely(!result))
+			break;
+
+		/* Part of the instruction that falls into the range */
+		uint64_t skip = offset > pos ? offset - pos : 0;
+		uint64_t keep = skip < len ? len - skip : 0;
+
+		if (keep > stop - pos - skip)
+			keep = stop - pos - skip;
+
+		if (op == PATCH_COPY)
+			for (uint64_t done = 0; result && done < keep;) {
+				size_t want = keep - done < BUFSIZE ? keep - done : BUFSIZE;
+				ssize_t got = pread(base, buf, want, boff + from + skip + done);
+
+				if (got < 0 && errno == EINTR)
+					continue;
+
+				result = got == (ssize_t) want && drain(out, buf, want);
+				done  += want;
+			}
+
+		else
+			for (uint64_t done = 0; result && done < len;) {
+				if (unlikely(!take_more(take))) {
+					result = false;
+					break;
+				}
+
+				size_t avail = take->fill - take->head;
+				if (avail > len - done)
+					avail = len - done;
+
+				/* Emit only the overlap of this chunk with the kept part */
+				uint64_t lo = done > skip ? done : skip, hi = done + avail < skip + keep ? done + avail : skip + keep;
+
+				if (lo < hi)
+					result = drain(out, take->buf + take->head + (lo - done), hi - lo);
+
+				take->head += avail;
+				done       += avail;
+			}
+
+		pos += len;
+	}
+
+	/* The delta must provide the whole range, unless it was left open */
+	if (result && pos < stop && length != UINT64_MAX) {
+		errno  = EILSEQ;
+		result = false;
+	}
+
+	free(buf);
+	free(take);
+
+	return result;
+}
+
+#ifdef TEST
+#include <fcntl.h>
+#include <stdio.h>
+
+#include "essai.h"
+
+/**
+ * \brief Size of test objects.
+ */
+#define SIZE 300000
+
+/**
+ * \brief Encode delta into file and apply it to a byte range.
+ */
+static bool roundtrip(const uint8_t *restrict base, size_t blen, const uint8_t *restrict target, size_t tlen, uint64_t offset, uint64_t length, uint64_t *restrict size) {
+	char bpath[] = "/tmp/patch-base-XXXXXX", dpath[] = "/tmp/patch-delta-XXXXXX", opath[] = "/tmp/patch-out-XXXXXX";
+	int bfd = mkstemp(bpath), dfd = mkstemp(dpath), ofd = mkstemp(opath);
+	bool result = false;
+
+	unlink(bpath);
+	unlink(dpath);
+	unlink(opath);
+
+	if (bfd < 0 || dfd < 0 || ofd < 0)
+		goto done;
+
+	/* The base is preceded by a header like in an object file */
+	uint8_t head[64] = { 0 };
+
+	if (!drain(bfd, head, sizeof head) || !drain(bfd, base, blen) ||
+		!drain(dfd, head, sizeof head) || !patch_encode(dfd, base, blen, target, tlen, size) ||
+		!patch_apply(ofd, bfd, sizeof head, blen, dfd, sizeof head, *size, offset, length))
+		goto done;
+
+	uint64_t want = offset < tlen ? tlen - offset : 0;
+	if (length != UINT64_MAX && want > length)
+		want = length;
+
+	uint8_t *back = malloc(want + 1);
+	result = back && lseek(ofd, 0, SEEK_END) == (off_t) want &&
+		pread(ofd, back, want, 0) == (ssize_t) want && !memcmp(back, target + offset, want);
+
+	free(back);
+
+done:
+	if (bfd >= 0)
+		close(bfd);
+
+	if (dfd >= 0)
+		close(dfd);
+
+	if (ofd >= 0)
+		close(ofd);
+
+	return result;
+}
+
+/**
+ * \brief Compute sketch features of buffer.
+ */
+static void features(uint64_t feature[restrict PATCH_FEATURES], const uint8_t *restrict data, size_t size) {
+	struct patch_sketch sketch;
+
+	patch_sketch_init(&sketch);
+
+	/* Feed in uneven pieces to cover the window carried over */
+	for (size_t pos = 0; pos < size; pos += 777)
+		patch_sketch_update(&sketch, data + pos, size - pos < 777 ? size - pos : 777);
+
+	memcpy(feature, sketch.feature, sizeof sketch.feature);
+}
+
+int main(void) {
+	static uint8_t base[SIZE], target[SIZE + 1000], other[SIZE];
+	uint64_t size;
+
+	srand(0);
+	for (size_t iter = 0; iter < SIZE; ++iter) {
+		base[iter]  = rand();
+		other[iter] = rand();
+	}
+
+	/* Revision with an edit, an insertion and a deletion */
+	memcpy(target, base, SIZE);
+	memset(target + 1000, 'x', 300);
+	memmove(target + 50000 + 1000, target + 50000, SIZE - 50000);
+	memset(target + 50000, 'y', 1000);
+	memmove(target + 200000, target + 201000, SIZE + 1000 - 201000);
+
+	size_t tlen = SIZE;
+
+	essaye(roundtrip(base, SIZE, target, tlen, 0, UINT64_MAX, &size) && size < tlen / 50);
+	essaye(roundtrip(base, SIZE, target, tlen, 0, tlen, &size));
+	essaye(roundtrip(base, SIZE, target, tlen, 1100, 60000, &size));
+	essaye(roundtrip(base, SIZE, target, tlen, 50500, 10, &size));
+	essaye(roundtrip(base, SIZE, target, tlen, tlen - 5, 5, &size));
+	essaye(roundtrip(base, SIZE, other, SIZE, 0, UINT64_MAX, &size) && size > SIZE);
+	essaye(roundtrip(base, 0, target, tlen, 0, UINT64_MAX, &size));
+	essaye(roundtrip(base, SIZE, target, 0, 0, UINT64_MAX, &size) && !size);
+
+	uint64_t one[PATCH_FEATURES], two[PATCH_FEATURES], three[PATCH_FEATURES];
+
+	features(one, base, SIZE);
+	features(two, target, tlen);
+	features(three, other, SIZE);
+
+	essaye(patch_similarity(one, one) == PATCH_FEATURES);
+	essaye(patch_similarity(one, two) >= PATCH_FEATURES / 2);
+	essaye(patch_similarity(one, three) == 0);
+
+	return EXIT_SUCCESS;
+}
+#endif /* TEST */
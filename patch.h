@@ -0,0 +1,118 @@
+#pragma once
+#ifndef OC_PATCH_H
+#define OC_PATCH_H
+
+/**
+ * \file
+ *
+ * \brief Binary deltas.
+ *
+ * A delta describes a target in terms of a base as a sequence of
+ * instructions, each of which either copies a byte range of the base or
+ * inserts literal bytes.  Similar bases are found through sketches,
+ * which keep the minima of several hash functions over the rolling hash
+ * values of sampled windows, so that the share of matching features
+ * estimates the resemblance of two objects.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Number of sketch features.
+ */
+#define PATCH_FEATURES 8
+
+/**
+ * \brief Rolling hash window size.
+ */
+#define PATCH_WINDOW 32
+
+/**
+ * \brief Largest base or target that can be encoded.
+ */
+#define PATCH_MAXIMUM UINT32_MAX
+
+/**
+ * \brief Delta instructions.
+ */
+enum patch_op {
+	PATCH_COPY   = 1, /**< Copy base range: offset and length follow. */
+	PATCH_INSERT = 2  /**< Insert literal bytes: length and bytes follow. */
+};
+
+/**
+ * \brief Sketch state.
+ */
+struct patch_sketch {
+	uint64_t feature[PATCH_FEATURES]; /**< Feature minima. */
+	uint64_t hash;                    /**< Rolling hash of the window. */
+	uint64_t fill;                    /**< Number of bytes seen. */
+	uint8_t  window[PATCH_WINDOW];    /**< Window ring buffer. */
+};
+
+/**
+ * \brief Start sketch.
+ *
+ * \param sketch Sketch state.
+ */
+extern void patch_sketch_init(struct patch_sketch *restrict sketch);
+
+/**
+ * \brief Feed data into sketch.
+ *
+ * \param sketch Sketch state.
+ * \param buf Data.
+ * \param size Size of data.
+ */
+extern void patch_sketch_update(struct patch_sketch *restrict sketch, const void *restrict buf, size_t size);
+
+/**
+ * \brief Compare sketches.
+ *
+ * Features that were never sampled do not count.
+ *
+ * \param one Features of one sketch.
+ * \param other Features of other sketch.
+ *
+ * \return Number of matching features.
+ */
+extern unsigned int patch_similarity(const uint64_t one[restrict PATCH_FEATURES], const uint64_t other[restrict PATCH_FEATURES]);
+
+/**
+ * \brief Encode delta.
+ *
+ * \param fd File descriptor to write the delta to.
+ * \param base Base.
+ * \param blen Size of base.
+ * \param target Target.
+ * \param tlen Size of target.
+ * \param size Buffer to hold the size of the delta.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool patch_encode(int fd, const void *restrict base, size_t blen, const void *restrict target, size_t tlen, uint64_t *restrict size);
+
+/**
+ * \brief Apply delta.
+ *
+ * The delta is read sequentially and only the byte range of the target
+ * that is asked for is written, so that copies outside of it cost
+ * nothing and literals outside of it are skipped.
+ *
+ * \param out File descriptor to write the target to.
+ * \param base File descriptor of the base.
+ * \param boff Offset of the base within its file.
+ * \param blen Size of the base.
+ * \param delta File descriptor of the delta.
+ * \param doff Offset of the delta within its file.
+ * \param dlen Size of the delta.
+ * \param offset Offset of first target byte.
+ * \param length Number of target bytes, which the delta must provide.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool patch_apply(int out, int base, uint64_t boff, uint64_t blen, int delta, uint64_t doff, uint64_t dlen, uint64_t offset, uint64_t length);
+
+#endif /* OC_PATCH_H */
@@ -0,0 +1,1153 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "binary.h"
+#include "codec.h"
+#include "endian.h"
+#include "expect.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Default uncompressed frame size.
+ */
+#define FRAME_DEFAULT (1 << 20)
+
+/**
+ * \brief Maximum uncompressed frame size.
+ */
+#define FRAME_MAXIMUM (1 << 26)
+
+/**
+ * \brief Default codec.
+ */
+#define CODEC_DEFAULT "zstd"
+
+/**
+ * \brief Default number of compression threads.
+ */
+#define THREADS_DEFAULT 4
+
+/**
+ * \brief Maximum number of compression threads.
+ */
+#define THREADS_MAXIMUM 64
+
+/**
+ * \brief Maximum size of the frame rings of parallel compression.
+ */
+#define MEMORY_MAXIMUM (1 << 28)
+
+/**
+ * \brief Default size of the largest object compressed with a dictionary.
+ */
+#define SMALL_DEFAULT (1 << 15)
+
+/**
+ * \brief Default maximum dictionary size.
+ */
+#define DICT_DEFAULT (110 << 10)
+
+/**
+ * \brief Default total size of the samples a dictionary is trained on.
+ */
+#define SAMPLE_DEFAULT (1 << 24)
+
+/**
+ * \brief Minimum number of samples a dictionary is trained on.
+ */
+#define SAMPLE_MINIMUM 16
+
+/**
+ * \brief Dictionary directory.
+ *
+ * Dictionaries are named by their decimal identifier, and the highest
+ * one is used for new objects.  They are never removed, as objects keep
+ * referring to them.
+ */
+#define DICTIONARIES ".dict"
+
+/**
+ * \brief Object file header.
+ *
+ * All integers are stored in little‐endian byte‐order.
+ */
+struct head {
+	uint8_t  magic[16];   /**< Binary representation magic sequence. */
+	uint8_t  codec;       /**< Codec identifier. */
+	uint8_t  reserved;    /**< Reserved for future use. */
+	uint16_t dict;        /**< Dictionary identifier or zero if there is none. */
+	uint32_t frame;       /**< Uncompressed frame size. */
+	uint64_t length;      /**< Uncompressed object length. */
+};
+
+/**
+ * \brief Seek table entry.
+ *
+ * A frame whose stored size equals its uncompressed size is stored
+ * verbatim.
+ */
+struct seek {
+	uint64_t offset; /**< Frame offset. */
+	uint32_t stored; /**< Stored frame size. */
+	uint32_t raw;    /**< Uncompressed frame size. */
+};
+
+/**
+ * \brief Object file trailer.
+ */
+struct tail {
+	uint64_t frames; /**< Number of frames. */
+	uint64_t table;  /**< Seek table offset. */
+};
+
+/**
+ * \brief Opened object.
+ */
+struct object {
+	int                 fd;    /**< Object file descriptor. */
+	const struct codec *codec; /**< Codec. */
+	uint32_t            frame; /**< Uncompressed frame size. */
+	uint64_t            length;/**< Uncompressed object length. */
+	uint64_t            frames;/**< Number of frames. */
+	struct seek        *seek;  /**< Seek table in native byte‐order. */
+	struct dict        *dict;  /**< Dictionary. */
+};
+
+/**
+ * \brief Opened dictionary.
+ */
+struct dict {
+	void              *map;   /**< Mapped dictionary file. */
+	size_t             size;  /**< Dictionary size. */
+	struct codec_dict *codec; /**< Codec dictionary. */
+};
+
+/**
+ * \brief Object file name.
+ */
+static char name[32 * 2 + 1];
+
+/**
+ * \brief Temporary object file name, unique to each deposit.
+ */
+static char part[32 * 2 + sizeof ".part.XXXXXX"];
+
+/**
+ * \brief Find most recent dictionary.
+ *
+ * \return Dictionary identifier or zero if there is none.
+ */
+static uint16_t dict_latest(void) {
+	DIR *dir = opendir(DICTIONARIES);
+	if (!dir)
+		return 0;
+
+	unsigned long int latest = 0;
+	struct dirent *ent;
+
+	while ((ent = readdir(dir))) {
+		char *end;
+		unsigned long int id = strtoul(ent->d_name, &end, 10);
+
+		if (*ent->d_name != '0' && !*end && id <= UINT16_MAX && id > latest)
+			latest = id;
+	}
+
+	closedir(dir);
+
+	return latest;
+}
+
+/**
+ * \brief Open dictionary.
+ *
+ * The dictionary file is mapped and digested once per process.
+ *
+ * \param id Dictionary identifier.
+ *
+ * \return Dictionary or <tt>(struct dict *) 0</tt> on failure.
+ */
+static struct dict *dict_open(uint16_t id) {
+	char path[sizeof DICTIONARIES "/65535"];
+	snprintf(path, sizeof path, DICTIONARIES "/%u", (unsigned int) id);
+
+	struct dict *dict = malloc(sizeof *dict);
+	if (unlikely(!dict))
+		return dict;
+
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	if (unlikely(fd < 0 || fstat(fd, &st) || !st.st_size ||
+		(dict->map = mmap((void *) 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)) {
+		if (fd >= 0)
+			close(fd);
+
+		free(dict);
+		return (struct dict *) 0;
+	}
+
+	close(fd);
+
+	dict->size  = st.st_size;
+	dict->codec = codec_dict_open(dict->map, dict->size);
+
+	if (unlikely(!dict->codec)) {
+		munmap(dict->map, dict->size);
+		free(dict);
+		return (struct dict *) 0;
+	}
+
+	return dict;
+}
+
+/**
+ * \brief Close dictionary.
+ *
+ * \param dict Dictionary.
+ */
+static void dict_close(struct dict *restrict dict) {
+	if (!dict)
+		return;
+
+	codec_dict_close(dict->codec);
+	munmap(dict->map, dict->size);
+	free(dict);
+}
+
+/**
+ * \brief Open object and load its seek table.
+ *
+ * \param obj Object to initialise.
+ * \param file Object file name.
+ *
+ * \return 0 if successful, 3 if there is no such object or \c EXIT_FAILURE on failure.
+ */
+static int object_open(struct object *restrict obj, const char *restrict file) {
+	obj->fd = open(file, O_RDONLY);
+	if (obj->fd < 0) {
+		if (errno == ENOENT)
+			return 3;
+
+		perror("Unable to open object");
+		return EXIT_FAILURE;
+	}
+
+	struct stat st;
+	struct head head;
+	struct tail tail;
+
+	if (unlikely(fstat(obj->fd, &st) ||
+		st.st_size < (off_t) (sizeof head + sizeof tail) ||
+		pread(obj->fd, &head, sizeof head, 0) != sizeof head ||
+		pread(obj->fd, &tail, sizeof tail, st.st_size - sizeof tail) != sizeof tail ||
+		memcmp(head.magic, magic, sizeof magic))) {
+		fputs("Damaged object file!\n", stderr);
+		close(obj->fd);
+		return EXIT_FAILURE;
+	}
+
+	obj->codec  = codec_ident(head.codec);
+	obj->frame  = le32(head.frame);
+	obj->length = le64(head.length);
+	obj->frames = le64(tail.frames);
+
+	uint64_t table = le64(tail.table);
+
+	if (unlikely(!obj->codec)) {
+		fprintf(stderr, "Unknown codec %u!\n", head.codec);
+		close(obj->fd);
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(!obj->frame || obj->frame > FRAME_MAXIMUM)) {
+		fputs("Damaged object file!\n", stderr);
+		close(obj->fd);
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(obj->frames > (uint64_t) st.st_size / sizeof *obj->seek ||
+		table + obj->frames * sizeof *obj->seek + sizeof tail != (uint64_t) st.st_size)) {
+		fputs("Damaged seek table!\n", stderr);
+		close(obj->fd);
+		return EXIT_FAILURE;
+	}
+
+	obj->seek = malloc(obj->frames * sizeof *obj->seek + 1);
+	if (unlikely(!obj->seek)) {
+		perror("Unable to allocate seek table");
+		close(obj->fd);
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(pread(obj->fd, obj->seek, obj->frames * sizeof *obj->seek, table) != (ssize_t) (obj->frames * sizeof *obj->seek))) {
+		perror("Unable to read seek table");
+		free(obj->seek);
+		close(obj->fd);
+		return EXIT_FAILURE;
+	}
+
+	uint64_t total = 0;
+
+	for (uint64_t iter = 0; iter < obj->frames; ++iter) {
+		obj->seek[iter].offset = le64(obj->seek[iter].offset);
+		obj->seek[iter].stored = le32(obj->seek[iter].stored);
+		obj->seek[iter].raw    = le32(obj->seek[iter].raw);
+
+		total += obj->seek[iter].raw;
+
+		if (unlikely(obj->seek[iter].raw > obj->frame ||
+			obj->seek[iter].offset + obj->seek[iter].stored > table)) {
+			fputs("Damaged seek table!\n", stderr);
+			free(obj->seek);
+			close(obj->fd);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (unlikely(total != obj->length)) {
+		fputs("Damaged seek table!\n", stderr);
+		free(obj->seek);
+		close(obj->fd);
+		return EXIT_FAILURE;
+	}
+
+	obj->dict = (struct dict *) 0;
+
+	if (head.dict && unlikely(obj->codec->ident != CODEC_ZSTD || !(obj->dict = dict_open(le16(head.dict))))) {
+		fprintf(stderr, "Unable to open dictionary %u!\n", (unsigned int) le16(head.dict));
+		free(obj->seek);
+		close(obj->fd);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Close object.
+ *
+ * \param obj Object.
+ */
+static void object_close(struct object *restrict obj) {
+	dict_close(obj->dict);
+	free(obj->seek);
+	close(obj->fd);
+}
+
+/**
+ * \brief Read and decode frame.
+ *
+ * \param obj Object.
+ * \param index Frame number.
+ * \param raw Buffer of at least the frame size to hold the decoded frame.
+ * \param comp Buffer of at least the frame size to hold the stored frame.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool frame_decode(const struct object *restrict obj, uint64_t index, uint8_t *restrict raw, uint8_t *restrict comp) {
+	const struct seek *seek = &obj->seek[index];
+
+	/* Verbatim frames are read directly */
+	if (seek->stored == seek->raw)
+		return pread(obj->fd, raw, seek->raw, seek->offset) == seek->raw;
+
+	if (unlikely(seek->stored > seek->raw))
+		return false;
+
+	if (unlikely(pread(obj->fd, comp, seek->stored, seek->offset) != seek->stored))
+		return false;
+
+	return obj->dict ?
+		codec_dict_decompress(obj->dict->codec, raw, seek->raw, comp, seek->stored) :
+		obj->codec->decompress(raw, seek->raw, comp, seek->stored);
+}
+
+/**
+ * \brief Parallel frame decoding state.
+ *
+ * Frames are decoded into a ring of slots by worker threads and written
+ * out in order, so that no more than the ring is held in memory.
+ */
+struct decode {
+	const struct object *obj;   /**< Object. */
+	uint64_t             last;  /**< Number past the last frame to decode. */
+	uint64_t             next;  /**< Next frame to decode. */
+	uint64_t             done;  /**< Number of frames written out. */
+	unsigned int         slots; /**< Number of ring slots. */
+	uint8_t             *ring;  /**< Frame ring. */
+	bool                *ready; /**< Whether the frame in a slot has been decoded. */
+	bool                 failed;/**< Whether decoding or writing failed. */
+	pthread_mutex_t      lock;  /**< Lock protecting the fields above. */
+	pthread_cond_t       cond;  /**< Signalled on every state change. */
+};
+
+/**
+ * \brief Frame decoding thread.
+ *
+ * \param arg Decoding state.
+ *
+ * \return <tt>(void *) 0</tt>.
+ */
+static void *decode_thread(void *arg) {
+	struct decode *dec = arg;
+	uint8_t *comp = malloc(dec->obj->frame + 1);
+	bool result = comp;
+
+	if (unlikely(!result))
+		perror("Unable to allocate frame buffer");
+
+	for (;;) {
+		pthread_mutex_lock(&dec->lock);
+
+		/* Wait for a free ring slot */
+		while (result && !dec->failed && dec->next < dec->last && dec->next >= dec->done + dec->slots)
+			pthread_cond_wait(&dec->cond, &dec->lock);
+
+		if (!result || dec->failed || dec->next >= dec->last) {
+			dec->failed |= !result;
+			pthread_cond_broadcast(&dec->cond);
+			pthread_mutex_unlock(&dec->lock);
+			break;
+		}
+
+		uint64_t seq = dec->next++;
+		pthread_mutex_unlock(&dec->lock);
+
+		result = frame_decode(dec->obj, seq, dec->ring + seq % dec->slots * dec->obj->frame, comp);
+		if (unlikely(!result))
+			fprintf(stderr, "Unable to decode frame %llu!\n", (unsigned long long) seq);
+
+		pthread_mutex_lock(&dec->lock);
+		dec->ready[seq % dec->slots] = result;
+		dec->failed |= !result;
+		pthread_cond_broadcast(&dec->cond);
+		pthread_mutex_unlock(&dec->lock);
+	}
+
+	free(comp);
+
+	return (void *) 0;
+}
+
+/**
+ * \brief Retrieve byte range of object.
+ *
+ * Every frame but the last holds exactly the frame size, so only the
+ * frames overlapping the range are read.  They are decoded in parallel
+ * by up to \c PRESS_THREADS threads.
+ *
+ * \param offset Offset of first byte.
+ * \param length Maximum number of bytes.
+ */
+static int op_retrieve(uint64_t offset, uint64_t length) {
+	struct object obj;
+
+	int rc = object_open(&obj, name);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	/* Clip range to object */
+	if (offset > obj.length)
+		offset = obj.length;
+
+	if (length > obj.length - offset)
+		length = obj.length - offset;
+
+	struct decode dec = {
+		.obj    = &obj,
+		.last   = length ? (offset + length - 1) / obj.frame + 1 : 0,
+		.next   = offset / obj.frame,
+		.done   = offset / obj.frame,
+		.failed = false
+	};
+
+	if (dec.last > obj.frames)
+		dec.last = obj.frames;
+
+	unsigned long int threads = setting("PRESS_THREADS", THREADS_DEFAULT);
+
+	if (threads > THREADS_MAXIMUM)
+		threads = THREADS_MAXIMUM;
+
+	if (threads > dec.last - dec.next)
+		threads = dec.last - dec.next;
+
+	if (threads > MEMORY_MAXIMUM / 2 / obj.frame)
+		threads = MEMORY_MAXIMUM / 2 / obj.frame;
+
+	/* Dictionary contexts cannot be shared, but only single frames use them */
+	if (!threads || obj.dict)
+		threads = 1;
+
+	dec.slots = threads * 2;
+	dec.ring  = malloc(dec.slots * obj.frame);
+	dec.ready = calloc(dec.slots, sizeof *dec.ready);
+
+	if (unlikely(!dec.ring || !dec.ready)) {
+		perror("Unable to allocate frame buffers");
+		free(dec.ready);
+		free(dec.ring);
+		object_close(&obj);
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_init(&dec.lock, (const pthread_mutexattr_t *) 0);
+	pthread_cond_init(&dec.cond, (const pthread_condattr_t *) 0);
+
+	pthread_t thread[THREADS_MAXIMUM];
+	size_t started = 0;
+
+	while (started < threads && !pthread_create(&thread[started], (const pthread_attr_t *) 0, decode_thread, &dec))
+		++started;
+
+	bool result = started > 0;
+
+	for (uint64_t iter = offset / obj.frame; result && length && iter < dec.last; ++iter) {
+		size_t slot = iter % dec.slots;
+
+		pthread_mutex_lock(&dec.lock);
+
+		while (!dec.ready[slot] && !dec.failed)
+			pthread_cond_wait(&dec.cond, &dec.lock);
+
+		result = !dec.failed;
+		pthread_mutex_unlock(&dec.lock);
+
+		if (!result)
+			break;
+
+		uint64_t skip = offset - iter * obj.frame;
+		uint64_t fill = skip < obj.seek[iter].raw ? obj.seek[iter].raw - skip : 0;
+
+		if (fill > length)
+			fill = length;
+
+		if (unlikely(!fill)) {
+			fprintf(stderr, "Unable to decode frame %llu!\n", (unsigned long long) iter);
+			result = false;
+		}
+
+		else if (unlikely(!stream_write(1, dec.ring + slot * obj.frame + skip, fill))) {
+			perror("Write error");
+			result = false;
+		}
+
+		offset += fill;
+		length -= fill;
+
+		pthread_mutex_lock(&dec.lock);
+		dec.ready[slot] = false;
+		dec.failed |= !result;
+		++dec.done;
+		pthread_cond_broadcast(&dec.cond);
+		pthread_mutex_unlock(&dec.lock);
+	}
+
+	pthread_mutex_lock(&dec.lock);
+	dec.failed |= !result;
+	pthread_cond_broadcast(&dec.cond);
+	pthread_mutex_unlock(&dec.lock);
+
+	while (started)
+		pthread_join(thread[--started], (void **) 0);
+
+	pthread_cond_destroy(&dec.cond);
+	pthread_mutex_destroy(&dec.lock);
+	free(dec.ready);
+	free(dec.ring);
+	object_close(&obj);
+
+	return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * \brief Describe object.
+ *
+ * \param dir Storage directory.
+ */
+static int op_inspect(const char *restrict dir) {
+	struct object obj;
+	struct stat st;
+
+	int rc = object_open(&obj, name);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	if (unlikely(fstat(obj.fd, &st))) {
+		perror("Unable to inspect object");
+		object_close(&obj);
+		return EXIT_FAILURE;
+	}
+
+	object_close(&obj);
+
+	printf("%" PRIu64 " %" PRIu64 " %" PRIu64 " %s/%s\n", obj.length, (uint64_t) st.st_size,
+		(uint64_t) st.st_mtime * UINT64_C(1000000000), dir, name);
+
+	if (unlikely(fflush(stdout))) {
+		perror("Unable to write description");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Parallel frame encoding state.
+ *
+ * Frames are read into a ring of slots, compressed by worker threads
+ * and written out in order, so that no more than the ring is held in
+ * memory.
+ */
+struct encode {
+	const struct codec *codec;   /**< Codec. */
+	struct codec_dict  *dict;    /**< Dictionary or <tt>(struct codec_dict *) 0</tt>. */
+	int                 level;   /**< Compression level. */
+	size_t              frame;   /**< Uncompressed frame size. */
+	size_t              bound;   /**< Upper bound of a compressed frame. */
+	unsigned int        slots;   /**< Number of ring slots. */
+	uint8_t            *raw;     /**< Uncompressed frame ring. */
+	uint8_t            *comp;    /**< Compressed frame ring. */
+	size_t             *fill;    /**< Uncompressed frame sizes. */
+	size_t             *stored;  /**< Stored frame sizes, equal to the uncompressed size for verbatim frames. */
+	bool               *ready;   /**< Whether the frame in a slot has been compressed. */
+	uint64_t            read;    /**< Number of frames read. */
+	uint64_t            next;    /**< Next frame to compress. */
+	bool                ended;   /**< Whether the input has ended. */
+	bool                failed;  /**< Whether reading or writing failed. */
+	pthread_mutex_t     lock;    /**< Lock protecting the fields above. */
+	pthread_cond_t      cond;    /**< Signalled on every state change. */
+};
+
+/**
+ * \brief Frame encoding thread.
+ *
+ * \param arg Encoding state.
+ *
+ * \return <tt>(void *) 0</tt>.
+ */
+static void *encode_thread(void *arg) {
+	struct encode *enc = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&enc->lock);
+
+		while (!enc->failed && !enc->ended && enc->next >= enc->read)
+			pthread_cond_wait(&enc->cond, &enc->lock);
+
+		if (enc->failed || enc->next >= enc->read) {
+			pthread_mutex_unlock(&enc->lock);
+			break;
+		}
+
+		uint64_t seq = enc->next++;
+		pthread_mutex_unlock(&enc->lock);
+
+		size_t slot = seq % enc->slots, fill = enc->fill[slot], stored = enc->bound;
+		const uint8_t *raw = enc->raw + slot * enc->frame;
+		uint8_t *comp = enc->comp + slot * enc->bound;
+
+		/* Store frames verbatim unless compression pays off */
+		if (!(enc->dict ?
+			codec_dict_compress(enc->dict, comp, &stored, raw, fill, enc->level) :
+			enc->codec->compress(comp, &stored, raw, fill, enc->level)) || stored >= fill)
+			stored = fill;
+
+		pthread_mutex_lock(&enc->lock);
+		enc->stored[slot] = stored;
+		enc->ready[slot]  = true;
+		pthread_cond_broadcast(&enc->cond);
+		pthread_mutex_unlock(&enc->lock);
+	}
+
+	return (void *) 0;
+}
+
+/**
+ * \brief Deposit object.
+ *
+ * Frames are compressed in parallel by up to \c PRESS_THREADS threads.
+ */
+static int op_deposit(void) {
+	const char *cname = getenv("PRESS_CODEC");
+	const struct codec *codec = codec_name(cname && *cname ? cname : CODEC_DEFAULT);
+	if (unlikely(!codec)) {
+		fprintf(stderr, "Unknown codec “%s”!\n", cname);
+		return EXIT_FAILURE;
+	}
+
+	int level = setting("PRESS_LEVEL", codec->level);
+
+	unsigned long int frame = setting("PRESS_FRAME", FRAME_DEFAULT);
+	if (unlikely(!frame || frame > FRAME_MAXIMUM)) {
+		fprintf(stderr, "Invalid frame size %lu!\n", frame);
+		return EXIT_FAILURE;
+	}
+
+	unsigned long int threads = setting("PRESS_THREADS", THREADS_DEFAULT);
+
+	if (threads > THREADS_MAXIMUM)
+		threads = THREADS_MAXIMUM;
+
+	if (threads > MEMORY_MAXIMUM / 2 / frame)
+		threads = MEMORY_MAXIMUM / 2 / frame;
+
+	if (!threads)
+		threads = 1;
+
+	unsigned long int small = setting("PRESS_SMALL", SMALL_DEFAULT);
+	struct dict *dict = (struct dict *) 0;
+
+	/* Concurrent deposits of an object must not share a file */
+	int fd = mkstemp(part);
+	if (unlikely(fd < 0 || fchmod(fd, 0644))) {
+		perror("Unable to create object file");
+
+		if (fd >= 0) {
+			close(fd);
+			unlink(part);
+		}
+
+		return EXIT_FAILURE;
+	}
+
+	int rc = EXIT_FAILURE;
+	size_t bound = codec->bound(frame);
+
+	struct encode enc = {
+		.codec  = codec,
+		.dict   = (struct codec_dict *) 0,
+		.level  = level,
+		.frame  = frame,
+		.bound  = bound > frame ? bound : frame,
+		.slots  = threads * 2,
+		.read   = 0,
+		.next   = 0,
+		.ended  = false,
+		.failed = false
+	};
+
+	enc.raw    = malloc(enc.slots * enc.frame);
+	enc.comp   = malloc(enc.slots * enc.bound);
+	enc.fill   = malloc(enc.slots * sizeof *enc.fill);
+	enc.stored = malloc(enc.slots * sizeof *enc.stored);
+	enc.ready  = calloc(enc.slots, sizeof *enc.ready);
+
+	size_t frames = 0, size = 64;
+	struct seek *seek = malloc(size * sizeof *seek);
+
+	pthread_t thread[THREADS_MAXIMUM];
+	size_t started = 0;
+
+	pthread_mutex_init(&enc.lock, (const pthread_mutexattr_t *) 0);
+	pthread_cond_init(&enc.cond, (const pthread_condattr_t *) 0);
+
+	if (unlikely(!enc.raw || !enc.comp || !enc.fill || !enc.stored || !enc.ready || !seek)) {
+		perror("Unable to allocate buffers");
+		goto done;
+	}
+
+	struct head head;
+	memset(&head, 0, sizeof head);
+
+	uint64_t offset = sizeof head, length = 0;
+
+	if (unlikely(lseek(fd, offset, SEEK_SET) < 0)) {
+		perror("Unable to seek in object file");
+		goto done;
+	}
+
+	while (started < threads && !pthread_create(&thread[started], (const pthread_attr_t *) 0, encode_thread, &enc))
+		++started;
+
+	if (unlikely(!started)) {
+		perror("Unable to start compression threads");
+		goto done;
+	}
+
+	for (;;) {
+		uint64_t seq = enc.read;
+		size_t slot = seq % enc.slots;
+
+		/* Write out the frame that last occupied the slot, or all pending frames at the end */
+		while (frames + enc.slots <= seq || enc.ended && frames < seq) {
+			size_t out = frames % enc.slots;
+
+			pthread_mutex_lock(&enc.lock);
+
+			while (!enc.ready[out])
+				pthread_cond_wait(&enc.cond, &enc.lock);
+
+			enc.ready[out] = false;
+			pthread_mutex_unlock(&enc.lock);
+
+			size_t stored = enc.stored[out], fill = enc.fill[out];
+			const uint8_t *data = stored == fill ? enc.raw + out * enc.frame : enc.comp + out * enc.bound;
+
+			if (unlikely(!stream_write(fd, data, stored))) {
+				perror("Write error");
+				goto done;
+			}
+
+			if (frames == size) {
+				struct seek *nseek = realloc(seek, (size *= 2) * sizeof *seek);
+				if (unlikely(!nseek)) {
+					perror("Unable to grow seek table");
+					goto done;
+				}
+
+				seek = nseek;
+			}
+
+			seek[frames++] = (struct seek) {
+				.offset = le64(offset),
+				.stored = le32((uint32_t) stored),
+				.raw    = le32((uint32_t) fill)
+			};
+
+			offset += stored;
+			length += fill;
+		}
+
+		if (enc.ended)
+			break;
+
+		ssize_t fill = stream_read(0, enc.raw + slot * enc.frame, frame);
+		if (unlikely(fill < 0)) {
+			perror("Read error");
+			goto done;
+		}
+
+		/* A short first frame holds the whole object, which may be small enough for the dictionary */
+		if (!seq && fill && (size_t) fill < frame && (size_t) fill <= small && codec->ident == CODEC_ZSTD) {
+			uint16_t id = dict_latest();
+
+			if (id && (dict = dict_open(id))) {
+				head.dict = le16(id);
+				enc.dict  = dict->codec;
+			}
+		}
+
+		pthread_mutex_lock(&enc.lock);
+
+		if (fill) {
+			enc.fill[slot] = fill;
+			++enc.read;
+		}
+
+		else
+			enc.ended = true;
+
+		pthread_cond_broadcast(&enc.cond);
+		pthread_mutex_unlock(&enc.lock);
+	}
+
+	/* Close standard input */
+	close(0);
+
+	struct tail tail = {
+		.frames = le64((uint64_t) frames),
+		.table  = le64(offset)
+	};
+
+	memcpy(head.magic, magic, sizeof magic);
+	head.codec  = codec->ident;
+	head.frame  = le32((uint32_t) frame);
+	head.length = le64(length);
+
+	if (unlikely(!stream_write(fd, seek, frames * sizeof *seek) ||
+		!stream_write(fd, &tail, sizeof tail) ||
+		pwrite(fd, &head, sizeof head, 0) != sizeof head ||
+		fdatasync(fd))) {
+		perror("Write error");
+		goto done;
+	}
+
+	if (unlikely(close(fd) || rename(part, name))) {
+		perror("Unable to commit object file");
+		unlink(part);
+	}
+
+	else
+		rc = EXIT_SUCCESS;
+
+	fd = -1;
+
+done:
+	pthread_mutex_lock(&enc.lock);
+	enc.failed = rc != EXIT_SUCCESS;
+	pthread_cond_broadcast(&enc.cond);
+	pthread_mutex_unlock(&enc.lock);
+
+	while (started)
+		pthread_join(thread[--started], (void **) 0);
+
+	if (fd >= 0) {
+		close(fd);
+		unlink(part);
+	}
+
+	pthread_cond_destroy(&enc.cond);
+	pthread_mutex_destroy(&enc.lock);
+
+	dict_close(dict);
+	free(seek);
+	free(enc.ready);
+	free(enc.stored);
+	free(enc.fill);
+	free(enc.comp);
+	free(enc.raw);
+
+	return rc;
+}
+
+/**
+ * \brief Train dictionary on small objects.
+ *
+ * Objects are sampled in directory order until the sample size is
+ * reached.  The new dictionary is used for subsequent deposits, while
+ * objects compressed with earlier ones keep referring to those.
+ */
+static int op_train(void) {
+	unsigned long int small    = setting("PRESS_SMALL", SMALL_DEFAULT);
+	unsigned long int budget   = setting("PRESS_SAMPLE", SAMPLE_DEFAULT);
+	unsigned long int capacity = setting("PRESS_DICT", DICT_DEFAULT);
+
+	if (small > FRAME_MAXIMUM)
+		small = FRAME_MAXIMUM;
+
+	uint16_t id = dict_latest();
+	if (unlikely(id == UINT16_MAX)) {
+		fputs("No dictionary identifiers left!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	DIR *dir = opendir(".");
+	if (unlikely(!dir)) {
+		perror("Unable to open storage directory");
+		return EXIT_FAILURE;
+	}
+
+	uint8_t *samples = malloc(budget + 1);
+	uint8_t *comp    = malloc(small + 1);
+	uint8_t *dict    = malloc(capacity + 1);
+
+	size_t count = 0, size = 64;
+	size_t *sizes = malloc(size * sizeof *sizes);
+
+	int rc = EXIT_FAILURE;
+
+	if (unlikely(!samples || !comp || !dict || !sizes)) {
+		perror("Unable to allocate buffers");
+		goto done;
+	}
+
+	uint64_t fill = 0;
+	uint8_t ident[32];
+	struct dirent *ent;
+
+	while (fill < budget && (ent = readdir(dir))) {
+		struct object obj;
+
+		if (strlen(ent->d_name) != 32 * 2 || !hexsint(ident, ent->d_name, sizeof ident) ||
+			object_open(&obj, ent->d_name) != EXIT_SUCCESS)
+			continue;
+
+		if (obj.length && obj.length <= small && obj.frames == 1 && obj.length <= budget - fill) {
+			if (count == size) {
+				size_t *nsizes = realloc(sizes, (size *= 2) * sizeof *sizes);
+				if (unlikely(!nsizes)) {
+					perror("Unable to grow sample table");
+					object_close(&obj);
+					goto done;
+				}
+
+				sizes = nsizes;
+			}
+
+			if (likely(frame_decode(&obj, 0, samples + fill, comp))) {
+				sizes[count++] = obj.length;
+				fill += obj.length;
+			}
+		}
+
+		object_close(&obj);
+	}
+
+	if (unlikely(count < SAMPLE_MINIMUM)) {
+		fputs("Too few small objects to train a dictionary on!\n", stderr);
+		goto done;
+	}
+
+	size_t dsize = codec_train(dict, capacity, samples, sizes, count);
+	if (unlikely(!dsize)) {
+		fputs("Unable to train dictionary!\n", stderr);
+		goto done;
+	}
+
+	char path[sizeof DICTIONARIES "/65535"], tmp[sizeof DICTIONARIES "/65535.part.XXXXXX"];
+	snprintf(path, sizeof path, DICTIONARIES "/%u", (unsigned int) id + 1);
+	snprintf(tmp, sizeof tmp, "%s.part.XXXXXX", path);
+
+	/* The directory exists unless this is the first dictionary */
+	mkdir(DICTIONARIES, 0755);
+
+	int fd = mkstemp(tmp);
+	if (unlikely(fd < 0 || fchmod(fd, 0644))) {
+		perror("Unable to create dictionary file");
+
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmp);
+		}
+
+		goto done;
+	}
+
+	bool written = stream_write(fd, dict, dsize) && !fdatasync(fd);
+
+	/* Linking fails if a concurrent training took the identifier */
+	if (unlikely(close(fd) || !written || link(tmp, path))) {
+		perror("Unable to commit dictionary file");
+		unlink(tmp);
+		goto done;
+	}
+
+	unlink(tmp);
+
+	printf("%u\n", (unsigned int) id + 1);
+
+	if (unlikely(fflush(stdout))) {
+		perror("Unable to write dictionary identifier");
+		goto done;
+	}
+
+	rc = EXIT_SUCCESS;
+
+done:
+	closedir(dir);
+	free(sizes);
+	free(dict);
+	free(comp);
+	free(samples);
+
+	return rc;
+}
+
+/**
+ * \brief List identifiers of all objects.
+ */
+static int op_list(void) {
+	DIR *dir = opendir(".");
+	if (unlikely(!dir)) {
+		perror("Unable to open storage directory");
+		return EXIT_FAILURE;
+	}
+
+	uint8_t ident[32];
+	struct dirent *ent;
+
+	/* Objects are named by their identifier, anything else is skipped */
+	while ((ent = readdir(dir)))
+		if (strlen(ent->d_name) == 32 * 2 && hexsint(ident, ent->d_name, sizeof ident))
+			puts(ent->d_name);
+
+	closedir(dir);
+
+	if (unlikely(fflush(stdout) || ferror(stdout))) {
+		perror("Unable to write identifiers");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector.
+ *
+ * \return EXIT_SUCCESS if successful or any other value on failure.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc != 6 && argc != 8)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	/* Change to storage directory */
+	if (unlikely(chdir(argv[1]))) {
+		perror("Unable to change to storage directory");
+		return EXIT_FAILURE;
+	}
+
+	/* Listing and training do not refer to an object */
+	if (!strcmp(argv[5], "list"))
+		return op_list();
+
+	if (!strcmp(argv[5], "train"))
+		return op_train();
+
+	uint8_t ident[32];
+	if (!hexsint(ident, argv[4], sizeof ident)) {
+		perror("Failed to parse identifier");
+		return EXIT_FAILURE;
+	}
+
+	inthexs(name, ident, sizeof ident);
+	strcpy(part, name);
+	strcat(part, ".part.XXXXXX");
+
+	/* Parse operation string */
+	if (!strcmp(argv[5], "assay"))
+		return access(name, F_OK) ? 3 : EXIT_SUCCESS;
+
+	else if (!strcmp(argv[5], "retrieve"))
+		return op_retrieve(0, UINT64_MAX);
+
+	else if (!strcmp(argv[5], "range")) {
+		uint64_t offset, length;
+
+		if (unlikely(argc != 8 || !decsint(&offset, argv[6]) || !decsint(&length, argv[7]))) {
+			fputs("Invalid byte range!\n", stderr);
+			return EXIT_FAILURE;
+		}
+
+		return op_retrieve(offset, length);
+	}
+
+	else if (!strcmp(argv[5], "inspect"))
+		return op_inspect(argv[1]);
+
+	else if (!strcmp(argv[5], "deposit"))
+		return op_deposit();
+
+	else if (!strcmp(argv[5], "efface")) {
+		if (unlikely(unlink(name) && errno != ENOENT)) {
+			perror("Unable to remove object");
+			return EXIT_FAILURE;
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	else {
+		fprintf(stderr, "Invalid storage operation “%s”!\n", argv[5]);
+		return 2;
+	}
+}
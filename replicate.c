@@ -0,0 +1,542 @@
+/* splice and fallocate are Linux extensions */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "expect.h"
+#include "path.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Deposit helper.
+ */
+#define DEPOSIT EXEC_BASE "deposit"
+
+/**
+ * \brief Maximum number of replicas.
+ */
+#define REPLICAS_MAXIMUM 16
+
+/**
+ * \brief Number of bytes moved per system call.
+ */
+#define CHUNK (1 << 20)
+
+/**
+ * \brief Spool space released at once after all replicas have read it.
+ */
+#define PUNCH_INTERVAL (64 << 20)
+
+/**
+ * \brief Poll timeout in milliseconds, bounding the delay in noticing
+ * finished replicas.
+ */
+#define POLL_TIMEOUT 100
+
+extern char **environ;
+
+/**
+ * \brief Replica states.
+ */
+enum state {
+	RUNNING,
+	SUCCEEDED,
+	FAILED
+};
+
+/**
+ * \brief Replica.
+ */
+struct replica {
+	const char *module; /**< Storage module name. */
+	pid_t       pid;    /**< Deposit process. */
+	int         fd;     /**< Pipe to the deposit process or −1 once closed. */
+	uint64_t    offset; /**< Spool offset up to which data has been passed on. */
+	enum state  state;  /**< State. */
+};
+
+/**
+ * \brief Replicas.
+ */
+static struct replica replicas[REPLICAS_MAXIMUM];
+
+/**
+ * \brief Number of replicas.
+ */
+static size_t count;
+
+/**
+ * \brief Number of replicas that stored the object.
+ */
+static size_t succeeded;
+
+/**
+ * \brief Number of replicas that failed.
+ */
+static size_t failed;
+
+/**
+ * \brief Spool holding the object.
+ *
+ * This is the input itself if it is a regular file and an unlinked
+ * temporary file otherwise, so every replica reads at its own pace.
+ */
+static int spool = -1;
+
+/**
+ * \brief Input is copied into the spool.
+ */
+static bool spooled;
+
+/**
+ * \brief Spool offset where the object ends so far.
+ */
+static uint64_t end;
+
+/**
+ * \brief Spool offset up to which space has been released.
+ */
+static uint64_t punched;
+
+/**
+ * \brief The whole object is in the spool.
+ */
+static bool eof;
+
+/**
+ * \brief Input is a pipe, which can be spliced from.
+ */
+static bool piped;
+
+/**
+ * \brief I/O buffer for inputs that cannot be spliced.
+ */
+static uint8_t buf[STREAM_BUFSIZE];
+
+/**
+ * \brief Open spool.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool spool_open(void) {
+	struct stat st;
+
+	if (unlikely(fstat(STDIN_FILENO, &st))) {
+		perror("Unable to inspect input");
+		return false;
+	}
+
+	/* Regular files are read directly */
+	if (S_ISREG(st.st_mode)) {
+		off_t pos = lseek(STDIN_FILENO, 0, SEEK_CUR);
+
+		if (unlikely(pos < 0)) {
+			perror("Unable to inspect input");
+			return false;
+		}
+
+		for (size_t iter = 0; iter < count; ++iter)
+			replicas[iter].offset = pos;
+
+		spool = STDIN_FILENO;
+		end   = st.st_size;
+		eof   = true;
+
+		return true;
+	}
+
+	char name[] = TEMP_BASE "replicate-XXXXXX";
+	char fallback[] = "/tmp/replicate-XXXXXX";
+
+	if ((spool = mkostemp(name, O_CLOEXEC)) >= 0)
+		unlink(name);
+
+	else if ((spool = mkostemp(fallback, O_CLOEXEC)) >= 0)
+		unlink(fallback);
+
+	else {
+		perror("Unable to create spool");
+		return false;
+	}
+
+	spooled = true;
+	piped   = S_ISFIFO(st.st_mode);
+
+	return true;
+}
+
+/**
+ * \brief Copy available input into the spool.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool spool_fill(void) {
+	while (!eof) {
+		ssize_t fill;
+
+		if (piped) {
+			loff_t pos = end;
+			fill = splice(STDIN_FILENO, (loff_t *) 0, spool, &pos, CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+			/* Splicing may be unsupported by the file system */
+			if (unlikely(fill < 0 && errno == EINVAL)) {
+				piped = false;
+				continue;
+			}
+		}
+
+		else if ((fill = read(STDIN_FILENO, buf, sizeof buf)) > 0 &&
+			unlikely(pwrite(spool, buf, fill, end) != fill))
+			fill = -1;
+
+		if (fill < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN)
+				return true;
+
+			perror("Unable to spool input");
+			return false;
+		}
+
+		if (!fill)
+			eof = true;
+
+		end += fill;
+
+		/* Reading from anything but a pipe may block */
+		if (!piped)
+			return true;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Release spool space every replica has read.
+ */
+static void spool_punch(void) {
+	uint64_t low = end;
+
+	for (size_t iter = 0; iter < count; ++iter)
+		if (replicas[iter].fd >= 0 && replicas[iter].offset < low)
+			low = replicas[iter].offset;
+
+	if (spooled && low - punched >= PUNCH_INTERVAL &&
+		!fallocate(spool, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, punched, low - punched))
+		punched = low;
+}
+
+/**
+ * \brief Start deposit process for replica.
+ *
+ * The process leads its own process group, so an abandoned deposit can
+ * be terminated before it sees a premature end of input.
+ *
+ * \param rep Replica.
+ * \param ident Object identifier string.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool replica_spawn(struct replica *restrict rep, const char *restrict ident) {
+	int pipefd[2];
+
+	if (unlikely(pipe2(pipefd, O_CLOEXEC))) {
+		perror("Unable to create pipe");
+		return false;
+	}
+
+	/* Larger pipes mean fewer wake‐ups */
+	fcntl(pipefd[1], F_SETPIPE_SZ, CHUNK);
+	fcntl(pipefd[1], F_SETFL, O_NONBLOCK);
+
+	posix_spawn_file_actions_t file_actions;
+	posix_spawnattr_t attr;
+	sigset_t sigdef;
+
+	sigemptyset(&sigdef);
+	sigaddset(&sigdef, SIGPIPE);
+
+	if (unlikely(posix_spawn_file_actions_init(&file_actions))) {
+		perror("Unable to set file descriptors up");
+		return false;
+	}
+
+	if (unlikely(posix_spawnattr_init(&attr))) {
+		perror("Unable to set attributes up");
+		posix_spawn_file_actions_destroy(&file_actions);
+		return false;
+	}
+
+	const char *argv[] = { "deposit", rep->module, ident, (char *) 0 };
+
+	bool result =
+		!posix_spawn_file_actions_adddup2(&file_actions, pipefd[0], 0) &&
+		!posix_spawn_file_actions_addopen(&file_actions, 1, "/dev/null", O_WRONLY, 0) &&
+		!posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF) &&
+		!posix_spawnattr_setpgroup(&attr, 0) &&
+		!posix_spawnattr_setsigdefault(&attr, &sigdef) &&
+		!(errno = posix_spawn(&rep->pid, DEPOSIT, &file_actions, &attr, (char **) argv, environ));
+
+	if (unlikely(!result)) {
+		fprintf(stderr, "Unable to spawn deposit into “%s”: %s\n", rep->module, strerror(errno));
+		close(pipefd[1]);
+	}
+
+	else
+		rep->fd = pipefd[1];
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&file_actions);
+	close(pipefd[0]);
+
+	return result;
+}
+
+/**
+ * \brief Pass spooled data on to replica.
+ *
+ * The pipe is closed once the whole object has been passed on.
+ *
+ * \param rep Replica.
+ */
+static void replica_feed(struct replica *restrict rep) {
+	while (rep->fd >= 0 && rep->offset < end) {
+		loff_t pos = rep->offset;
+		ssize_t fill = splice(spool, &pos, rep->fd, (loff_t *) 0, end - rep->offset > CHUNK ? CHUNK : end - rep->offset, SPLICE_F_NONBLOCK);
+
+		if (fill > 0) {
+			rep->offset += fill;
+			continue;
+		}
+
+		if (fill < 0 && errno == EINTR)
+			continue;
+
+		if (fill < 0 && errno == EAGAIN)
+			return;
+
+		/* The deposit process went away; its exit status tells why */
+		close(rep->fd);
+		rep->fd = -1;
+	}
+
+	if (rep->fd >= 0 && eof) {
+		close(rep->fd);
+		rep->fd = -1;
+	}
+}
+
+/**
+ * \brief Collect exit status of finished deposit processes.
+ *
+ * \param block Wait for at least one process.
+ */
+static void replica_reap(bool block) {
+	for (;;) {
+		int status;
+		pid_t pid = waitpid(-1, &status, block ? 0 : WNOHANG);
+
+		if (pid < 0 && errno == EINTR)
+			continue;
+
+		if (pid <= 0)
+			return;
+
+		for (size_t iter = 0; iter < count; ++iter) {
+			struct replica *rep = &replicas[iter];
+
+			if (rep->pid != pid || rep->state != RUNNING)
+				continue;
+
+			if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+				rep->state = SUCCEEDED;
+				++succeeded;
+			}
+
+			else {
+				fprintf(stderr, "Deposit into “%s” failed!\n", rep->module);
+				rep->state = FAILED;
+				++failed;
+
+				if (rep->fd >= 0) {
+					close(rep->fd);
+					rep->fd = -1;
+				}
+			}
+		}
+
+		block = false;
+	}
+}
+
+/**
+ * \brief Terminate deposits that have not finished.
+ *
+ * The processes are killed before their pipes are closed, so none of
+ * them sees the end of its input, and storage modules only store an
+ * object once they have seen the end of its input.
+ */
+static void replica_abandon(void) {
+	for (size_t iter = 0; iter < count; ++iter) {
+		struct replica *rep = &replicas[iter];
+
+		if (rep->state == RUNNING && rep->pid > 0)
+			kill(-rep->pid, SIGTERM);
+
+		if (rep->fd >= 0) {
+			close(rep->fd);
+			rep->fd = -1;
+		}
+	}
+}
+
+/**
+ * \brief Number of replicas still being fed.
+ */
+static size_t replica_feeding(void) {
+	size_t feeding = 0;
+
+	for (size_t iter = 0; iter < count; ++iter)
+		feeding += replicas[iter].fd >= 0;
+
+	return feeding;
+}
+
+/**
+ * \brief Wait until input or a pipe becomes ready.
+ */
+static void await(void) {
+	struct pollfd pfd[REPLICAS_MAXIMUM + 1];
+	nfds_t nfds = 0;
+
+	if (!eof)
+		pfd[nfds++] = (struct pollfd) { .fd = STDIN_FILENO, .events = POLLIN };
+
+	for (size_t iter = 0; iter < count; ++iter)
+		if (replicas[iter].fd >= 0 && replicas[iter].offset < end)
+			pfd[nfds++] = (struct pollfd) { .fd = replicas[iter].fd, .events = POLLOUT };
+
+	poll(pfd, nfds, POLL_TIMEOUT);
+}
+
+/**
+ * \brief Main routine.
+ *
+ * The object read from standard input is deposited into every module
+ * concurrently.  The program succeeds as soon as \a quorum deposits have
+ * completed; the others are left to complete in the background.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector: quorum, identifier and module names.
+ *
+ * \return EXIT_SUCCESS if the quorum was reached or EXIT_FAILURE otherwise.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc < 4 || argc - 3 > REPLICAS_MAXIMUM)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	uint64_t quorum;
+	uint8_t ident[32];
+
+	count = argc - 3;
+
+	if (unlikely(!decsint(&quorum, argv[1]) || quorum > count)) {
+		fprintf(stderr, "Invalid quorum “%s”!\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	/* Default to a majority */
+	if (!quorum)
+		quorum = count / 2 + 1;
+
+	if (unlikely(strlen(argv[2]) != 32 * 2 || !hexsint(ident, argv[2], sizeof ident))) {
+		fprintf(stderr, "Failed to parse identifier “%s”!\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	/* Departed replicas show up as errors rather than signals */
+	signal(SIGPIPE, SIG_IGN);
+
+	for (size_t iter = 0; iter < count; ++iter)
+		replicas[iter] = (struct replica) {
+			.module = argv[3 + iter],
+			.pid    = -1,
+			.fd     = -1,
+			.offset = 0,
+			.state  = RUNNING
+		};
+
+	if (unlikely(!spool_open()))
+		return EXIT_FAILURE;
+
+	for (size_t iter = 0; iter < count; ++iter)
+		if (unlikely(!replica_spawn(&replicas[iter], argv[2]))) {
+			replicas[iter].state = FAILED;
+			++failed;
+		}
+
+	/* Feed replicas until the quorum is reached or cannot be reached any more */
+	while (succeeded < quorum && failed <= count - quorum) {
+		if (unlikely(!spool_fill())) {
+			replica_abandon();
+			return EXIT_FAILURE;
+		}
+
+		for (size_t iter = 0; iter < count; ++iter)
+			replica_feed(&replicas[iter]);
+
+		spool_punch();
+		replica_reap(eof && !replica_feeding());
+
+		if (!eof || replica_feeding())
+			await();
+	}
+
+	if (failed > count - quorum) {
+		fputs("Write quorum not reached!\n", stderr);
+		replica_abandon();
+		return EXIT_FAILURE;
+	}
+
+	/* Leave the remaining replicas to a background process */
+	if (replica_feeding() && !fork()) {
+		while (replica_feeding()) {
+			if (unlikely(!spool_fill())) {
+				replica_abandon();
+				_exit(EXIT_FAILURE);
+			}
+
+			for (size_t iter = 0; iter < count; ++iter)
+				replica_feed(&replicas[iter]);
+
+			spool_punch();
+
+			if (replica_feeding())
+				await();
+		}
+
+		_exit(EXIT_SUCCESS);
+	}
+
+	return EXIT_SUCCESS;
+}
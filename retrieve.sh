@@ -2,12 +2,18 @@
 
 set -e
 
-if [ $# -ne 2 ]
+if [ $# -ne 2 -a $# -ne 4 ]
 then
 	echo "Invalid number of arguments" >&2
 	exit 1
 fi
 
+# Record metrics of storage operations
+tally="/usr/libexec/opencorpus/tally"
+
+# Spread global storage over the store roots in its routing table
+route="/usr/libexec/opencorpus/route"
+
 # Find storage module
 if [ -n "$HOME" -a -x "$HOME/.opencorpus/storage/$1" ]
 then
@@ -32,7 +38,7 @@ else
 	exit 1
 fi
 
-mkdir -p "$cache"
+mkdir -p "$cache" "$cache/objects"
 
 # Create temp directory
 if [ -w "/var/tmp/opencorpus/storage" ]
@@ -47,7 +53,61 @@ mkdir -p "$temp"
 # Clean temp directory upon exit
 trap 'rm -f -r -- "$temp"' EXIT
 
-# Launch storage module
+# Read cache configuration
+if [ -r "/etc/opencorpus/cache" ]
+then
+	. "/etc/opencorpus/cache"
+	export CACHE_SIZE
+fi
+
+# Serve from object cache unless it is to be bypassed
+if [ -z "$NO_CACHE" ] && "/usr/libexec/opencorpus/cache" "$cache/objects" "$2" "serve" ${3:+"$3" "$4"}
+then
+	exit 0
+fi
+
+# Retrieve whole objects through the object cache and byte ranges directly
+fetch() {
+	if [ -z "$offset" -a -n "$NO_CACHE" ]
+	then
+		"$tally" "$name" "retrieve" "$@" "retrieve"
+		return
+	elif [ -z "$offset" ]
+	then
+		"/usr/libexec/opencorpus/cache" "$cache/objects" "$id" "fill" "$tally" "$name" "retrieve" "$@" "retrieve"
+		return
+	fi
+
+	status=0
+	"$tally" "$name" "range" "$@" "range" "$offset" "$length" || status=$?
+
+	if [ $status -ne 2 ]
+	then
+		return $status
+	fi
+
+	# The module cannot seek, so skip through the object instead
+	{ "$tally" "$name" "retrieve" "$@" "retrieve" || echo $? >"$temp/status"; } \
+		| tail -c "+$((offset + 1))" | head -c "$length"
+
+	# The module is cut off by SIGPIPE once the range has been read
+	status=0
+	[ ! -s "$temp/status" ] || status=`cat "$temp/status"`
+
+	if [ $status -eq 141 ]
+	then
+		status=0
+	fi
+
+	return $status
+}
+
+name="$1"
+id="$2"
+offset="$3"
+length="$4"
+
+# Launch storage module through the object cache
 if [ -z "$NO_SANDBOX" ]
 then
 	export SYDBOX_WRITE="/dev/fd:/dev/full:/dev/null:/dev/stderr:/dev/stdout:/dev/shm:/dev/tty:/dev/zero:/proc/self/attr:/proc/self/fd:/proc/self/task:/tmp:$cache:$temp"
@@ -56,18 +116,18 @@ then
 #	export SYDBOX_NET_WHITELIST_CONNECT="$SYDBOX_NET_WHITELIST_BIND"
 
 	# Try to retrieve from local storage
-	if sydbox -C -L -B "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "assay"
+	if "$tally" "$1" "assay" sydbox -C -L -B "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "assay"
 	then
-		sydbox -C -L -B "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "retrieve"
+		fetch sydbox -C -L -B "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2"
 	else
-		sydbox -C -L -B "$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2" "retrieve"
+		fetch sydbox -C -L -B "$route" "$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2"
 	fi
 else
 	# Try local storage
-	if "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "assay"
+	if "$tally" "$1" "assay" "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "assay"
 	then
-		"$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2" "retrieve"
+		fetch "$module" "$HOME/.opencorpus/corpus/$1" "$cache" "$temp" "$2"
 	else
-		"$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2" "retrieve"
+		fetch "$route" "$module" "/var/db/opencorpus/$1" "$cache" "$temp" "$2"
 	fi
 fi
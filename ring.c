@@ -0,0 +1,879 @@
+/* io_uring is entered through raw system calls */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+# include <linux/io_uring.h>
+# include <sys/syscall.h>
+#endif
+
+#include "egress.h"
+#include "expect.h"
+#include "ring.h"
+
+/* Direct descriptors appeared along with this flag */
+#if defined(__NR_io_uring_setup) && defined(IORING_FILE_INDEX_ALLOC)
+# define RING_URING_AVAILABLE
+#endif
+
+/**
+ * \def atomic_load(var)
+ *
+ * \brief Load value shared with the kernel.
+ *
+ * \param var Variable.
+ */
+
+/**
+ * \def atomic_store(var, val)
+ *
+ * \brief Store value shared with the kernel.
+ *
+ * \param var Variable.
+ * \param val Value.
+ */
+#if defined(__clang__) || defined(__GNUC__)
+# define atomic_load(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+# define atomic_store(var, val) __atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+#else
+# error "Atomic operations are not available for this compiler"
+#endif
+
+/**
+ * \brief Stages of an operation chain, kept in the low bits of user data.
+ */
+enum {
+	STAGE_OPEN,
+	STAGE_TRANSFER,
+	STAGE_CLOSE,
+	STAGE_SYNC,
+	STAGE_BITS = 2
+};
+
+#ifdef RING_URING_AVAILABLE
+/**
+ * \brief Operation chain in flight.
+ */
+struct ring_chain {
+	uint64_t     tag;     /**< Caller tag. */
+	int64_t      result;  /**< Result so far. */
+	unsigned int pending; /**< Number of outstanding operations. */
+};
+
+/**
+ * \brief io_uring state.
+ */
+struct ring_uring {
+	int                  fd;          /**< Ring file descriptor. */
+	void                *sqmap;       /**< Submission queue mapping. */
+	size_t               sqsize;      /**< Size of submission queue mapping. */
+	void                *cqmap;       /**< Completion queue mapping. */
+	size_t               cqsize;      /**< Size of completion queue mapping. */
+	struct io_uring_sqe *sqes;        /**< Submission queue entries. */
+	size_t               sqesize;     /**< Size of submission queue entries. */
+	unsigned int        *sq_tail;     /**< Submission queue tail. */
+	unsigned int        *sq_mask;     /**< Submission queue index mask. */
+	unsigned int        *sq_array;    /**< Submission queue index array. */
+	unsigned int        *cq_head;     /**< Completion queue head. */
+	unsigned int        *cq_tail;     /**< Completion queue tail. */
+	unsigned int        *cq_mask;     /**< Completion queue index mask. */
+	struct io_uring_cqe *cqes;        /**< Completion queue entries. */
+	unsigned int         tail;        /**< Local submission queue tail. */
+	unsigned int         unsubmitted; /**< Number of entries not yet submitted. */
+	struct ring_chain    chain[];     /**< Chains by slot. */
+};
+
+/**
+ * \brief Operations the io_uring engine relies on.
+ */
+static const uint8_t uring_ops[] = {
+	IORING_OP_OPENAT, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED, IORING_OP_FSYNC, IORING_OP_CLOSE
+};
+
+/**
+ * \brief Tear io_uring down.
+ *
+ * \param uring io_uring state.
+ */
+static void uring_close(struct ring_uring *restrict uring) {
+	if (uring->sqes)
+		munmap(uring->sqes, uring->sqesize);
+
+	if (uring->cqmap && uring->cqmap != uring->sqmap)
+		munmap(uring->cqmap, uring->cqsize);
+
+	if (uring->sqmap)
+		munmap(uring->sqmap, uring->sqsize);
+
+	/* Closing the ring releases registered buffers and files */
+	if (uring->fd >= 0)
+		close(uring->fd);
+
+	free(uring);
+}
+
+/**
+ * \brief Set io_uring up.
+ *
+ * \param ring Ring context.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool uring_open(struct ring *restrict ring) {
+	struct ring_uring *uring = calloc(1, sizeof *uring + ring->depth * sizeof *uring->chain);
+	if (unlikely(!uring))
+		return false;
+
+	uring->fd = -1;
+
+	/* Chains are at most three entries long and complete before their slot is reused */
+	struct io_uring_params params;
+	memset(&params, 0, sizeof params);
+
+	if ((uring->fd = syscall(__NR_io_uring_setup, ring->depth * 4, &params)) < 0)
+		goto failure;
+
+	/* Skipping completions appeared after direct descriptors */
+	if (!(params.features & IORING_FEAT_CQE_SKIP))
+		goto failure;
+
+	uring->sqsize = params.sq_off.array + params.sq_entries * sizeof (unsigned int);
+	uring->cqsize = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP && uring->cqsize > uring->sqsize)
+		uring->sqsize = uring->cqsize;
+
+	uring->sqmap = mmap((void *) 0, uring->sqsize, PROT_READ | PROT_WRITE, MAP_SHARED, uring->fd, IORING_OFF_SQ_RING);
+	if (uring->sqmap == MAP_FAILED) {
+		uring->sqmap = (void *) 0;
+		goto failure;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		uring->cqmap = uring->sqmap;
+
+	else if ((uring->cqmap = mmap((void *) 0, uring->cqsize, PROT_READ | PROT_WRITE, MAP_SHARED, uring->fd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+		uring->cqmap = (void *) 0;
+		goto failure;
+	}
+
+	uring->sqesize = params.sq_entries * sizeof (struct io_uring_sqe);
+	uring->sqes = mmap((void *) 0, uring->sqesize, PROT_READ | PROT_WRITE, MAP_SHARED, uring->fd, IORING_OFF_SQES);
+	if (uring->sqes == MAP_FAILED) {
+		uring->sqes = (struct io_uring_sqe *) 0;
+		goto failure;
+	}
+
+	uint8_t *sq = uring->sqmap, *cq = uring->cqmap;
+
+	uring->sq_tail  = (unsigned int *) (sq + params.sq_off.tail);
+	uring->sq_mask  = (unsigned int *) (sq + params.sq_off.ring_mask);
+	uring->sq_array = (unsigned int *) (sq + params.sq_off.array);
+	uring->cq_head  = (unsigned int *) (cq + params.cq_off.head);
+	uring->cq_tail  = (unsigned int *) (cq + params.cq_off.tail);
+	uring->cq_mask  = (unsigned int *) (cq + params.cq_off.ring_mask);
+	uring->cqes     = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+	uring->tail     = *uring->sq_tail;
+
+	/* Probe for the operations used */
+	size_t probesize = sizeof (struct io_uring_probe) + 256 * sizeof (struct io_uring_probe_op);
+	struct io_uring_probe *probe = calloc(1, probesize);
+
+	bool probed = probe && !syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_PROBE, probe, 256);
+
+	for (size_t iter = 0; probed && iter < sizeof uring_ops; ++iter)
+		probed = uring_ops[iter] <= probe->last_op && probe->ops[uring_ops[iter]].flags & IO_URING_OP_SUPPORTED;
+
+	free(probe);
+
+	if (!probed)
+		goto failure;
+
+	/* Register slot buffers and an empty file table */
+	struct iovec *iov  = malloc(ring->depth * sizeof *iov);
+	int          *file = malloc(ring->depth * sizeof *file);
+	bool registered = iov && file;
+
+	for (unsigned int iter = 0; registered && iter < ring->depth; ++iter) {
+		iov[iter].iov_base = ring_buffer(ring, iter);
+		iov[iter].iov_len  = ring->bufsize;
+		file[iter] = -1;
+	}
+
+	registered = registered &&
+		!syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_BUFFERS, iov, ring->depth) &&
+		!syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_FILES, file, ring->depth);
+
+	free(iov);
+	free(file);
+
+	if (!registered)
+		goto failure;
+
+	ring->uring = uring;
+	return true;
+
+failure:
+	uring_close(uring);
+	return false;
+}
+
+/**
+ * \brief Get next submission queue entry.
+ *
+ * \param uring io_uring state.
+ * \param slot Slot.
+ * \param stage Stage within the chain.
+ *
+ * \return Zeroed submission queue entry.
+ */
+static struct io_uring_sqe *uring_entry(struct ring_uring *restrict uring, unsigned int slot, unsigned int stage) {
+	unsigned int index = uring->tail++ & *uring->sq_mask;
+	struct io_uring_sqe *sqe = &uring->sqes[index];
+
+	memset(sqe, 0, sizeof *sqe);
+	sqe->user_data = (uint64_t) slot << STAGE_BITS | stage;
+
+	uring->sq_array[index] = index;
+	++uring->unsubmitted;
+	++uring->chain[slot].pending;
+
+	return sqe;
+}
+
+/**
+ * \brief Submit entries and optionally wait for a completion.
+ *
+ * \param uring io_uring state.
+ * \param wait Wait for a completion.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool uring_enter(struct ring_uring *restrict uring, bool wait) {
+	atomic_store(*uring->sq_tail, uring->tail);
+
+	for (;;) {
+		long int submitted = syscall(__NR_io_uring_enter, uring->fd, uring->unsubmitted, wait ? 1 : 0,
+			wait ? IORING_ENTER_GETEVENTS : 0, (void *) 0, 0);
+
+		if (likely(submitted >= 0)) {
+			uring->unsubmitted -= submitted;
+			return true;
+		}
+
+		if (errno != EINTR)
+			return false;
+	}
+}
+
+/**
+ * \brief Reap completion.
+ *
+ * Chains complete once all of their operations have.  The first genuine
+ * error of a chain is its result, while cancellations of linked
+ * operations and failures to close are of no concern.
+ *
+ * \param ring Ring context.
+ * \param done Buffer to hold the completion.
+ *
+ * \return \c true if a chain completed or \c false otherwise.
+ */
+static bool uring_reap(struct ring *restrict ring, struct ring_completion *restrict done) {
+	struct ring_uring *uring = ring->uring;
+	unsigned int head = *uring->cq_head;
+
+	while (head != atomic_load(*uring->cq_tail)) {
+		const struct io_uring_cqe *cqe = &uring->cqes[head & *uring->cq_mask];
+
+		unsigned int slot  = cqe->user_data >> STAGE_BITS;
+		unsigned int stage = cqe->user_data & ((1 << STAGE_BITS) - 1);
+		int32_t      res   = cqe->res;
+
+		atomic_store(*uring->cq_head, ++head);
+
+		struct ring_chain *chain = &uring->chain[slot];
+
+		if (res < 0) {
+			if (chain->result >= 0 && res != -ECANCELED && stage != STAGE_CLOSE)
+				chain->result = res;
+		}
+
+		else if (stage == STAGE_TRANSFER && chain->result >= 0)
+			chain->result = res;
+
+		if (!--chain->pending) {
+			done->tag    = chain->tag;
+			done->slot   = slot;
+			done->result = chain->result;
+			return true;
+		}
+	}
+
+	return false;
+}
+#endif /* RING_URING_AVAILABLE */
+
+/**
+ * \brief Begin operation chain.
+ *
+ * \param ring Ring context.
+ * \param slot Slot.
+ * \param length Transfer length.
+ * \param tag Caller tag.
+ *
+ * \return \c true if the chain may be queued or \c false otherwise.
+ */
+static bool ring_begin(struct ring *restrict ring, unsigned int slot, size_t length, uint64_t tag) {
+	if (unlikely(slot >= ring->depth || length > ring->bufsize || ring->queued == ring->depth)) {
+		errno = EINVAL;
+		return false;
+	}
+
+#ifdef RING_URING_AVAILABLE
+	if (ring->engine == RING_URING) {
+		ring->uring->chain[slot].tag     = tag;
+		ring->uring->chain[slot].result  = 0;
+		ring->uring->chain[slot].pending = 0;
+	}
+#endif
+
+	++ring->queued;
+
+	return true;
+}
+
+/**
+ * \brief Record chain carried out synchronously.
+ *
+ * \param ring Ring context.
+ * \param slot Slot.
+ * \param tag Caller tag.
+ * \param result Result.
+ */
+static void ring_finish(struct ring *restrict ring, unsigned int slot, uint64_t tag, int64_t result) {
+	ring->done[ring->ready].tag    = tag;
+	ring->done[ring->ready].slot   = slot;
+	ring->done[ring->ready].result = result;
+	++ring->ready;
+}
+
+/**
+ * \brief Read from file synchronously.
+ *
+ * \param fd File descriptor.
+ * \param buf Buffer.
+ * \param offset File offset.
+ * \param length Number of bytes to read.
+ *
+ * \return Number of bytes read or negated error number.
+ */
+static int64_t sync_read(int fd, uint8_t *restrict buf, uint64_t offset, size_t length) {
+	size_t fill = 0;
+
+	while (fill < length) {
+		ssize_t in = pread(fd, buf + fill, length - fill, offset + fill);
+
+		if (unlikely(in < 0)) {
+			if (errno == EINTR)
+				continue;
+
+			return -errno;
+		}
+
+		if (!in)
+			break;
+
+		fill += in;
+	}
+
+	return fill;
+}
+
+/**
+ * \brief Write to file synchronously.
+ *
+ * \param fd File descriptor.
+ * \param buf Buffer.
+ * \param offset File offset.
+ * \param length Number of bytes to write.
+ * \param sync Synchronise file data.
+ *
+ * \return Number of bytes written or negated error number.
+ */
+static int64_t sync_write(int fd, const uint8_t *restrict buf, uint64_t offset, size_t length, bool sync) {
+	size_t fill = 0;
+
+	while (fill < length) {
+		ssize_t out = pwrite(fd, buf + fill, length - fill, offset + fill);
+
+		if (unlikely(out < 0)) {
+			if (errno == EINTR)
+				continue;
+
+			return -errno;
+		}
+
+		fill += out;
+	}
+
+	return sync && fdatasync(fd) ? -errno : (int64_t) fill;
+}
+
+bool ring_open(struct ring *restrict ring, enum ring_engine engine, unsigned int depth, size_t bufsize) {
+	prime(bool);
+
+	if (unlikely(!depth || depth > RING_DEPTH_MAXIMUM || !bufsize))
+		egress(0, false, EINVAL);
+
+	ring->engine  = RING_SYNC;
+	ring->depth   = depth;
+	ring->bufsize = bufsize;
+	ring->queued  = 0;
+	ring->ready   = 0;
+	ring->uring   = (struct ring_uring *) 0;
+
+	/* Registered buffers are pinned, so they are mapped rather than allocated */
+	ring->buf = mmap((void *) 0, depth * bufsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (unlikely(ring->buf == MAP_FAILED))
+		egress(0, false, errno);
+
+	ring->done = malloc(depth * sizeof *ring->done);
+	if (unlikely(!ring->done))
+		egress(1, false, errno);
+
+#ifdef RING_URING_AVAILABLE
+	if (engine == RING_URING && uring_open(ring))
+		ring->engine = RING_URING;
+#endif
+
+	egress(0, true, errno);
+
+egress1:
+	munmap(ring->buf, depth * bufsize);
+
+egress0:
+	final();
+}
+
+bool ring_load(struct ring *restrict ring, unsigned int slot, const char *restrict path, uint64_t offset, size_t length, uint64_t tag) {
+	if (unlikely(!ring_begin(ring, slot, length, tag)))
+		return false;
+
+#ifdef RING_URING_AVAILABLE
+	if (ring->engine == RING_URING) {
+		struct io_uring_sqe *sqe = uring_entry(ring->uring, slot, STAGE_OPEN);
+		sqe->opcode     = IORING_OP_OPENAT;
+		sqe->flags      = IOSQE_IO_LINK;
+		sqe->fd         = AT_FDCWD;
+		sqe->addr       = (uintptr_t) path;
+		/* Direct descriptors are never inherited, so O_CLOEXEC is refused */
+		sqe->open_flags = O_RDONLY;
+		sqe->file_index = slot + 1;
+
+		/* The file is closed even if reading fails */
+		sqe = uring_entry(ring->uring, slot, STAGE_TRANSFER);
+		sqe->opcode    = IORING_OP_READ_FIXED;
+		sqe->flags     = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+		sqe->fd        = slot;
+		sqe->addr      = (uintptr_t) ring_buffer(ring, slot);
+		sqe->len       = length;
+		sqe->off       = offset;
+		sqe->buf_index = slot;
+
+		sqe = uring_entry(ring->uring, slot, STAGE_CLOSE);
+		sqe->opcode     = IORING_OP_CLOSE;
+		sqe->file_index = slot + 1;
+
+		return true;
+	}
+#endif
+
+	int64_t result;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		result = -errno;
+
+	else {
+		result = sync_read(fd, ring_buffer(ring, slot), offset, length);
+		close(fd);
+	}
+
+	ring_finish(ring, slot, tag, result);
+
+	return true;
+}
+
+bool ring_read(struct ring *restrict ring, unsigned int slot, int fd, uint64_t offset, size_t length, uint64_t tag) {
+	if (unlikely(!ring_begin(ring, slot, length, tag)))
+		return false;
+
+#ifdef RING_URING_AVAILABLE
+	if (ring->engine == RING_URING) {
+		struct io_uring_sqe *sqe = uring_entry(ring->uring, slot, STAGE_TRANSFER);
+		sqe->opcode    = IORING_OP_READ_FIXED;
+		sqe->fd        = fd;
+		sqe->addr      = (uintptr_t) ring_buffer(ring, slot);
+		sqe->len       = length;
+		sqe->off       = offset;
+		sqe->buf_index = slot;
+
+		return true;
+	}
+#endif
+
+	ring_finish(ring, slot, tag, sync_read(fd, ring_buffer(ring, slot), offset, length));
+
+	return true;
+}
+
+bool ring_write(struct ring *restrict ring, unsigned int slot, int fd, uint64_t offset, size_t length, bool sync, uint64_t tag) {
+	if (unlikely(!ring_begin(ring, slot, length, tag)))
+		return false;
+
+#ifdef RING_URING_AVAILABLE
+	if (ring->engine == RING_URING) {
+		/* A short write cancels synchronisation */
+		struct io_uring_sqe *sqe = uring_entry(ring->uring, slot, STAGE_TRANSFER);
+		sqe->opcode    = IORING_OP_WRITE_FIXED;
+		sqe->flags     = sync ? IOSQE_IO_LINK : 0;
+		sqe->fd        = fd;
+		sqe->addr      = (uintptr_t) ring_buffer(ring, slot);
+		sqe->len       = length;
+		sqe->off       = offset;
+		sqe->buf_index = slot;
+
+		if (sync) {
+			sqe = uring_entry(ring->uring, slot, STAGE_SYNC);
+			sqe->opcode      = IORING_OP_FSYNC;
+			sqe->fd          = fd;
+			sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+		}
+
+		return true;
+	}
+#endif
+
+	ring_finish(ring, slot, tag, sync_write(fd, ring_buffer(ring, slot), offset, length, sync));
+
+	return true;
+}
+
+bool ring_submit(struct ring *restrict ring) {
+#ifdef RING_URING_AVAILABLE
+	if (ring->engine == RING_URING && ring->uring->unsubmitted)
+		return uring_enter(ring->uring, false);
+#endif
+
+	return true;
+}
+
+bool ring_wait(struct ring *restrict ring, struct ring_completion *restrict done) {
+	if (unlikely(!ring->queued)) {
+		errno = ENOENT;
+		return false;
+	}
+
+#ifdef RING_URING_AVAILABLE
+	if (ring->engine == RING_URING) {
+		while (!uring_reap(ring, done))
+			if (unlikely(!uring_enter(ring->uring, true)))
+				return false;
+
+		--ring->queued;
+		return true;
+	}
+#endif
+
+	*done = ring->done[--ring->ready];
+	--ring->queued;
+
+	return true;
+}
+
+void ring_close(struct ring *restrict ring) {
+	struct ring_completion done;
+
+	while (ring->queued && ring_wait(ring, &done));
+
+#ifdef RING_URING_AVAILABLE
+	if (ring->uring)
+		uring_close(ring->uring);
+#endif
+
+	free(ring->done);
+	munmap(ring->buf, ring->depth * ring->bufsize);
+}
+
+#if defined(TEST) || defined(BENCH)
+#include <stdio.h>
+
+#include <sys/stat.h>
+
+/**
+ * \brief Create file filled with pattern.
+ *
+ * \param path File path.
+ * \param size File size.
+ * \param seed Pattern seed.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool fill(const char *restrict path, size_t size, unsigned int seed) {
+	uint8_t block[4096];
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+	if (fd < 0)
+		return false;
+
+	bool result = true;
+
+	for (size_t pos = 0; result && pos < size; pos += sizeof block) {
+		size_t len = size - pos < sizeof block ? size - pos : sizeof block;
+
+		for (size_t iter = 0; iter < len; ++iter)
+			block[iter] = (pos + iter) * 31 + seed;
+
+		result = write(fd, block, len) == (ssize_t) len;
+	}
+
+	return !close(fd) && result;
+}
+#endif
+
+#ifdef TEST
+#include "essai.h"
+
+/**
+ * \brief Check buffer against pattern.
+ *
+ * \param buf Buffer.
+ * \param size Buffer size.
+ * \param seed Pattern seed.
+ *
+ * \return \c true if the buffer matches or \c false otherwise.
+ */
+static bool matches(const uint8_t *restrict buf, size_t size, unsigned int seed) {
+	for (size_t iter = 0; iter < size; ++iter)
+		if (buf[iter] != (uint8_t) (iter * 31 + seed))
+			return false;
+
+	return true;
+}
+
+/**
+ * \brief Exercise engine.
+ *
+ * \param engine Engine.
+ * \param dir Scratch directory.
+ */
+static bool exercise(enum ring_engine engine, const char *restrict dir) {
+	char path[8][64];
+	struct ring ring;
+	struct ring_completion done;
+
+	for (unsigned int iter = 0; iter < 8; ++iter) {
+		snprintf(path[iter], sizeof path[iter], "%s/%u", dir, iter);
+		if (!fill(path[iter], 1000 * (iter + 1), iter))
+			return false;
+	}
+
+	if (!ring_open(&ring, engine, 8, 8192))
+		return false;
+
+	bool result = true;
+
+	/* Whole files in one batch, with short reads at the end of file */
+	for (unsigned int iter = 0; iter < 8; ++iter)
+		result = result && ring_load(&ring, iter, path[iter], 0, ring.bufsize, iter);
+
+	for (unsigned int iter = 0; result && iter < 8; ++iter)
+		result = ring_wait(&ring, &done) && done.slot == done.tag &&
+			done.result == 1000 * (done.slot + 1) && matches(ring_buffer(&ring, done.slot), done.result, done.slot);
+
+	/* Nothing is left to wait for */
+	result = result && !ring_wait(&ring, &done);
+
+	/* Failures are reported per chain */
+	result = result && ring_load(&ring, 0, "/nonexistent", 0, 16, 42) &&
+		ring_wait(&ring, &done) && done.tag == 42 && done.result == -ENOENT;
+
+	/* Write with synchronisation, then read back */
+	int fd = open(path[0], O_RDWR);
+	memset(ring_buffer(&ring, 3), 0x5a, 100);
+
+	result = result && fd >= 0 &&
+		ring_write(&ring, 3, fd, 500, 100, true, 7) && ring_wait(&ring, &done) && done.result == 100 &&
+		ring_read(&ring, 5, fd, 0, 1000, 8) && ring_wait(&ring, &done) && done.result == 1000 &&
+		matches(ring_buffer(&ring, 5), 500, 0) && ((uint8_t *) ring_buffer(&ring, 5))[599] == 0x5a;
+
+	if (fd >= 0)
+		close(fd);
+
+	/* Oversized transfers are refused */
+	result = result && !ring_read(&ring, 0, 0, 0, ring.bufsize + 1, 0) && !ring_read(&ring, 8, 0, 0, 1, 0);
+
+	ring_close(&ring);
+
+	for (unsigned int iter = 0; iter < 8; ++iter)
+		unlink(path[iter]);
+
+	return result;
+}
+
+int main(void) {
+	char dir[] = "/tmp/ring-XXXXXX";
+	essaye(mkdtemp(dir));
+
+	struct ring ring;
+	essaye(ring_open(&ring, RING_URING, 4, 4096));
+	printf("Engine: %s\n", ring.engine == RING_URING ? "io_uring" : "synchronous");
+	ring_close(&ring);
+
+	essaye(exercise(RING_SYNC, dir));
+	essaye(exercise(RING_URING, dir));
+
+	rmdir(dir);
+
+	return EXIT_SUCCESS;
+}
+#endif /* TEST */
+
+#ifdef BENCH
+#include <time.h>
+
+#include "string.h"
+
+/**
+ * \brief Get monotonic time.
+ *
+ * \return Seconds since an arbitrary point.
+ */
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * \brief Read or rewrite every file through ring.
+ *
+ * \param engine Engine.
+ * \param write Rewrite and synchronise instead of reading.
+ * \param names File names.
+ * \param fds Open file descriptors for rewriting.
+ * \param files Number of files.
+ * \param size File size.
+ * \param depth Number of slots.
+ *
+ * \return Elapsed time in seconds or a negative value on failure.
+ */
+static double run(enum ring_engine engine, bool write, char (*names)[64], const int *restrict fds, size_t files, size_t size, unsigned int depth) {
+	struct ring ring;
+	if (!ring_open(&ring, engine, depth, size))
+		return -1;
+
+	if (ring.engine != engine) {
+		ring_close(&ring);
+		return -1;
+	}
+
+	struct ring_completion done;
+	double start = now();
+	size_t next = 0, failed = 0;
+
+	/* Keep every slot busy, submitting in batches */
+	for (unsigned int slot = 0; slot < depth && next < files; ++slot, ++next)
+		if (!(write ? ring_write(&ring, slot, fds[next], 0, size, true, next) : ring_load(&ring, slot, names[next], 0, size, next)))
+			++failed;
+
+	while (ring_wait(&ring, &done)) {
+		if (done.result != (int64_t) size)
+			++failed;
+
+		if (next < files) {
+			if (!(write ? ring_write(&ring, done.slot, fds[next], 0, size, true, next) : ring_load(&ring, done.slot, names[next], 0, size, next)))
+				++failed;
+
+			++next;
+		}
+	}
+
+	double elapsed = now() - start;
+	ring_close(&ring);
+
+	return failed ? -1 : elapsed;
+}
+
+/**
+ * \brief Benchmark routine.
+ *
+ * Reads \c RING_FILES files of \c RING_SIZE bytes each through chains of
+ * open, read and close, and rewrites them with data synchronisation,
+ * once synchronously and once through io_uring with \c RING_DEPTH
+ * chains in flight.  The files are in the page cache for reading.
+ */
+int main(void) {
+	size_t       files = setting("RING_FILES", 2000);
+	size_t       size  = setting("RING_SIZE", 64 * 1024);
+	unsigned int depth = setting("RING_DEPTH", 64);
+
+	char dir[] = "/tmp/ring-bench-XXXXXX";
+	char (*names)[64] = malloc(files * sizeof *names);
+	int *fds = malloc(files * sizeof *fds);
+
+	if (!names || !fds || !mkdtemp(dir)) {
+		perror("Unable to set benchmark up");
+		return EXIT_FAILURE;
+	}
+
+	for (size_t iter = 0; iter < files; ++iter) {
+		snprintf(names[iter], sizeof names[iter], "%s/%zu", dir, iter);
+
+		if (!fill(names[iter], size, iter) || (fds[iter] = open(names[iter], O_WRONLY)) < 0) {
+			perror("Unable to create file");
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("engine op files depth seconds ops/s MiB/s\n");
+
+	static const char *const engines[] = { [RING_SYNC] = "sync", [RING_URING] = "io_uring" };
+	int rc = EXIT_SUCCESS;
+
+	for (int write = 0; write < 2; ++write)
+		for (int engine = RING_SYNC; engine <= RING_URING; ++engine) {
+			double elapsed = run(engine, write, names, fds, files, size, engine == RING_SYNC ? 1 : depth);
+
+			if (elapsed < 0) {
+				printf("%s %s - - - - -\n", engines[engine], write ? "write" : "read");
+				rc = EXIT_FAILURE;
+				continue;
+			}
+
+			printf("%s %s %zu %u %.3f %.1f %.1f\n", engines[engine], write ? "write" : "read", files,
+				engine == RING_SYNC ? 1 : depth, elapsed, files / elapsed, files * (double) size / elapsed / 1048576);
+		}
+
+	for (size_t iter = 0; iter < files; ++iter) {
+		close(fds[iter]);
+		unlink(names[iter]);
+	}
+
+	rmdir(dir);
+
+	return rc;
+}
+#endif /* BENCH */
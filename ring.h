@@ -0,0 +1,155 @@
+#pragma once
+#ifndef OC_RING_H
+#define OC_RING_H
+
+/**
+ * \file
+ *
+ * \brief Batched file I/O.
+ *
+ * Operations are queued into slots, each of which owns a transfer buffer
+ * and a file table entry, are submitted together and complete in any
+ * order.  On Linux they go through io_uring with registered buffers and
+ * files, so that an operation chain costs no system call of its own.
+ * Elsewhere, or if io_uring is unavailable, every operation is carried
+ * out synchronously as it is queued.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Maximum number of slots.
+ */
+#define RING_DEPTH_MAXIMUM 1024
+
+/**
+ * \brief I/O engines.
+ */
+enum ring_engine {
+	RING_SYNC, /**< Synchronous system calls. */
+	RING_URING /**< io_uring. */
+};
+
+/**
+ * \brief Completed operation chain.
+ */
+struct ring_completion {
+	uint64_t     tag;    /**< Caller tag. */
+	unsigned int slot;   /**< Slot, which is free again. */
+	int64_t      result; /**< Bytes transferred or negated error number. */
+};
+
+/**
+ * \brief Ring context structure.
+ */
+struct ring {
+	enum ring_engine        engine;  /**< Engine in use. */
+	unsigned int            depth;   /**< Number of slots. */
+	size_t                  bufsize; /**< Size of each slot buffer. */
+	uint8_t                *buf;     /**< Slot buffers. */
+	unsigned int            queued;  /**< Chains queued or in flight. */
+	struct ring_completion *done;    /**< Completions of chains carried out synchronously. */
+	unsigned int            ready;   /**< Number of such completions. */
+	struct ring_uring      *uring;   /**< io_uring state. */
+};
+
+/**
+ * \brief Get slot buffer.
+ *
+ * \param ring Ring context.
+ * \param slot Slot.
+ */
+#define ring_buffer(ring, slot) ((void *) ((ring)->buf + (size_t) (slot) * (ring)->bufsize))
+
+/**
+ * \brief Set ring up.
+ *
+ * \param ring Ring context.
+ * \param engine Preferred engine, which falls back to \c RING_SYNC.
+ * \param depth Number of slots.
+ * \param bufsize Size of each slot buffer.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool ring_open(struct ring *restrict ring, enum ring_engine engine, unsigned int depth, size_t bufsize);
+
+/**
+ * \brief Queue reading of file.
+ *
+ * Opening, reading into the slot buffer and closing are linked, so that
+ * a failure cancels the rest of the chain.  The path must stay valid
+ * until the chain is submitted.
+ *
+ * \param ring Ring context.
+ * \param slot Free slot.
+ * \param path File path.
+ * \param offset File offset.
+ * \param length Number of bytes to read, at most the buffer size.
+ * \param tag Caller tag.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool ring_load(struct ring *restrict ring, unsigned int slot, const char *restrict path, uint64_t offset, size_t length, uint64_t tag);
+
+/**
+ * \brief Queue reading from open file.
+ *
+ * \param ring Ring context.
+ * \param slot Free slot.
+ * \param fd File descriptor.
+ * \param offset File offset.
+ * \param length Number of bytes to read, at most the buffer size.
+ * \param tag Caller tag.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool ring_read(struct ring *restrict ring, unsigned int slot, int fd, uint64_t offset, size_t length, uint64_t tag);
+
+/**
+ * \brief Queue writing to open file.
+ *
+ * \param ring Ring context.
+ * \param slot Free slot holding the data.
+ * \param fd File descriptor.
+ * \param offset File offset.
+ * \param length Number of bytes to write, at most the buffer size.
+ * \param sync Synchronise file data once written.
+ * \param tag Caller tag.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool ring_write(struct ring *restrict ring, unsigned int slot, int fd, uint64_t offset, size_t length, bool sync, uint64_t tag);
+
+/**
+ * \brief Submit queued operations.
+ *
+ * \param ring Ring context.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool ring_submit(struct ring *restrict ring);
+
+/**
+ * \brief Wait for operation chain to complete.
+ *
+ * Queued operations are submitted first.
+ *
+ * \param ring Ring context.
+ * \param done Buffer to hold the completion.
+ *
+ * \return \c true if successful or \c false on failure or if nothing is queued.
+ */
+extern bool ring_wait(struct ring *restrict ring, struct ring_completion *restrict done);
+
+/**
+ * \brief Tear ring down.
+ *
+ * Operations still in flight are waited for.
+ *
+ * \param ring Ring context.
+ */
+extern void ring_close(struct ring *restrict ring);
+
+#endif /* OC_RING_H */
@@ -0,0 +1,1375 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "endian.h"
+#include "erasure.h"
+#include "expect.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Routing table file name within the storage directory.
+ */
+#define ROUTE_NAME ".routes"
+
+/**
+ * \brief Maximum number of store roots.
+ */
+#define ROUTES_MAXIMUM 64
+
+/**
+ * \brief Largest number of bytes of a shard in one stripe.
+ */
+#define ERASURE_BLOCK (64 * 1024)
+
+/**
+ * \brief Store root.
+ */
+struct root {
+	double   weight; /**< Relative share of objects. */
+	uint64_t seed;   /**< Hash of the path. */
+	char    *path;   /**< Storage directory. */
+};
+
+extern char **environ;
+
+/**
+ * \brief Store roots in table order.
+ */
+static struct root roots[ROUTES_MAXIMUM];
+
+/**
+ * \brief Number of store roots.
+ */
+static size_t count;
+
+/**
+ * \brief Store root indices in order of preference for an identifier.
+ */
+static size_t order[ROUTES_MAXIMUM];
+
+/**
+ * \brief Scores of the store roots for an identifier.
+ */
+static double score[ROUTES_MAXIMUM];
+
+/**
+ * \brief Erasure code objects are spread with.
+ */
+static struct erasure code;
+
+/**
+ * \brief Number of shards of each object, or zero if objects are kept whole.
+ */
+static unsigned int shards;
+
+/**
+ * \brief Shard header, in little‐endian byte‐order.
+ */
+struct shard_header {
+	uint8_t  mark[4];  /**< Magic sequence. */
+	uint8_t  data;     /**< Number of data shards. */
+	uint8_t  parity;   /**< Number of parity shards. */
+	uint8_t  index;    /**< Shard number. */
+	uint8_t  reserved; /**< Zero. */
+	uint64_t size;     /**< Object size. */
+	uint32_t block;    /**< Bytes of the shard in each stripe. */
+	uint32_t sum;      /**< FNV‐1a of the object identifier and the fields above. */
+};
+
+/**
+ * \brief Shard header magic sequence.
+ */
+static const uint8_t shard_mark[4] = { 'O', 'C', 'R', 'S' };
+
+/**
+ * \brief Shard layout of an object.
+ */
+struct layout {
+	uint64_t size;    /**< Object size. */
+	uint32_t block;   /**< Bytes of each shard in a stripe. */
+	uint64_t stripes; /**< Number of stripes. */
+};
+
+/**
+ * \brief Shard being read.
+ */
+struct reader {
+	pid_t        pid;   /**< Storage module process ID. */
+	int          fd;    /**< Output of the storage module. */
+	unsigned int index; /**< Shard number. */
+	uint64_t     next;  /**< Next stripe to read. */
+};
+
+/**
+ * \brief Storage modules depositing shards, or -1.
+ */
+static pid_t sinks[ERASURE_SHARDS_MAXIMUM];
+
+/**
+ * \brief Finalise 64‐bit hash value.
+ */
+static uint64_t mix(uint64_t x) {
+	x ^= x >> 30;
+	x *= UINT64_C(0xbf58476d1ce4e5b9);
+	x ^= x >> 27;
+	x *= UINT64_C(0x94d049bb133111eb);
+	x ^= x >> 31;
+	return x;
+}
+
+/**
+ * \brief Read routing table.
+ *
+ * Each line holds a positive weight and the absolute path of a store
+ * root, separated by white space.  Empty lines and lines starting with
+ * \c # are ignored.  A missing table leaves no roots.  A line reading
+ * <tt>erasure</tt> followed by numbers of data and parity shards spreads
+ * every object over that many roots instead, of which there must be at
+ * least as many.
+ *
+ * \param dir Storage directory.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool table_read(const char *restrict dir) {
+	char path[strlen(dir) + sizeof "/" ROUTE_NAME];
+	strcat(strcpy(path, dir), "/" ROUTE_NAME);
+
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return errno == ENOENT;
+
+	char line[4096];
+	bool result = true;
+
+	while (result && fgets(line, sizeof line, file)) {
+		line[strcspn(line, "\n")] = 0;
+
+		double weight;
+		int pos;
+
+		unsigned int data, parity;
+
+		if (!line[strspn(line, " \t")] || line[strspn(line, " \t")] == '#')
+			continue;
+
+		if (sscanf(line, " erasure %u %u %n", &data, &parity, &pos) == 2 && !line[pos]) {
+			if (unlikely(shards || !parity || !erasure_open(&code, data, parity, ERASURE_AVX2))) {
+				fprintf(stderr, "Invalid erasure code “%s”!\n", line);
+				result = false;
+				break;
+			}
+
+			shards = data + parity;
+			continue;
+		}
+
+		if (unlikely(count == ROUTES_MAXIMUM ||
+			sscanf(line, "%lf %n", &weight, &pos) != 1 || !(weight > 0) ||
+			line[pos] != '/' || !(roots[count].path = strdup(&line[pos])))) {
+			fprintf(stderr, "Invalid route “%s”!\n", line);
+			result = false;
+			break;
+		}
+
+		/* FNV‐1a */
+		uint64_t seed = UINT64_C(0xcbf29ce484222325);
+		for (const char *iter = roots[count].path; *iter; ++iter)
+			seed = (seed ^ (uint8_t) *iter) * UINT64_C(0x100000001b3);
+
+		roots[count].weight = weight;
+		roots[count].seed   = seed;
+		++count;
+	}
+
+	fclose(file);
+
+	if (unlikely(result && shards > count)) {
+		fprintf(stderr, "Erasure code needs %u store roots!\n", shards);
+		result = false;
+	}
+
+	return result;
+}
+
+/**
+ * \brief Compare store roots by score.
+ */
+static int order_compare(const void *a, const void *b) {
+	size_t x = *(const size_t *) a, y = *(const size_t *) b;
+	return score[x] > score[y] ? -1 : score[x] < score[y] ? 1 : x < y ? -1 : x > y;
+}
+
+/**
+ * \brief Rank store roots for identifier.
+ *
+ * Weighted rendezvous hashing: every root draws a uniform variate from
+ * the identifier and its path, and the root with the highest
+ * −weight ∕ ln(variate) holds the object.  Adding a root only moves
+ * objects onto that root, and removing one only moves its own objects.
+ *
+ * \param ident Object identifier.
+ */
+static void rank(const uint8_t ident[restrict 32]) {
+	for (size_t iter = 0; iter < count; ++iter) {
+		uint64_t hash = roots[iter].seed;
+
+		for (size_t word = 0; word < 32; word += 8) {
+			uint64_t value = 0;
+
+			for (size_t byte = 0; byte < 8; ++byte)
+				value = value << 8 | ident[word + byte];
+
+			hash = mix(hash ^ value);
+		}
+
+		/* Uniform in (0, 1) */
+		double variate = ((hash >> 11) + 0.5) / 9007199254740992.0;
+
+		score[iter] = -roots[iter].weight / log(variate);
+		order[iter] = iter;
+	}
+
+	qsort(order, count, sizeof *order, order_compare);
+}
+
+/**
+ * \brief Create pipe whose ends are not inherited.
+ *
+ * \param pipefd Array receiving the file descriptors.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool conduit(int pipefd[2]) {
+	if (pipe(pipefd))
+		return false;
+
+	/* Only the ends duplicated onto standard input or output reach a module */
+	fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(pipefd[1], F_SETFD, FD_CLOEXEC);
+
+	return true;
+}
+
+/**
+ * \brief Run storage module on store root.
+ *
+ * \param argv Argument vector of the module, whose storage directory is replaced.
+ * \param root Store root.
+ * \param op Operation.
+ * \param in Standard input or -1 to inherit it.
+ * \param out Standard output or -1 to inherit it.
+ * \param pid Pointer to variable receiving the process ID.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool launch(char *argv[], const struct root *restrict root, const char *restrict op, int in, int out, pid_t *restrict pid) {
+	posix_spawn_file_actions_t file_actions;
+	if (unlikely(posix_spawn_file_actions_init(&file_actions))) {
+		perror("Unable to set file descriptors up");
+		return false;
+	}
+
+	posix_spawnattr_t attr;
+	if (unlikely(posix_spawnattr_init(&attr))) {
+		perror("Unable to set process attributes up");
+		posix_spawn_file_actions_destroy(&file_actions);
+		return false;
+	}
+
+	argv[1] = root->path;
+	argv[5] = (char *) op;
+
+	/* Shards are written with SIGPIPE ignored, which modules must not inherit */
+	sigset_t sigdef;
+	sigemptyset(&sigdef);
+	sigaddset(&sigdef, SIGPIPE);
+
+	bool result =
+		(in  < 0 || !posix_spawn_file_actions_adddup2(&file_actions, in, 0)) &&
+		(out < 0 || !posix_spawn_file_actions_adddup2(&file_actions, out, 1)) &&
+		!posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF) &&
+		!posix_spawnattr_setsigdefault(&attr, &sigdef) &&
+		!(errno = posix_spawn(pid, argv[0], &file_actions, &attr, argv, environ));
+
+	if (unlikely(!result))
+		perror("Unable to spawn storage module");
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&file_actions);
+
+	return result;
+}
+
+/**
+ * \brief Wait for storage module.
+ *
+ * \param pid Process ID.
+ *
+ * \return Exit status of the module or EXIT_FAILURE if it terminated abnormally.
+ */
+static int await(pid_t pid) {
+	int status;
+
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR) {
+			perror("Unable to wait for storage module");
+			return EXIT_FAILURE;
+		}
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
+
+/**
+ * \brief Check whether store root exists.
+ *
+ * Roots are created by the first deposit routed to them.
+ */
+static bool present(const struct root *restrict root) {
+	return !access(root->path, F_OK);
+}
+
+/**
+ * \brief Run storage module on store root and wait for it.
+ *
+ * \param argv Argument vector of the module.
+ * \param root Store root.
+ * \param op Operation.
+ *
+ * \return Exit status of the module or EXIT_FAILURE on failure.
+ */
+static int run(char *argv[], const struct root *restrict root, const char *restrict op) {
+	pid_t pid;
+	return launch(argv, root, op, -1, -1, &pid) ? await(pid) : EXIT_FAILURE;
+}
+
+/**
+ * \brief Replace this process by the storage module on store root.
+ *
+ * \param argv Argument vector of the module.
+ * \param root Store root.
+ *
+ * \return EXIT_FAILURE.
+ */
+static int hand(char *argv[], const struct root *restrict root) {
+	argv[1] = root->path;
+	execv(argv[0], argv);
+
+	perror("Unable to execute storage module");
+	return EXIT_FAILURE;
+}
+
+/**
+ * \brief Move object between store roots.
+ *
+ * The object is streamed from one module process into another and only
+ * effaced from its former root once the deposit has succeeded.  An
+ * object effaced while it is being moved may reappear on its new root.
+ *
+ * \param argv Argument vector of the module.
+ * \param from Current store root.
+ * \param to New store root.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool move(char *argv[], const struct root *restrict from, const struct root *restrict to) {
+	if (unlikely(mkdir(to->path, 0777) && errno != EEXIST)) {
+		perror("Unable to create store root");
+		return false;
+	}
+
+	int pipefd[2];
+	if (unlikely(!conduit(pipefd))) {
+		perror("Unable to create pipe");
+		return false;
+	}
+
+	pid_t source, sink;
+	bool sourced = launch(argv, from, "retrieve", -1, pipefd[1], &source);
+	bool sunk    = launch(argv, to, "deposit", pipefd[0], -1, &sink);
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+
+	bool retrieved = sourced && await(source) == EXIT_SUCCESS;
+	bool deposited = sunk && await(sink) == EXIT_SUCCESS;
+
+	/* A truncated copy would be preferred over the intact one */
+	if (!retrieved) {
+		if (deposited)
+			run(argv, to, "efface");
+
+		return false;
+	}
+
+	return deposited && run(argv, from, "efface") == EXIT_SUCCESS;
+}
+
+/**
+ * \brief Compute shard header checksum.
+ *
+ * \param hdr Shard header.
+ * \param ident Object identifier.
+ *
+ * \return Checksum in native byte‐order.
+ */
+static uint32_t shard_sum(const struct shard_header *restrict hdr, const uint8_t ident[restrict 32]) {
+	const uint8_t *byte = (const uint8_t *) hdr;
+
+	/* FNV‐1a */
+	uint32_t sum = UINT32_C(0x811c9dc5);
+	for (size_t iter = 0; iter < 32; ++iter)
+		sum = (sum ^ ident[iter]) * UINT32_C(0x01000193);
+
+	for (size_t iter = 0; iter < offsetof(struct shard_header, sum); ++iter)
+		sum = (sum ^ byte[iter]) * UINT32_C(0x01000193);
+
+	return sum;
+}
+
+/**
+ * \brief Lay object out in stripes.
+ *
+ * Shards are cut into blocks of at most \c ERASURE_BLOCK bytes, so that
+ * a stripe of one block from every shard fits in memory, and small
+ * objects are padded to a multiple of 64 bytes per shard only.
+ *
+ * \param lay Buffer to hold the layout.
+ * \param size Object size.
+ * \param block Block size, or zero to choose one.
+ */
+static void lay_out(struct layout *restrict lay, uint64_t size, uint32_t block) {
+	if (!block && size) {
+		uint64_t share = ((size + code.data - 1) / code.data + 63) / 64 * 64;
+		block = share < ERASURE_BLOCK ? share : ERASURE_BLOCK;
+	}
+
+	lay->size    = size;
+	lay->block   = block;
+	lay->stripes = size ? (size + (uint64_t) code.data * block - 1) / ((uint64_t) code.data * block) : 0;
+}
+
+/**
+ * \brief Run storage module on store root with its output in a pipe.
+ *
+ * \param argv Argument vector of the module.
+ * \param root Store root.
+ * \param op Operation.
+ * \param fd Pointer to variable receiving the read end of the pipe.
+ * \param pid Pointer to variable receiving the process ID.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool tap(char *argv[], const struct root *restrict root, const char *restrict op, int *restrict fd, pid_t *restrict pid) {
+	int pipefd[2];
+	if (unlikely(!conduit(pipefd))) {
+		perror("Unable to create pipe");
+		return false;
+	}
+
+	bool result = launch(argv, root, op, -1, pipefd[1], pid);
+	close(pipefd[1]);
+
+	if (unlikely(!result)) {
+		close(pipefd[0]);
+		return false;
+	}
+
+	*fd = pipefd[0];
+	return true;
+}
+
+/**
+ * \brief Stop reading shard.
+ *
+ * \param reader Shard reader.
+ */
+static void reader_close(struct reader *restrict reader) {
+	close(reader->fd);
+	kill(reader->pid, SIGTERM);
+	await(reader->pid);
+}
+
+/**
+ * \brief Start reading shard from store root.
+ *
+ * The shard header is read and checked against the object identifier,
+ * the erasure code and the layout of shards read before, if known.
+ * Shards already held are turned down.
+ *
+ * \param argv Argument vector of the module.
+ * \param reader Shard reader to set up.
+ * \param root Store root.
+ * \param ident Object identifier.
+ * \param lay Object layout, filled in by the first shard.
+ * \param known Whether the object layout is known.
+ * \param held Shards already held, or null.
+ *
+ * \return 0 if successful, 3 if there is no shard on the store root or
+ * EXIT_FAILURE if there is no usable one.
+ */
+static int reader_open(char *argv[], struct reader *restrict reader, const struct root *restrict root, const uint8_t ident[restrict 32], struct layout *restrict lay, bool *restrict known, const bool *restrict held) {
+	struct shard_header hdr;
+	struct layout found;
+
+	if (unlikely(!tap(argv, root, "retrieve", &reader->fd, &reader->pid)))
+		return EXIT_FAILURE;
+
+	if (stream_read(reader->fd, &hdr, sizeof hdr) != sizeof hdr) {
+		close(reader->fd);
+		return await(reader->pid) == 3 ? 3 : EXIT_FAILURE;
+	}
+
+	bool valid =
+		!memcmp(hdr.mark, shard_mark, sizeof shard_mark) && le32(hdr.sum) == shard_sum(&hdr, ident) &&
+		hdr.data == code.data && hdr.parity == code.parity && hdr.index < shards &&
+		le32(hdr.block) <= ERASURE_BLOCK && (le32(hdr.block) || !hdr.size);
+
+	if (valid)
+		lay_out(&found, le64(hdr.size), le32(hdr.block));
+
+	if (unlikely(!valid || *known && (found.size != lay->size || found.block != lay->block))) {
+		fprintf(stderr, "Invalid shard of object %s on “%s”!\n", argv[4], root->path);
+		reader_close(reader);
+		return EXIT_FAILURE;
+	}
+
+	if (held && held[hdr.index]) {
+		reader_close(reader);
+		return EXIT_FAILURE;
+	}
+
+	if (!*known) {
+		*lay = found;
+		*known = true;
+	}
+
+	reader->index = hdr.index;
+	reader->next  = 0;
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Find out which shard of object store root holds.
+ *
+ * \param argv Argument vector of the module.
+ * \param root Store root.
+ * \param ident Object identifier.
+ * \param index Pointer to variable receiving the shard number.
+ *
+ * \return 0 if successful, 3 if there is no shard on the store root or
+ * EXIT_FAILURE if there is no usable one.
+ */
+static int shard_probe(char *argv[], const struct root *restrict root, const uint8_t ident[restrict 32], unsigned int *restrict index) {
+	struct reader reader;
+	struct layout lay;
+	bool known = false;
+
+	if (!present(root))
+		return 3;
+
+	int status = reader_open(argv, &reader, root, ident, &lay, &known, (const bool *) 0);
+
+	if (status == EXIT_SUCCESS) {
+		*index = reader.index;
+		reader_close(&reader);
+	}
+
+	return status;
+}
+
+/**
+ * \brief Stop depositing shards.
+ *
+ * \param sig Signal number.
+ */
+static void sink_abandon(int sig) {
+	for (unsigned int iter = 0; iter < shards; ++iter)
+		if (sinks[iter] > 0)
+			kill(sinks[iter], SIGTERM);
+
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+/**
+ * \brief Deposit object as shards.
+ *
+ * The object is read from a spool file in the temporary directory,
+ * unless standard input is a regular file, since its size goes into
+ * every shard header.  Shard \e i goes to the store root ranked \e i‐th
+ * for the identifier.  Storage modules are stopped, rather than left to
+ * store truncated shards, if the object cannot be read whole or this
+ * process is stopped.
+ *
+ * \param argv Argument vector of the module.
+ * \param ident Object identifier.
+ *
+ * \return EXIT_SUCCESS if every shard was deposited or EXIT_FAILURE otherwise.
+ */
+static int op_deposit(char *argv[], const uint8_t ident[restrict 32]) {
+	struct stat st;
+	off_t pos;
+	int in = 0;
+
+	if (fstat(in, &st) || !S_ISREG(st.st_mode) || (pos = lseek(in, 0, SEEK_CUR)) < 0) {
+		char path[strlen(argv[3]) + sizeof "/spool.XXXXXX"];
+		strcat(strcpy(path, argv[3]), "/spool.XXXXXX");
+
+		if (unlikely((in = mkstemp(path)) < 0)) {
+			perror("Unable to create spool file");
+			return EXIT_FAILURE;
+		}
+
+		unlink(path);
+
+		uint8_t buf[ERASURE_BLOCK];
+		ssize_t fill;
+
+		while ((fill = stream_read(0, buf, sizeof buf)) > 0)
+			if (unlikely(!stream_write(in, buf, fill))) {
+				perror("Unable to spool object");
+				return EXIT_FAILURE;
+			}
+
+		if (unlikely(fill < 0 || fstat(in, &st) || lseek(in, 0, SEEK_SET))) {
+			perror("Unable to spool object");
+			return EXIT_FAILURE;
+		}
+
+		pos = 0;
+	}
+
+	struct layout lay;
+	lay_out(&lay, st.st_size - pos, 0);
+
+	uint8_t *space = malloc((size_t) shards * lay.block + 1);
+	uint8_t *shard[ERASURE_SHARDS_MAXIMUM];
+	int fds[ERASURE_SHARDS_MAXIMUM];
+	bool failed[ERASURE_SHARDS_MAXIMUM];
+
+	if (unlikely(!space)) {
+		perror("Unable to allocate stripe");
+		return EXIT_FAILURE;
+	}
+
+	/* Shards that cannot be written any more show up as errors */
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGHUP, sink_abandon);
+	signal(SIGINT, sink_abandon);
+	signal(SIGTERM, sink_abandon);
+
+	for (unsigned int iter = 0; iter < shards; ++iter) {
+		const struct root *root = &roots[order[iter]];
+		int pipefd[2];
+
+		shard[iter]  = &space[(size_t) iter * lay.block];
+		sinks[iter]  = -1;
+		fds[iter]    = -1;
+		failed[iter] = true;
+
+		if (unlikely(mkdir(root->path, 0777) && errno != EEXIST)) {
+			perror("Unable to create store root");
+			continue;
+		}
+
+		if (unlikely(!conduit(pipefd))) {
+			perror("Unable to create pipe");
+			continue;
+		}
+
+		if (likely(launch(argv, root, "deposit", pipefd[0], -1, &sinks[iter]))) {
+			fds[iter]    = pipefd[1];
+			failed[iter] = false;
+		}
+
+		else
+			close(pipefd[1]);
+
+		close(pipefd[0]);
+	}
+
+	bool broken = false;
+
+	for (unsigned int iter = 0; iter < shards; ++iter) {
+		struct shard_header hdr = {
+			.data   = code.data,
+			.parity = code.parity,
+			.index  = iter,
+			.size   = le64(lay.size),
+			.block  = le32(lay.block)
+		};
+
+		memcpy(hdr.mark, shard_mark, sizeof shard_mark);
+		hdr.sum = le32(shard_sum(&hdr, ident));
+
+		if (!failed[iter] && unlikely(!stream_write(fds[iter], &hdr, sizeof hdr)))
+			failed[iter] = true;
+	}
+
+	for (uint64_t stripe = 0; !broken && stripe < lay.stripes; ++stripe) {
+		size_t width = (size_t) code.data * lay.block;
+		uint64_t left = lay.size - stripe * width;
+		size_t want = left < width ? left : width;
+
+		if (unlikely(stream_read(in, space, want) != (ssize_t) want)) {
+			perror("Unable to read object");
+			broken = true;
+			break;
+		}
+
+		memset(&space[want], 0, width - want);
+		erasure_encode(&code, shard, lay.block);
+
+		for (unsigned int iter = 0; iter < shards; ++iter)
+			if (!failed[iter] && unlikely(!stream_write(fds[iter], shard[iter], lay.block)))
+				failed[iter] = true;
+	}
+
+	/* Shards cut short must not be stored */
+	for (unsigned int iter = 0; iter < shards; ++iter)
+		if (sinks[iter] > 0 && (broken || failed[iter]))
+			kill(sinks[iter], SIGTERM);
+
+	for (unsigned int iter = 0; iter < shards; ++iter)
+		if (fds[iter] >= 0)
+			close(fds[iter]);
+
+	int rc = broken ? EXIT_FAILURE : EXIT_SUCCESS;
+
+	for (unsigned int iter = 0; iter < shards; ++iter) {
+		if (sinks[iter] > 0 && await(sinks[iter]) != EXIT_SUCCESS)
+			failed[iter] = true;
+
+		sinks[iter] = -1;
+
+		if (!broken && failed[iter]) {
+			fprintf(stderr, "Failed to deposit shard %u of object %s on “%s”!\n", iter, argv[4], roots[order[iter]].path);
+			rc = EXIT_FAILURE;
+		}
+	}
+
+	free(space);
+
+	return rc;
+}
+
+/**
+ * \brief Retrieve byte range of object from shards.
+ *
+ * Shards are read from the store roots in order of preference, so that
+ * the data shards are read and no decoding is needed as long as they
+ * can be.  Any shard is taken wherever it is found, since objects may
+ * not have been rebalanced yet.  A shard that breaks off is replaced by
+ * the next one found, which is read up to the current stripe, and the
+ * missing data shards are recovered from the parity shards.
+ *
+ * \param argv Argument vector of the module.
+ * \param ident Object identifier.
+ * \param offset Offset of first byte.
+ * \param length Maximum number of bytes.
+ *
+ * \return EXIT_SUCCESS if successful, 3 if there is no such object or
+ * EXIT_FAILURE on failure.
+ */
+static int op_retrieve(char *argv[], const uint8_t ident[restrict 32], uint64_t offset, uint64_t length) {
+	struct reader reader[ERASURE_SHARDS_MAXIMUM];
+	bool held[ERASURE_SHARDS_MAXIMUM] = { false };
+	struct layout lay;
+	bool known = false, found = false;
+	unsigned int active = 0;
+	size_t next = 0;
+
+	/* Missing objects are reported before any output is written */
+	while (active < code.data && next < count) {
+		const struct root *root = &roots[order[next++]];
+
+		if (!present(root))
+			continue;
+
+		int status = reader_open(argv, &reader[active], root, ident, &lay, &known, held);
+
+		if (status != 3)
+			found = true;
+
+		if (status == EXIT_SUCCESS)
+			held[reader[active++].index] = true;
+	}
+
+	if (active < code.data) {
+		while (active)
+			reader_close(&reader[--active]);
+
+		if (!found)
+			return 3;
+
+		fprintf(stderr, "Too few shards of object %s to recover it!\n", argv[4]);
+		return EXIT_FAILURE;
+	}
+
+	/* Clip range to object */
+	if (offset > lay.size)
+		offset = lay.size;
+
+	if (length > lay.size - offset)
+		length = lay.size - offset;
+
+	uint64_t width = (uint64_t) code.data * lay.block;
+	uint64_t first = length ? offset / width : 0, last = length ? (offset + length + width - 1) / width : 0;
+
+	uint8_t *space = malloc((size_t) shards * lay.block + 1);
+	uint8_t *shard[ERASURE_SHARDS_MAXIMUM];
+	bool have[ERASURE_SHARDS_MAXIMUM];
+	int rc = EXIT_SUCCESS;
+
+	if (unlikely(!space)) {
+		perror("Unable to allocate stripe");
+		rc = EXIT_FAILURE;
+	}
+
+	for (unsigned int iter = 0; space && iter < shards; ++iter)
+		shard[iter] = &space[(size_t) iter * lay.block];
+
+	for (uint64_t stripe = first; rc == EXIT_SUCCESS && stripe < last; ++stripe) {
+		memset(have, 0, sizeof have);
+
+		for (unsigned int iter = 0; iter < active;) {
+			struct reader *cur = &reader[iter];
+			bool intact = true;
+
+			/* Shards opened late skip to the current stripe */
+			while (intact && cur->next <= stripe) {
+				intact = stream_read(cur->fd, shard[cur->index], lay.block) == (ssize_t) lay.block;
+				++cur->next;
+			}
+
+			if (intact) {
+				have[cur->index] = true;
+				++iter;
+				continue;
+			}
+
+			fprintf(stderr, "Shard %u of object %s broke off, recovering it from the others\n", cur->index, argv[4]);
+
+			held[cur->index] = false;
+			reader_close(cur);
+			*cur = reader[--active];
+
+			while (next < count) {
+				const struct root *root = &roots[order[next++]];
+
+				if (present(root) && reader_open(argv, &reader[active], root, ident, &lay, &known, held) == EXIT_SUCCESS) {
+					held[reader[active++].index] = true;
+					break;
+				}
+			}
+		}
+
+		if (unlikely(!erasure_decode(&code, shard, have, lay.block))) {
+			fprintf(stderr, "Too few shards of object %s to recover it!\n", argv[4]);
+			rc = EXIT_FAILURE;
+			break;
+		}
+
+		/* Data shards hold consecutive blocks of the stripe */
+		uint64_t from = stripe * width > offset ? stripe * width : offset;
+		uint64_t to = (stripe + 1) * width < offset + length ? (stripe + 1) * width : offset + length;
+
+		if (unlikely(!stream_write(1, &space[from - stripe * width], to - from))) {
+			perror("Unable to write object");
+			rc = EXIT_FAILURE;
+		}
+	}
+
+	while (active)
+		reader_close(&reader[--active]);
+
+	free(space);
+
+	return rc;
+}
+
+/**
+ * \brief Check whether object can be retrieved from shards.
+ *
+ * Store roots holding a shard are counted, without reading the shards.
+ *
+ * \param argv Argument vector of the module.
+ *
+ * \return EXIT_SUCCESS if enough store roots hold a shard, 3 if none does
+ * or EXIT_FAILURE otherwise.
+ */
+static int op_assay(char *argv[]) {
+	unsigned int held = 0;
+	bool failed = false;
+
+	for (size_t iter = 0; iter < count && held < code.data; ++iter) {
+		if (!present(&roots[order[iter]]))
+			continue;
+
+		int status = run(argv, &roots[order[iter]], "assay");
+
+		if (status == EXIT_SUCCESS)
+			++held;
+
+		else if (status != 3)
+			failed = true;
+	}
+
+	if (held >= code.data)
+		return EXIT_SUCCESS;
+
+	if (held)
+		fprintf(stderr, "Too few shards of object %s to recover it!\n", argv[4]);
+
+	return held || failed ? EXIT_FAILURE : 3;
+}
+
+/**
+ * \brief Describe object stored as shards.
+ *
+ * The object size is read from a shard header and the stored size is
+ * summed over all shards, while the deposit time and the location are
+ * those of the most preferred shard.
+ *
+ * \param argv Argument vector of the module.
+ * \param ident Object identifier.
+ *
+ * \return EXIT_SUCCESS if successful, 3 if there is no such object or
+ * EXIT_FAILURE on failure.
+ */
+static int op_inspect(char *argv[], const uint8_t ident[restrict 32]) {
+	struct layout lay;
+	bool known = false, sized = true;
+	uint64_t stored = 0;
+	char stamp[32] = "-", location[4096] = "";
+	int rc = 3;
+
+	for (size_t iter = 0; iter < count; ++iter) {
+		const struct root *root = &roots[order[iter]];
+		struct reader reader;
+		char line[sizeof stamp + sizeof location + 64], size[32], used[32], when[32];
+		int fd, pos;
+		pid_t pid;
+
+		if (!present(root))
+			continue;
+
+		if (!known && reader_open(argv, &reader, root, ident, &lay, &known, (const bool *) 0) == EXIT_SUCCESS)
+			reader_close(&reader);
+
+		if (unlikely(!tap(argv, root, "inspect", &fd, &pid)))
+			return EXIT_FAILURE;
+
+		ssize_t fill = stream_read(fd, line, sizeof line - 1);
+		close(fd);
+
+		int status = await(pid);
+
+		if (status == 3)
+			continue;
+
+		line[fill > 0 ? fill : 0] = 0;
+		line[strcspn(line, "\n")] = 0;
+
+		uint64_t bytes;
+		if (unlikely(status != EXIT_SUCCESS || sscanf(line, "%31s %31s %31s %n", size, used, when, &pos) != 3)) {
+			fprintf(stderr, "Unable to inspect shard of object %s on “%s”!\n", argv[4], root->path);
+			return EXIT_FAILURE;
+		}
+
+		if (sized && decsint(&bytes, used))
+			stored += bytes;
+		else
+			sized = false;
+
+		if (rc == 3) {
+			snprintf(location, sizeof location, "%s", &line[pos]);
+			strcpy(stamp, when);
+		}
+
+		rc = EXIT_SUCCESS;
+	}
+
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	if (unlikely(!known)) {
+		fprintf(stderr, "No readable shard of object %s!\n", argv[4]);
+		return EXIT_FAILURE;
+	}
+
+	char total[32] = "-";
+	if (sized)
+		snprintf(total, sizeof total, "%" PRIu64, stored);
+
+	printf("%" PRIu64 " %s %s %s\n", lay.size, total, stamp, location);
+
+	if (unlikely(fflush(stdout))) {
+		perror("Unable to write description");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Move shard onto a store root it is routed to.
+ *
+ * The shards of an object belong on the store roots ranked first for
+ * its identifier, in any order, since lookups take shards wherever they
+ * are found.  A shard held elsewhere moves onto the first of them that
+ * holds no shard of the object, or is effaced if it turns out to be a
+ * copy of a shard held there.
+ *
+ * \param argv Argument vector of the module.
+ * \param from Index of the current store root.
+ * \param ident Object identifier.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool reshard(char *argv[], size_t from, const uint8_t ident[restrict 32]) {
+	unsigned int index, other;
+
+	for (unsigned int iter = 0; iter < shards; ++iter)
+		if (order[iter] == from)
+			return true;
+
+	/* Shards are only looked at when the module knows the object is there */
+	for (unsigned int iter = 0; iter < shards; ++iter) {
+		const struct root *root = &roots[order[iter]];
+
+		if (!present(root) || run(argv, root, "assay") == 3)
+			return move(argv, &roots[from], root);
+	}
+
+	int status = shard_probe(argv, &roots[from], ident, &index);
+	if (status != EXIT_SUCCESS)
+		return status == 3;
+
+	for (unsigned int iter = 0; iter < shards; ++iter)
+		if (shard_probe(argv, &roots[order[iter]], ident, &other) == EXIT_SUCCESS && other == index)
+			return run(argv, &roots[from], "efface") == EXIT_SUCCESS;
+
+	fprintf(stderr, "No store root is free for shard %u of object %s!\n", index, argv[4]);
+	return false;
+}
+
+/**
+ * \brief List objects on store root.
+ *
+ * \param argv Argument vector of the module.
+ * \param root Store root.
+ * \param idents Pointer to array of identifiers to append to.
+ * \param len Pointer to number of identifiers.
+ * \param size Pointer to capacity of array.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool listing(char *argv[], const struct root *restrict root, uint8_t (**idents)[32], size_t *restrict len, size_t *restrict size) {
+	int fd;
+	pid_t pid;
+
+	if (unlikely(!tap(argv, root, "list", &fd, &pid)))
+		return false;
+
+	FILE *list = fdopen(fd, "r");
+	if (unlikely(!list)) {
+		perror("Unable to read object list");
+		close(fd);
+		await(pid);
+		return false;
+	}
+
+	char line[32 * 2 + 2];
+	bool result = true;
+
+	while (fgets(line, sizeof line, list)) {
+		line[strcspn(line, "\n")] = 0;
+
+		if (*len == *size) {
+			void *grown = realloc(*idents, (*size = *size ? *size * 2 : 1024) * sizeof **idents);
+			if (unlikely(!grown)) {
+				perror("Unable to allocate object list");
+				result = false;
+				break;
+			}
+
+			*idents = grown;
+		}
+
+		if (strlen(line) == 32 * 2 && hexsint((*idents)[*len], line, sizeof **idents))
+			++*len;
+	}
+
+	fclose(list);
+
+	if (unlikely(await(pid) != EXIT_SUCCESS)) {
+		fprintf(stderr, "Unable to list objects in “%s”!\n", root->path);
+		result = false;
+	}
+
+	return result;
+}
+
+/**
+ * \brief Compare identifiers.
+ */
+static int ident_compare(const void *a, const void *b) {
+	return memcmp(a, b, 32);
+}
+
+/**
+ * \brief List objects stored as shards.
+ *
+ * Every object is listed once, however many store roots hold a shard of it.
+ *
+ * \param argv Argument vector of the module.
+ *
+ * \return EXIT_SUCCESS if successful or EXIT_FAILURE on failure.
+ */
+static int op_list(char *argv[]) {
+	uint8_t (*idents)[32] = (uint8_t (*)[32]) 0;
+	size_t len = 0, size = 0;
+	int rc = EXIT_SUCCESS;
+
+	for (size_t iter = 0; iter < count; ++iter)
+		if (present(&roots[iter]) && unlikely(!listing(argv, &roots[iter], &idents, &len, &size)))
+			rc = EXIT_FAILURE;
+
+	qsort(idents, len, sizeof *idents, ident_compare);
+
+	for (size_t iter = 0; iter < len; ++iter) {
+		char line[32 * 2 + 1];
+
+		if (iter && !memcmp(idents[iter], idents[iter - 1], sizeof *idents))
+			continue;
+
+		inthexs(line, idents[iter], sizeof *idents);
+		puts(line);
+	}
+
+	free(idents);
+
+	if (unlikely(fflush(stdout))) {
+		perror("Unable to write object list");
+		rc = EXIT_FAILURE;
+	}
+
+	return rc;
+}
+
+/**
+ * \brief Move objects onto the store roots they are routed to.
+ *
+ * Objects stay retrievable throughout, as lookups fall back to lower
+ * ranked roots.  Shards of objects spread by erasure coding move one by
+ * one, as complete objects do.
+ *
+ * \param argv Argument vector of the module.
+ *
+ * \return EXIT_SUCCESS if successful or EXIT_FAILURE on failure.
+ */
+static int op_rebalance(char *argv[]) {
+	int rc = EXIT_SUCCESS;
+
+	for (size_t iter = 0; iter < count; ++iter) {
+		/* Read the whole list first, so the module does not hold locks while objects move */
+		uint8_t (*idents)[32] = (uint8_t (*)[32]) 0;
+		size_t len = 0, size = 0;
+		char line[32 * 2 + 1];
+
+		if (!present(&roots[iter]))
+			continue;
+
+		if (unlikely(!listing(argv, &roots[iter], &idents, &len, &size))) {
+			free(idents);
+			rc = EXIT_FAILURE;
+			continue;
+		}
+
+		for (size_t obj = 0; obj < len; ++obj) {
+			rank(idents[obj]);
+
+			if (!shards && order[0] == iter)
+				continue;
+
+			argv[4] = line;
+			inthexs(line, idents[obj], sizeof *idents);
+
+			if (shards) {
+				if (unlikely(!reshard(argv, iter, idents[obj]))) {
+					fprintf(stderr, "Failed to move shard of object %s on “%s”!\n", line, roots[iter].path);
+					rc = EXIT_FAILURE;
+				}
+			}
+
+			else if (unlikely(!move(argv, &roots[iter], &roots[order[0]]))) {
+				fprintf(stderr, "Failed to move object %s to “%s”!\n", line, roots[order[0]].path);
+				rc = EXIT_FAILURE;
+			}
+		}
+
+		free(idents);
+	}
+
+	return rc;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * Runs a storage module over the store roots listed in the routing table
+ * of the storage directory, or on the storage directory itself if it has
+ * none.  Deposits go to the root the identifier is routed to.  Lookups
+ * try the roots in order of preference, so objects not yet rebalanced
+ * after a root was added are still found.  Effacement and listing cover
+ * all roots.  With an erasure code in the table, objects are deposited
+ * as shards on as many roots and put back together when retrieved, even
+ * with up to as many shards lost as there are parity shards.  Byte
+ * ranges are then read by skipping through the shards.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector: storage module followed by its arguments.
+ *
+ * \return Exit status of the storage module or EXIT_FAILURE on failure.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc != 7 && argc != 9)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	char **args = &argv[1];
+	const char *op = args[5];
+
+	if (unlikely(!table_read(args[1]))) {
+		perror("Unable to read routing table");
+		return EXIT_FAILURE;
+	}
+
+	if (!count) {
+		execv(args[0], args);
+
+		perror("Unable to execute storage module");
+		return EXIT_FAILURE;
+	}
+
+	/* Maintenance operations do not refer to an object */
+	if (!strcmp(op, "rebalance"))
+		return op_rebalance(args);
+
+	else if (!strcmp(op, "list") && shards)
+		return op_list(args);
+
+	else if (!strcmp(op, "list")) {
+		int rc = EXIT_SUCCESS;
+
+		for (size_t iter = 0; iter < count; ++iter) {
+			if (!present(&roots[iter]))
+				continue;
+
+			int status = run(args, &roots[iter], op);
+
+			if (status != EXIT_SUCCESS)
+				rc = status;
+		}
+
+		return rc;
+	}
+
+	uint8_t ident[32];
+	if (!hexsint(ident, args[4], sizeof ident)) {
+		perror("Failed to parse identifier");
+		return EXIT_FAILURE;
+	}
+
+	rank(ident);
+
+	if (shards) {
+		uint64_t offset, length;
+
+		if (!strcmp(op, "deposit"))
+			return op_deposit(args, ident);
+
+		else if (!strcmp(op, "retrieve"))
+			return op_retrieve(args, ident, 0, UINT64_MAX);
+
+		else if (!strcmp(op, "range")) {
+			if (unlikely(argc != 9 || !decsint(&offset, args[6]) || !decsint(&length, args[7]))) {
+				fputs("Invalid byte range!\n", stderr);
+				return EXIT_FAILURE;
+			}
+
+			/* Shards are retrieved whole */
+			args[6] = (char *) 0;
+
+			return op_retrieve(args, ident, offset, length);
+		}
+
+		else if (!strcmp(op, "assay"))
+			return op_assay(args);
+
+		else if (!strcmp(op, "inspect"))
+			return op_inspect(args, ident);
+	}
+
+	if (!strcmp(op, "deposit")) {
+		if (unlikely(mkdir(roots[order[0]].path, 0777) && errno != EEXIST)) {
+			perror("Unable to create store root");
+			return EXIT_FAILURE;
+		}
+
+		return hand(args, &roots[order[0]]);
+	}
+
+	else if (!strcmp(op, "efface")) {
+		int rc = 3;
+
+		for (size_t iter = 0; iter < count; ++iter) {
+			if (!present(&roots[order[iter]]))
+				continue;
+
+			int status = run(args, &roots[order[iter]], op);
+
+			if (status == EXIT_SUCCESS && rc == 3 || status != EXIT_SUCCESS && status != 3)
+				rc = status;
+		}
+
+		return rc;
+	}
+
+	/* Missing objects are reported before any output is written */
+	size_t last = count;
+	while (last && !present(&roots[order[last - 1]]))
+		--last;
+
+	for (size_t iter = 0; iter + 1 < last; ++iter) {
+		if (!present(&roots[order[iter]]))
+			continue;
+
+		int status = run(args, &roots[order[iter]], op);
+
+		if (status != 3)
+			return status;
+	}
+
+	return last ? hand(args, &roots[order[last - 1]]) : 3;
+}
@@ -0,0 +1,209 @@
+/* pipe2 is a Linux extension */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+
+#include "expect.h"
+#include "skein.h"
+#include "storage.h"
+#include "stream.h"
+#include "string.h"
+#include "sweep.h"
+
+/**
+ * \brief Scrubbing state.
+ */
+struct scrub {
+	const char     *module; /**< Storage module name. */
+	uint64_t        rate;   /**< Bytes read per second, zero if unlimited. */
+	unsigned int    duty;   /**< Percentage of time a thread may spend hashing. */
+	uint64_t        due;    /**< Time at which the next read may start. */
+	pthread_mutex_t lock;   /**< Lock protecting the time above. */
+};
+
+/**
+ * \brief Get monotonic time.
+ *
+ * \return Nanoseconds since an arbitrary point.
+ */
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/**
+ * \brief Sleep.
+ *
+ * \param nsecs Nanoseconds to sleep, cut short once scrubbing is stopped.
+ */
+static void pause_for(uint64_t nsecs) {
+	struct timespec ts = {
+		.tv_sec  = nsecs / UINT64_C(1000000000),
+		.tv_nsec = nsecs % UINT64_C(1000000000)
+	};
+
+	while (!sweep_stopped && nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+/**
+ * \brief Throttle reading.
+ *
+ * Reads are spaced out across all threads so that no more than the
+ * given rate of bytes is read per second on average.  Each read is paid
+ * for after the fact, by holding back the next one.
+ *
+ * \param scrub Scrubbing state.
+ * \param bytes Number of bytes read.
+ */
+static void throttle(struct scrub *restrict scrub, uint64_t bytes) {
+	if (!scrub->rate)
+		return;
+
+	uint64_t time = now();
+
+	pthread_mutex_lock(&scrub->lock);
+
+	uint64_t start = scrub->due > time ? scrub->due : time;
+	scrub->due = start + bytes * UINT64_C(1000000000) / scrub->rate;
+
+	pthread_mutex_unlock(&scrub->lock);
+
+	if (start > time)
+		pause_for(start - time);
+}
+
+/**
+ * \brief Verify object.
+ *
+ * The object is retrieved through a pipe, bypassing the object cache.
+ * After hashing each chunk, the thread rests long enough to keep within
+ * its duty cycle.
+ *
+ * \param arg Scrubbing state.
+ * \param ident Object identifier.
+ * \param buf Read buffer of \c SWEEP_CHUNK bytes.
+ *
+ * \return Outcome.
+ */
+static enum sweep_outcome verify(void *restrict arg, const uint8_t ident[restrict 32], uint8_t *restrict buf) {
+	struct scrub *scrub = arg;
+	int pipefd[2];
+	pid_t fetcher;
+
+	if (unlikely(pipe2(pipefd, O_CLOEXEC)))
+		return SWEEP_FAILED;
+
+	bool result = retrieve_uncached(&fetcher, scrub->module, ident, 2, pipefd[1]);
+	close(pipefd[1]);
+
+	if (unlikely(!result)) {
+		close(pipefd[0]);
+		return SWEEP_FAILED;
+	}
+
+	struct skein ctx;
+	bool fault = false;
+
+	skein_init(&ctx);
+
+	while (!sweep_stopped) {
+		ssize_t fill = stream_read(pipefd[0], buf, SWEEP_CHUNK);
+
+		if (fill <= 0) {
+			fault = fill < 0;
+			break;
+		}
+
+		throttle(scrub, fill);
+
+		uint64_t start = now();
+		skein_feed(&ctx, buf, fill);
+
+		if (scrub->duty < 100)
+			pause_for((now() - start) * (100 - scrub->duty) / scrub->duty);
+	}
+
+	/* A retrieval cut short by a stop is not waited for */
+	if (sweep_stopped)
+		kill(fetcher, SIGTERM);
+
+	close(pipefd[0]);
+
+	int status = sweep_reap(fetcher);
+
+	if (sweep_stopped)
+		return SWEEP_FAILED;
+
+	if (fault || status != EXIT_SUCCESS)
+		return status == 3 ? SWEEP_MISSING : SWEEP_FAILED;
+
+	uint8_t hash[SKEIN_BYTES];
+	skein_plug(&ctx, hash);
+
+	return memcmp(hash, ident, 32) ? SWEEP_CORRUPT : SWEEP_DONE;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * Every object listed in the module is read back and hashed, by up to
+ * \c SCRUB_THREADS threads, which default to the number of online
+ * processors.  \c SCRUB_RATE limits reading to that many bytes per
+ * second across all threads, and \c SCRUB_DUTY to that percentage of
+ * time spent hashing per thread.  Intact, missing and corrupt objects
+ * are all recorded in the checkpoint, so that a stopped pass resumes
+ * where it was; objects that could not be read are only reported.  The
+ * checkpoint is emptied once a pass is complete, so that the next pass
+ * verifies every object again.  Scrubbing stops at
+ * once when asked to.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector: module name and checkpoint file.
+ *
+ * \return EXIT_SUCCESS if every listed object is intact or EXIT_FAILURE otherwise.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc != 3)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	long int cores = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned long int duty = setting("SCRUB_DUTY", 100);
+
+	struct scrub scrub = {
+		.module = argv[1],
+		.rate   = setting("SCRUB_RATE", 0),
+		.duty   = duty < 1 ? 1 : duty > 100 ? 100 : duty
+	};
+
+	struct sweep job = {
+		.module  = scrub.module,
+		.name    = "intact",
+		.settled = 1u << SWEEP_DONE | 1u << SWEEP_MISSING | 1u << SWEEP_CORRUPT,
+		.threads = setting("SCRUB_THREADS", cores > 0 ? cores : 1),
+		.restart = true,
+		.arg     = &scrub,
+		.visit   = verify
+	};
+
+	pthread_mutex_init(&scrub.lock, (const pthread_mutexattr_t *) 0);
+
+	int status = sweep(&job, argv[2]);
+
+	pthread_mutex_destroy(&scrub.lock);
+	return status;
+}
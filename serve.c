@@ -0,0 +1,731 @@
+/* memfd_create, accept4 and file sealing are Linux extensions */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "expect.h"
+#include "path.h"
+#include "serve.h"
+#include "skein.h"
+#include "storage.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Number of objects kept open.
+ */
+#define ENTRIES 256
+
+/**
+ * \brief Number of bytes hashed per read.
+ */
+#define CHUNK (1 << 20)
+
+/**
+ * \brief Default budget for materialised objects.
+ */
+#define MEMORY_DEFAULT (UINT64_C(256) << 20)
+
+/**
+ * \brief Open object.
+ *
+ * Objects a storage module keeps verbatim in a plain file are served
+ * from that file, once its bytes were found to hash to the identifier.
+ * Any other object is materialised into a sealed memory file, which
+ * counts against the memory budget.
+ */
+struct entry {
+	uint8_t  ident[32];             /**< Object identifier. */
+	char     module[SERVE_NAMELEN]; /**< Storage module name. */
+	int      fd;                    /**< Read‐only file descriptor or -1 if the entry is free. */
+	uint64_t offset;                /**< Offset of the object within the file. */
+	uint64_t size;                  /**< Object size. */
+	uint64_t memory;                /**< Bytes held in memory. */
+	uint64_t used;                  /**< Tick of last use. */
+	dev_t    dev;                   /**< Device of the store file. */
+	ino_t    ino;                   /**< Inode of the store file. */
+	char    *path;                  /**< Store file or null if materialised. */
+};
+
+/**
+ * \brief Open objects.
+ */
+static struct entry table[ENTRIES];
+
+/**
+ * \brief Lock protecting the table and the counters below.
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \brief Use counter.
+ */
+static uint64_t tick;
+
+/**
+ * \brief Bytes held in memory.
+ */
+static uint64_t memory;
+
+/**
+ * \brief Budget for bytes held in memory.
+ */
+static uint64_t budget = MEMORY_DEFAULT;
+
+/**
+ * \brief Number of objects forgotten.
+ *
+ * Objects opened while another was forgotten are not kept, since they
+ * may have been opened before it was effaced.
+ */
+static uint64_t forgotten;
+
+/**
+ * \brief Release entry.
+ *
+ * \param entry Entry in use.
+ */
+static void release(struct entry *restrict entry) {
+	close(entry->fd);
+	free(entry->path);
+
+	memory -= entry->memory;
+
+	entry->fd = -1;
+	entry->path = (char *) 0;
+	entry->memory = 0;
+}
+
+/**
+ * \brief Find open object.
+ *
+ * Store files that were replaced or removed since they were opened are
+ * dropped, so that an object never outlives its file.
+ *
+ * \param req Request.
+ * \param reply Reply to fill in.
+ * \param epoch Buffer to hold the number of objects forgotten so far.
+ *
+ * \return Duplicate file descriptor or -1 if the object is not open.
+ */
+static int lookup(const struct serve_request *restrict req, struct serve_reply *restrict reply, uint64_t *restrict epoch) {
+	int fd = -1;
+
+	pthread_mutex_lock(&lock);
+
+	*epoch = forgotten;
+
+	for (size_t iter = 0; iter < ENTRIES; ++iter) {
+		struct entry *entry = &table[iter];
+
+		if (entry->fd < 0 || memcmp(entry->ident, req->ident, 32) || strcmp(entry->module, req->module))
+			continue;
+
+		struct stat st;
+		if (entry->path && (stat(entry->path, &st) || st.st_dev != entry->dev || st.st_ino != entry->ino)) {
+			release(entry);
+			break;
+		}
+
+		if ((fd = fcntl(entry->fd, F_DUPFD_CLOEXEC, 0)) >= 0) {
+			entry->used = ++tick;
+			reply->offset = entry->offset;
+			reply->size = entry->size;
+		}
+
+		break;
+	}
+
+	pthread_mutex_unlock(&lock);
+	return fd;
+}
+
+/**
+ * \brief Keep object open.
+ *
+ * The least recently used entries make room, including as many
+ * materialised objects as it takes to stay within the memory budget.
+ * Objects larger than the whole budget are not kept.
+ *
+ * \param req Request.
+ * \param fd Read‐only file descriptor, which is taken over.
+ * \param offset Offset of the object within the file.
+ * \param size Object size.
+ * \param path Store file, taken over, or null if materialised.
+ * \param epoch Number of objects forgotten before the object was opened.
+ */
+static void insert(const struct serve_request *restrict req, int fd, uint64_t offset, uint64_t size, char *restrict path, uint64_t epoch) {
+	uint64_t need = path ? 0 : size;
+	struct stat st;
+
+	if (need > budget || path && fstat(fd, &st)) {
+		close(fd);
+		free(path);
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+
+	if (epoch != forgotten) {
+		pthread_mutex_unlock(&lock);
+		close(fd);
+		free(path);
+		return;
+	}
+
+	for (;;) {
+		struct entry *victim = (struct entry *) 0;
+		bool full = memory + need > budget;
+
+		for (size_t iter = 0; iter < ENTRIES; ++iter) {
+			struct entry *entry = &table[iter];
+
+			/* Another request got there first */
+			if (entry->fd >= 0 && !memcmp(entry->ident, req->ident, 32) && !strcmp(entry->module, req->module)) {
+				pthread_mutex_unlock(&lock);
+				close(fd);
+				free(path);
+				return;
+			}
+
+			if (full ? entry->memory && (!victim || entry->used < victim->used) :
+				!victim || victim->fd >= 0 && (entry->fd < 0 || entry->used < victim->used))
+				victim = entry;
+		}
+
+		if (unlikely(!victim)) {
+			pthread_mutex_unlock(&lock);
+			close(fd);
+			free(path);
+			return;
+		}
+
+		if (victim->fd >= 0)
+			release(victim);
+
+		if (!full) {
+			memcpy(victim->ident, req->ident, 32);
+			strcpy(victim->module, req->module);
+			victim->fd = fd;
+			victim->offset = offset;
+			victim->size = size;
+			victim->memory = need;
+			victim->used = ++tick;
+			victim->path = path;
+
+			if (path) {
+				victim->dev = st.st_dev;
+				victim->ino = st.st_ino;
+			}
+
+			memory += need;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * \brief Forget object.
+ *
+ * \param req Request.
+ */
+static void forget(const struct serve_request *restrict req) {
+	pthread_mutex_lock(&lock);
+
+	for (size_t iter = 0; iter < ENTRIES; ++iter) {
+		struct entry *entry = &table[iter];
+
+		if (entry->fd >= 0 && !memcmp(entry->ident, req->ident, 32) && !strcmp(entry->module, req->module))
+			release(entry);
+	}
+
+	++forgotten;
+
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * \brief Check object bytes against identifier.
+ *
+ * \param fd File descriptor.
+ * \param offset Offset of the object within the file.
+ * \param size Object size.
+ * \param ident Object identifier.
+ *
+ * \return \c true if the bytes hash to the identifier or \c false otherwise.
+ */
+static bool verify(int fd, uint64_t offset, uint64_t size, const uint8_t ident[restrict 32]) {
+	uint8_t *buf = malloc(CHUNK);
+	if (unlikely(!buf))
+		return false;
+
+	struct skein ctx;
+	skein_init(&ctx);
+
+	while (size) {
+		ssize_t fill = pread(fd, buf, size < CHUNK ? size : CHUNK, offset);
+		if (fill < 0 && errno == EINTR)
+			continue;
+
+		if (fill <= 0)
+			break;
+
+		skein_feed(&ctx, buf, fill);
+		offset += fill;
+		size -= fill;
+	}
+
+	free(buf);
+
+	uint8_t hash[SKEIN_BYTES];
+	skein_plug(&ctx, hash);
+
+	return !size && !memcmp(hash, ident, 32);
+}
+
+/**
+ * \brief Open object in its store file.
+ *
+ * Modules describe objects they keep verbatim by a file name, with \c @
+ * and an offset appended for objects inside containers, and by a stored
+ * size equal to the object size.  Since that does not rule out an
+ * encoding of the same size, the bytes are hashed before the file is
+ * trusted.
+ *
+ * \param req Request.
+ * \param reply Reply to fill in.
+ * \param info Object description, whose location is clobbered.
+ * \param path Buffer to hold the store file name, to be freed.
+ *
+ * \return Read‐only file descriptor or -1 on failure.
+ */
+static int direct(const struct serve_request *restrict req, struct serve_reply *restrict reply, struct inspection *restrict info, char **restrict path) {
+	errno = EINVAL;
+
+	if (info->size == UINT64_MAX || info->stored != info->size || *info->location != '/' || strchr(info->location, '#'))
+		return -1;
+
+	uint64_t offset = 0;
+	char *at = strrchr(info->location, '@');
+
+	if (at) {
+		*at = 0;
+
+		if (!decsint(&offset, at + 1))
+			return -1;
+	}
+
+	/* A vanished file does not mean that the object is gone */
+	int fd = open(info->location, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || offset > (uint64_t) st.st_size || info->size > (uint64_t) st.st_size - offset ||
+		!verify(fd, offset, info->size, req->ident) || !(*path = strdup(info->location))) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	reply->offset = offset;
+	reply->size = info->size;
+	return fd;
+}
+
+/**
+ * \brief Materialise object.
+ *
+ * The object is retrieved into a memory file, which is then sealed so
+ * that no client can change it.  Without memory files, an unlinked
+ * temporary file is reopened read‐only instead.  Retrieval is cut short
+ * once the object exceeds the memory budget.
+ *
+ * \param req Request.
+ * \param reply Reply to fill in.
+ *
+ * \return Read‐only file descriptor or -1 on failure, with \c errno set
+ * to \c ENOENT if there is no such object or to \c EFBIG if it is too
+ * large.
+ */
+static int materialise(const struct serve_request *restrict req, struct serve_reply *restrict reply) {
+#ifdef MFD_ALLOW_SEALING
+	int fd = memfd_create("object", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	int out = fd;
+#else
+	char name[] = TEMP_BASE "serve-XXXXXX";
+
+	int out = mkstemp(name);
+	if (out < 0)
+		return -1;
+
+	int fd = open(name, O_RDONLY | O_CLOEXEC);
+	unlink(name);
+	fcntl(out, F_SETFD, FD_CLOEXEC);
+#endif
+
+	if (unlikely(fd < 0)) {
+		if (out >= 0)
+			close(out);
+
+		return -1;
+	}
+
+	int pipefd[2], status, errnum;
+	pid_t pid;
+
+	if (unlikely(pipe2(pipefd, O_CLOEXEC)))
+		goto failure;
+
+	bool result = retrieve(&pid, req->module, req->ident, 2, pipefd[1]);
+	close(pipefd[1]);
+
+	if (unlikely(!result)) {
+		close(pipefd[0]);
+		goto failure;
+	}
+
+	uint8_t *buf = malloc(CHUNK);
+	uint64_t size = 0;
+
+	errnum = buf ? 0 : errno;
+
+	while (!errnum) {
+		ssize_t fill = read(pipefd[0], buf, CHUNK);
+		if (fill < 0 && errno == EINTR)
+			continue;
+
+		if (fill <= 0) {
+			errnum = fill < 0 ? errno : 0;
+			break;
+		}
+
+		if ((size += fill) > budget)
+			errnum = EFBIG;
+		else if (unlikely(!stream_write(out, buf, fill)))
+			errnum = errno;
+	}
+
+	free(buf);
+
+	if (errnum)
+		kill(pid, SIGTERM);
+
+	close(pipefd[0]);
+
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR) {
+			errnum = errnum ? errnum : errno;
+			break;
+		}
+
+	if (errnum) {
+		errno = errnum;
+		goto failure;
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+		errno = WIFEXITED(status) && WEXITSTATUS(status) == 3 ? ENOENT : EIO;
+		goto failure;
+	}
+
+#ifdef MFD_ALLOW_SEALING
+	if (unlikely(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)))
+		goto failure;
+#else
+	close(out);
+#endif
+
+	reply->offset = 0;
+	reply->size = size;
+	return fd;
+
+failure:
+	errnum = errno;
+
+	if (out != fd)
+		close(out);
+
+	close(fd);
+	errno = errnum;
+	return -1;
+}
+
+/**
+ * \brief Open object afresh.
+ *
+ * Objects that cannot be served from their store file and are known to
+ * exceed the memory budget are left to retrieval by the client.
+ *
+ * \param req Request.
+ * \param reply Reply to fill in.
+ * \param path Buffer to hold the store file name, to be freed.
+ *
+ * \return Read‐only file descriptor or -1 on failure.
+ */
+static int prepare(const struct serve_request *restrict req, struct serve_reply *restrict reply, char **restrict path) {
+	struct inspection info;
+
+	if (inspect(req->module, req->ident, 2, &info)) {
+		int fd = direct(req, reply, &info, path);
+		if (fd >= 0)
+			return fd;
+
+		if (info.size != UINT64_MAX && info.size > budget) {
+			errno = EFBIG;
+			return -1;
+		}
+	}
+
+	else if (errno == ENOENT)
+		return -1;
+
+	return materialise(req, reply);
+}
+
+/**
+ * \brief Send reply.
+ *
+ * \param sock Client socket.
+ * \param reply Reply.
+ * \param fd File descriptor to pass or -1.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool answer(int sock, const struct serve_reply *restrict reply, int fd) {
+	union {
+		struct cmsghdr hdr;
+		char           buf[CMSG_SPACE(sizeof (int))];
+	} control;
+
+	struct iovec iov = { (void *) reply, sizeof *reply };
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (fd >= 0) {
+		memset(&control, 0, sizeof control);
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof control.buf;
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof (int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof (int));
+	}
+
+	ssize_t sent;
+	while ((sent = sendmsg(sock, &msg, MSG_NOSIGNAL)) < 0)
+		if (errno != EINTR)
+			return false;
+
+	/* The descriptor went along with the first byte */
+	const char *rest = (const char *) reply + sent;
+	size_t left = sizeof *reply - sent;
+
+	while (left) {
+		sent = send(sock, rest, left, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+
+		if (sent <= 0)
+			return false;
+
+		rest += sent;
+		left -= sent;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Serve client.
+ *
+ * \param arg Client socket.
+ *
+ * \return <tt>(void *) 0</tt>.
+ */
+static void *client_thread(void *arg) {
+	int sock = (int) (intptr_t) arg;
+
+	for (;;) {
+		struct serve_request req;
+		size_t fill = 0;
+
+		while (fill < sizeof req) {
+			ssize_t got = recv(sock, (char *) &req + fill, sizeof req - fill, 0);
+			if (got < 0 && errno == EINTR)
+				continue;
+
+			if (got <= 0)
+				break;
+
+			fill += got;
+		}
+
+		if (fill < sizeof req)
+			break;
+
+		struct serve_reply reply;
+		char *path = (char *) 0;
+		bool fresh = false;
+		uint64_t epoch;
+		int fd = -1;
+
+		memset(&reply, 0, sizeof reply);
+
+		if (!memchr(req.module, 0, sizeof req.module) || !*req.module || *req.module == '.' || strchr(req.module, '/'))
+			reply.error = EINVAL;
+
+		else if (req.op == SERVE_FORGET)
+			forget(&req);
+
+		else if (req.op != SERVE_OPEN)
+			reply.error = EINVAL;
+
+		else if ((fd = lookup(&req, &reply, &epoch)) < 0) {
+			fresh = true;
+
+			if ((fd = prepare(&req, &reply, &path)) < 0)
+				reply.error = errno;
+		}
+
+		bool result = answer(sock, &reply, fd);
+
+		/* Keep newly opened objects for the next request */
+		if (fd >= 0 && fresh)
+			insert(&req, fd, reply.offset, reply.size, path, epoch);
+		else if (fd >= 0)
+			close(fd);
+
+		if (!result)
+			break;
+	}
+
+	close(sock);
+	return (void *) 0;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * The server listens on \c SERVE_PATH and answers every client in a
+ * thread of its own until it is terminated.  The memory budget for
+ * materialised objects may be set through \c SERVE_MEMORY in bytes.
+ * Invoked as “forget” with a module name and an object identifier, the
+ * listening server is told to forget that object instead.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector: nothing, or “forget”, module name and object identifier.
+ *
+ * \return EXIT_FAILURE on failure, or EXIT_SUCCESS once forgotten.
+ */
+int main(int argc, char *argv[]) {
+	const char *path = getenv("SERVE_PATH");
+	const char *str = getenv("SERVE_MEMORY");
+
+	if (argc == 4 && !strcmp(argv[1], "forget")) {
+		uint8_t ident[32];
+
+		if (unlikely(strlen(argv[3]) != 32 * 2 || !hexsint(ident, argv[3], 32))) {
+			fputs("Invalid object identifier!\n", stderr);
+			return EXIT_FAILURE;
+		}
+
+		if (unlikely(!storage_forget(argv[2], ident))) {
+			perror("Unable to forget object");
+			return EXIT_FAILURE;
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	if (unlikely(argc != 1)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	if (!path || !*path)
+		path = SERVE_PATH;
+
+	if (str && *str && unlikely(!decsint(&budget, str))) {
+		fputs("Invalid memory budget!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	for (size_t iter = 0; iter < ENTRIES; ++iter)
+		table[iter].fd = -1;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+
+	if (unlikely(strlen(path) >= sizeof addr.sun_path)) {
+		fputs("Socket path too long!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	strcpy(addr.sun_path, path);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (unlikely(sock < 0)) {
+		perror("Unable to create socket");
+		return EXIT_FAILURE;
+	}
+
+	/* A previous server may have left its socket behind */
+	unlink(path);
+
+	if (unlikely(bind(sock, (struct sockaddr *) &addr, sizeof addr) || listen(sock, SOMAXCONN))) {
+		perror("Unable to listen on socket");
+		return EXIT_FAILURE;
+	}
+
+	/* A client going away is noticed as a write error */
+	signal(SIGPIPE, SIG_IGN);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	for (;;) {
+		int client = accept4(sock, (struct sockaddr *) 0, (socklen_t *) 0, SOCK_CLOEXEC);
+
+		if (client < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			perror("Unable to accept connection");
+			return EXIT_FAILURE;
+		}
+
+		pthread_t thread;
+		if (unlikely(pthread_create(&thread, &attr, client_thread, (void *) (intptr_t) client))) {
+			fputs("Unable to start client thread!\n", stderr);
+			close(client);
+		}
+	}
+}
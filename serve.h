@@ -0,0 +1,61 @@
+#pragma once
+#ifndef OC_SERVE_H
+#define OC_SERVE_H
+
+/**
+ * \file
+ *
+ * \brief Object server protocol.
+ *
+ * Clients send requests over a Unix domain stream socket and receive a
+ * reply for each, in order.  A successful reply carries a read‐only
+ * file descriptor as \c SCM_RIGHTS ancillary data, together with the
+ * offset and size of the object within the file.  Fields are in host
+ * byte order, since both ends run on the same machine.
+ */
+
+#include <stdint.h>
+
+/**
+ * \brief Default socket path.
+ *
+ * It may be overridden through \c SERVE_PATH.
+ */
+#define SERVE_PATH "/var/run/opencorpus/serve"
+
+/**
+ * \brief Maximum length of module names, including the terminator.
+ */
+#define SERVE_NAMELEN 64
+
+/**
+ * \brief Open object and pass its file descriptor.
+ */
+#define SERVE_OPEN 0
+
+/**
+ * \brief Stop keeping object open, replying without file descriptor.
+ */
+#define SERVE_FORGET 1
+
+/**
+ * \brief Request.
+ */
+struct serve_request {
+	uint8_t  ident[32];             /**< Object identifier. */
+	char     module[SERVE_NAMELEN]; /**< Storage module name. */
+	uint32_t op;                    /**< Operation. */
+	uint32_t reserved;              /**< Reserved, set to zero. */
+};
+
+/**
+ * \brief Reply.
+ */
+struct serve_reply {
+	int32_t  error;    /**< Zero or error number. */
+	uint32_t reserved; /**< Reserved, set to zero. */
+	uint64_t offset;   /**< Offset of the object within the file. */
+	uint64_t size;     /**< Object size. */
+};
+
+#endif /* OC_SERVE_H */
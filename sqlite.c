@@ -1,288 +1,1321 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-#include <sys/mman.h>
-#include <sys/stat.h>
-
 #include <sqlite3.h>
 
 #include "expect.h"
+#include "stream.h"
 #include "string.h"
 
 /**
- * \brief Size of I/O buffer.
+ * \brief Database file name of unsharded stores.
+ */
+#define DATABASE_NAME "corpus"
+
+/**
+ * \brief Shard database file name format.
+ */
+#define SHARD_NAME "corpus-%u-%u"
+
+/**
+ * \brief Maximum length of database file names.
+ */
+#define SHARD_NAMELEN (sizeof "corpus-4294967295-4294967295-journal")
+
+/**
+ * \brief File recording the number of shards.
+ */
+#define LAYOUT_NAME "shards"
+
+/**
+ * \brief Lock file guarding the shard layout.
+ */
+#define LOCK_NAME "corpus.lock"
+
+/**
+ * \brief Maximum number of shards.
+ */
+#define SHARD_MAXIMUM 256
+
+/**
+ * \brief Current schema version.
+ */
+#define SCHEMA_VERSION 3
+
+/**
+ * \brief Size of chunks of large objects.
+ *
+ * Smaller objects are stored inline.
+ */
+#define CHUNK_SIZE (1 << 22)
+
+/**
+ * \brief Default number of threads fetching chunks.
+ */
+#define THREADS_DEFAULT 4
+
+/**
+ * \brief Maximum number of threads fetching chunks.
+ */
+#define THREADS_MAXIMUM 64
+
+/**
+ * \brief Number of rows copied per transaction while resharding.
+ */
+#define RESHARD_BATCH 1024
+
+/**
+ * \brief Prepared statements.
+ */
+enum statement {
+	STMT_BEGIN,
+	STMT_COMMIT,
+	STMT_ROLLBACK,
+	STMT_LOOKUP,
+	STMT_INSERT,
+	STMT_RESIZE,
+	STMT_DELETE,
+	STMT_CHUNK,
+	STMT_PURGE,
+	STMT_SCAN,
+	STMT_SCAN_CHUNKS,
+	STMT_COPY_CHUNK,
+	STMT_LIST,
+	STMTS
+};
+
+/**
+ * \brief Statement texts.
+ */
+static const char *const queries[STMTS] = {
+	[STMT_BEGIN]    = "BEGIN IMMEDIATE",
+	[STMT_COMMIT]   = "COMMIT",
+	[STMT_ROLLBACK] = "ROLLBACK",
+	[STMT_LOOKUP]   = "SELECT ROWID, object IS NULL, coalesce(size, length(object)), time FROM corpus WHERE ident=?",
+	[STMT_INSERT]   = "INSERT OR REPLACE INTO corpus (ident, object, size, time) VALUES(?, ?, ?, ?)",
+	[STMT_RESIZE]   = "UPDATE corpus SET size=? WHERE ident=?",
+	[STMT_DELETE]   = "DELETE FROM corpus WHERE ident=?",
+	[STMT_CHUNK]    = "INSERT INTO chunk (ident, seq, data) VALUES(?, ?, ?)",
+	[STMT_PURGE]    = "DELETE FROM chunk WHERE ident=?",
+	[STMT_SCAN]     = "SELECT ident, object, size, time FROM corpus",
+
+	[STMT_SCAN_CHUNKS] = "SELECT ident, seq, data FROM chunk",
+	[STMT_COPY_CHUNK]  = "INSERT OR REPLACE INTO chunk (ident, seq, data) VALUES(?, ?, ?)",
+	[STMT_LIST]        = "SELECT ident FROM corpus"
+};
+
+/**
+ * \brief Schema migrations, indexed by the version they start from.
+ */
+static const char *const migrations[SCHEMA_VERSION] = {
+	/* Databases predating versioning have the same table */
+	"CREATE TABLE IF NOT EXISTS corpus (ident BLOB PRIMARY KEY, object BLOB);",
+
+	/* Large objects are split into chunks */
+	"ALTER TABLE corpus ADD COLUMN size INTEGER;"
+	"CREATE TABLE chunk (ident BLOB NOT NULL, seq INTEGER NOT NULL, data BLOB NOT NULL, PRIMARY KEY (ident, seq));",
+
+	/* Deposit time in nanoseconds, unknown for older objects */
+	"ALTER TABLE corpus ADD COLUMN time INTEGER;"
+};
+
+/**
+ * \brief Shard connection.
  */
-#define BUFSIZE 4096
+struct shard {
+	sqlite3      *db;                  /**< Database handle. */
+	sqlite3_stmt *stmt[STMTS];         /**< Prepared statements. */
+	char          name[SHARD_NAMELEN]; /**< Database file name. */
+};
+
+/**
+ * \brief Object location.
+ */
+struct object {
+	sqlite3_int64 row;     /**< Row identifier. */
+	bool          chunked; /**< Object is split into chunks. */
+	uint64_t      size;    /**< Object size. */
+	uint64_t      time;    /**< Deposit time in nanoseconds or 0 if unknown. */
+};
+
+/**
+ * \brief Parallel chunk retrieval.
+ *
+ * Workers claim chunks in order and fill a ring of chunk buffers, which
+ * the main thread drains in order.
+ */
+struct fetch {
+	pthread_mutex_t lock;   /**< Lock protecting the fields below. */
+	pthread_cond_t  cond;   /**< Signalled on every state change. */
+	const char     *name;   /**< Database file name. */
+	const uint8_t  *ident;  /**< Object identifier. */
+	uint64_t        size;   /**< Object size. */
+	uint64_t        offset; /**< Offset of first byte to write out. */
+	uint64_t        end;    /**< Offset past last byte to write out. */
+	uint64_t        chunks; /**< Number of chunks up to the range end. */
+	uint64_t        next;   /**< Next chunk to be claimed. */
+	uint64_t        done;   /**< Number of chunks written out. */
+	size_t          slots;  /**< Number of ring slots. */
+	uint8_t        *ring;   /**< Ring of chunk buffers. */
+	bool           *ready;  /**< Ring slot holds its chunk. */
+	bool            failed; /**< Retrieval failed. */
+};
 
 /**
  * \brief I/O buffer.
  */
-static uint8_t buf[BUFSIZE];
+static uint8_t buf[CHUNK_SIZE];
 
 /**
- * \brief SQLite database handle.
+ * \brief Shard connections.
  */
-static sqlite3 *db;
+static struct shard shards[SHARD_MAXIMUM];
+
+/**
+ * \brief Shard connections of the layout being replaced while resharding.
+ */
+static struct shard former[SHARD_MAXIMUM];
+
+/**
+ * \brief Get current time.
+ *
+ * \return Nanoseconds since the epoch.
+ */
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t) ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/**
+ * \brief Close shard connection.
+ *
+ * \param shard Shard connection.
+ */
+static void shard_close(struct shard *restrict shard) {
+	for (size_t iter = 0; iter < STMTS; ++iter) {
+		sqlite3_finalize(shard->stmt[iter]);
+		shard->stmt[iter] = (sqlite3_stmt *) 0;
+	}
+
+	sqlite3_close(shard->db);
+	shard->db = (sqlite3 *) 0;
+}
 
 /**
  * \brief SQLite cleanup routine.
  */
 static void atexit_sqlite() {
-	sqlite3_close(db);
+	for (size_t iter = 0; iter < SHARD_MAXIMUM; ++iter) {
+		shard_close(&shards[iter]);
+		shard_close(&former[iter]);
+	}
 }
 
 /**
- * \brief Main routine.
+ * \brief Format database file name.
  *
- * \param argc Number of arguments.
- * \param argv Argument vector.
+ * \param name Buffer of at least \c SHARD_NAMELEN bytes.
+ * \param count Number of shards or 0 for an unsharded store.
+ * \param num Shard number.
+ */
+static void shard_name(char *restrict name, unsigned int count, unsigned int num) {
+	if (count)
+		snprintf(name, SHARD_NAMELEN, SHARD_NAME, count, num);
+	else
+		strcpy(name, DATABASE_NAME);
+}
+
+/**
+ * \brief Select shard for identifier.
  *
- * \return EXIT_SUCCESS if successful or any other value on failure.
+ * \param ident Object identifier.
+ * \param count Number of shards or 0 for an unsharded store.
+ *
+ * \return Shard number.
  */
-int main(int argc, char *argv[]) {
-	if (unlikely(argc != 6)) {
-		fputs("Invalid number of command line arguments!\n", stderr);
+static unsigned int shard_select(const uint8_t ident[restrict 32], unsigned int count) {
+	return count ? ((unsigned int) ident[0] << 8 | ident[1]) % count : 0;
+}
+
+/**
+ * \brief Get prepared statement.
+ *
+ * Statements are prepared once per connection and reset for reuse.
+ *
+ * \param shard Shard connection.
+ * \param which Statement.
+ *
+ * \return Statement or <tt>(sqlite3_stmt *) 0</tt> on failure.
+ */
+static sqlite3_stmt *statement(struct shard *restrict shard, enum statement which) {
+	sqlite3_stmt *stmt = shard->stmt[which];
+
+	if (stmt) {
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+		return stmt;
+	}
+
+	if (unlikely(sqlite3_prepare_v3(shard->db, queries[which], -1, SQLITE_PREPARE_PERSISTENT, &stmt, (const char **) 0) != SQLITE_OK)) {
+		fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(shard->db));
+		return (sqlite3_stmt *) 0;
+	}
+
+	return shard->stmt[which] = stmt;
+}
+
+/**
+ * \brief Execute statement without result rows.
+ *
+ * \param shard Shard connection.
+ * \param which Statement.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool execute(struct shard *restrict shard, enum statement which) {
+	sqlite3_stmt *stmt = statement(shard, which);
+	if (unlikely(!stmt))
+		return false;
+
+	if (unlikely(sqlite3_step(stmt) != SQLITE_DONE)) {
+		fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(shard->db));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Read schema version.
+ *
+ * \param db Database handle.
+ *
+ * \return Schema version or -1 on failure.
+ */
+static int schema_version(sqlite3 *restrict db) {
+	sqlite3_stmt *stmt;
+	int version = -1;
+
+	if (likely(sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, (const char **) 0) == SQLITE_OK)) {
+		if (sqlite3_step(stmt) == SQLITE_ROW)
+			version = sqlite3_column_int(stmt, 0);
+
+		sqlite3_finalize(stmt);
+	}
+
+	return version;
+}
+
+/**
+ * \brief Bring database schema up to date.
+ *
+ * The schema version is kept in the \c user_version pragma, so that the
+ * common case costs a single pragma read instead of DDL.
+ *
+ * \param shard Shard connection.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool schema(struct shard *restrict shard) {
+	if (likely(schema_version(shard->db) == SCHEMA_VERSION))
+		return true;
+
+	if (unlikely(sqlite3_exec(shard->db, "PRAGMA journal_mode=WAL; BEGIN IMMEDIATE", (void *) 0, (void *) 0, (char **) 0) != SQLITE_OK)) {
+		fprintf(stderr, "Unable to begin transaction: %s\n", sqlite3_errmsg(shard->db));
+		return false;
+	}
+
+	/* Another process may have migrated the schema meanwhile */
+	int version = schema_version(shard->db);
+	if (unlikely(version > SCHEMA_VERSION || version < 0)) {
+		fprintf(stderr, "Unsupported schema version %d!\n", version);
+		sqlite3_exec(shard->db, "ROLLBACK", (void *) 0, (void *) 0, (char **) 0);
+		return false;
+	}
+
+	for (; version < SCHEMA_VERSION; ++version) {
+		char *errmsg;
+
+		if (unlikely(sqlite3_exec(shard->db, migrations[version], (void *) 0, (void *) 0, &errmsg) != SQLITE_OK)) {
+			fprintf(stderr, "Unable to migrate schema: %s\n", errmsg);
+			sqlite3_free(errmsg);
+			sqlite3_exec(shard->db, "ROLLBACK", (void *) 0, (void *) 0, (char **) 0);
+			return false;
+		}
+	}
+
+	char pragma[sizeof "PRAGMA user_version=" + 10];
+	snprintf(pragma, sizeof pragma, "PRAGMA user_version=%d", SCHEMA_VERSION);
+
+	if (unlikely(sqlite3_exec(shard->db, pragma, (void *) 0, (void *) 0, (char **) 0) != SQLITE_OK ||
+		sqlite3_exec(shard->db, "COMMIT", (void *) 0, (void *) 0, (char **) 0) != SQLITE_OK)) {
+		fprintf(stderr, "Unable to migrate schema: %s\n", sqlite3_errmsg(shard->db));
+		sqlite3_exec(shard->db, "ROLLBACK", (void *) 0, (void *) 0, (char **) 0);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Open database connection.
+ *
+ * \param db Pointer to variable receiving the database handle.
+ * \param name Database file name.
+ * \param create Create database if it does not exist.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool database_open(sqlite3 **restrict db, const char *restrict name, bool create) {
+	if (unlikely(sqlite3_open_v2(name, db, SQLITE_OPEN_READWRITE | (create ? SQLITE_OPEN_CREATE : 0), (const char *) 0) != SQLITE_OK)) {
+		fprintf(stderr, "Cannot open database: %s\n", sqlite3_errmsg(*db));
+		sqlite3_close(*db);
+		*db = (sqlite3 *) 0;
+		return false;
+	}
+
+	sqlite3_busy_timeout(*db, 60000);
+
+	/* Tune page cache and map the database */
+	sqlite3_exec(*db,
+		"PRAGMA cache_size=-16384;"
+		"PRAGMA mmap_size=268435456",
+		(void *) 0, (void *) 0, (char **) 0);
+
+	return true;
+}
+
+/**
+ * \brief Open shard connection.
+ *
+ * \param shard Shard connection.
+ * \param name Database file name.
+ * \param create Create database if it does not exist.
+ *
+ * \return 0 if successful, 3 if the database does not exist or \c EXIT_FAILURE on failure.
+ */
+static int shard_open(struct shard *restrict shard, const char *restrict name, bool create) {
+	if (shard->db)
+		return EXIT_SUCCESS;
+
+	/* Shards are created lazily by the first deposit */
+	if (!create && access(name, F_OK)) {
+		if (errno == ENOENT)
+			return 3;
+
+		perror("Cannot access database");
 		return EXIT_FAILURE;
 	}
 
-	/* Change to storage directory */
-	if (unlikely(chdir(argv[1]))) {
-		perror("Unable to change to storage directory");
+	if (unlikely(!database_open(&shard->db, name, create)))
+		return EXIT_FAILURE;
+
+	strcpy(shard->name, name);
+
+	if (unlikely(!schema(shard))) {
+		shard_close(shard);
 		return EXIT_FAILURE;
 	}
 
-	uint8_t ident[32];
-	if (!hexsint(ident, argv[4], sizeof ident)) {
-		perror("Failed to parse identifier");
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Read number of shards.
+ *
+ * \param count Pointer to variable receiving the number of shards or 0 for an unsharded store.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool layout_read(unsigned int *restrict count) {
+	FILE *file = fopen(LAYOUT_NAME, "r");
+	if (!file) {
+		*count = 0;
+		return errno == ENOENT;
+	}
+
+	bool result = fscanf(file, "%u", count) == 1 && *count <= SHARD_MAXIMUM;
+	fclose(file);
+
+	if (unlikely(!result))
+		fputs("Invalid shard layout!\n", stderr);
+
+	return result;
+}
+
+/**
+ * \brief Record number of shards.
+ *
+ * \param count Number of shards.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool layout_write(unsigned int count) {
+	FILE *file = fopen(LAYOUT_NAME ".part", "w");
+	if (unlikely(!file))
+		return false;
+
+	bool result = fprintf(file, "%u\n", count) > 0 && !fflush(file) && !fdatasync(fileno(file));
+	result = !fclose(file) && result && !rename(LAYOUT_NAME ".part", LAYOUT_NAME);
+
+	if (!result)
+		unlink(LAYOUT_NAME ".part");
+
+	return result;
+}
+
+/**
+ * \brief Lock shard layout.
+ *
+ * The lock is held until the process exits.
+ *
+ * \param type Lock type.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool layout_lock(short type) {
+	int fd = open(LOCK_NAME, O_RDWR | O_CREAT, 0644);
+	if (unlikely(fd < 0))
+		return false;
+
+	struct flock lock = {
+		.l_type   = type,
+		.l_whence = SEEK_SET,
+		.l_start  = 0,
+		.l_len    = 0
+	};
+
+	return !fcntl(fd, F_SETLKW, &lock);
+}
+
+/**
+ * \brief Remove database files.
+ *
+ * \param name Database file name.
+ */
+static void database_remove(const char *restrict name) {
+	char path[SHARD_NAMELEN];
+
+	unlink(name);
+
+	snprintf(path, sizeof path, "%s-wal", name);
+	unlink(path);
+
+	snprintf(path, sizeof path, "%s-shm", name);
+	unlink(path);
+
+	snprintf(path, sizeof path, "%s-journal", name);
+	unlink(path);
+}
+
+/**
+ * \brief Open shard holding identifier.
+ *
+ * \param ident Object identifier.
+ * \param create Create shard if it does not exist.
+ * \param shard Pointer to variable receiving the shard connection.
+ *
+ * \return 0 if successful, 3 if the shard does not exist or \c EXIT_FAILURE on failure.
+ */
+static int shard_get(const uint8_t ident[restrict 32], bool create, struct shard **restrict shard) {
+	unsigned int count;
+	if (unlikely(!layout_read(&count)))
+		return EXIT_FAILURE;
+
+	unsigned int num = shard_select(ident, count);
+	char name[SHARD_NAMELEN];
+	shard_name(name, count, num);
+
+	*shard = &shards[num];
+
+	return shard_open(*shard, name, create);
+}
+
+/**
+ * \brief Look object up.
+ *
+ * \param shard Shard connection.
+ * \param ident Object identifier.
+ * \param obj Buffer to hold the object location.
+ *
+ * \return 0 if found, 3 if not found or \c EXIT_FAILURE on failure.
+ */
+static int lookup(struct shard *restrict shard, const uint8_t ident[restrict 32], struct object *restrict obj) {
+	sqlite3_stmt *stmt = statement(shard, STMT_LOOKUP);
+	if (unlikely(!stmt))
+		return EXIT_FAILURE;
+
+	if (unlikely(sqlite3_bind_blob(stmt, 1, ident, 32, SQLITE_STATIC) != SQLITE_OK)) {
+		fprintf(stderr, "Failed to bind value: %s\n", sqlite3_errmsg(shard->db));
 		return EXIT_FAILURE;
 	}
 
-	/* Close database upon exit */
-	atexit(atexit_sqlite);
+	switch (sqlite3_step(stmt)) {
+	case SQLITE_DONE:
+		return 3;
 
-	/* Open database */
-	if (unlikely(sqlite3_open("corpus", &db) != SQLITE_OK)) {
-		fprintf(stderr, "Cannot open database: %s\n", sqlite3_errmsg(db));
+	case SQLITE_ROW:
+		obj->row     = sqlite3_column_int64(stmt, 0);
+		obj->chunked = sqlite3_column_int(stmt, 1);
+		obj->size    = sqlite3_column_int64(stmt, 2);
+		obj->time    = sqlite3_column_int64(stmt, 3);
+		sqlite3_reset(stmt);
+		return EXIT_SUCCESS;
+
+	default:
+		fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(shard->db));
 		return EXIT_FAILURE;
 	}
+}
+
+/**
+ * \brief Assay object.
+ */
+static int op_assay(const uint8_t ident[restrict 32]) {
+	struct shard *shard;
+	int rc = shard_get(ident, false, &shard);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	struct object obj;
+	return lookup(shard, ident, &obj);
+}
+
+/**
+ * \brief Describe object.
+ *
+ * Chunked objects are stored verbatim as well, so the stored size is the
+ * object size.
+ *
+ * \param ident Object identifier.
+ * \param dir Storage directory.
+ */
+static int op_inspect(const uint8_t ident[restrict 32], const char *restrict dir) {
+	struct shard *shard;
+	int rc = shard_get(ident, false, &shard);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	struct object obj;
+	rc = lookup(shard, ident, &obj);
+	if (rc != EXIT_SUCCESS)
+		return rc;
 
-	/* Create table */
-	char *errmsg;
-	if (unlikely(sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS corpus (ident BLOB PRIMARY KEY, object BLOB)",
-		(void *) 0, (void *) 0, &errmsg) != SQLITE_OK)) {
-		fprintf(stderr, "Unable to create table: %s\n", errmsg);
+	char stamp[sizeof "18446744073709551615"] = "-";
+	if (obj.time)
+		snprintf(stamp, sizeof stamp, "%" PRIu64, obj.time);
+
+	printf("%" PRIu64 " %" PRIu64 " %s %s/%s#%lld\n", obj.size, obj.size, stamp, dir, shard->name, (long long int) obj.row);
+
+	if (unlikely(fflush(stdout))) {
+		perror("Unable to write description");
 		return EXIT_FAILURE;
 	}
 
-	/* Parse operation string */
-	if (!strcmp(argv[5], "assay")) {
-		const char *query = "SELECT object FROM corpus WHERE ident=?";
+	return EXIT_SUCCESS;
+}
 
-		sqlite3_stmt *stmt;
-		if (unlikely(sqlite3_prepare_v2(db, query, -1, &stmt, (const char **) 0) != SQLITE_OK)) {
-			fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
-			return EXIT_FAILURE;
+/**
+ * \brief Retrieve inline object.
+ *
+ * \param shard Shard connection.
+ * \param obj Object location.
+ * \param offset Offset of first byte.
+ * \param length Number of bytes.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool retrieve_inline(struct shard *restrict shard, const struct object *restrict obj, uint64_t offset, uint64_t length) {
+	/* Open BLOB */
+	sqlite3_blob *blob;
+	if (unlikely(sqlite3_blob_open(shard->db, "main", "corpus", "object", obj->row, 0, &blob) != SQLITE_OK)) {
+		fprintf(stderr, "Cannot open BLOB: %s\n", sqlite3_errmsg(shard->db));
+		return false;
+	}
+
+	/* Inline objects are smaller than a chunk */
+	int index = offset, bytes = offset + length;
+
+	while (index < bytes) {
+		int fill = bytes - index > (int) sizeof buf ? (int) sizeof buf : bytes - index;
+
+		if (unlikely(sqlite3_blob_read(blob, buf, fill, index) != SQLITE_OK)) {
+			fprintf(stderr, "Cannot read from BLOB: %s\n", sqlite3_errmsg(shard->db));
+			sqlite3_blob_close(blob);
+			return false;
 		}
 
-		if (unlikely(sqlite3_bind_blob(stmt, 1, ident, sizeof ident, SQLITE_STATIC) != SQLITE_OK)) {
-			fprintf(stderr, "Failed to bind value: %s\n", sqlite3_errmsg(db));
-			return EXIT_FAILURE;
+		if (unlikely(!stream_write(1, buf, fill))) {
+			perror("Write error");
+			sqlite3_blob_close(blob);
+			return false;
 		}
 
-		int rc = sqlite3_step(stmt);
-		switch (rc) {
-		case SQLITE_DONE:
-			sqlite3_finalize(stmt);
-			return 3;
+		index += fill;
+	}
 
-		case SQLITE_ROW:
-			break;
+	sqlite3_blob_close(blob);
 
-		default:
-			fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
-			return EXIT_FAILURE;
-		}
+	return true;
+}
 
-		sqlite3_finalize(stmt);
+/**
+ * \brief Read chunk into buffer.
+ *
+ * \param db Database handle.
+ * \param stmt Chunk lookup statement.
+ * \param blob Pointer to BLOB handle, opened on first use.
+ * \param fetch Retrieval state.
+ * \param seq Chunk number.
+ * \param dest Chunk buffer.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool chunk_read(sqlite3 *restrict db, sqlite3_stmt *restrict stmt, sqlite3_blob **restrict blob, const struct fetch *restrict fetch, uint64_t seq, uint8_t *restrict dest) {
+	uint64_t expect = fetch->size - seq * CHUNK_SIZE;
+	if (expect > CHUNK_SIZE)
+		expect = CHUNK_SIZE;
+
+	sqlite3_reset(stmt);
+
+	if (unlikely(sqlite3_bind_int64(stmt, 2, seq) != SQLITE_OK || sqlite3_step(stmt) != SQLITE_ROW)) {
+		fprintf(stderr, "Missing chunk %llu: %s\n", (unsigned long long) seq, sqlite3_errmsg(db));
+		return false;
 	}
 
-	else if (!strcmp(argv[5], "retrieve")) {
-		/* Get row ID */
-		const char *query = "SELECT ROWID FROM corpus WHERE ident=?";
+	sqlite3_int64 row = sqlite3_column_int64(stmt, 0);
 
-		sqlite3_stmt *stmt;
-		if (unlikely(sqlite3_prepare_v2(db, query, -1, &stmt, (const char **) 0) != SQLITE_OK)) {
-			fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
-			return EXIT_FAILURE;
-		}
+	if (unlikely(*blob ?
+		sqlite3_blob_reopen(*blob, row) != SQLITE_OK :
+		sqlite3_blob_open(db, "main", "chunk", "data", row, 0, blob) != SQLITE_OK)) {
+		fprintf(stderr, "Cannot open BLOB: %s\n", sqlite3_errmsg(db));
+		return false;
+	}
 
-		if (unlikely(sqlite3_bind_blob(stmt, 1, ident, sizeof ident, SQLITE_STATIC) != SQLITE_OK)) {
-			fprintf(stderr, "Failed to bind value: %s\n", sqlite3_errmsg(db));
-			return EXIT_FAILURE;
+	if (unlikely((uint64_t) sqlite3_blob_bytes(*blob) != expect)) {
+		fprintf(stderr, "Chunk %llu has unexpected size!\n", (unsigned long long) seq);
+		return false;
+	}
+
+	if (unlikely(sqlite3_blob_read(*blob, dest, expect, 0) != SQLITE_OK)) {
+		fprintf(stderr, "Cannot read from BLOB: %s\n", sqlite3_errmsg(db));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Chunk fetching thread.
+ *
+ * Every thread reads through its own connection.  Identifiers are
+ * content hashes, so chunks read in different snapshots still belong
+ * to the same object.
+ *
+ * \param arg Retrieval state.
+ *
+ * \return <tt>(void *) 0</tt>.
+ */
+static void *fetch_thread(void *arg) {
+	struct fetch *fetch = arg;
+	sqlite3 *db = (sqlite3 *) 0;
+	sqlite3_stmt *stmt = (sqlite3_stmt *) 0;
+	sqlite3_blob *blob = (sqlite3_blob *) 0;
+
+	bool result = database_open(&db, fetch->name, false) &&
+		sqlite3_prepare_v2(db, "SELECT ROWID FROM chunk WHERE ident=? AND seq=?", -1, &stmt, (const char **) 0) == SQLITE_OK &&
+		sqlite3_bind_blob(stmt, 1, fetch->ident, 32, SQLITE_STATIC) == SQLITE_OK;
+
+	if (unlikely(!result))
+		fprintf(stderr, "Unable to prepare chunk retrieval: %s\n", sqlite3_errmsg(db));
+
+	for (;;) {
+		pthread_mutex_lock(&fetch->lock);
+
+		/* Wait for a free ring slot */
+		while (result && !fetch->failed && fetch->next < fetch->chunks && fetch->next >= fetch->done + fetch->slots)
+			pthread_cond_wait(&fetch->cond, &fetch->lock);
+
+		if (!result || fetch->failed || fetch->next >= fetch->chunks) {
+			fetch->failed |= !result;
+			pthread_cond_broadcast(&fetch->cond);
+			pthread_mutex_unlock(&fetch->lock);
+			break;
 		}
 
-		int rc = sqlite3_step(stmt);
-		switch (rc) {
-		case SQLITE_DONE:
-			return 3;
-			sqlite3_finalize(stmt);
+		uint64_t seq = fetch->next++;
+		pthread_mutex_unlock(&fetch->lock);
+
+		result = chunk_read(db, stmt, &blob, fetch, seq, fetch->ring + seq % fetch->slots * CHUNK_SIZE);
+
+		pthread_mutex_lock(&fetch->lock);
+		fetch->ready[seq % fetch->slots] = result;
+		pthread_cond_broadcast(&fetch->cond);
+		pthread_mutex_unlock(&fetch->lock);
+	}
+
+	sqlite3_blob_close(blob);
+	sqlite3_finalize(stmt);
+	sqlite3_close(db);
+
+	return (void *) 0;
+}
+
+/**
+ * \brief Retrieve byte range of chunked object.
+ *
+ * Chunks are fetched in parallel by up to \c SQLITE_THREADS threads and
+ * written out in order.  Only chunks overlapping the range are read.
+ *
+ * \param shard Shard connection.
+ * \param ident Object identifier.
+ * \param obj Object location.
+ * \param offset Offset of first byte.
+ * \param length Number of bytes.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool retrieve_chunked(struct shard *restrict shard, const uint8_t ident[restrict 32], const struct object *restrict obj, uint64_t offset, uint64_t length) {
+	unsigned long int threads = setting("SQLITE_THREADS", THREADS_DEFAULT);
+
+	struct fetch fetch = {
+		.name   = shard->name,
+		.ident  = ident,
+		.size   = obj->size,
+		.offset = offset,
+		.end    = offset + length,
+		.chunks = (offset + length + CHUNK_SIZE - 1) / CHUNK_SIZE,
+		.next   = offset / CHUNK_SIZE,
+		.done   = offset / CHUNK_SIZE,
+		.failed = false
+	};
+
+	if (threads > THREADS_MAXIMUM)
+		threads = THREADS_MAXIMUM;
+
+	if (threads > fetch.chunks - fetch.next)
+		threads = fetch.chunks - fetch.next;
+
+	if (!threads)
+		threads = 1;
+
+	fetch.slots = threads * 2;
+	fetch.ring  = malloc(fetch.slots * CHUNK_SIZE);
+	fetch.ready = calloc(fetch.slots, sizeof *fetch.ready);
+
+	if (unlikely(!fetch.ring || !fetch.ready)) {
+		perror("Unable to allocate chunk buffers");
+		free(fetch.ring);
+		free(fetch.ready);
+		return false;
+	}
+
+	pthread_mutex_init(&fetch.lock, (const pthread_mutexattr_t *) 0);
+	pthread_cond_init(&fetch.cond, (const pthread_condattr_t *) 0);
+
+	pthread_t thread[THREADS_MAXIMUM];
+	size_t started = 0;
+
+	while (started < threads && !pthread_create(&thread[started], (const pthread_attr_t *) 0, fetch_thread, &fetch))
+		++started;
+
+	bool result = started > 0;
+
+	for (uint64_t seq = offset / CHUNK_SIZE; result && seq < fetch.chunks; ++seq) {
+		size_t slot = seq % fetch.slots;
+
+		pthread_mutex_lock(&fetch.lock);
+
+		while (!fetch.ready[slot] && !fetch.failed)
+			pthread_cond_wait(&fetch.cond, &fetch.lock);
 
-		case SQLITE_ROW:
+		result = !fetch.failed;
+		pthread_mutex_unlock(&fetch.lock);
+
+		if (!result)
 			break;
 
-		default:
-			fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
-			return EXIT_FAILURE;
+		/* Write out the part of the chunk within the range */
+		uint64_t start = seq * CHUNK_SIZE;
+		uint64_t from  = fetch.offset > start ? fetch.offset - start : 0;
+		uint64_t to    = fetch.end - start < CHUNK_SIZE ? fetch.end - start : CHUNK_SIZE;
+
+		if (unlikely(!stream_write(1, fetch.ring + slot * CHUNK_SIZE + from, to - from))) {
+			perror("Write error");
+			result = false;
 		}
 
-		sqlite3_int64 row = sqlite3_column_int64(stmt, 0);
-		sqlite3_finalize(stmt);
+		pthread_mutex_lock(&fetch.lock);
+		fetch.ready[slot] = false;
+		fetch.failed |= !result;
+		++fetch.done;
+		pthread_cond_broadcast(&fetch.cond);
+		pthread_mutex_unlock(&fetch.lock);
+	}
 
-		/* Open BLOB */
-		sqlite3_blob *blob;
-		if (unlikely(sqlite3_blob_open(db, (char *) 0, "corpus", "object", row, 0, &blob) != SQLITE_OK)) {
-			fprintf(stderr, "Cannot open BLOB: %s\n", sqlite3_errmsg(db));
-			return EXIT_FAILURE;
-		}
+	pthread_mutex_lock(&fetch.lock);
+	fetch.failed |= !result;
+	pthread_cond_broadcast(&fetch.cond);
+	pthread_mutex_unlock(&fetch.lock);
 
-		int index = 0;
-		int bytes = sqlite3_blob_bytes(blob);
+	while (started)
+		pthread_join(thread[--started], (void **) 0);
 
-#define BUFFILL (BUFSIZE > bytes - index ? bytes - index : BUFSIZE)
+	pthread_cond_destroy(&fetch.cond);
+	pthread_mutex_destroy(&fetch.lock);
+	free(fetch.ready);
+	free(fetch.ring);
 
-		while (index < bytes) {
-			if (unlikely(sqlite3_blob_read(blob, buf, BUFFILL, index) != SQLITE_OK)) {
-				fprintf(stderr, "Cannot read from BLOB: %s\n", sqlite3_errmsg(db));
-				return EXIT_FAILURE;
-			}
+	return result;
+}
 
-			if (unlikely(write(1, buf, BUFFILL) != BUFFILL)) {
-				perror("Write error");
-				return EXIT_FAILURE;
-			}
+/**
+ * \brief Retrieve byte range of object.
+ *
+ * \param ident Object identifier.
+ * \param offset Offset of first byte.
+ * \param length Maximum number of bytes.
+ */
+static int op_retrieve(const uint8_t ident[restrict 32], uint64_t offset, uint64_t length) {
+	struct shard *shard;
+	int rc = shard_get(ident, false, &shard);
+	if (rc != EXIT_SUCCESS)
+		return rc;
 
-			index += BUFFILL;
-		}
+	/* Look the row up and read it in the same snapshot */
+	if (unlikely(sqlite3_exec(shard->db, "BEGIN", (void *) 0, (void *) 0, (char **) 0) != SQLITE_OK)) {
+		fprintf(stderr, "Unable to begin transaction: %s\n", sqlite3_errmsg(shard->db));
+		return EXIT_FAILURE;
 	}
 
-	else if (!strcmp(argv[5], "deposit")) {
-		/* Write to temporary file */
-		if (unlikely(chdir(argv[3]))) {
-			perror("Failed to change to temporary directory");
-			return EXIT_FAILURE;
-		}
+	struct object obj;
+	rc = lookup(shard, ident, &obj);
+	if (rc != EXIT_SUCCESS)
+		return rc;
 
-		char template[] = "temp-XXXXXX";
-		int fd = mkstemp(template);
-		if (unlikely(fd < 0)) {
-			perror("Cannot create temporary file");
-			return EXIT_FAILURE;
-		}
+	/* Clip range to object */
+	if (offset > obj.size)
+		offset = obj.size;
+
+	if (length > obj.size - offset)
+		length = obj.size - offset;
 
-		unlink(template);
+	if (obj.chunked)
+		return retrieve_chunked(shard, ident, &obj, offset, length) ? EXIT_SUCCESS : EXIT_FAILURE;
 
-		ssize_t in, out;
+	return retrieve_inline(shard, &obj, offset, length) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * \brief Store chunk.
+ *
+ * \param shard Shard connection.
+ * \param ident Object identifier.
+ * \param seq Chunk number.
+ * \param size Chunk size.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool chunk_write(struct shard *restrict shard, const uint8_t ident[restrict 32], uint64_t seq, size_t size) {
+	sqlite3_stmt *stmt = statement(shard, STMT_CHUNK);
+
+	if (unlikely(!stmt ||
+		sqlite3_bind_blob(stmt, 1, ident, 32, SQLITE_STATIC) != SQLITE_OK ||
+		sqlite3_bind_int64(stmt, 2, seq) != SQLITE_OK ||
+		sqlite3_bind_blob(stmt, 3, buf, size, SQLITE_STATIC) != SQLITE_OK ||
+		sqlite3_step(stmt) != SQLITE_DONE)) {
+		fprintf(stderr, "Unable to store chunk: %s\n", sqlite3_errmsg(shard->db));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Deposit object.
+ *
+ * Objects smaller than a chunk are stored inline.  Larger objects are
+ * streamed chunk by chunk, so memory use is bounded by the chunk size.
+ */
+static int op_deposit(const uint8_t ident[restrict 32]) {
+	ssize_t fill = stream_read(0, buf, sizeof buf);
+	if (unlikely(fill < 0)) {
+		perror("Read error");
+		return EXIT_FAILURE;
+	}
+
+	struct shard *shard;
+	int rc = shard_get(ident, true, &shard);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	if (unlikely(!execute(shard, STMT_BEGIN)))
+		return EXIT_FAILURE;
+
+	bool chunked = fill == sizeof buf;
+
+	sqlite3_stmt *stmt = statement(shard, STMT_PURGE);
+	if (unlikely(!stmt ||
+		sqlite3_bind_blob(stmt, 1, ident, 32, SQLITE_STATIC) != SQLITE_OK ||
+		sqlite3_step(stmt) != SQLITE_DONE)) {
+		fprintf(stderr, "Unable to remove chunks: %s\n", sqlite3_errmsg(shard->db));
+		goto failure;
+	}
+
+	stmt = statement(shard, STMT_INSERT);
+	if (unlikely(!stmt ||
+		sqlite3_bind_blob(stmt, 1, ident, 32, SQLITE_STATIC) != SQLITE_OK ||
+		(chunked ?
+			sqlite3_bind_null(stmt, 2) :
+			sqlite3_bind_blob(stmt, 2, buf, fill, SQLITE_STATIC)) != SQLITE_OK ||
+		sqlite3_bind_int64(stmt, 3, fill) != SQLITE_OK ||
+		sqlite3_bind_int64(stmt, 4, now()) != SQLITE_OK ||
+		sqlite3_step(stmt) != SQLITE_DONE)) {
+		fprintf(stderr, "Unable to store object: %s\n", sqlite3_errmsg(shard->db));
+		goto failure;
+	}
+
+	if (chunked) {
+		uint64_t seq = 0, size = 0;
 
 		do {
-			in = read(0, buf, BUFSIZE);
-			if (unlikely(in < 0)) {
+			if (unlikely(!chunk_write(shard, ident, seq++, fill)))
+				goto failure;
+
+			size += fill;
+
+			fill = stream_read(0, buf, sizeof buf);
+			if (unlikely(fill < 0)) {
 				perror("Read error");
-				return EXIT_FAILURE;
+				goto failure;
 			}
+		} while (fill);
 
-			out = write(fd, buf, in);
-			if (unlikely(out < 0)) {
-				perror("Write error");
-				return EXIT_FAILURE;
-			}
+		stmt = statement(shard, STMT_RESIZE);
+		if (unlikely(!stmt ||
+			sqlite3_bind_int64(stmt, 1, size) != SQLITE_OK ||
+			sqlite3_bind_blob(stmt, 2, ident, 32, SQLITE_STATIC) != SQLITE_OK ||
+			sqlite3_step(stmt) != SQLITE_DONE)) {
+			fprintf(stderr, "Unable to store object: %s\n", sqlite3_errmsg(shard->db));
+			goto failure;
+		}
+	}
 
-			else if (unlikely(out < in)) {
-				fputs("Write error!\n", stderr);
-				return EXIT_FAILURE;
-			}
-		} while (likely(in > 0));
+	/* Close standard input */
+	close(0);
 
-		/* Close standard input */
-		close(0);
+	if (unlikely(!execute(shard, STMT_COMMIT)))
+		goto failure;
 
-		struct stat st;
-		if (unlikely(fstat(fd, &st))) {
-			perror("Cannot stat file");
-			return EXIT_FAILURE;
-		}
+	return EXIT_SUCCESS;
 
-		void *object = mmap((void *) 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
-		if (unlikely(object == MAP_FAILED)) {
-			perror("Unable to mmap file");
+failure:
+	execute(shard, STMT_ROLLBACK);
+
+	return EXIT_FAILURE;
+}
+
+/**
+ * \brief Efface object.
+ */
+static int op_efface(const uint8_t ident[restrict 32]) {
+	struct shard *shard;
+	int rc = shard_get(ident, false, &shard);
+	if (rc != EXIT_SUCCESS)
+		return rc == 3 ? EXIT_SUCCESS : rc;
+
+	if (unlikely(!execute(shard, STMT_BEGIN)))
+		return EXIT_FAILURE;
+
+	static const enum statement remove[] = { STMT_DELETE, STMT_PURGE };
+
+	for (size_t iter = 0; iter < sizeof remove / sizeof *remove; ++iter) {
+		sqlite3_stmt *stmt = statement(shard, remove[iter]);
+
+		if (unlikely(!stmt ||
+			sqlite3_bind_blob(stmt, 1, ident, 32, SQLITE_STATIC) != SQLITE_OK ||
+			sqlite3_step(stmt) != SQLITE_DONE)) {
+			fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(shard->db));
+			execute(shard, STMT_ROLLBACK);
 			return EXIT_FAILURE;
 		}
+	}
 
-		close(fd);
+	return execute(shard, STMT_COMMIT) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * \brief Commit open transactions of all shards.
+ *
+ * \param count Number of shards.
+ * \param begin Begin new transactions.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool reshard_commit(unsigned int count, bool begin) {
+	for (unsigned int iter = 0; iter < count; ++iter) {
+		if (unlikely(!execute(&shards[iter], STMT_COMMIT) || begin && !execute(&shards[iter], STMT_BEGIN)))
+			return false;
+	}
 
-		const char *query = "INSERT OR REPLACE INTO corpus (ident, object) VALUES(?, ?)";
+	return true;
+}
 
-		sqlite3_stmt *stmt;
-		if (unlikely(sqlite3_prepare_v2(db, query, -1, &stmt, (const char **) 0) != SQLITE_OK)) {
-			fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
-			munmap(object, st.st_size);
-			return EXIT_FAILURE;
+/**
+ * \brief Copy rows into the new layout.
+ *
+ * The first column of every row is the object identifier, which
+ * selects the target shard.  The remaining columns are copied as is.
+ *
+ * \param source Source shard connection.
+ * \param scan Statement selecting the rows.
+ * \param insert Statement inserting a row.
+ * \param count Number of new shards.
+ * \param copied Pointer to number of rows copied in the current transaction.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool reshard_copy(struct shard *restrict source, enum statement scan, enum statement insert, unsigned int count, unsigned int *restrict copied) {
+	sqlite3_stmt *rows = statement(source, scan);
+	if (unlikely(!rows))
+		return false;
+
+	int columns = sqlite3_column_count(rows);
+
+	int rc;
+	while ((rc = sqlite3_step(rows)) == SQLITE_ROW) {
+		if (unlikely(sqlite3_column_bytes(rows, 0) != 32))
+			continue;
+
+		const uint8_t *ident = sqlite3_column_blob(rows, 0);
+		struct shard *target = &shards[shard_select(ident, count)];
+
+		sqlite3_stmt *stmt = statement(target, insert);
+		if (unlikely(!stmt))
+			return false;
+
+		rc = sqlite3_bind_blob(stmt, 1, ident, 32, SQLITE_TRANSIENT);
+
+		for (int column = 1; rc == SQLITE_OK && column < columns; ++column)
+			rc = sqlite3_bind_value(stmt, column + 1, sqlite3_column_value(rows, column));
+
+		if (unlikely(rc != SQLITE_OK || sqlite3_step(stmt) != SQLITE_DONE)) {
+			fprintf(stderr, "Failed to copy object: %s\n", sqlite3_errmsg(target->db));
+			return false;
 		}
 
-		if (unlikely(sqlite3_bind_blob(stmt, 1, ident, sizeof ident, SQLITE_STATIC) != SQLITE_OK)) {
-			fprintf(stderr, "Failed to bind value: %s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
-			munmap(object, st.st_size);
-			return EXIT_FAILURE;
+		if (++*copied == RESHARD_BATCH) {
+			if (unlikely(!reshard_commit(count, true)))
+				return false;
+
+			*copied = 0;
 		}
+	}
+
+	if (unlikely(rc != SQLITE_DONE)) {
+		fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(source->db));
+		return false;
+	}
+
+	sqlite3_reset(rows);
 
-		if (unlikely(sqlite3_bind_blob(stmt, 2, object, st.st_size, SQLITE_STATIC) != SQLITE_OK)) {
-			fprintf(stderr, "Failed to bind value: %s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
-			munmap(object, st.st_size);
+	return true;
+}
+
+/**
+ * \brief Redistribute objects over the number of shards given in \c SQLITE_SHARDS.
+ *
+ * The layout is locked exclusively while objects are copied, so other
+ * operations wait until the new layout is in place.
+ */
+static int op_reshard(void) {
+	unsigned long int count = setting("SQLITE_SHARDS", 0);
+
+	if (unlikely(!count || count > SHARD_MAXIMUM)) {
+		fprintf(stderr, "SQLITE_SHARDS must be between 1 and %u!\n", SHARD_MAXIMUM);
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(!layout_lock(F_WRLCK))) {
+		perror("Unable to lock shard layout");
+		return EXIT_FAILURE;
+	}
+
+	unsigned int prior;
+	if (unlikely(!layout_read(&prior)))
+		return EXIT_FAILURE;
+
+	if (prior == count)
+		return EXIT_SUCCESS;
+
+	char name[SHARD_NAMELEN];
+
+	/* Discard leftovers of an interrupted attempt and create new shards */
+	for (unsigned int iter = 0; iter < count; ++iter) {
+		shard_name(name, count, iter);
+		database_remove(name);
+
+		if (unlikely(shard_open(&shards[iter], name, true) != EXIT_SUCCESS ||
+			!execute(&shards[iter], STMT_BEGIN)))
 			return EXIT_FAILURE;
-		}
+	}
 
-		if (unlikely(sqlite3_step(stmt) != SQLITE_DONE)) {
-			fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
-			munmap(object, st.st_size);
+	unsigned int copied = 0;
+
+	for (unsigned int iter = 0; iter < (prior ? prior : 1); ++iter) {
+		shard_name(name, prior, iter);
+
+		int rc = shard_open(&former[iter], name, false);
+		if (rc == 3)
+			continue;
+
+		if (unlikely(rc != EXIT_SUCCESS ||
+			!reshard_copy(&former[iter], STMT_SCAN, STMT_INSERT, count, &copied) ||
+			!reshard_copy(&former[iter], STMT_SCAN_CHUNKS, STMT_COPY_CHUNK, count, &copied)))
 			return EXIT_FAILURE;
-		}
+	}
 
-		sqlite3_finalize(stmt);
-		munmap(object, st.st_size);
+	if (unlikely(!reshard_commit(count, false)))
+		return EXIT_FAILURE;
+
+	if (unlikely(!layout_write(count))) {
+		perror("Unable to record shard layout");
+		return EXIT_FAILURE;
+	}
+
+	/* Remove previous layout */
+	for (unsigned int iter = 0; iter < (prior ? prior : 1); ++iter) {
+		shard_close(&former[iter]);
+		shard_name(name, prior, iter);
+		database_remove(name);
 	}
 
-	else if (!strcmp(argv[5], "efface")) {
-		const char *query = "DELETE FROM corpus WHERE ident=?";
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief List identifiers of all objects.
+ */
+static int op_list(void) {
+	unsigned int count;
+	if (unlikely(!layout_read(&count)))
+		return EXIT_FAILURE;
+
+	char name[SHARD_NAMELEN], ident[32 * 2 + 1];
+
+	for (unsigned int iter = 0; iter < (count ? count : 1); ++iter) {
+		shard_name(name, count, iter);
 
-		sqlite3_stmt *stmt;
-		if (unlikely(sqlite3_prepare_v2(db, query, -1, &stmt, (const char **) 0) != SQLITE_OK)) {
-			fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+		int rc = shard_open(&shards[iter], name, false);
+		if (rc == 3)
+			continue;
+
+		sqlite3_stmt *rows;
+		if (unlikely(rc != EXIT_SUCCESS || !(rows = statement(&shards[iter], STMT_LIST))))
 			return EXIT_FAILURE;
-		}
 
-		if (unlikely(sqlite3_bind_blob(stmt, 1, ident, sizeof ident, SQLITE_STATIC) != SQLITE_OK)) {
-			fprintf(stderr, "Failed to bind value: %s\n", sqlite3_errmsg(db));
+		while ((rc = sqlite3_step(rows)) == SQLITE_ROW)
+			if (likely(sqlite3_column_bytes(rows, 0) == 32)) {
+				inthexs(ident, sqlite3_column_blob(rows, 0), 32);
+				puts(ident);
+			}
+
+		if (unlikely(rc != SQLITE_DONE)) {
+			fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(shards[iter].db));
 			return EXIT_FAILURE;
 		}
+	}
+
+	if (unlikely(fflush(stdout) || ferror(stdout))) {
+		perror("Unable to write identifiers");
+		return EXIT_FAILURE;
+	}
 
-		if (unlikely(sqlite3_step(stmt) != SQLITE_DONE)) {
-			fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector.
+ *
+ * \return EXIT_SUCCESS if successful or any other value on failure.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc != 6 && argc != 8)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	/* Change to storage directory */
+	if (unlikely(chdir(argv[1]))) {
+		perror("Unable to change to storage directory");
+		return EXIT_FAILURE;
+	}
+
+	/* Close databases upon exit */
+	atexit(atexit_sqlite);
+
+	/* Maintenance operations do not refer to an object */
+	if (!strcmp(argv[5], "reshard"))
+		return op_reshard();
+
+	/* Keep the shard layout from changing underneath */
+	if (unlikely(!layout_lock(F_RDLCK))) {
+		perror("Unable to lock shard layout");
+		return EXIT_FAILURE;
+	}
+
+	/* Listing does not refer to an object */
+	if (!strcmp(argv[5], "list"))
+		return op_list();
+
+	uint8_t ident[32];
+	if (!hexsint(ident, argv[4], sizeof ident)) {
+		perror("Failed to parse identifier");
+		return EXIT_FAILURE;
+	}
+
+	/* Parse operation string */
+	if (!strcmp(argv[5], "assay"))
+		return op_assay(ident);
+
+	else if (!strcmp(argv[5], "retrieve"))
+		return op_retrieve(ident, 0, UINT64_MAX);
+
+	else if (!strcmp(argv[5], "range")) {
+		uint64_t offset, length;
+
+		if (unlikely(argc != 8 || !decsint(&offset, argv[6]) || !decsint(&length, argv[7]))) {
+			fputs("Invalid byte range!\n", stderr);
 			return EXIT_FAILURE;
 		}
+
+		return op_retrieve(ident, offset, length);
 	}
 
+	else if (!strcmp(argv[5], "inspect"))
+		return op_inspect(ident, argv[1]);
+
+	else if (!strcmp(argv[5], "deposit"))
+		return op_deposit(ident);
+
+	else if (!strcmp(argv[5], "efface"))
+		return op_efface(ident);
+
 	else {
 		fprintf(stderr, "Invalid storage operation “%s”!\n", argv[5]);
 		return 2;
 	}
-
-	return EXIT_SUCCESS;
 }
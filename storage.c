@@ -1,33 +1,127 @@
+#include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <spawn.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
 #include "egress.h"
 #include "expect.h"
 #include "path.h"
+#include "serve.h"
 #include "storage.h"
 #include "string.h"
 
 #define RETRIEVE EXEC_BASE "retrieve"
 #define DEPOSIT  EXEC_BASE "deposit"
 #define EFFACE   EXEC_BASE "efface"
+#define REPLICATE EXEC_BASE "replicate"
+#define INSPECT  EXEC_BASE "inspect"
+#define WARM     EXEC_BASE "warm"
+#define FLIGHT   EXEC_BASE "flight"
+#define LIST     EXEC_BASE "list"
+#define MIGRATE  EXEC_BASE "migrate"
+#define SCRUB    EXEC_BASE "scrub"
+
+/**
+ * \brief Maximum number of modules in a replicated deposit.
+ */
+#define REPLICAS_MAXIMUM 16
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
 
 extern char **environ;
 
-bool retrieve(pid_t *restrict pid, const char *restrict module, const uint8_t ident[restrict 32], int log, int out) {
+/**
+ * \brief Spawn program writing to output.
+ *
+ * \param pid Pointer to process ID variable.
+ * \param path Program to spawn.
+ * \param argv Argument vector.
+ * \param envp Environment.
+ * \param log Log file descriptor.
+ * \param out Output file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool fetch(pid_t *restrict pid, const char *restrict path, const char *argv[], char *const envp[], int log, int out) {
 	prime(bool);
 
-	char idstr[32 * 2 + 1];
+	/* Check permissions */
+	if (unlikely(access(path, X_OK)))
+		egress(0, false, errno);
 
-	/* Convert identifier to hexadecimal ASCII string */
-	inthexs(idstr, ident, 32);
+	posix_spawn_file_actions_t file_actions;
+	posix_spawnattr_t attr;
+	sigset_t sigdef;
+
+	/* Set file descriptors up */
+	if (unlikely(posix_spawn_file_actions_init(&file_actions)))
+		egress(0, false, errno);
+
+	if (unlikely(posix_spawnattr_init(&attr)))
+		egress(1, false, errno);
+
+	/* Standard input will not be used */
+	if (unlikely(posix_spawn_file_actions_addopen(&file_actions, 0, "/dev/null", O_RDONLY, 0)))
+		egress(2, false, errno);
+
+	/* Write output to standard output */
+	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, out, 1)))
+		egress(2, false, errno);
+
+	/* Use standard error for logging */
+	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, log, 2)))
+		egress(2, false, errno);
+
+	sigemptyset(&sigdef);
+	sigaddset(&sigdef, SIGPIPE);
+
+	/* Pipelines rely on SIGPIPE, which the caller may ignore */
+	if (unlikely(posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF) || posix_spawnattr_setsigdefault(&attr, &sigdef)))
+		egress(2, false, errno);
+
+	if (unlikely(posix_spawn(pid, path, &file_actions, &attr, (char **) argv, envp)))
+		egress(2, false, errno);
+
+	egress(2, true, errno);
+
+egress2:
+	posix_spawnattr_destroy(&attr);
+
+egress1:
+	posix_spawn_file_actions_destroy(&file_actions);
+
+egress0:
+	final();
+}
+
+/**
+ * \brief Spawn program that only logs.
+ *
+ * \param pid Pointer to process ID variable.
+ * \param path Program to spawn.
+ * \param argv Argument vector.
+ * \param log Log file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool launch(pid_t *restrict pid, const char *restrict path, const char *argv[], int log) {
+	prime(bool);
 
 	/* Check permissions */
-	if (unlikely(access(RETRIEVE, X_OK)))
+	if (unlikely(access(path, X_OK)))
 		egress(0, false, errno);
 
 	posix_spawn_file_actions_t file_actions;
@@ -40,18 +134,15 @@ bool retrieve(pid_t *restrict pid, const char *restrict module, const uint8_t id
 	if (unlikely(posix_spawn_file_actions_addopen(&file_actions, 0, "/dev/null", O_RDONLY, 0)))
 		egress(1, false, errno);
 
-	/* Write object to standard output */
-	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, out, 1)))
+	/* Standard output will not be used */
+	if (unlikely(posix_spawn_file_actions_addopen(&file_actions, 1, "/dev/null", O_WRONLY, 0)))
 		egress(1, false, errno);
 
 	/* Use standard error for logging */
 	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, log, 2)))
 		egress(1, false, errno);
 
-	/* Set argument vector up */
-	const char *argv[] = { "retrieve", module, idstr, (char *) 0 };
-
-	if (unlikely(posix_spawn(pid, RETRIEVE, &file_actions, (posix_spawnattr_t *) 0, (char **) argv, environ)))
+	if (unlikely(posix_spawn(pid, path, &file_actions, (posix_spawnattr_t *) 0, (char **) argv, environ)))
 		egress(1, false, errno);
 
 	egress(1, true, errno);
@@ -63,6 +154,69 @@ egress0:
 	final();
 }
 
+bool retrieve(pid_t *restrict pid, const char *restrict module, const uint8_t ident[restrict 32], int log, int out) {
+	char idstr[32 * 2 + 1];
+
+	/* Convert identifier to hexadecimal ASCII string */
+	inthexs(idstr, ident, 32);
+
+	/* Set argument vector up, sharing the retrieval with concurrent ones */
+	const char *argv[] = { "flight", "retrieve", module, idstr, RETRIEVE, module, idstr, (char *) 0 };
+
+	if (access(FLIGHT, X_OK))
+		return fetch(pid, RETRIEVE, &argv[4], environ, log, out);
+
+	return fetch(pid, FLIGHT, argv, environ, log, out);
+}
+
+bool retrieve_uncached(pid_t *restrict pid, const char *restrict module, const uint8_t ident[restrict 32], int log, int out) {
+	static char nocache[] = "NO_CACHE=1";
+	char idstr[32 * 2 + 1];
+	size_t count = 0;
+
+	/* Convert identifier to hexadecimal ASCII string */
+	inthexs(idstr, ident, 32);
+
+	/* Set argument vector up */
+	const char *argv[] = { "retrieve", module, idstr, (char *) 0 };
+
+	while (environ[count])
+		count++;
+
+	/* Set environment up, telling retrieve to bypass the object cache */
+	char **envp = malloc((count + 2) * sizeof *envp);
+	if (unlikely(!envp))
+		return false;
+
+	size_t num = 0;
+	for (size_t idx = 0; idx < count; idx++)
+		if (strncmp(environ[idx], nocache, sizeof "NO_CACHE=" - 1))
+			envp[num++] = environ[idx];
+
+	envp[num++] = nocache;
+	envp[num] = (char *) 0;
+
+	bool result = fetch(pid, RETRIEVE, argv, envp, log, out);
+
+	free(envp);
+	return result;
+}
+
+bool retrieve_range(pid_t *restrict pid, const char *restrict module, const uint8_t ident[restrict 32], uint64_t offset, uint64_t length, int log, int out) {
+	char idstr[32 * 2 + 1], offstr[sizeof "18446744073709551615"], lenstr[sizeof "18446744073709551615"];
+
+	/* Convert identifier to hexadecimal ASCII string */
+	inthexs(idstr, ident, 32);
+
+	snprintf(offstr, sizeof offstr, "%" PRIu64, offset);
+	snprintf(lenstr, sizeof lenstr, "%" PRIu64, length);
+
+	/* Set argument vector up */
+	const char *argv[] = { "retrieve", module, idstr, offstr, lenstr, (char *) 0 };
+
+	return fetch(pid, RETRIEVE, argv, environ, log, out);
+}
+
 bool deposit(pid_t *restrict pid, const char *restrict module, const uint8_t ident[restrict 32], int log, int in) {
 	prime(bool);
 
@@ -93,10 +247,71 @@ bool deposit(pid_t *restrict pid, const char *restrict module, const uint8_t ide
 	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, log, 2)))
 		egress(1, false, errno);
 
+	/* Set argument vector up, collapsing concurrent deposits of the object */
+	const char *argv[] = { "flight", "deposit", module, idstr, DEPOSIT, module, idstr, (char *) 0 };
+	bool shared = !access(FLIGHT, X_OK);
+
+	if (unlikely(posix_spawnp(pid, shared ? FLIGHT : DEPOSIT, &file_actions, (posix_spawnattr_t *) 0, (char **) (shared ? argv : &argv[4]), environ)))
+		egress(1, false, errno);
+
+	egress(1, true, errno);
+
+egress1:
+	posix_spawn_file_actions_destroy(&file_actions);
+
+egress0:
+	final();
+}
+
+bool deposit_replicated(pid_t *restrict pid, const char *const modules[], unsigned int quorum, const uint8_t ident[restrict 32], int log, int in) {
+	prime(bool);
+
+	char idstr[32 * 2 + 1];
+	char quorumstr[sizeof "4294967295"];
+
+	/* Convert identifier to hexadecimal ASCII string */
+	inthexs(idstr, ident, 32);
+	snprintf(quorumstr, sizeof quorumstr, "%u", quorum);
+
 	/* Set argument vector up */
-	const char *argv[] = { "deposit", module, idstr, (char *) 0 };
+	const char *argv[3 + REPLICAS_MAXIMUM + 1] = { "replicate", quorumstr, idstr };
+	size_t argc = 3;
+
+	while (*modules) {
+		if (unlikely(argc == 3 + REPLICAS_MAXIMUM))
+			egress(0, false, E2BIG);
+
+		argv[argc++] = *modules++;
+	}
+
+	if (unlikely(argc == 3 || quorum > argc - 3))
+		egress(0, false, EINVAL);
+
+	argv[argc] = (char *) 0;
+
+	/* Check permissions */
+	if (unlikely(access(REPLICATE, X_OK)))
+		egress(0, false, errno);
+
+	posix_spawn_file_actions_t file_actions;
+
+	/* Set file descriptors up */
+	if (unlikely(posix_spawn_file_actions_init(&file_actions)))
+		egress(0, false, errno);
 
-	if (unlikely(posix_spawnp(pid, DEPOSIT, &file_actions, (posix_spawnattr_t *) 0, (char **) argv, environ)))
+	/* Read object from standard input */
+	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, in, 0)))
+		egress(1, false, errno);
+
+	/* Standard output will not be used */
+	if (unlikely(posix_spawn_file_actions_addopen(&file_actions, 1, "/dev/null", O_RDONLY, 0)))
+		egress(1, false, errno);
+
+	/* Use standard error for logging */
+	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, log, 2)))
+		egress(1, false, errno);
+
+	if (unlikely(posix_spawn(pid, REPLICATE, &file_actions, (posix_spawnattr_t *) 0, (char **) argv, environ)))
 		egress(1, false, errno);
 
 	egress(1, true, errno);
@@ -152,3 +367,391 @@ egress1:
 egress0:
 	final();
 }
+
+bool storage_list(pid_t *restrict pid, const char *restrict module, int log, int out) {
+	/* Set argument vector up */
+	const char *argv[] = { "list", module, (char *) 0 };
+
+	return fetch(pid, LIST, argv, environ, log, out);
+}
+
+bool storage_migrate(pid_t *restrict pid, const char *restrict source, const char *restrict dest, const char *restrict checkpoint, int log) {
+	/* Set argument vector up */
+	const char *argv[] = { "migrate", source, dest, checkpoint, (char *) 0 };
+
+	return launch(pid, MIGRATE, argv, log);
+}
+
+bool storage_scrub(pid_t *restrict pid, const char *restrict module, const char *restrict checkpoint, int log) {
+	/* Set argument vector up */
+	const char *argv[] = { "scrub", module, checkpoint, (char *) 0 };
+
+	return launch(pid, SCRUB, argv, log);
+}
+
+bool storage_prefetch(pid_t *restrict pid, const char *restrict module, const uint8_t idents[][32], size_t count, int log) {
+	prime(bool);
+
+	/* Check permissions */
+	if (unlikely(access(WARM, X_OK)))
+		egress(0, false, errno);
+
+	/* Pass identifiers through an unlinked file, which cannot fill up */
+	char name[] = TEMP_BASE "prefetch-XXXXXX";
+	char fallback[] = "/tmp/prefetch-XXXXXX";
+
+	int fd = mkstemp(name);
+	if (fd >= 0)
+		unlink(name);
+	else if ((fd = mkstemp(fallback)) >= 0)
+		unlink(fallback);
+	else
+		egress(0, false, errno);
+
+	FILE *list = fdopen(fd, "w+");
+	if (unlikely(!list)) {
+		close(fd);
+		egress(0, false, errno);
+	}
+
+	for (size_t iter = 0; iter < count; ++iter) {
+		char idstr[32 * 2 + 1];
+
+		/* Convert identifier to hexadecimal ASCII string */
+		inthexs(idstr, idents[iter], 32);
+
+		if (unlikely(fprintf(list, "%s\n", idstr) < 0))
+			egress(1, false, errno);
+	}
+
+	if (unlikely(fflush(list) || lseek(fd, 0, SEEK_SET)))
+		egress(1, false, errno);
+
+	posix_spawn_file_actions_t file_actions;
+
+	/* Set file descriptors up */
+	if (unlikely(posix_spawn_file_actions_init(&file_actions)))
+		egress(1, false, errno);
+
+	/* Read identifiers from standard input */
+	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, fd, 0)))
+		egress(2, false, errno);
+
+	/* Standard output will not be used */
+	if (unlikely(posix_spawn_file_actions_addopen(&file_actions, 1, "/dev/null", O_WRONLY, 0)))
+		egress(2, false, errno);
+
+	/* Use standard error for logging */
+	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, log, 2)))
+		egress(2, false, errno);
+
+	/* Set argument vector up */
+	const char *argv[] = { "warm", module, (char *) 0 };
+
+	if (unlikely(posix_spawn(pid, WARM, &file_actions, (posix_spawnattr_t *) 0, (char **) argv, environ)))
+		egress(2, false, errno);
+
+	egress(2, true, errno);
+
+egress2:
+	posix_spawn_file_actions_destroy(&file_actions);
+
+egress1:
+	fclose(list);
+
+egress0:
+	final();
+}
+
+bool storage_prefetch_cancel(pid_t pid) {
+	return !kill(pid, SIGTERM);
+}
+
+/**
+ * \brief Parse description field.
+ *
+ * \param dest Pointer to value variable, set to \c UINT64_MAX for “-”.
+ * \param src Pointer to the field, advanced past its separator.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool field(uint64_t *restrict dest, char **restrict src) {
+	char *sep = strchr(*src, ' ');
+	if (unlikely(!sep))
+		return false;
+
+	*sep = 0;
+
+	if (!strcmp(*src, "-"))
+		*dest = UINT64_MAX;
+	else if (unlikely(!decsint(dest, *src)))
+		return false;
+
+	*src = sep + 1;
+	return true;
+}
+
+bool inspect(const char *restrict module, const uint8_t ident[restrict 32], int log, struct inspection *restrict info) {
+	prime(bool);
+
+	char idstr[32 * 2 + 1];
+	char line[3 * sizeof "18446744073709551615" + LOCATION_MAX];
+
+	/* Convert identifier to hexadecimal ASCII string */
+	inthexs(idstr, ident, 32);
+
+	/* Check permissions */
+	if (unlikely(access(INSPECT, X_OK)))
+		egress(0, false, errno);
+
+	int pipefd[2];
+	if (unlikely(pipe(pipefd)))
+		egress(0, false, errno);
+
+	/* Keep the pipe out of processes other threads spawn meanwhile */
+	fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(pipefd[1], F_SETFD, FD_CLOEXEC);
+
+	posix_spawn_file_actions_t file_actions;
+
+	/* Set file descriptors up */
+	if (unlikely(posix_spawn_file_actions_init(&file_actions)))
+		egress(1, false, errno);
+
+	/* Standard input will not be used */
+	if (unlikely(posix_spawn_file_actions_addopen(&file_actions, 0, "/dev/null", O_RDONLY, 0)))
+		egress(2, false, errno);
+
+	/* Write description to standard output */
+	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, pipefd[1], 1)))
+		egress(2, false, errno);
+
+	/* Use standard error for logging */
+	if (unlikely(posix_spawn_file_actions_adddup2(&file_actions, log, 2)))
+		egress(2, false, errno);
+
+	if (unlikely(posix_spawn_file_actions_addclose(&file_actions, pipefd[0])))
+		egress(2, false, errno);
+
+	/* Set argument vector up */
+	const char *argv[] = { "inspect", module, idstr, (char *) 0 };
+
+	pid_t pid;
+	if (unlikely(posix_spawn(&pid, INSPECT, &file_actions, (posix_spawnattr_t *) 0, (char **) argv, environ)))
+		egress(2, false, errno);
+
+	close(pipefd[1]);
+	pipefd[1] = -1;
+
+	/* Read description, draining excess output so the module can exit */
+	size_t len = 0;
+	for (;;) {
+		char spill[256];
+		bool full = len == sizeof line - 1;
+
+		ssize_t fill = read(pipefd[0], full ? spill : line + len, full ? sizeof spill : sizeof line - 1 - len);
+		if (fill < 0 && errno == EINTR)
+			continue;
+
+		if (fill <= 0)
+			break;
+
+		if (!full)
+			len += fill;
+	}
+
+	line[len] = 0;
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR)
+			egress(2, false, errno);
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 3)
+		egress(2, false, ENOENT);
+
+	if (unlikely(!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS))
+		egress(2, false, EIO);
+
+	/* Parse “size stored time location” */
+	char *ptr = line, *end = strchr(line, '\n');
+	if (unlikely(!end || !field(&info->size, &ptr) || !field(&info->stored, &ptr) || !field(&info->time, &ptr) ||
+		(size_t) (end - ptr) >= sizeof info->location))
+		egress(2, false, EPROTO);
+
+	memcpy(info->location, ptr, end - ptr);
+	info->location[end - ptr] = 0;
+
+	egress(2, true, errno);
+
+egress2:
+	posix_spawn_file_actions_destroy(&file_actions);
+
+egress1:
+	close(pipefd[0]);
+
+	if (pipefd[1] >= 0)
+		close(pipefd[1]);
+
+egress0:
+	final();
+}
+
+/**
+ * \brief Send request to object server.
+ *
+ * \param module Storage module name.
+ * \param ident Object identifier.
+ * \param op Request operation.
+ *
+ * \return Connected socket or -1 on failure, with \c errno set to
+ * \c ECONNREFUSED if no server is listening.
+ */
+static int serve_ask(const char *restrict module, const uint8_t ident[restrict 32], uint32_t op) {
+	prime(int);
+
+	const char *path = getenv("SERVE_PATH");
+	struct serve_request req;
+	struct sockaddr_un addr;
+
+	if (!path || !*path)
+		path = SERVE_PATH;
+
+	if (unlikely(strlen(module) >= sizeof req.module || strlen(path) >= sizeof addr.sun_path))
+		egress(0, -1, ENAMETOOLONG);
+
+	memset(&req, 0, sizeof req);
+	memcpy(req.ident, ident, 32);
+	strcpy(req.module, module);
+	req.op = op;
+
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (unlikely(sock < 0))
+		egress(0, -1, errno);
+
+	/* A missing socket must not pass for a missing object */
+	if (connect(sock, (struct sockaddr *) &addr, sizeof addr))
+		egress(1, -1, errno == ENOENT ? ECONNREFUSED : errno);
+
+	/* Send request */
+	for (size_t done = 0; done < sizeof req;) {
+		ssize_t sent = send(sock, (const char *) &req + done, sizeof req - done, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+
+		if (unlikely(sent <= 0))
+			egress(1, -1, sent < 0 ? errno : EPIPE);
+
+		done += sent;
+	}
+
+	egress(0, sock, errno);
+
+egress1:
+	close(sock);
+
+egress0:
+	final();
+}
+
+bool storage_open(const char *restrict module, const uint8_t ident[restrict 32], int *restrict fd, uint64_t *restrict offset, uint64_t *restrict size) {
+	prime(bool);
+
+	struct serve_reply reply;
+
+	int sock = serve_ask(module, ident, SERVE_OPEN);
+	if (sock < 0)
+		egress(0, false, errno);
+
+	union {
+		struct cmsghdr hdr;
+		char           buf[CMSG_SPACE(sizeof (int))];
+	} control;
+
+	struct iovec iov = { &reply, sizeof reply };
+	struct msghdr msg;
+	int passed = -1;
+
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof control.buf;
+
+	/* Receive reply, with the descriptor arriving alongside its first byte */
+	ssize_t fill;
+	while ((fill = recvmsg(sock, &msg, 0)) < 0)
+		if (errno != EINTR)
+			egress(1, false, errno);
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len >= CMSG_LEN(sizeof (int)))
+			memcpy(&passed, CMSG_DATA(cmsg), sizeof (int));
+
+	for (size_t done = fill; fill > 0 && done < sizeof reply; done += fill)
+		while ((fill = recv(sock, (char *) &reply + done, sizeof reply - done, 0)) < 0 && errno == EINTR);
+
+	if (unlikely(fill <= 0 || msg.msg_flags & MSG_CTRUNC))
+		egress(2, false, fill < 0 ? errno : EPROTO);
+
+	if (reply.error)
+		egress(2, false, reply.error);
+
+	if (unlikely(passed < 0))
+		egress(2, false, EPROTO);
+
+	fcntl(passed, F_SETFD, FD_CLOEXEC);
+
+	*fd = passed;
+	*offset = reply.offset;
+	*size = reply.size;
+
+	egress(1, true, errno);
+
+egress2:
+	if (passed >= 0)
+		close(passed);
+
+egress1:
+	close(sock);
+
+egress0:
+	final();
+}
+
+bool storage_forget(const char *restrict module, const uint8_t ident[restrict 32]) {
+	prime(bool);
+
+	struct serve_reply reply;
+
+	/* Without a server, nothing is kept open */
+	int sock = serve_ask(module, ident, SERVE_FORGET);
+	if (sock < 0)
+		egress(0, errno == ECONNREFUSED, errno);
+
+	for (size_t done = 0; done < sizeof reply;) {
+		ssize_t fill = recv(sock, (char *) &reply + done, sizeof reply - done, 0);
+		if (fill < 0 && errno == EINTR)
+			continue;
+
+		if (unlikely(fill <= 0))
+			egress(1, false, fill < 0 ? errno : EPROTO);
+
+		done += fill;
+	}
+
+	if (reply.error)
+		egress(1, false, reply.error);
+
+	egress(1, true, errno);
+
+egress1:
+	close(sock);
+
+egress0:
+	final();
+}
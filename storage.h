@@ -9,6 +9,7 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -24,6 +25,41 @@
  */
 extern bool retrieve(pid_t *restrict pid, const char *restrict module, const uint8_t ident[restrict 32], int log, int out);
 
+/**
+ * \brief Retrieve object bypassing the object cache.
+ *
+ * The object is neither served from nor left in the object cache, and
+ * the retrieval is not shared with concurrent ones, so that reading
+ * through the whole store leaves the cached working set alone.
+ *
+ * \param pid Pointer to process ID variable.
+ * \param module Storage module name.
+ * \param ident Object identifier.
+ * \param log Log file descriptor.
+ * \param out Output file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool retrieve_uncached(pid_t *restrict pid, const char *restrict module, const uint8_t ident[restrict 32], int log, int out);
+
+/**
+ * \brief Retrieve byte range of object.
+ *
+ * The range is clipped to the size of the object, so \c UINT64_MAX may
+ * be passed as \a length to retrieve everything from \a offset on.
+ *
+ * \param pid Pointer to process ID variable.
+ * \param module Storage module name.
+ * \param ident Object identifier.
+ * \param offset Offset of first byte.
+ * \param length Number of bytes.
+ * \param log Log file descriptor.
+ * \param out Output file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool retrieve_range(pid_t *restrict pid, const char *restrict module, const uint8_t ident[restrict 32], uint64_t offset, uint64_t length, int log, int out);
+
 /**
  * \brief Deposit object.
  *
@@ -37,6 +73,24 @@ extern bool retrieve(pid_t *restrict pid, const char *restrict module, const uin
  */
 extern bool deposit(pid_t *restrict pid, const char *restrict module, const uint8_t ident[restrict 32], int log, int in);
 
+/**
+ * \brief Deposit object into several storage modules at once.
+ *
+ * The process exits successfully as soon as \a quorum of the modules
+ * have stored the object; the remaining deposits complete in the
+ * background.  A \a quorum of zero requests a majority.
+ *
+ * \param pid Pointer to process ID variable.
+ * \param modules Null‐terminated list of storage module names.
+ * \param quorum Number of modules required to store the object.
+ * \param ident Object identifier.
+ * \param log Log file descriptor.
+ * \param in Input file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool deposit_replicated(pid_t *restrict pid, const char *const modules[], unsigned int quorum, const uint8_t ident[restrict 32], int log, int in);
+
 /**
  * \brief Efface object.
  *
@@ -49,4 +103,168 @@ extern bool deposit(pid_t *restrict pid, const char *restrict module, const uint
  */
 extern bool efface(pid_t *restrict pid, const char *restrict module, const uint8_t ident[restrict 32], int log);
 
+/**
+ * \brief List objects.
+ *
+ * The identifiers of the objects in local and global storage are
+ * written as hexadecimal strings, one per line.  An object may be listed
+ * more than once.
+ *
+ * \param pid Pointer to process ID variable.
+ * \param module Storage module name.
+ * \param log Log file descriptor.
+ * \param out Output file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool storage_list(pid_t *restrict pid, const char *restrict module, int log, int out);
+
+/**
+ * \brief Migrate objects between storage modules.
+ *
+ * Every object listed in \a source is streamed into \a dest, with up to
+ * \c MIGRATE_PARALLEL transfers in flight, and its identifier verified
+ * on the way.  Migrated identifiers are appended to the checkpoint file,
+ * so that a later migration with the same checkpoint skips them.  Missing
+ * and corrupt objects are reported to the log.  The migrating process
+ * exits successfully once every object has been migrated; \c SIGTERM
+ * stops it after the transfers in flight.
+ *
+ * \param pid Pointer to process ID variable.
+ * \param source Source storage module name.
+ * \param dest Destination storage module name.
+ * \param checkpoint Checkpoint file name.
+ * \param log Log file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool storage_migrate(pid_t *restrict pid, const char *restrict source, const char *restrict dest, const char *restrict checkpoint, int log);
+
+/**
+ * \brief Verify stored objects.
+ *
+ * Every object listed in \a module is read back and checked to hash to
+ * its identifier, by up to \c SCRUB_THREADS threads.  Reading may be
+ * limited to \c SCRUB_RATE bytes per second and hashing to
+ * \c SCRUB_DUTY percent of each thread's time, so that scrubbing can run
+ * alongside other work.  Each object is appended to the checkpoint file
+ * with its outcome, “intact”, “missing” or “corrupt”, so that a
+ * scrubbing resumed with the same checkpoint skips it; the checkpoint is
+ * emptied once a pass is complete, so that the next one verifies every
+ * object again.  Missing and corrupt objects
+ * are also reported to the log.  The scrubbing process exits
+ * successfully once every object has been found intact; \c SIGTERM stops
+ * it at once.
+ *
+ * \param pid Pointer to process ID variable.
+ * \param module Storage module name.
+ * \param checkpoint Checkpoint file name.
+ * \param log Log file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool storage_scrub(pid_t *restrict pid, const char *restrict module, const char *restrict checkpoint, int log);
+
+/**
+ * \brief Prefetch objects into the object cache.
+ *
+ * The objects are retrieved in the background in the given order, with
+ * up to \c PREFETCH_PARALLEL retrievals in flight, so that later calls to
+ * retrieve() find them cached.  The prefetching process exits once all
+ * objects have been fetched.
+ *
+ * \param pid Pointer to process ID variable.
+ * \param module Storage module name.
+ * \param idents Object identifiers.
+ * \param count Number of object identifiers.
+ * \param log Log file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool storage_prefetch(pid_t *restrict pid, const char *restrict module, const uint8_t idents[][32], size_t count, int log);
+
+/**
+ * \brief Cancel outstanding prefetches.
+ *
+ * Objects already in the cache stay there.  The prefetching process must
+ * still be waited for.
+ *
+ * \param pid Process ID of the prefetching process.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool storage_prefetch_cancel(pid_t pid);
+
+/**
+ * \brief Maximum length of object locations, including the terminator.
+ */
+#define LOCATION_MAX 4096
+
+/**
+ * \brief Object description.
+ *
+ * Quantities the storage module cannot determine without reading the
+ * object are set to \c UINT64_MAX.
+ */
+struct inspection {
+	uint64_t size;                   /**< Object size. */
+	uint64_t stored;                 /**< Bytes occupied in the storage backend. */
+	uint64_t time;                   /**< Deposit time in nanoseconds since the epoch. */
+	char     location[LOCATION_MAX]; /**< Location in the storage backend. */
+};
+
+/**
+ * \brief Describe object without retrieving it.
+ *
+ * Unlike the other functions, this waits for the storage module to
+ * answer.  The location is informational, such as a file name or a URI,
+ * with \c @ and an offset appended for objects inside containers.
+ *
+ * \param module Storage module name.
+ * \param ident Object identifier.
+ * \param log Log file descriptor.
+ * \param info Buffer to hold the description.
+ *
+ * \return \c true if successful or \c false on failure, with \c errno
+ * set to \c ENOENT if there is no such object.
+ */
+extern bool inspect(const char *restrict module, const uint8_t ident[restrict 32], int log, struct inspection *restrict info);
+
+/**
+ * \brief Open object through the object server.
+ *
+ * The server passes a read‐only file descriptor, which is either the
+ * store file holding the object verbatim or a sealed memory file, so
+ * that the object can be read without copies through pipes and without
+ * spawning anything.  The object occupies \a size bytes from \a offset
+ * on.  If no server is listening or the object is too large to be held
+ * in memory, retrieve() still works.
+ *
+ * \param module Storage module name.
+ * \param ident Object identifier.
+ * \param fd Pointer to file descriptor variable.
+ * \param offset Pointer to variable to hold the offset of the object.
+ * \param size Pointer to variable to hold the object size.
+ *
+ * \return \c true if successful or \c false on failure, with \c errno
+ * set to \c ENOENT if there is no such object, to \c EFBIG if the object
+ * would have to be held in memory but exceeds the server's budget, or to
+ * \c ECONNREFUSED if no server is listening.
+ */
+extern bool storage_open(const char *restrict module, const uint8_t ident[restrict 32], int *restrict fd, uint64_t *restrict offset, uint64_t *restrict size);
+
+/**
+ * \brief Make object server forget object.
+ *
+ * The server stops handing out an object it keeps open, such as after
+ * the object was effaced.  Descriptors already passed stay valid.
+ *
+ * \param module Storage module name.
+ * \param ident Object identifier.
+ *
+ * \return \c true if successful or if no server is listening, or
+ * \c false on failure.
+ */
+extern bool storage_forget(const char *restrict module, const uint8_t ident[restrict 32]);
+
 #endif
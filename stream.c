@@ -0,0 +1,115 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sys/sendfile.h>
+#include <sys/types.h>
+
+#include "egress.h"
+#include "expect.h"
+#include "stream.h"
+
+ssize_t stream_read(int fd, void *restrict buf, size_t size) {
+	size_t fill = 0;
+
+	while (fill < size) {
+		ssize_t in = read(fd, (uint8_t *) buf + fill, size - fill);
+
+		if (unlikely(in < 0)) {
+			if (errno == EINTR)
+				continue;
+
+			return -1;
+		}
+
+		if (!in)
+			break;
+
+		fill += in;
+	}
+
+	return fill;
+}
+
+bool stream_write(int fd, const void *restrict buf, size_t size) {
+	while (size) {
+		ssize_t out = write(fd, buf, size);
+
+		if (unlikely(out < 0)) {
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		buf   = (const uint8_t *) buf + out;
+		size -= out;
+	}
+
+	return true;
+}
+
+bool stream_send(int out, int in, uint64_t offset, uint64_t length) {
+	prime(bool);
+
+	off_t pos = offset;
+
+	while (length) {
+		ssize_t sent = sendfile(out, in, &pos, length > SSIZE_MAX ? SSIZE_MAX : length);
+
+		if (likely(sent > 0)) {
+			length -= sent;
+			continue;
+		}
+
+		if (!sent)
+			egress(0, false, EIO);
+
+		if (errno == EINTR)
+			continue;
+
+		/* Fall back to copying through user space */
+		if (errno == EINVAL || errno == ENOSYS)
+			break;
+
+		egress(0, false, errno);
+	}
+
+	if (likely(!length))
+		egress(0, true, errno);
+
+	uint8_t *buf = malloc(STREAM_BUFSIZE);
+	if (unlikely(!buf))
+		egress(0, false, errno);
+
+	while (length) {
+		ssize_t fill = pread(in, buf, length > STREAM_BUFSIZE ? STREAM_BUFSIZE : length, pos);
+
+		if (unlikely(fill < 0)) {
+			if (errno == EINTR)
+				continue;
+
+			egress(1, false, errno);
+		}
+
+		if (unlikely(!fill))
+			egress(1, false, EIO);
+
+		if (unlikely(!stream_write(out, buf, fill)))
+			egress(1, false, errno);
+
+		pos    += fill;
+		length -= fill;
+	}
+
+	egress(1, true, errno);
+
+egress1:
+	free(buf);
+
+egress0:
+	final();
+}
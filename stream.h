@@ -0,0 +1,57 @@
+#pragma once
+#ifndef OC_STREAM_H
+#define OC_STREAM_H
+
+/**
+ * \file
+ *
+ * \brief Stream transfer.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * \brief Size of transfer buffers.
+ */
+#define STREAM_BUFSIZE (1 << 20)
+
+/**
+ * \brief Read until buffer is full or end of file.
+ *
+ * \param fd Input file descriptor.
+ * \param buf Buffer.
+ * \param size Size of buffer.
+ *
+ * \return Number of bytes read or -1 on failure.
+ */
+extern ssize_t stream_read(int fd, void *restrict buf, size_t size);
+
+/**
+ * \brief Write entire buffer.
+ *
+ * \param fd Output file descriptor.
+ * \param buf Buffer.
+ * \param size Number of bytes to write.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool stream_write(int fd, const void *restrict buf, size_t size);
+
+/**
+ * \brief Send file region.
+ *
+ * \param out Output file descriptor.
+ * \param in Input file descriptor.
+ * \param offset Offset of region.
+ * \param length Length of region.
+ *
+ * The region is transferred within the kernel where possible.  The file
+ * offset of \a in is not changed.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+extern bool stream_send(int out, int in, uint64_t offset, uint64_t length);
+
+#endif /* OC_STREAM_H */
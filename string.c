@@ -143,6 +143,41 @@ egress0:
 	final();
 }
 
+bool decsint(uint64_t *restrict dest, const char *restrict src) {
+	prime(bool);
+
+	uint64_t num = 0;
+
+	if (unlikely(!*src))
+		egress(0, false, EINVAL);
+
+	for (; *src; ++src) {
+		/* Check character range */
+		if (unlikely(*src < '0' || *src > '9'))
+			egress(0, false, EINVAL);
+
+		uint64_t digit = (uint64_t) (*src - '0');
+
+		/* Check for overflow */
+		if (unlikely(num > (UINT64_MAX - digit) / 10))
+			egress(0, false, ERANGE);
+
+		num = num * 10 + digit;
+	}
+
+	*dest = num;
+
+	egress(0, true, errno);
+
+egress0:
+	final();
+}
+
+unsigned long int setting(const char *restrict var, unsigned long int preset) {
+	const char *str = getenv(var);
+	return str && *str ? strtoul(str, (char **) 0, 10) : preset;
+}
+
 char *concat(const char *restrict prefix, ...) {
 	prime(char *);
 
@@ -229,6 +264,19 @@ int main(void) {
 	essaye(hexcint('f') == 0xf);
 	essaye(hexcint('F') == 0xf);
 
+	uint64_t num;
+	essaye(decsint(&num, "0") && num == 0);
+	essaye(decsint(&num, "4096") && num == 4096);
+	essaye(decsint(&num, "18446744073709551615") && num == UINT64_MAX);
+	essaye(!decsint(&num, "18446744073709551616"));
+	essaye(!decsint(&num, ""));
+	essaye(!decsint(&num, "-1"));
+	essaye(!decsint(&num, "12a"));
+
+	essaye(!setenv("OC_TEST_SETTING", "42", 1) && setting("OC_TEST_SETTING", 7) == 42);
+	essaye(!setenv("OC_TEST_SETTING", "", 1) && setting("OC_TEST_SETTING", 7) == 7);
+	essaye(!unsetenv("OC_TEST_SETTING") && setting("OC_TEST_SETTING", 7) == 7);
+
 	char *test;
 	essaye((test = concat("foo", (char *) 0)) && !strcmp(test, "foo"));
 	free(test);
@@ -37,6 +37,27 @@ extern void inthexs(char *restrict buf, const void *restrict src, size_t size);
  */
 extern bool hexsint(void *restrict dest, const char *restrict src, size_t size);
 
+/**
+ * \brief Convert decimal ASCII string to integer.
+ *
+ * \param dest Pointer to integer.
+ * \param src Zero‐terminated ASCII string.
+ *
+ * \return \c true on success or \c false if \a src is invalid or out of
+ * range.
+ */
+extern bool decsint(uint64_t *restrict dest, const char *restrict src);
+
+/**
+ * \brief Parse size from environment.
+ *
+ * \param var Environment variable name.
+ * \param preset Default value, used if the variable is unset or empty.
+ *
+ * \return Size.
+ */
+extern unsigned long int setting(const char *restrict var, unsigned long int preset);
+
 /**
  * \brief Concatenate strings.
  *
@@ -0,0 +1,301 @@
+/* pipe2 is a Linux extension */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "expect.h"
+#include "storage.h"
+#include "stream.h"
+#include "string.h"
+#include "sweep.h"
+
+/**
+ * \brief Size of a line buffer, checkpoint lines included.
+ */
+#define LINE_SIZE (32 * 2 + 16)
+
+/**
+ * \brief Outcome names.
+ */
+static const char *const outcomes[SWEEP_OUTCOMES] = {
+	[SWEEP_DONE]    = "done",
+	[SWEEP_SKIPPED] = "skipped",
+	[SWEEP_MISSING] = "missing",
+	[SWEEP_CORRUPT] = "corrupt",
+	[SWEEP_FAILED]  = "failed"
+};
+
+/**
+ * \brief Sweep state.
+ */
+struct state {
+	const struct sweep *job;                   /**< Sweep description. */
+	FILE               *list;                  /**< Identifiers to visit. */
+	uint8_t           (*done)[32];             /**< Identifiers settled before, sorted. */
+	size_t              prior;                 /**< Number of identifiers settled before. */
+	int                 checkpoint;            /**< Checkpoint file descriptor. */
+	uint64_t            count[SWEEP_OUTCOMES]; /**< Number of objects by outcome. */
+	pthread_mutex_t     lock;                  /**< Lock protecting the list, the checkpoint and the counts. */
+};
+
+volatile sig_atomic_t sweep_stopped;
+
+/**
+ * \brief Note stop.
+ */
+static void stop(int sig) {
+	sweep_stopped = 1;
+}
+
+/**
+ * \brief Name outcome.
+ *
+ * \param job Sweep description.
+ * \param outcome Outcome.
+ *
+ * \return Outcome name.
+ */
+static const char *name(const struct sweep *restrict job, enum sweep_outcome outcome) {
+	return outcome == SWEEP_DONE && job->name ? job->name : outcomes[outcome];
+}
+
+/**
+ * \brief Compare identifiers.
+ *
+ * \param one One identifier.
+ * \param other Other identifier.
+ *
+ * \return Negative, zero or positive number.
+ */
+static int compare(const void *one, const void *other) {
+	return memcmp(one, other, 32);
+}
+
+/**
+ * \brief Load checkpoint.
+ *
+ * \param state Sweep state.
+ * \param path Checkpoint file name.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool resume(struct state *restrict state, const char *restrict path) {
+	state->checkpoint = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (unlikely(state->checkpoint < 0))
+		return false;
+
+	FILE *file = fdopen(dup(state->checkpoint), "r");
+	if (unlikely(!file))
+		return false;
+
+	char line[LINE_SIZE];
+	size_t cap = 0;
+
+	/* A line torn by a crash is ignored */
+	while (fgets(line, sizeof line, file)) {
+		if (state->prior == cap) {
+			void *grown = realloc(state->done, (cap = cap ? cap * 2 : 1024) * sizeof *state->done);
+			if (unlikely(!grown)) {
+				fclose(file);
+				return false;
+			}
+
+			state->done = grown;
+		}
+
+		if (strchr(line, '\n') && (line[32 * 2] == ' ' || line[32 * 2] == '\n') && hexsint(state->done[state->prior], line, 32))
+			++state->prior;
+	}
+
+	fclose(file);
+
+	qsort(state->done, state->prior, sizeof *state->done, compare);
+	return true;
+}
+
+int sweep_reap(pid_t pid) {
+	int status;
+
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR)
+			return EXIT_FAILURE;
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
+
+/**
+ * \brief Visit listed objects.
+ *
+ * \param arg Sweep state.
+ *
+ * \return <tt>(void *) 0</tt>.
+ */
+static void *sweep_thread(void *arg) {
+	struct state *state = arg;
+	const struct sweep *job = state->job;
+	uint8_t *buf = malloc(SWEEP_CHUNK);
+
+	while (buf && !sweep_stopped) {
+		char line[LINE_SIZE];
+		uint8_t ident[32];
+
+		pthread_mutex_lock(&state->lock);
+		bool more = fgets(line, sizeof line, state->list);
+		pthread_mutex_unlock(&state->lock);
+
+		if (!more)
+			break;
+
+		line[strcspn(line, "\n")] = 0;
+
+		if (!*line)
+			continue;
+
+		enum sweep_outcome outcome;
+
+		if (unlikely(strlen(line) != 32 * 2 || !hexsint(ident, line, 32))) {
+			fprintf(stderr, "Failed to parse identifier “%s”!\n", line);
+			outcome = SWEEP_FAILED;
+		}
+
+		else if (bsearch(ident, state->done, state->prior, sizeof *state->done, compare))
+			outcome = SWEEP_SKIPPED;
+
+		else
+			outcome = job->visit(job->arg, ident, buf);
+
+		/* Objects stopped short are tried again next time */
+		if (outcome == SWEEP_FAILED && sweep_stopped)
+			break;
+
+		if (outcome != SWEEP_DONE && outcome != SWEEP_SKIPPED)
+			fprintf(stderr, "Object %s is %s!\n", line, name(job, outcome));
+
+		pthread_mutex_lock(&state->lock);
+		++state->count[outcome];
+
+		/* Appends of whole lines do not interleave */
+		if (outcome != SWEEP_SKIPPED && job->settled & 1u << outcome) {
+			strcat(strcat(strcat(line, " "), name(job, outcome)), "\n");
+
+			if (unlikely(!stream_write(state->checkpoint, line, strlen(line))))
+				perror("Unable to write checkpoint");
+		}
+
+		pthread_mutex_unlock(&state->lock);
+	}
+
+	if (unlikely(!buf)) {
+		pthread_mutex_lock(&state->lock);
+		++state->count[SWEEP_FAILED];
+		pthread_mutex_unlock(&state->lock);
+	}
+
+	free(buf);
+	return (void *) 0;
+}
+
+int sweep(const struct sweep *restrict job, const char *restrict checkpoint) {
+	unsigned long int threads = job->threads;
+
+	if (!threads)
+		threads = 1;
+
+	if (threads > SWEEP_THREADS_MAXIMUM)
+		threads = SWEEP_THREADS_MAXIMUM;
+
+	struct state state = {
+		.job = job
+	};
+
+	if (unlikely(!resume(&state, checkpoint))) {
+		perror("Unable to load checkpoint");
+		return EXIT_FAILURE;
+	}
+
+	struct sigaction action = { .sa_handler = stop };
+	sigemptyset(&action.sa_mask);
+
+	if (unlikely(sigaction(SIGTERM, &action, (struct sigaction *) 0) || sigaction(SIGINT, &action, (struct sigaction *) 0))) {
+		perror("Unable to handle stopping");
+		return EXIT_FAILURE;
+	}
+
+	int pipefd[2];
+	if (unlikely(pipe2(pipefd, O_CLOEXEC))) {
+		perror("Unable to create pipe");
+		return EXIT_FAILURE;
+	}
+
+	pid_t lister;
+	if (unlikely(!storage_list(&lister, job->module, 2, pipefd[1]))) {
+		perror("Unable to list objects");
+		return EXIT_FAILURE;
+	}
+
+	close(pipefd[1]);
+
+	if (unlikely(!(state.list = fdopen(pipefd[0], "r")))) {
+		perror("Unable to read object list");
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_init(&state.lock, (const pthread_mutexattr_t *) 0);
+
+	pthread_t thread[SWEEP_THREADS_MAXIMUM];
+	unsigned long int started = 0;
+
+	while (started < threads && !pthread_create(&thread[started], (const pthread_attr_t *) 0, sweep_thread, &state))
+		++started;
+
+	if (unlikely(!started)) {
+		fputs("Unable to start threads!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	while (started)
+		pthread_join(thread[--started], (void **) 0);
+
+	pthread_mutex_destroy(&state.lock);
+
+	/* A stopped sweep leaves the lister behind */
+	if (sweep_stopped)
+		kill(lister, SIGTERM);
+
+	fclose(state.list);
+
+	int listed = sweep_reap(lister);
+
+	/* A complete pass leaves nothing to resume */
+	if (job->restart && !sweep_stopped && listed == EXIT_SUCCESS && unlikely(ftruncate(state.checkpoint, 0)))
+		perror("Unable to empty checkpoint");
+
+	if (unlikely(fsync(state.checkpoint)))
+		perror("Unable to synchronise checkpoint");
+
+	close(state.checkpoint);
+	free(state.done);
+
+	for (enum sweep_outcome outcome = 0; outcome < SWEEP_OUTCOMES; ++outcome)
+		fprintf(stderr, "%s%s %" PRIu64, outcome ? ", " : "", name(job, outcome), state.count[outcome]);
+
+	fputc('\n', stderr);
+
+	if (sweep_stopped || listed != EXIT_SUCCESS || state.count[SWEEP_MISSING] || state.count[SWEEP_CORRUPT] || state.count[SWEEP_FAILED])
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#ifndef OC_SWEEP_H
+#define OC_SWEEP_H
+
+/**
+ * \file
+ *
+ * \brief Resumable passes over every object of a storage module.
+ *
+ * A sweep lists the objects of a module and hands each of them to a
+ * visitor, on a pool of threads.  Identifiers are appended to a
+ * checkpoint file with their outcome once settled, and objects found in
+ * the checkpoint file are skipped, so that an interrupted sweep resumes
+ * where it stopped.  A sweep may instead start over once a pass is
+ * complete, so that every object is visited again.  \c SIGTERM and \c SIGINT stop the sweep; visitors
+ * observe \c sweep_stopped to cut their object short.
+ */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+
+/**
+ * \brief Maximum number of threads.
+ */
+#define SWEEP_THREADS_MAXIMUM 64
+
+/**
+ * \brief Size of the buffer handed to visitors.
+ */
+#define SWEEP_CHUNK (1 << 20)
+
+/**
+ * \brief Outcomes of visiting an object.
+ */
+enum sweep_outcome {
+	SWEEP_DONE,    /**< Object was dealt with. */
+	SWEEP_SKIPPED, /**< Object was settled before. */
+	SWEEP_MISSING, /**< Object was listed but could not be found. */
+	SWEEP_CORRUPT, /**< Object does not hash to its identifier. */
+	SWEEP_FAILED,  /**< Object could not be dealt with. */
+	SWEEP_OUTCOMES
+};
+
+/**
+ * \brief Sweep description.
+ */
+struct sweep {
+	const char   *module;  /**< Storage module to list. */
+	const char   *name;    /**< Name of the \c SWEEP_DONE outcome. */
+	unsigned int  settled; /**< Outcomes recorded in the checkpoint, as bits. */
+	unsigned long threads; /**< Number of threads. */
+	bool          restart; /**< Empty the checkpoint once a pass is complete. */
+	void         *arg;     /**< Argument passed to the visitor. */
+
+	/**
+	 * \brief Visit object.
+	 *
+	 * \param arg Argument of the sweep.
+	 * \param ident Object identifier.
+	 * \param buf Buffer of \c SWEEP_CHUNK bytes.
+	 *
+	 * \return Outcome, \c SWEEP_FAILED if stopped short.
+	 */
+	enum sweep_outcome (*visit)(void *restrict arg, const uint8_t ident[restrict 32], uint8_t *restrict buf);
+};
+
+/**
+ * \brief Sweep was stopped.
+ */
+extern volatile sig_atomic_t sweep_stopped;
+
+/**
+ * \brief Wait for process.
+ *
+ * \param pid Process ID.
+ *
+ * \return Exit status or \c EXIT_FAILURE if the process did not exit.
+ */
+extern int sweep_reap(pid_t pid);
+
+/**
+ * \brief Sweep module.
+ *
+ * Missing, corrupt and failed objects are reported on standard error as
+ * they are met, and the number of objects by outcome once done.  An
+ * object stopped short is neither counted nor recorded.
+ *
+ * \param job Sweep description.
+ * \param checkpoint Checkpoint file name.
+ *
+ * \return \c EXIT_SUCCESS if every listed object was dealt with or
+ * skipped, or \c EXIT_FAILURE otherwise.
+ */
+extern int sweep(const struct sweep *restrict job, const char *restrict checkpoint);
+
+#endif /* OC_SWEEP_H */
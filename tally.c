@@ -0,0 +1,303 @@
+/* splice is a Linux extension */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "expect.h"
+#include "journal.h"
+#include "meter.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Number of bytes moved per system call.
+ */
+#define CHUNK (1 << 20)
+
+extern char **environ;
+
+/**
+ * \brief I/O buffer for descriptors that cannot be spliced.
+ */
+static uint8_t buf[STREAM_BUFSIZE];
+
+/**
+ * \brief Get monotonic time.
+ *
+ * \return Microseconds since an arbitrary point.
+ */
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * UINT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
+/**
+ * \brief Record event in the journal.
+ *
+ * The object identifier is taken from the first argument of the command
+ * that looks like one.
+ *
+ * \param argv Argument vector: module name, operation and command.
+ * \param op Operation.
+ * \param time Start time in nanoseconds since the epoch.
+ * \param duration Duration in microseconds.
+ * \param status Exit status.
+ * \param bytes Bytes transferred.
+ */
+static void chronicle(char *argv[], enum meter_op op, uint64_t time, uint64_t duration, int status, uint64_t bytes) {
+	const char *dir = getenv("JOURNAL_PATH");
+	struct journal journal;
+
+	if (!dir || !*dir)
+		dir = JOURNAL_PATH;
+
+	/* Events are best effort as well */
+	if (!journal_open(&journal, dir, getpid(), true))
+		return;
+
+	struct journal_record rec;
+	memset(&rec, 0, sizeof rec);
+
+	/* A failed conversion may leave part of an identifier behind */
+	for (char **arg = &argv[3]; *arg; ++arg) {
+		if (strlen(*arg) == 32 * 2 && hexsint(rec.ident, *arg, 32))
+			break;
+
+		memset(rec.ident, 0, sizeof rec.ident);
+	}
+
+	strncpy(rec.module, argv[1], sizeof rec.module - 1);
+	rec.time = time;
+	rec.duration = duration;
+	rec.bytes = bytes;
+	rec.status = status;
+	rec.pid = getpid();
+	rec.op = op;
+
+	journal_append(&journal, &rec);
+	journal_close(&journal);
+}
+
+/**
+ * \brief Relay data between module and caller.
+ *
+ * One side is always a pipe, so data is spliced unless the other side
+ * does not allow it.
+ *
+ * \param out Output file descriptor.
+ * \param in Input file descriptor.
+ * \param total Buffer to hold the number of bytes relayed.
+ *
+ * \return \c true if the end of input was reached or \c false on failure.
+ */
+static bool relay(int out, int in, uint64_t *restrict total) {
+	bool spliced = true;
+
+	for (;;) {
+		ssize_t fill;
+
+		if (spliced) {
+			fill = splice(in, (loff_t *) 0, out, (loff_t *) 0, CHUNK, SPLICE_F_MOVE);
+
+			if (fill < 0 && errno == EINVAL) {
+				spliced = false;
+				continue;
+			}
+		}
+
+		else if ((fill = read(in, buf, sizeof buf)) > 0 && unlikely(!stream_write(out, buf, fill)))
+			fill = -1;
+
+		if (fill < 0 && errno == EINTR)
+			continue;
+
+		if (fill <= 0)
+			return !fill;
+
+		*total += fill;
+	}
+}
+
+/**
+ * \brief Main routine.
+ *
+ * Without arguments, the metrics are written to standard output.
+ * Otherwise, the command is run as a storage operation on behalf of the
+ * module and its latency, exit status and transferred bytes are
+ * recorded.  Standard input is passed through for deposits and standard
+ * output for retrievals and inspections, which are counted on the way.
+ * Deposits from regular files are handed to the module untouched, so that
+ * it can tell their size, and counted from the file size instead.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector: module name, operation and command.
+ *
+ * \return Exit status of the command or EXIT_FAILURE on failure.
+ */
+int main(int argc, char *argv[]) {
+	const char *path = getenv("METER_PATH");
+	struct meter meter;
+
+	if (!path || !*path)
+		path = METER_PATH;
+
+	if (argc == 1) {
+		if (unlikely(!meter_open(&meter, path))) {
+			perror("Unable to open metrics");
+			return EXIT_FAILURE;
+		}
+
+		bool result = meter_dump(&meter, stdout);
+		meter_close(&meter);
+
+		if (unlikely(!result)) {
+			perror("Unable to write metrics");
+			return EXIT_FAILURE;
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	if (unlikely(argc < 4)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	enum meter_op op = meter_op(argv[2]);
+
+	/* Metrics are best effort */
+	struct meter_cell *cell = (struct meter_cell *) 0;
+	bool metered = meter_open(&meter, path);
+
+	if (metered && !(cell = meter_cell(&meter, argv[1], op)))
+		fprintf(stderr, "No room for metrics of module “%s”!\n", argv[1]);
+
+	bool input  = op == METER_DEPOSIT;
+	uint64_t in = 0, out = 0;
+
+	/* Modules may take advantage of regular files */
+	struct stat st;
+	if (input && !fstat(0, &st) && S_ISREG(st.st_mode)) {
+		off_t pos = lseek(0, 0, SEEK_CUR);
+
+		if (pos >= 0 && pos < st.st_size)
+			in = st.st_size - pos;
+
+		input = false;
+	}
+
+	bool output = op == METER_RETRIEVE || op == METER_RANGE || op == METER_INSPECT;
+
+	int pipefd[2] = { -1, -1 };
+	if (unlikely((input || output) && pipe(pipefd))) {
+		perror("Unable to create pipe");
+		return EXIT_FAILURE;
+	}
+
+	posix_spawn_file_actions_t file_actions;
+	posix_spawnattr_t attr;
+	sigset_t sigdef;
+
+	sigemptyset(&sigdef);
+	sigaddset(&sigdef, SIGPIPE);
+
+	if (unlikely(posix_spawn_file_actions_init(&file_actions) || posix_spawnattr_init(&attr))) {
+		perror("Unable to set spawning up");
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(
+		input && posix_spawn_file_actions_adddup2(&file_actions, pipefd[0], 0) ||
+		output && posix_spawn_file_actions_adddup2(&file_actions, pipefd[1], 1) ||
+		(input || output) && (
+			posix_spawn_file_actions_addclose(&file_actions, pipefd[0]) ||
+			posix_spawn_file_actions_addclose(&file_actions, pipefd[1])) ||
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF) ||
+		posix_spawnattr_setsigdefault(&attr, &sigdef))) {
+		perror("Unable to set spawning up");
+		return EXIT_FAILURE;
+	}
+
+	/* A reader going away is noticed as a write error */
+	signal(SIGPIPE, SIG_IGN);
+
+	if (cell)
+		meter_begin(cell);
+
+	struct timespec wall;
+	clock_gettime(CLOCK_REALTIME, &wall);
+
+	uint64_t start = now();
+
+	pid_t pid;
+	if (unlikely(errno = posix_spawnp(&pid, argv[3], &file_actions, &attr, &argv[3], environ))) {
+		perror("Unable to spawn command");
+
+		if (cell)
+			meter_end(cell, now() - start, EXIT_FAILURE << 8, 0, 0);
+
+		chronicle(argv, op, (uint64_t) wall.tv_sec * UINT64_C(1000000000) + wall.tv_nsec, now() - start, EXIT_FAILURE, 0);
+		return EXIT_FAILURE;
+	}
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&file_actions);
+
+	bool broken = false;
+
+	if (input) {
+		close(pipefd[0]);
+
+		/* A module must not take input cut short for the whole object */
+		if (unlikely(broken = !relay(pipefd[1], 0, &in) && errno != EPIPE)) {
+			perror("Unable to relay input");
+			kill(pid, SIGTERM);
+		}
+
+		close(pipefd[1]);
+	}
+
+	/* A reader going away ends the transfer for the module as well */
+	else if (output) {
+		close(pipefd[1]);
+		relay(1, pipefd[0], &out);
+		close(pipefd[0]);
+	}
+
+	int status;
+	while (unlikely(waitpid(pid, &status, 0) < 0))
+		if (errno != EINTR) {
+			perror("Unable to wait for command");
+			status = EXIT_FAILURE << 8;
+			break;
+		}
+
+	if (cell)
+		meter_end(cell, now() - start, status, in, out);
+
+	if (metered)
+		meter_close(&meter);
+
+	int rc = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+	if (broken && !rc)
+		rc = EXIT_FAILURE;
+	chronicle(argv, op, (uint64_t) wall.tv_sec * UINT64_C(1000000000) + wall.tv_nsec, now() - start, rc, in + out);
+
+	return rc;
+}
@@ -0,0 +1,676 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "expect.h"
+#include "index.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Archive file name.
+ */
+#define ARCHIVE_NAME "corpus.tar"
+
+/**
+ * \brief Index file name.
+ */
+#define INDEX_NAME "corpus.tar.idx"
+
+/**
+ * \brief Size of archive blocks.
+ */
+#define BLOCK 512
+
+/**
+ * \brief Largest size representable in octal.
+ */
+#define OCTAL_LIMIT (UINT64_C(1) << 33)
+
+/**
+ * \brief Index state word holding the offset of the end‐of‐archive marker.
+ */
+#define STATE_END 0
+
+/**
+ * \brief Index state word holding the archive size at the last scan.
+ */
+#define STATE_SIZE 1
+
+/**
+ * \brief Index state word holding the archive inode number at the last scan.
+ */
+#define STATE_INODE 2
+
+/**
+ * \brief POSIX ustar header.
+ */
+struct header {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char pad[12];
+};
+
+/**
+ * \brief I/O buffer.
+ */
+static uint8_t buf[STREAM_BUFSIZE];
+
+/**
+ * \brief Round up to block size.
+ *
+ * \param size Size to round.
+ *
+ * \return Rounded size.
+ */
+static inline uint64_t align(uint64_t size) {
+	return size + BLOCK - 1 & ~(uint64_t) (BLOCK - 1);
+}
+
+/**
+ * \brief Compute header checksum.
+ *
+ * \param head Header.
+ *
+ * \return Checksum.
+ */
+static uint32_t header_sum(const struct header *restrict head) {
+	const uint8_t *byte = (const uint8_t *) head;
+	uint32_t sum = 0;
+
+	for (size_t iter = 0; iter < sizeof *head; ++iter)
+		sum += iter >= offsetof(struct header, chksum) && iter < offsetof(struct header, typeflag) ? ' ' : byte[iter];
+
+	return sum;
+}
+
+/**
+ * \brief Parse numeric header field.
+ *
+ * Both octal and the base‐256 encoding used for large values are
+ * understood.
+ *
+ * \param field Field.
+ * \param size Size of field.
+ * \param value Pointer to variable receiving the value.
+ *
+ * \return \c true if successful or \c false if the field is invalid.
+ */
+static bool header_number(const char *restrict field, size_t size, uint64_t *restrict value) {
+	const uint8_t *byte = (const uint8_t *) field;
+
+	*value = 0;
+
+	if (byte[0] & 0x80) {
+		/* Negative values are invalid */
+		if (byte[0] & 0x40)
+			return false;
+
+		for (size_t iter = 1; iter < size; ++iter) {
+			if (*value >> 56)
+				return false;
+
+			*value = *value << 8 | byte[iter];
+		}
+
+		return true;
+	}
+
+	size_t iter = 0;
+	while (iter < size && field[iter] == ' ')
+		++iter;
+
+	for (; iter < size && field[iter] >= '0' && field[iter] <= '7'; ++iter)
+		*value = *value << 3 | (uint64_t) (field[iter] - '0');
+
+	return iter == size || field[iter] == ' ' || field[iter] == '\0';
+}
+
+/**
+ * \brief Format numeric header field.
+ *
+ * Values that do not fit in octal are stored in base‐256.
+ *
+ * \param field Field.
+ * \param size Size of field.
+ * \param value Value.
+ */
+static void header_format(char *restrict field, size_t size, uint64_t value) {
+	if (value >> 3 * (size - 1)) {
+		memset(field, 0, size);
+		field[0] = (char) 0x80;
+
+		for (size_t iter = size - 1; value && iter; --iter, value >>= 8)
+			field[iter] = (char) (value & 0xff);
+	}
+
+	else {
+		field[size - 1] = '\0';
+
+		for (size_t iter = size - 1; iter--; value >>= 3)
+			field[iter] = (char) ('0' + (value & 7));
+	}
+}
+
+/**
+ * \brief Parse member name as object identifier.
+ *
+ * \param head Header.
+ * \param ident Buffer to hold the identifier.
+ *
+ * \return \c true if the member is an object or \c false otherwise.
+ */
+static bool header_ident(const struct header *restrict head, uint8_t ident[restrict 32]) {
+	char name[sizeof head->name + 1];
+
+	memcpy(name, head->name, sizeof head->name);
+	name[sizeof head->name] = '\0';
+
+	const char *hex = strncmp(name, "./", 2) ? name : name + 2;
+
+	return !head->prefix[0] &&
+		(head->typeflag == '0' || head->typeflag == '\0') &&
+		strlen(hex) == 32 * 2 && hexsint(ident, hex, 32);
+}
+
+/**
+ * \brief Read and validate header.
+ *
+ * \param fd Archive file descriptor.
+ * \param offset Header offset.
+ * \param head Buffer to hold the header.
+ * \param size Pointer to variable receiving the member size.
+ *
+ * \return \c true if there is a valid header or \c false at the end of the archive.
+ */
+static bool header_read(int fd, uint64_t offset, struct header *restrict head, uint64_t *restrict size) {
+	uint64_t sum;
+
+	return pread(fd, head, sizeof *head, offset) == sizeof *head &&
+		header_number(head->chksum, sizeof head->chksum, &sum) &&
+		sum == header_sum(head) &&
+		header_number(head->size, sizeof head->size, size);
+}
+
+/**
+ * \brief Index archive members appended since the last scan.
+ *
+ * A dirty index is rebuilt from the start of the archive, as is the
+ * index of an archive that shrank or was replaced.  Scanning stops at
+ * the first block that is not a valid header, which is where the next
+ * member will be appended.
+ *
+ * \param idx Writable index.
+ * \param fd Archive file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool catchup(struct index *restrict idx, int fd) {
+	struct stat st;
+	if (unlikely(fstat(fd, &st)))
+		return false;
+
+	if (idx->dirty || (uint64_t) st.st_size < idx->head->state[STATE_SIZE] || (uint64_t) st.st_ino != idx->head->state[STATE_INODE]) {
+		index_reset(idx);
+		idx->head->state[STATE_END]   = 0;
+		idx->head->state[STATE_SIZE]  = 0;
+		idx->head->state[STATE_INODE] = st.st_ino;
+	}
+
+	uint64_t offset = idx->head->state[STATE_END];
+
+	for (;;) {
+		struct header head;
+		uint64_t size;
+		uint8_t ident[32];
+
+		if (offset + BLOCK > (uint64_t) st.st_size || !header_read(fd, offset, &head, &size))
+			break;
+
+		uint64_t next = offset + BLOCK + align(size);
+		if (next > (uint64_t) st.st_size)
+			break;
+
+		if (header_ident(&head, ident)) {
+			struct index_entry *entry = index_insert(idx, ident);
+			if (unlikely(!entry))
+				return false;
+
+			uint64_t mtime;
+			if (!header_number(head.mtime, sizeof head.mtime, &mtime))
+				mtime = 0;
+
+			/* Later members supersede earlier ones */
+			entry->offset = offset + BLOCK;
+			entry->length = size;
+			entry->stored = size;
+			entry->time   = mtime * UINT64_C(1000000000);
+		}
+
+		offset = next;
+	}
+
+	idx->head->state[STATE_END]  = offset;
+	idx->head->state[STATE_SIZE] = st.st_size;
+	idx->dirty = false;
+
+	return true;
+}
+
+/**
+ * \brief Open index and bring it up to date with the archive.
+ *
+ * \param idx Index context.
+ * \param fd Archive file descriptor.
+ * \param write Open for writing.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool tar_index(struct index *restrict idx, int fd, bool write) {
+	if (index_open(idx, INDEX_NAME, write)) {
+		struct stat st;
+
+		if (!idx->dirty && !fstat(fd, &st) &&
+			(uint64_t) st.st_size == idx->head->state[STATE_SIZE] &&
+			(uint64_t) st.st_ino == idx->head->state[STATE_INODE])
+			return true;
+
+		if (!write)
+			index_close(idx);
+	}
+
+	else if (errno != EINVAL && errno != ENOENT)
+		return false;
+
+	/* The archive was modified, or the index is missing or damaged */
+	if (!write && unlikely(!index_open(idx, INDEX_NAME, true)))
+		return false;
+
+	if (unlikely(!catchup(idx, fd))) {
+		index_close(idx);
+		return false;
+	}
+
+	if (write)
+		return true;
+
+	index_close(idx);
+
+	return index_open(idx, INDEX_NAME, false);
+}
+
+/**
+ * \brief Look object up.
+ *
+ * \param ident Object identifier.
+ * \param entry Buffer to hold the index entry.
+ * \param fd Pointer to variable receiving the archive file descriptor or <tt>(int *) 0</tt>.
+ *
+ * \return 0 if found, 3 if not found or \c EXIT_FAILURE on failure.
+ */
+static int lookup(const uint8_t ident[restrict 32], struct index_entry *restrict entry, int *restrict fd) {
+	int archive = open(ARCHIVE_NAME, O_RDONLY);
+	if (archive < 0) {
+		if (errno == ENOENT)
+			return 3;
+
+		perror("Unable to open archive");
+		return EXIT_FAILURE;
+	}
+
+	struct index idx;
+	if (unlikely(!tar_index(&idx, archive, false))) {
+		perror("Unable to open index");
+		close(archive);
+		return EXIT_FAILURE;
+	}
+
+	const struct index_entry *found = index_find(&idx, ident);
+	if (found)
+		*entry = *found;
+
+	index_close(&idx);
+
+	if (found && fd)
+		*fd = archive;
+	else
+		close(archive);
+
+	return found ? EXIT_SUCCESS : 3;
+}
+
+/**
+ * \brief Retrieve byte range of object.
+ *
+ * \param ident Object identifier.
+ * \param offset Offset of first byte.
+ * \param length Maximum number of bytes.
+ */
+static int op_retrieve(const uint8_t ident[restrict 32], uint64_t offset, uint64_t length) {
+	struct index_entry entry;
+	int fd;
+
+	int rc = lookup(ident, &entry, &fd);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	/* Clip range to object */
+	if (offset > entry.length)
+		offset = entry.length;
+
+	if (length > entry.length - offset)
+		length = entry.length - offset;
+
+	if (unlikely(!stream_send(1, fd, entry.offset + offset, length))) {
+		perror("Unable to send object");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	close(fd);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Describe object.
+ *
+ * \param ident Object identifier.
+ * \param dir Storage directory.
+ */
+static int op_inspect(const uint8_t ident[restrict 32], const char *restrict dir) {
+	struct index_entry entry;
+
+	int rc = lookup(ident, &entry, (int *) 0);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	printf("%" PRIu64 " %" PRIu64 " %" PRIu64 " %s/" ARCHIVE_NAME "@%" PRIu64 "\n",
+		entry.length, entry.stored, entry.time, dir, entry.offset);
+
+	if (unlikely(fflush(stdout))) {
+		perror("Unable to write description");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Deposit object.
+ *
+ * The member is appended in place of the end‐of‐archive marker.  Its
+ * header is written last, so an interrupted deposit leaves the archive
+ * ending where it ended before.
+ */
+static int op_deposit(const uint8_t ident[restrict 32]) {
+	int fd = open(ARCHIVE_NAME, O_RDWR | O_CREAT, 0644);
+	if (unlikely(fd < 0)) {
+		perror("Unable to open archive");
+		return EXIT_FAILURE;
+	}
+
+	struct flock lock = {
+		.l_type   = F_WRLCK,
+		.l_whence = SEEK_SET,
+		.l_start  = 0,
+		.l_len    = 0
+	};
+
+	/* Serialise appenders */
+	if (unlikely(fcntl(fd, F_SETLKW, &lock))) {
+		perror("Unable to lock archive");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	struct index idx;
+	if (unlikely(!tar_index(&idx, fd, true))) {
+		perror("Unable to open index");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	uint64_t offset = idx.head->state[STATE_END];
+	index_close(&idx);
+
+	if (unlikely(lseek(fd, offset + BLOCK, SEEK_SET) < 0)) {
+		perror("Unable to seek in archive");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	/* Append object data */
+	uint64_t length = 0;
+	for (;;) {
+		ssize_t fill = stream_read(0, buf, sizeof buf);
+		if (unlikely(fill < 0)) {
+			perror("Read error");
+			goto failure;
+		}
+
+		if (!fill)
+			break;
+
+		if (unlikely(!stream_write(fd, buf, fill))) {
+			perror("Write error");
+			goto failure;
+		}
+
+		length += fill;
+	}
+
+	/* Close standard input */
+	close(0);
+
+	/* Pad member and terminate archive */
+	uint64_t end = offset + BLOCK + align(length);
+	memset(buf, 0, BLOCK * 3);
+
+	if (unlikely(!stream_write(fd, buf, end - (offset + BLOCK + length) + BLOCK * 2) ||
+		ftruncate(fd, end + BLOCK * 2))) {
+		perror("Write error");
+		goto failure;
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	struct header head;
+	memset(&head, 0, sizeof head);
+
+	inthexs(head.name, ident, 32);
+	header_format(head.mode, sizeof head.mode, 0644);
+	header_format(head.uid, sizeof head.uid, 0);
+	header_format(head.gid, sizeof head.gid, 0);
+	header_format(head.size, sizeof head.size, length);
+	header_format(head.mtime, sizeof head.mtime, ts.tv_sec);
+	head.typeflag = '0';
+	memcpy(head.magic, "ustar", sizeof head.magic);
+	memcpy(head.version, "00", sizeof head.version);
+
+	uint32_t sum = header_sum(&head);
+	header_format(head.chksum, sizeof head.chksum - 1, sum);
+	head.chksum[sizeof head.chksum - 1] = ' ';
+
+	/* Commit member */
+	if (unlikely(fdatasync(fd) || pwrite(fd, &head, sizeof head, offset) != sizeof head || fdatasync(fd))) {
+		perror("Unable to commit member");
+		goto failure;
+	}
+
+	if (unlikely(!tar_index(&idx, fd, true))) {
+		perror("Unable to open index");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	/* The scan may have picked the member up already */
+	struct index_entry *entry = index_insert(&idx, ident);
+	if (unlikely(!entry)) {
+		perror("Unable to insert index entry");
+		index_close(&idx);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	entry->offset = offset + BLOCK;
+	entry->length = length;
+	entry->stored = length;
+	entry->time   = (uint64_t) ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+
+	idx.head->state[STATE_END]  = end;
+	idx.head->state[STATE_SIZE] = end + BLOCK * 2;
+
+	index_close(&idx);
+	close(fd);
+
+	return EXIT_SUCCESS;
+
+failure:
+	/* Restore end‐of‐archive marker */
+	memset(buf, 0, BLOCK * 2);
+	if (pwrite(fd, buf, BLOCK * 2, offset) != BLOCK * 2 || ftruncate(fd, offset + BLOCK * 2))
+		perror("Unable to discard partial member");
+
+	close(fd);
+
+	return EXIT_FAILURE;
+}
+
+/**
+ * \brief List identifiers of all objects.
+ */
+static int op_list(void) {
+	int archive = open(ARCHIVE_NAME, O_RDONLY);
+	if (archive < 0) {
+		if (errno == ENOENT)
+			return EXIT_SUCCESS;
+
+		perror("Unable to open archive");
+		return EXIT_FAILURE;
+	}
+
+	struct index idx;
+	if (unlikely(!tar_index(&idx, archive, false))) {
+		perror("Unable to open index");
+		close(archive);
+		return EXIT_FAILURE;
+	}
+
+	size_t count;
+	uint8_t (*idents)[32] = index_idents(&idx, &count);
+	index_close(&idx);
+	close(archive);
+
+	if (unlikely(!idents)) {
+		perror("Unable to list objects");
+		return EXIT_FAILURE;
+	}
+
+	char name[32 * 2 + 1];
+	for (size_t iter = 0; iter < count; ++iter) {
+		inthexs(name, idents[iter], sizeof idents[iter]);
+		puts(name);
+	}
+
+	free(idents);
+
+	if (unlikely(fflush(stdout) || ferror(stdout))) {
+		perror("Unable to write identifiers");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector.
+ *
+ * \return EXIT_SUCCESS if successful or any other value on failure.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc != 6 && argc != 8)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	/* Change to storage directory */
+	if (unlikely(chdir(argv[1]))) {
+		perror("Unable to change to storage directory");
+		return EXIT_FAILURE;
+	}
+
+	/* Listing does not refer to an object */
+	if (!strcmp(argv[5], "list"))
+		return op_list();
+
+	uint8_t ident[32];
+	if (!hexsint(ident, argv[4], sizeof ident)) {
+		perror("Failed to parse identifier");
+		return EXIT_FAILURE;
+	}
+
+	/* Parse operation string */
+	if (!strcmp(argv[5], "assay")) {
+		struct index_entry entry;
+		return lookup(ident, &entry, (int *) 0);
+	}
+
+	else if (!strcmp(argv[5], "retrieve"))
+		return op_retrieve(ident, 0, UINT64_MAX);
+
+	else if (!strcmp(argv[5], "range")) {
+		uint64_t offset, length;
+
+		if (unlikely(argc != 8 || !decsint(&offset, argv[6]) || !decsint(&length, argv[7]))) {
+			fputs("Invalid byte range!\n", stderr);
+			return EXIT_FAILURE;
+		}
+
+		return op_retrieve(ident, offset, length);
+	}
+
+	else if (!strcmp(argv[5], "inspect"))
+		return op_inspect(ident, argv[1]);
+
+	else if (!strcmp(argv[5], "deposit"))
+		return op_deposit(ident);
+
+	else if (!strcmp(argv[5], "efface")) {
+		fputs("The tar storage module does not support effacement!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	else {
+		fprintf(stderr, "Invalid storage operation “%s”!\n", argv[5]);
+		return 2;
+	}
+}
@@ -0,0 +1,242 @@
+/* memfd_create and file sealing are Linux extensions */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "egress.h"
+#include "expect.h"
+#include "path.h"
+#include "serve.h"
+#include "storage.h"
+#include "view.h"
+
+/**
+ * \brief Mapped object.
+ */
+struct mapping {
+	struct mapping   *next;                  /**< Next mapping. */
+	uint8_t           ident[32];             /**< Object identifier. */
+	char              module[SERVE_NAMELEN]; /**< Storage module name. */
+	void             *base;                  /**< Start of the mapping, which is page‐aligned. */
+	size_t            span;                  /**< Size of the mapping. */
+	const uint8_t    *ptr;                   /**< Object bytes. */
+	size_t            len;                   /**< Object size. */
+	unsigned long int refs;                  /**< Number of views. */
+};
+
+/**
+ * \brief Mapped objects.
+ */
+static struct mapping *mappings;
+
+/**
+ * \brief Lock protecting the mappings.
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \brief Share existing mapping.
+ *
+ * \param view Buffer to hold the view.
+ * \param module Storage module name.
+ * \param ident Object identifier.
+ * \param map Mapping to use unless the object is mapped already, or null.
+ *
+ * \return Mapping in use, which is \a map if it was taken, or null if
+ * neither was there.
+ */
+static struct mapping *share(struct view *restrict view, const char *restrict module, const uint8_t ident[restrict 32], struct mapping *restrict map) {
+	struct mapping *iter;
+
+	pthread_mutex_lock(&lock);
+
+	for (iter = mappings; iter; iter = iter->next)
+		if (!memcmp(iter->ident, ident, 32) && !strcmp(iter->module, module))
+			break;
+
+	if (!iter && map) {
+		map->next = mappings;
+		mappings = iter = map;
+	}
+
+	if (iter) {
+		++iter->refs;
+		view->ptr = iter->ptr;
+		view->len = iter->len;
+	}
+
+	pthread_mutex_unlock(&lock);
+	return iter;
+}
+
+/**
+ * \brief Materialise object.
+ *
+ * The object is retrieved into a memory file, which is then sealed, or
+ * into an unlinked temporary file where there are no memory files.
+ *
+ * \param module Storage module name.
+ * \param ident Object identifier.
+ * \param log Log file descriptor.
+ *
+ * \return File descriptor or -1 on failure.
+ */
+static int materialise(const char *restrict module, const uint8_t ident[restrict 32], int log) {
+#ifdef MFD_ALLOW_SEALING
+	int fd = memfd_create("object", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+	char name[] = TEMP_BASE "view-XXXXXX";
+	char fallback[] = "/tmp/view-XXXXXX";
+
+	int fd = mkstemp(name);
+	if (fd >= 0)
+		unlink(name);
+	else if ((fd = mkstemp(fallback)) >= 0)
+		unlink(fallback);
+
+	if (fd >= 0)
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+
+	if (unlikely(fd < 0))
+		return -1;
+
+	pid_t pid;
+	int status, errnum;
+
+	if (unlikely(!retrieve(&pid, module, ident, log, fd)))
+		goto failure;
+
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR)
+			goto failure;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+		errno = WIFEXITED(status) && WEXITSTATUS(status) == 3 ? ENOENT : EIO;
+		goto failure;
+	}
+
+#ifdef MFD_ALLOW_SEALING
+	if (unlikely(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)))
+		goto failure;
+#endif
+
+	return fd;
+
+failure:
+	errnum = errno;
+	close(fd);
+	errno = errnum;
+	return -1;
+}
+
+bool view_map(struct view *restrict view, const char *restrict module, const uint8_t ident[restrict 32], int log) {
+	prime(bool);
+
+	if (unlikely(strlen(module) >= SERVE_NAMELEN))
+		egress(0, false, ENAMETOOLONG);
+
+	if (share(view, module, ident, (struct mapping *) 0))
+		egress(0, true, errno);
+
+	int fd;
+	uint64_t offset = 0, size;
+
+	/* Without a server, the object is materialised in this process */
+	if (!storage_open(module, ident, &fd, &offset, &size)) {
+		struct stat st;
+
+		if (errno != ECONNREFUSED || (fd = materialise(module, ident, log)) < 0)
+			egress(0, false, errno);
+
+		if (unlikely(fstat(fd, &st)))
+			egress(1, false, errno);
+
+		size = st.st_size;
+	}
+
+	/* There is nothing to map */
+	if (!size) {
+		view->ptr = "";
+		view->len = 0;
+		egress(1, true, errno);
+	}
+
+	long page = sysconf(_SC_PAGESIZE);
+	uint64_t start = offset - offset % (page > 0 ? page : 1);
+
+	if (unlikely(size > SIZE_MAX - (offset - start)))
+		egress(1, false, EFBIG);
+
+	struct mapping *map = malloc(sizeof *map);
+	if (unlikely(!map))
+		egress(1, false, ENOMEM);
+
+	memcpy(map->ident, ident, 32);
+	strcpy(map->module, module);
+	map->span = offset - start + size;
+	map->len = size;
+	map->refs = 0;
+
+	if (unlikely((map->base = mmap((void *) 0, map->span, PROT_READ, MAP_SHARED, fd, start)) == MAP_FAILED))
+		egress(2, false, errno);
+
+	map->ptr = (const uint8_t *) map->base + (offset - start);
+
+	/* Another thread may have mapped the object meanwhile */
+	if (share(view, module, ident, map) != map) {
+		munmap(map->base, map->span);
+		egress(2, true, errno);
+	}
+
+	egress(1, true, errno);
+
+egress2:
+	free(map);
+
+egress1:
+	close(fd);
+
+egress0:
+	final();
+}
+
+void view_unmap(struct view *restrict view) {
+	struct mapping **link, *map = (struct mapping *) 0;
+
+	pthread_mutex_lock(&lock);
+
+	for (link = &mappings; *link; link = &(*link)->next)
+		if ((*link)->ptr == view->ptr && view->len) {
+			map = *link;
+
+			if (--map->refs)
+				map = (struct mapping *) 0;
+			else
+				*link = map->next;
+
+			break;
+		}
+
+	pthread_mutex_unlock(&lock);
+
+	if (map) {
+		munmap(map->base, map->span);
+		free(map);
+	}
+
+	view->ptr = (const void *) 0;
+	view->len = 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef OC_VIEW_H
+#define OC_VIEW_H
+
+/**
+ * \file
+ *
+ * \brief Mapped objects.
+ *
+ * Objects are mapped into memory for random access.  Objects a storage
+ * module keeps verbatim in a plain file are mapped from that file as
+ * handed out by the object server, and any other object is materialised
+ * into a sealed memory file first.  Every object is mapped only once per
+ * process, however often it is asked for, and unmapped when its last
+ * view goes away.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief View of mapped object.
+ */
+struct view {
+	const void *ptr; /**< Object bytes. */
+	size_t      len; /**< Object size. */
+};
+
+/**
+ * \brief Map object.
+ *
+ * \param view Buffer to hold the view.
+ * \param module Storage module name.
+ * \param ident Object identifier.
+ * \param log Log file descriptor for storage modules spawned on the way.
+ *
+ * \return \c true if successful or \c false on failure, with \c errno
+ * set to \c ENOENT if there is no such object.
+ */
+extern bool view_map(struct view *restrict view, const char *restrict module, const uint8_t ident[restrict 32], int log);
+
+/**
+ * \brief Release view.
+ *
+ * \param view View of mapped object.
+ */
+extern void view_unmap(struct view *restrict view);
+
+#endif /* OC_VIEW_H */
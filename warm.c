@@ -0,0 +1,203 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "expect.h"
+#include "path.h"
+#include "string.h"
+
+/**
+ * \brief Retrieval helper, which fills the object cache.
+ */
+#define RETRIEVE EXEC_BASE "retrieve"
+
+/**
+ * \brief Default number of concurrent retrievals.
+ */
+#define PARALLEL_DEFAULT 4
+
+/**
+ * \brief Maximum number of concurrent retrievals.
+ */
+#define PARALLEL_MAXIMUM 64
+
+extern char **environ;
+
+/**
+ * \brief Running retrievals.
+ */
+static pid_t running[PARALLEL_MAXIMUM];
+
+/**
+ * \brief Number of running retrievals.
+ */
+static size_t active;
+
+/**
+ * \brief Prefetching was cancelled.
+ */
+static volatile sig_atomic_t cancelled;
+
+/**
+ * \brief Note cancellation.
+ */
+static void cancel(int sig) {
+	cancelled = 1;
+}
+
+/**
+ * \brief Start retrieval of object into the cache.
+ *
+ * The retrieval leads its own process group, so that cancellation also
+ * reaches the cache and storage module processes it starts.
+ *
+ * \param module Storage module name.
+ * \param ident Object identifier string.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool launch(const char *restrict module, const char *restrict ident) {
+	posix_spawn_file_actions_t file_actions;
+	posix_spawnattr_t attr;
+
+	if (unlikely(posix_spawn_file_actions_init(&file_actions))) {
+		perror("Unable to set file descriptors up");
+		return false;
+	}
+
+	if (unlikely(posix_spawnattr_init(&attr))) {
+		perror("Unable to set attributes up");
+		posix_spawn_file_actions_destroy(&file_actions);
+		return false;
+	}
+
+	/* The object only goes to the cache */
+	const char *argv[] = { "retrieve", module, ident, (char *) 0 };
+
+	pid_t pid;
+	bool result =
+		!posix_spawn_file_actions_addopen(&file_actions, 0, "/dev/null", O_RDONLY, 0) &&
+		!posix_spawn_file_actions_addopen(&file_actions, 1, "/dev/null", O_WRONLY, 0) &&
+		!posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP) &&
+		!posix_spawnattr_setpgroup(&attr, 0) &&
+		!(errno = posix_spawn(&pid, RETRIEVE, &file_actions, &attr, (char **) argv, environ));
+
+	if (unlikely(!result))
+		perror("Unable to spawn retrieval");
+	else
+		running[active++] = pid;
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&file_actions);
+
+	return result;
+}
+
+/**
+ * \brief Wait for a retrieval to finish.
+ *
+ * Missing objects and failed retrievals are of no concern, as the hint
+ * merely goes unused.
+ *
+ * \return \c true if a retrieval finished or \c false if interrupted.
+ */
+static bool reap(void) {
+	pid_t pid = waitpid(-1, (int *) 0, 0);
+	if (pid < 0)
+		return false;
+
+	for (size_t iter = 0; iter < active; ++iter)
+		if (running[iter] == pid) {
+			running[iter] = running[--active];
+			break;
+		}
+
+	return true;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * Identifiers are read from standard input, one per line, and fetched
+ * into the object cache in order with up to \c PREFETCH_PARALLEL
+ * retrievals in flight.  \c SIGTERM cancels outstanding prefetches.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector: storage module name.
+ *
+ * \return EXIT_SUCCESS if successful or EXIT_FAILURE on failure.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc != 2)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	unsigned long int parallel = setting("PREFETCH_PARALLEL", PARALLEL_DEFAULT);
+
+	if (!parallel)
+		parallel = 1;
+
+	if (parallel > PARALLEL_MAXIMUM)
+		parallel = PARALLEL_MAXIMUM;
+
+	/* Interrupt waiting on cancellation */
+	struct sigaction action = { .sa_handler = cancel };
+	sigemptyset(&action.sa_mask);
+
+	if (unlikely(sigaction(SIGTERM, &action, (struct sigaction *) 0))) {
+		perror("Unable to handle cancellation");
+		return EXIT_FAILURE;
+	}
+
+	char line[32 * 2 + 2];
+	int rc = EXIT_SUCCESS;
+
+	while (!cancelled && fgets(line, sizeof line, stdin)) {
+		line[strcspn(line, "\n")] = 0;
+
+		if (!*line)
+			continue;
+
+		uint8_t ident[32];
+		if (unlikely(strlen(line) != 32 * 2 || !hexsint(ident, line, sizeof ident))) {
+			fprintf(stderr, "Failed to parse identifier “%s”!\n", line);
+			rc = EXIT_FAILURE;
+			break;
+		}
+
+		while (!cancelled && active == parallel)
+			reap();
+
+		if (cancelled || unlikely(!launch(argv[1], line)))
+			break;
+	}
+
+	bool killed = false;
+
+	while (active) {
+		/* Cancellation reaches every process a retrieval started */
+		if (cancelled && !killed) {
+			for (size_t iter = 0; iter < active; ++iter)
+				kill(-running[iter], SIGTERM);
+
+			killed = true;
+		}
+
+		if (!reap() && errno == ECHILD)
+			break;
+	}
+
+	return rc;
+}
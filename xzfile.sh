@@ -2,23 +2,46 @@
 
 set -e
 
+# Compress and decompress independent blocks on all cores
+threads="${XZ_THREADS:-0}"
+
 case "$5" in
 	"assay")
 		[ -f "$1/$4.xz" ] || exit 3
 	;;
 
 	"retrieve")
-		xz -d -c <"$1/$4.xz"
+		xz -d -c -T "$threads" <"$1/$4.xz"
+	;;
+
+	"range")
+		# Compressed streams cannot seek
+		exit 2
+	;;
+
+	"inspect")
+		[ -f "$1/$4.xz" ] || exit 3
+		size=`xz --robot --list "$1/$4.xz" | awk '$1 == "totals" { print $5 }'`
+		echo "$size `stat -c "%s %Y" "$1/$4.xz"`000000000 $1/$4.xz"
 	;;
 
 	"deposit")
-		xz -z -c -7 >"$1/$4.xz"
+		# Store objects whole or not at all, even when cut short
+		trap 'rm -f -- "$1/$4.xz.$$.part"' EXIT
+		trap 'exit 1' HUP INT TERM
+		xz -z -c -7 -T "$threads" >"$1/$4.xz.$$.part"
+		mv -f -- "$1/$4.xz.$$.part" "$1/$4.xz"
 	;;
 
 	"efface")
 		rm -- "$1/$4.xz"
 	;;
 
+	"list")
+		[ -d "$1" ] || exit 0
+		ls -- "$1" | sed -n 's/^\([0-9A-Fa-f]\{64\}\)\.xz$/\1/p'
+	;;
+
 	*)
 		echo "Invalid storage operation “$5”!" >&2
 		exit 2
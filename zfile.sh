@@ -4,21 +4,41 @@ set -e
 
 case "$5" in
 	"assay")
-		[ -f "$1/$4" ] || exit 3
+		[ -f "$1/$4.gz" ] || exit 3
 	;;
 
 	"retrieve")
 		gzip -d -c <"$1/$4.gz"
 	;;
 
+	"range")
+		# Compressed streams cannot seek
+		exit 2
+	;;
+
+	"inspect")
+		# The size of the decompressed stream is not recorded
+		[ -f "$1/$4.gz" ] || exit 3
+		echo "- `stat -c "%s %Y" "$1/$4.gz"`000000000 $1/$4.gz"
+	;;
+
 	"deposit")
-		gzip -z -c -9 >"$1/$4.gz"
+		# Store objects whole or not at all, even when cut short
+		trap 'rm -f -- "$1/$4.gz.$$.part"' EXIT
+		trap 'exit 1' HUP INT TERM
+		gzip -c -9 >"$1/$4.gz.$$.part"
+		mv -f -- "$1/$4.gz.$$.part" "$1/$4.gz"
 	;;
 
 	"efface")
 		rm -- "$1/$4.gz"
 	;;
 
+	"list")
+		[ -d "$1" ] || exit 0
+		ls -- "$1" | sed -n 's/^\([0-9A-Fa-f]\{64\}\)\.gz$/\1/p'
+	;;
+
 	*)
 		echo "Invalid storage operation “$5”!" >&2
 		exit 2
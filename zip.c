@@ -0,0 +1,1194 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include "expect.h"
+#include "index.h"
+#include "stream.h"
+#include "string.h"
+
+/**
+ * \brief Archive file name.
+ */
+#define ARCHIVE_NAME "corpus.zip"
+
+/**
+ * \brief Index file name.
+ */
+#define INDEX_NAME "corpus.zip.idx"
+
+/**
+ * \brief Default number of deposits between central directory rewrites.
+ */
+#define BATCH_DEFAULT 64
+
+/**
+ * \brief Default deflate compression level.
+ */
+#define LEVEL_DEFAULT 6
+
+/**
+ * \brief Index flag for deflated entries.
+ */
+#define ZIP_DEFLATED INDEX_USER
+
+/**
+ * \brief Store general purpose bit flags in index entry flags.
+ */
+#define ZIP_FLAGS(bits) ((uint32_t) (bits) << 16)
+
+/**
+ * \brief Extract general purpose bit flags from index entry flags.
+ */
+#define ZIP_BITS(flags) ((uint16_t) ((flags) >> 16))
+
+/**
+ * \brief Index state word holding the offset of the central directory.
+ */
+#define STATE_END 0
+
+/**
+ * \brief Index state word holding the number of deposits not yet in the central directory.
+ */
+#define STATE_PENDING 1
+
+/**
+ * \brief Index state word holding the archive inode number.
+ */
+#define STATE_INODE 2
+
+/* Record signatures */
+#define SIG_LOCAL   UINT32_C(0x04034b50)
+#define SIG_CENTRAL UINT32_C(0x02014b50)
+#define SIG_END     UINT32_C(0x06054b50)
+#define SIG_END64   UINT32_C(0x06064b50)
+#define SIG_LOCATOR UINT32_C(0x07064b50)
+
+/* Fixed record sizes */
+#define LOCAL_SIZE   30
+#define CENTRAL_SIZE 46
+#define END_SIZE     22
+#define END64_SIZE   56
+#define LOCATOR_SIZE 20
+
+/**
+ * \brief Length of member names.
+ */
+#define NAME_SIZE (32 * 2)
+
+/**
+ * \brief Zip64 extended information extra field tag.
+ */
+#define ZIP64_TAG 0x0001
+
+/**
+ * \brief Size of local Zip64 extra field.
+ */
+#define ZIP64_LOCAL (4 + 16)
+
+/**
+ * \brief Version needed to extract Zip64 members.
+ */
+#define VERSION_ZIP64 45
+
+/**
+ * \brief Version made by (UNIX, specification 4.5).
+ */
+#define VERSION_MADE (3 << 8 | VERSION_ZIP64)
+
+/**
+ * \brief General purpose flag indicating encryption.
+ */
+#define BIT_ENCRYPTED 0x0001
+
+/**
+ * \brief General purpose flag indicating a trailing data descriptor.
+ */
+#define BIT_DESCRIPTOR 0x0008
+
+/* Compression methods */
+#define METHOD_STORED   0
+#define METHOD_DEFLATED 8
+
+/**
+ * \brief I/O buffer.
+ */
+static uint8_t buf[STREAM_BUFSIZE];
+
+/**
+ * \brief Secondary I/O buffer for compression.
+ */
+static uint8_t aux[STREAM_BUFSIZE];
+
+static inline uint16_t get16(const uint8_t *restrict ptr) {
+	return (uint16_t) (ptr[0] | ptr[1] << 8);
+}
+
+static inline uint32_t get32(const uint8_t *restrict ptr) {
+	return (uint32_t) get16(ptr) | (uint32_t) get16(ptr + 2) << 16;
+}
+
+static inline uint64_t get64(const uint8_t *restrict ptr) {
+	return (uint64_t) get32(ptr) | (uint64_t) get32(ptr + 4) << 32;
+}
+
+static inline uint8_t *put16(uint8_t *restrict ptr, uint16_t val) {
+	ptr[0] = (uint8_t) val;
+	ptr[1] = (uint8_t) (val >> 8);
+	return ptr + 2;
+}
+
+static inline uint8_t *put32(uint8_t *restrict ptr, uint32_t val) {
+	return put16(put16(ptr, (uint16_t) val), (uint16_t) (val >> 16));
+}
+
+static inline uint8_t *put64(uint8_t *restrict ptr, uint64_t val) {
+	return put32(put32(ptr, (uint32_t) val), (uint32_t) (val >> 32));
+}
+
+/**
+ * \brief Convert time to MS‐DOS representation.
+ *
+ * \param stamp Nanoseconds since the epoch.
+ * \param dtime Pointer to variable receiving the time.
+ * \param ddate Pointer to variable receiving the date.
+ */
+static void dos_time(uint64_t stamp, uint16_t *restrict dtime, uint16_t *restrict ddate) {
+	time_t sec = stamp / UINT64_C(1000000000);
+	struct tm tm;
+
+	if (!localtime_r(&sec, &tm) || tm.tm_year < 80) {
+		*dtime = 0;
+		*ddate = 1 << 5 | 1;
+		return;
+	}
+
+	*dtime = (uint16_t) (tm.tm_hour << 11 | tm.tm_min << 5 | tm.tm_sec / 2);
+	*ddate = (uint16_t) ((tm.tm_year - 80) << 9 | (tm.tm_mon + 1) << 5 | tm.tm_mday);
+}
+
+/**
+ * \brief Convert time from MS‐DOS representation.
+ *
+ * \param dtime Time.
+ * \param ddate Date.
+ *
+ * \return Nanoseconds since the epoch.
+ */
+static uint64_t unix_time(uint16_t dtime, uint16_t ddate) {
+	struct tm tm = {
+		.tm_sec   = (dtime & 0x1f) * 2,
+		.tm_min   = dtime >> 5 & 0x3f,
+		.tm_hour  = dtime >> 11,
+		.tm_mday  = ddate & 0x1f,
+		.tm_mon   = (ddate >> 5 & 0x0f) - 1,
+		.tm_year  = (ddate >> 9) + 80,
+		.tm_isdst = -1
+	};
+
+	time_t sec = mktime(&tm);
+	return sec < 0 ? 0 : (uint64_t) sec * UINT64_C(1000000000);
+}
+
+/**
+ * \brief Apply Zip64 extended information.
+ *
+ * Only fields whose 32‐bit counterparts are saturated are present in the
+ * extra field, in the order given here.
+ *
+ * \param extra Extra fields.
+ * \param size Size of extra fields.
+ * \param length Pointer to uncompressed size.
+ * \param stored Pointer to compressed size.
+ * \param offset Pointer to local header offset or <tt>(uint64_t *) 0</tt>.
+ */
+static void zip64_apply(const uint8_t *restrict extra, size_t size, uint64_t *restrict length, uint64_t *restrict stored, uint64_t *restrict offset) {
+	while (size >= 4) {
+		uint16_t tag = get16(extra), len = get16(extra + 2);
+		if (len > size - 4)
+			return;
+
+		if (tag == ZIP64_TAG) {
+			const uint8_t *field = extra + 4, *end = field + len;
+
+			if (*length == UINT32_MAX && field + 8 <= end) {
+				*length = get64(field);
+				field += 8;
+			}
+
+			if (*stored == UINT32_MAX && field + 8 <= end) {
+				*stored = get64(field);
+				field += 8;
+			}
+
+			if (offset && *offset == UINT32_MAX && field + 8 <= end)
+				*offset = get64(field);
+
+			return;
+		}
+
+		extra += 4 + len;
+		size  -= 4 + len;
+	}
+}
+
+/**
+ * \brief Parse member name as object identifier.
+ *
+ * \param name Member name.
+ * \param size Length of name.
+ * \param ident Buffer to hold the identifier.
+ *
+ * \return \c true if the member is an object or \c false otherwise.
+ */
+static bool member_ident(const uint8_t *restrict name, size_t size, uint8_t ident[restrict 32]) {
+	return size == NAME_SIZE && hexsint(ident, (const char *) name, 32);
+}
+
+/**
+ * \brief Store member in index.
+ *
+ * Later members supersede earlier ones.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool member_index(struct index *restrict idx, const uint8_t ident[restrict 32], uint64_t offset, uint64_t length, uint64_t stored, uint32_t crc, uint16_t method, uint16_t bits, uint64_t stamp) {
+	/* Members that cannot be served are not objects */
+	if (method != METHOD_STORED && method != METHOD_DEFLATED || bits & BIT_ENCRYPTED)
+		return true;
+
+	struct index_entry *entry = index_insert(idx, ident);
+	if (unlikely(!entry))
+		return false;
+
+	entry->offset = offset;
+	entry->length = length;
+	entry->stored = stored;
+	entry->time   = stamp;
+	entry->aux    = crc;
+	entry->flags  = INDEX_USED | (method == METHOD_DEFLATED ? ZIP_DEFLATED : 0) | ZIP_FLAGS(bits);
+
+	return true;
+}
+
+/**
+ * \brief Load central directory into index.
+ *
+ * \param idx Writable index.
+ * \param map Archive mapping.
+ * \param size Archive size.
+ * \param start Pointer to variable receiving the central directory offset.
+ *
+ * \return \c true if successful or \c false if there is no valid central directory.
+ */
+static bool central_load(struct index *restrict idx, const uint8_t *restrict map, uint64_t size, uint64_t *restrict start) {
+	if (size < END_SIZE)
+		return false;
+
+	/* Locate end of central directory record behind the archive comment */
+	uint64_t pos = size - END_SIZE, low = pos > UINT16_MAX ? pos - UINT16_MAX : 0;
+	while (get32(map + pos) != SIG_END || pos + END_SIZE + get16(map + pos + 20) != size) {
+		if (pos-- == low)
+			return false;
+	}
+
+	uint64_t entries = get16(map + pos + 10);
+	uint64_t cdsize  = get32(map + pos + 12);
+	uint64_t cdoff   = get32(map + pos + 16);
+	uint64_t limit   = pos;
+
+	if (pos >= LOCATOR_SIZE && get32(map + pos - LOCATOR_SIZE) == SIG_LOCATOR) {
+		uint64_t end64 = get64(map + pos - LOCATOR_SIZE + 8);
+
+		if (end64 + END64_SIZE > pos - LOCATOR_SIZE || get32(map + end64) != SIG_END64)
+			return false;
+
+		entries = get64(map + end64 + 32);
+		cdsize  = get64(map + end64 + 40);
+		cdoff   = get64(map + end64 + 48);
+		limit   = end64;
+	}
+
+	if (cdoff > limit || cdsize > limit - cdoff)
+		return false;
+
+	const uint8_t *ptr = map + cdoff, *end = ptr + cdsize;
+
+	for (uint64_t iter = 0; iter < entries; ++iter) {
+		if (end - ptr < CENTRAL_SIZE || get32(ptr) != SIG_CENTRAL)
+			return false;
+
+		size_t nlen = get16(ptr + 28), elen = get16(ptr + 30), clen = get16(ptr + 32);
+		if ((size_t) (end - ptr) < CENTRAL_SIZE + nlen + elen + clen)
+			return false;
+
+		uint64_t length = get32(ptr + 24), stored = get32(ptr + 20), offset = get32(ptr + 42);
+		zip64_apply(ptr + CENTRAL_SIZE + nlen, elen, &length, &stored, &offset);
+
+		uint8_t ident[32];
+		if (member_ident(ptr + CENTRAL_SIZE, nlen, ident) && offset < cdoff &&
+			unlikely(!member_index(idx, ident, offset, length, stored, get32(ptr + 16), get16(ptr + 10), get16(ptr + 8),
+				unix_time(get16(ptr + 12), get16(ptr + 14)))))
+			return false;
+
+		ptr += CENTRAL_SIZE + nlen + elen + clen;
+	}
+
+	*start = cdoff;
+
+	return true;
+}
+
+/**
+ * \brief Index members by their local headers.
+ *
+ * This recovers deposits that were appended after the central directory
+ * was last written.  Scanning stops at the first record that is not a
+ * local header with known sizes.
+ *
+ * \param idx Writable index.
+ * \param fd Archive file descriptor.
+ * \param size Archive size.
+ * \param offset Pointer to scan start, updated to where scanning stopped.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool local_scan(struct index *restrict idx, int fd, uint64_t size, uint64_t *restrict offset) {
+	for (;;) {
+		uint8_t head[LOCAL_SIZE];
+
+		if (*offset + LOCAL_SIZE > size ||
+			pread(fd, head, sizeof head, *offset) != sizeof head ||
+			get32(head) != SIG_LOCAL || get16(head + 6) & BIT_DESCRIPTOR)
+			return true;
+
+		size_t nlen = get16(head + 26), elen = get16(head + 28);
+		if (pread(fd, buf, nlen + elen, *offset + LOCAL_SIZE) != (ssize_t) (nlen + elen))
+			return true;
+
+		uint64_t length = get32(head + 22), stored = get32(head + 18);
+		zip64_apply(buf + nlen, elen, &length, &stored, (uint64_t *) 0);
+
+		uint64_t next = *offset + LOCAL_SIZE + nlen + elen + stored;
+		if (next > size)
+			return true;
+
+		uint8_t ident[32];
+		if (member_ident(buf, nlen, ident) &&
+			unlikely(!member_index(idx, ident, *offset, length, stored, get32(head + 14), get16(head + 8), get16(head + 6),
+				unix_time(get16(head + 10), get16(head + 12)))))
+			return false;
+
+		*offset = next;
+	}
+}
+
+/**
+ * \brief Rebuild index from archive.
+ *
+ * \param idx Writable index.
+ * \param fd Archive file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool rebuild(struct index *restrict idx, int fd) {
+	struct stat st;
+	if (unlikely(fstat(fd, &st)))
+		return false;
+
+	index_reset(idx);
+
+	uint64_t start = 0;
+	bool central = false;
+
+	if (st.st_size) {
+		void *map = mmap((void *) 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (unlikely(map == MAP_FAILED))
+			return false;
+
+		central = central_load(idx, map, st.st_size, &start);
+		munmap(map, st.st_size);
+	}
+
+	/* Fall back to local headers if deposits overwrote the central directory */
+	if (!central) {
+		index_reset(idx);
+		start = 0;
+
+		if (unlikely(!local_scan(idx, fd, st.st_size, &start)))
+			return false;
+	}
+
+	idx->head->state[STATE_END]     = start;
+	idx->head->state[STATE_PENDING] = !central && idx->head->count;
+	idx->head->state[STATE_INODE]   = st.st_ino;
+	idx->dirty = false;
+
+	return true;
+}
+
+/**
+ * \brief Open index and rebuild it if required.
+ *
+ * \param idx Index context.
+ * \param fd Archive file descriptor.
+ * \param write Open for writing.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool zip_index(struct index *restrict idx, int fd, bool write) {
+	if (index_open(idx, INDEX_NAME, write)) {
+		struct stat st;
+
+		/* Archives rewritten by other tools are replaced */
+		if (!idx->dirty && !fstat(fd, &st) &&
+			(uint64_t) st.st_ino == idx->head->state[STATE_INODE] &&
+			(uint64_t) st.st_size >= idx->head->state[STATE_END])
+			return true;
+
+		if (!write)
+			index_close(idx);
+	}
+
+	else if (errno != EINVAL && errno != ENOENT)
+		return false;
+
+	if (!write && unlikely(!index_open(idx, INDEX_NAME, true)))
+		return false;
+
+	if (unlikely(!rebuild(idx, fd))) {
+		index_close(idx);
+		return false;
+	}
+
+	if (write)
+		return true;
+
+	index_close(idx);
+
+	return index_open(idx, INDEX_NAME, false);
+}
+
+/**
+ * \brief Write central directory.
+ *
+ * The central directory is written at the end of the last member and
+ * the archive is truncated behind it.
+ *
+ * \param idx Writable index.
+ * \param fd Locked archive file descriptor.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool flush(struct index *restrict idx, int fd) {
+	uint64_t start = idx->head->state[STATE_END], entries = 0;
+	size_t fill = 0;
+
+	if (unlikely(lseek(fd, start, SEEK_SET) < 0))
+		return false;
+
+	for (uint64_t iter = 0; iter < idx->head->slots; ++iter) {
+		const struct index_entry *entry = &idx->slot[iter];
+
+		if (!(entry->flags & INDEX_USED))
+			continue;
+
+		if (fill + CENTRAL_SIZE + NAME_SIZE + 4 + 24 > sizeof buf) {
+			if (unlikely(!stream_write(fd, buf, fill)))
+				return false;
+
+			fill = 0;
+		}
+
+		/* Saturated fields move to the Zip64 extra field */
+		bool wide_length = entry->length >= UINT32_MAX;
+		bool wide_stored = entry->stored >= UINT32_MAX;
+		bool wide_offset = entry->offset >= UINT32_MAX;
+		uint16_t extra = (uint16_t) (8 * (wide_length + wide_stored + wide_offset));
+
+		uint16_t dtime, ddate;
+		dos_time(entry->time, &dtime, &ddate);
+
+		uint8_t *ptr = buf + fill;
+		ptr = put32(ptr, SIG_CENTRAL);
+		ptr = put16(ptr, VERSION_MADE);
+		ptr = put16(ptr, VERSION_ZIP64);
+		ptr = put16(ptr, ZIP_BITS(entry->flags));
+		ptr = put16(ptr, entry->flags & ZIP_DEFLATED ? METHOD_DEFLATED : METHOD_STORED);
+		ptr = put16(ptr, dtime);
+		ptr = put16(ptr, ddate);
+		ptr = put32(ptr, entry->aux);
+		ptr = put32(ptr, wide_stored ? UINT32_MAX : (uint32_t) entry->stored);
+		ptr = put32(ptr, wide_length ? UINT32_MAX : (uint32_t) entry->length);
+		ptr = put16(ptr, NAME_SIZE);
+		ptr = put16(ptr, extra ? 4 + extra : 0);
+		ptr = put16(ptr, 0);
+		ptr = put16(ptr, 0);
+		ptr = put16(ptr, 0);
+		ptr = put32(ptr, UINT32_C(0100644) << 16);
+		ptr = put32(ptr, wide_offset ? UINT32_MAX : (uint32_t) entry->offset);
+
+		inthexs((char *) ptr, entry->ident, 32);
+		ptr += NAME_SIZE;
+
+		if (extra) {
+			ptr = put16(ptr, ZIP64_TAG);
+			ptr = put16(ptr, extra);
+
+			if (wide_length)
+				ptr = put64(ptr, entry->length);
+
+			if (wide_stored)
+				ptr = put64(ptr, entry->stored);
+
+			if (wide_offset)
+				ptr = put64(ptr, entry->offset);
+		}
+
+		fill = ptr - buf;
+		++entries;
+	}
+
+	uint64_t cdsize = lseek(fd, 0, SEEK_CUR) - start + fill;
+	uint64_t end64  = start + cdsize;
+	bool wide = entries >= UINT16_MAX || cdsize >= UINT32_MAX || start >= UINT32_MAX;
+
+	uint8_t *ptr = buf + fill;
+
+	if (wide) {
+		ptr = put32(ptr, SIG_END64);
+		ptr = put64(ptr, END64_SIZE - 12);
+		ptr = put16(ptr, VERSION_MADE);
+		ptr = put16(ptr, VERSION_ZIP64);
+		ptr = put32(ptr, 0);
+		ptr = put32(ptr, 0);
+		ptr = put64(ptr, entries);
+		ptr = put64(ptr, entries);
+		ptr = put64(ptr, cdsize);
+		ptr = put64(ptr, start);
+
+		ptr = put32(ptr, SIG_LOCATOR);
+		ptr = put32(ptr, 0);
+		ptr = put64(ptr, end64);
+		ptr = put32(ptr, 1);
+	}
+
+	ptr = put32(ptr, SIG_END);
+	ptr = put16(ptr, 0);
+	ptr = put16(ptr, 0);
+	ptr = put16(ptr, wide ? UINT16_MAX : (uint16_t) entries);
+	ptr = put16(ptr, wide ? UINT16_MAX : (uint16_t) entries);
+	ptr = put32(ptr, wide ? UINT32_MAX : (uint32_t) cdsize);
+	ptr = put32(ptr, wide ? UINT32_MAX : (uint32_t) start);
+	ptr = put16(ptr, 0);
+
+	fill = ptr - buf;
+
+	if (unlikely(!stream_write(fd, buf, fill) ||
+		ftruncate(fd, lseek(fd, 0, SEEK_CUR)) ||
+		fdatasync(fd)))
+		return false;
+
+	idx->head->state[STATE_PENDING] = 0;
+
+	return true;
+}
+
+/**
+ * \brief Open and lock archive for modification.
+ *
+ * \param idx Index context to open for writing.
+ *
+ * \return Archive file descriptor or -1 on failure.
+ */
+static int archive_lock(struct index *restrict idx) {
+	int fd = open(ARCHIVE_NAME, O_RDWR | O_CREAT, 0644);
+	if (unlikely(fd < 0)) {
+		perror("Unable to open archive");
+		return -1;
+	}
+
+	struct flock lock = {
+		.l_type   = F_WRLCK,
+		.l_whence = SEEK_SET,
+		.l_start  = 0,
+		.l_len    = 0
+	};
+
+	/* Serialise writers */
+	if (unlikely(fcntl(fd, F_SETLKW, &lock))) {
+		perror("Unable to lock archive");
+		close(fd);
+		return -1;
+	}
+
+	if (unlikely(!zip_index(idx, fd, true))) {
+		perror("Unable to open index");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * \brief Look object up.
+ *
+ * \param ident Object identifier.
+ * \param entry Buffer to hold the index entry.
+ * \param fd Pointer to variable receiving the archive file descriptor or <tt>(int *) 0</tt>.
+ *
+ * \return 0 if found, 3 if not found or \c EXIT_FAILURE on failure.
+ */
+static int lookup(const uint8_t ident[restrict 32], struct index_entry *restrict entry, int *restrict fd) {
+	int archive = open(ARCHIVE_NAME, O_RDONLY);
+	if (archive < 0) {
+		if (errno == ENOENT)
+			return 3;
+
+		perror("Unable to open archive");
+		return EXIT_FAILURE;
+	}
+
+	struct index idx;
+	if (unlikely(!zip_index(&idx, archive, false))) {
+		perror("Unable to open index");
+		close(archive);
+		return EXIT_FAILURE;
+	}
+
+	const struct index_entry *found = index_find(&idx, ident);
+	if (found)
+		*entry = *found;
+
+	index_close(&idx);
+
+	if (found && fd)
+		*fd = archive;
+	else
+		close(archive);
+
+	return found ? EXIT_SUCCESS : 3;
+}
+
+/**
+ * \brief Decompress byte range of deflated member.
+ *
+ * Deflate streams cannot be entered in the middle, so the output is
+ * decompressed from the start and discarded up to \a skip.  The checksum
+ * is verified only if the range extends to the end of the member.
+ *
+ * \param fd Archive file descriptor.
+ * \param offset Offset of member data.
+ * \param entry Index entry.
+ * \param skip Number of bytes to discard.
+ * \param limit Number of bytes to send.
+ *
+ * \return \c true if successful or \c false on failure.
+ */
+static bool inflate_send(int fd, uint64_t offset, const struct index_entry *restrict entry, uint64_t skip, uint64_t limit) {
+	z_stream zs;
+	memset(&zs, 0, sizeof zs);
+
+	if (unlikely(inflateInit2(&zs, -MAX_WBITS) != Z_OK))
+		return false;
+
+	uint64_t remain = entry->stored, length = 0;
+	uLong crc = crc32(0, Z_NULL, 0);
+	bool partial = skip + limit < entry->length;
+	int rc = Z_OK;
+
+	while (rc != Z_STREAM_END) {
+		if (!zs.avail_in) {
+			if (unlikely(!remain))
+				break;
+
+			ssize_t fill = pread(fd, buf, remain > sizeof buf ? sizeof buf : remain, offset);
+			if (unlikely(fill <= 0))
+				break;
+
+			zs.next_in  = buf;
+			zs.avail_in = fill;
+			offset += fill;
+			remain -= fill;
+		}
+
+		zs.next_out  = aux;
+		zs.avail_out = sizeof aux;
+
+		rc = inflate(&zs, Z_NO_FLUSH);
+		if (unlikely(rc != Z_OK && rc != Z_STREAM_END))
+			break;
+
+		size_t out = sizeof aux - zs.avail_out;
+		crc = crc32(crc, aux, out);
+		length += out;
+
+		/* Send the part of the output within the range */
+		if (length > skip && limit) {
+			size_t from = length - out < skip ? skip - (length - out) : 0;
+			size_t len  = out - from > limit ? limit : out - from;
+
+			if (unlikely(!stream_write(1, aux + from, len))) {
+				inflateEnd(&zs);
+				return false;
+			}
+
+			limit -= len;
+		}
+
+		if (partial && !limit) {
+			inflateEnd(&zs);
+			return true;
+		}
+	}
+
+	inflateEnd(&zs);
+
+	if (unlikely(rc != Z_STREAM_END || length != entry->length || crc != entry->aux)) {
+		fputs("Damaged archive member!\n", stderr);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Retrieve byte range of object.
+ *
+ * \param ident Object identifier.
+ * \param skip Offset of first byte.
+ * \param limit Maximum number of bytes.
+ */
+static int op_retrieve(const uint8_t ident[restrict 32], uint64_t skip, uint64_t limit) {
+	struct index_entry entry;
+	int fd;
+
+	int rc = lookup(ident, &entry, &fd);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	uint8_t head[LOCAL_SIZE];
+	if (unlikely(pread(fd, head, sizeof head, entry.offset) != sizeof head || get32(head) != SIG_LOCAL)) {
+		fputs("Damaged local header!\n", stderr);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	uint64_t offset = entry.offset + LOCAL_SIZE + get16(head + 26) + get16(head + 28);
+
+	/* Clip range to object */
+	if (skip > entry.length)
+		skip = entry.length;
+
+	if (limit > entry.length - skip)
+		limit = entry.length - skip;
+
+	/* Stored members are sent directly */
+	if (unlikely(entry.flags & ZIP_DEFLATED ?
+		!inflate_send(fd, offset, &entry, skip, limit) :
+		!stream_send(1, fd, offset + skip, limit))) {
+		perror("Unable to send object");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	close(fd);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Describe object.
+ *
+ * \param ident Object identifier.
+ * \param dir Storage directory.
+ */
+static int op_inspect(const uint8_t ident[restrict 32], const char *restrict dir) {
+	struct index_entry entry;
+
+	int rc = lookup(ident, &entry, (int *) 0);
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	printf("%" PRIu64 " %" PRIu64 " %" PRIu64 " %s/" ARCHIVE_NAME "@%" PRIu64 "\n",
+		entry.length, entry.stored, entry.time, dir, entry.offset);
+
+	if (unlikely(fflush(stdout))) {
+		perror("Unable to write description");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Deposit object.
+ *
+ * The member is appended where the central directory starts.  Its local
+ * header always carries a Zip64 extra field, so its size need not be
+ * known in advance.  The central directory is rewritten only once every
+ * \c ZIP_BATCH deposits; until then the index is authoritative and the
+ * local headers allow recovery.
+ */
+static int op_deposit(const uint8_t ident[restrict 32]) {
+	struct index idx;
+
+	int fd = archive_lock(&idx);
+	if (unlikely(fd < 0))
+		return EXIT_FAILURE;
+
+	uint64_t offset = idx.head->state[STATE_END];
+	index_close(&idx);
+
+	int level = setting("ZIP_LEVEL", LEVEL_DEFAULT);
+	uint16_t method = level ? METHOD_DEFLATED : METHOD_STORED;
+
+	z_stream zs;
+	memset(&zs, 0, sizeof zs);
+
+	if (method == METHOD_DEFLATED &&
+		unlikely(deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)) {
+		fputs("Unable to initialise compressor!\n", stderr);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(lseek(fd, offset + LOCAL_SIZE + NAME_SIZE + ZIP64_LOCAL, SEEK_SET) < 0)) {
+		perror("Unable to seek in archive");
+		goto failure;
+	}
+
+	/* Append member data */
+	uint64_t length = 0, stored = 0;
+	uLong crc = crc32(0, Z_NULL, 0);
+
+	for (bool eof = false; !eof;) {
+		ssize_t fill = stream_read(0, buf, sizeof buf);
+		if (unlikely(fill < 0)) {
+			perror("Read error");
+			goto failure;
+		}
+
+		eof     = !fill;
+		crc     = crc32(crc, buf, fill);
+		length += fill;
+
+		if (method == METHOD_STORED) {
+			if (unlikely(!stream_write(fd, buf, fill))) {
+				perror("Write error");
+				goto failure;
+			}
+
+			stored += fill;
+			continue;
+		}
+
+		zs.next_in  = buf;
+		zs.avail_in = fill;
+
+		do {
+			zs.next_out  = aux;
+			zs.avail_out = sizeof aux;
+
+			if (unlikely(deflate(&zs, eof ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR)) {
+				fputs("Compression error!\n", stderr);
+				goto failure;
+			}
+
+			size_t out = sizeof aux - zs.avail_out;
+			if (unlikely(!stream_write(fd, aux, out))) {
+				perror("Write error");
+				goto failure;
+			}
+
+			stored += out;
+		} while (!zs.avail_out);
+	}
+
+	/* Close standard input */
+	close(0);
+
+	if (method == METHOD_DEFLATED)
+		deflateEnd(&zs);
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	uint64_t stamp = (uint64_t) ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+	uint16_t dtime, ddate;
+	dos_time(stamp, &dtime, &ddate);
+
+	uint8_t head[LOCAL_SIZE + NAME_SIZE + ZIP64_LOCAL + 1];
+	uint8_t *ptr = head;
+
+	ptr = put32(ptr, SIG_LOCAL);
+	ptr = put16(ptr, VERSION_ZIP64);
+	ptr = put16(ptr, 0);
+	ptr = put16(ptr, method);
+	ptr = put16(ptr, dtime);
+	ptr = put16(ptr, ddate);
+	ptr = put32(ptr, crc);
+	ptr = put32(ptr, UINT32_MAX);
+	ptr = put32(ptr, UINT32_MAX);
+	ptr = put16(ptr, NAME_SIZE);
+	ptr = put16(ptr, ZIP64_LOCAL);
+
+	inthexs((char *) ptr, ident, 32);
+	ptr += NAME_SIZE;
+
+	ptr = put16(ptr, ZIP64_TAG);
+	ptr = put16(ptr, 16);
+	ptr = put64(ptr, length);
+	ptr = put64(ptr, stored);
+
+	/* Commit member */
+	if (unlikely(fdatasync(fd) || pwrite(fd, head, ptr - head, offset) != ptr - head || fdatasync(fd))) {
+		perror("Unable to commit member");
+		goto failure;
+	}
+
+	if (unlikely(!zip_index(&idx, fd, true))) {
+		perror("Unable to open index");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	if (unlikely(!member_index(&idx, ident, offset, length, stored, crc, method, 0, stamp))) {
+		perror("Unable to insert index entry");
+		index_close(&idx);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	idx.head->state[STATE_END] = offset + (ptr - head) + stored;
+
+	int rc = EXIT_SUCCESS;
+
+	if (++idx.head->state[STATE_PENDING] >= setting("ZIP_BATCH", BATCH_DEFAULT) && unlikely(!flush(&idx, fd))) {
+		perror("Unable to write central directory");
+		rc = EXIT_FAILURE;
+	}
+
+	index_close(&idx);
+	close(fd);
+
+	return rc;
+
+failure:
+	if (method == METHOD_DEFLATED)
+		deflateEnd(&zs);
+
+	/* Restore central directory overwritten by partial member */
+	if (zip_index(&idx, fd, true)) {
+		if (!flush(&idx, fd))
+			perror("Unable to restore central directory");
+
+		index_close(&idx);
+	}
+
+	close(fd);
+
+	return EXIT_FAILURE;
+}
+
+/**
+ * \brief Efface object.
+ *
+ * The local header name is invalidated so that recovery does not revive
+ * the member, and the central directory is rewritten without it.  The
+ * member data remains in the archive.
+ */
+static int op_efface(const uint8_t ident[restrict 32]) {
+	struct index idx;
+
+	int fd = archive_lock(&idx);
+	if (unlikely(fd < 0))
+		return EXIT_FAILURE;
+
+	struct index_entry *entry = index_find(&idx, ident);
+	if (!entry) {
+		index_close(&idx);
+		close(fd);
+		return EXIT_SUCCESS;
+	}
+
+	uint8_t head[LOCAL_SIZE + NAME_SIZE];
+	char name[NAME_SIZE + 1];
+	uint8_t mark = '-';
+
+	inthexs(name, ident, 32);
+
+	if (unlikely(pread(fd, head, sizeof head, entry->offset) != sizeof head || get32(head) != SIG_LOCAL ||
+		get16(head + 26) != NAME_SIZE || memcmp(head + LOCAL_SIZE, name, NAME_SIZE) ||
+		pwrite(fd, &mark, sizeof mark, entry->offset + LOCAL_SIZE) != sizeof mark)) {
+		perror("Unable to invalidate local header");
+		index_close(&idx);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	index_remove(&idx, entry);
+
+	int rc = EXIT_SUCCESS;
+
+	if (unlikely(!flush(&idx, fd))) {
+		perror("Unable to write central directory");
+		rc = EXIT_FAILURE;
+	}
+
+	index_close(&idx);
+	close(fd);
+
+	return rc;
+}
+
+/**
+ * \brief Write central directory if deposits are pending.
+ */
+static int op_flush(void) {
+	struct index idx;
+
+	int fd = archive_lock(&idx);
+	if (unlikely(fd < 0))
+		return EXIT_FAILURE;
+
+	int rc = EXIT_SUCCESS;
+
+	if (idx.head->state[STATE_PENDING] && unlikely(!flush(&idx, fd))) {
+		perror("Unable to write central directory");
+		rc = EXIT_FAILURE;
+	}
+
+	index_close(&idx);
+	close(fd);
+
+	return rc;
+}
+
+/**
+ * \brief List identifiers of all objects.
+ */
+static int op_list(void) {
+	int archive = open(ARCHIVE_NAME, O_RDONLY);
+	if (archive < 0) {
+		if (errno == ENOENT)
+			return EXIT_SUCCESS;
+
+		perror("Unable to open archive");
+		return EXIT_FAILURE;
+	}
+
+	struct index idx;
+	if (unlikely(!zip_index(&idx, archive, false))) {
+		perror("Unable to open index");
+		close(archive);
+		return EXIT_FAILURE;
+	}
+
+	size_t count;
+	uint8_t (*idents)[32] = index_idents(&idx, &count);
+	index_close(&idx);
+	close(archive);
+
+	if (unlikely(!idents)) {
+		perror("Unable to list objects");
+		return EXIT_FAILURE;
+	}
+
+	char name[32 * 2 + 1];
+	for (size_t iter = 0; iter < count; ++iter) {
+		inthexs(name, idents[iter], sizeof idents[iter]);
+		puts(name);
+	}
+
+	free(idents);
+
+	if (unlikely(fflush(stdout) || ferror(stdout))) {
+		perror("Unable to write identifiers");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * \brief Main routine.
+ *
+ * \param argc Number of arguments.
+ * \param argv Argument vector.
+ *
+ * \return EXIT_SUCCESS if successful or any other value on failure.
+ */
+int main(int argc, char *argv[]) {
+	if (unlikely(argc != 6 && argc != 8)) {
+		fputs("Invalid number of command line arguments!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	/* Change to storage directory */
+	if (unlikely(chdir(argv[1]))) {
+		perror("Unable to change to storage directory");
+		return EXIT_FAILURE;
+	}
+
+	/* Maintenance operations do not refer to an object */
+	if (!strcmp(argv[5], "flush"))
+		return op_flush();
+
+	else if (!strcmp(argv[5], "list"))
+		return op_list();
+
+	uint8_t ident[32];
+	if (!hexsint(ident, argv[4], sizeof ident)) {
+		perror("Failed to parse identifier");
+		return EXIT_FAILURE;
+	}
+
+	/* Parse operation string */
+	if (!strcmp(argv[5], "assay")) {
+		struct index_entry entry;
+		return lookup(ident, &entry, (int *) 0);
+	}
+
+	else if (!strcmp(argv[5], "retrieve"))
+		return op_retrieve(ident, 0, UINT64_MAX);
+
+	else if (!strcmp(argv[5], "range")) {
+		uint64_t offset, length;
+
+		if (unlikely(argc != 8 || !decsint(&offset, argv[6]) || !decsint(&length, argv[7]))) {
+			fputs("Invalid byte range!\n", stderr);
+			return EXIT_FAILURE;
+		}
+
+		return op_retrieve(ident, offset, length);
+	}
+
+	else if (!strcmp(argv[5], "inspect"))
+		return op_inspect(ident, argv[1]);
+
+	else if (!strcmp(argv[5], "deposit"))
+		return op_deposit(ident);
+
+	else if (!strcmp(argv[5], "efface"))
+		return op_efface(ident);
+
+	else {
+		fprintf(stderr, "Invalid storage operation “%s”!\n", argv[5]);
+		return 2;
+	}
+}